@@ -32,9 +32,13 @@
 //
 
 #import <Cocoa/Cocoa.h>
+
+@class QSBPerformanceCountersView;
+
 // QSBDebugWindow is a window that only appears in debug builds and is useful
 // for debugging queries. It gives some basic data on queries, results and
-// timings.
+// timings. A drawer shows live HGSPerformanceCounters with sparklines of
+// their recent history.
 @interface QSBDebugWindowController : NSWindowController {
  @private
   IBOutlet NSBrowser *mixedResults_;
@@ -46,8 +50,15 @@
   NSMutableArray *searchOperations_;
   NSMutableArray *updatedResults_;
   NSDate *queryControllerStartTime_;
+  NSDrawer *countersDrawer_;
+  QSBPerformanceCountersView *countersView_;
+  NSDictionary *lastCountersSnapshot_;
+  __weak NSTimer *countersTimer_;
 }
 
 + (id)sharedWindowController;
 
+// Saves the latest counters snapshot and the sparkline history as a plist.
+- (IBAction)exportCountersSnapshot:(id)sender;
+
 @end
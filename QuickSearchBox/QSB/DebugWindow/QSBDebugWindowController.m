@@ -35,10 +35,26 @@
 #import <Vermilion/Vermilion.h>
 #import "QSBSearchController.h"
 #import "QSBTableResult.h"
+#import "QSBPerformanceCountersView.h"
 
 static NSString *const kQSBDWTopResultsKey = @"Top Results";
 static NSString *const kQSBDWMoreResultsKey =@"More Results";
 static NSUInteger kQSBDWResultRowCount = 10;
+static const NSTimeInterval kQSBDWCountersInterval = 1.0;
+
+// Metrics shown in the counters drawer, and how to print their values.
+static NSString *const kQSBDWQueriesPerSecond = @"Queries/sec";
+static NSString *const kQSBDWFirstResultMean = @"First result mean (ms)";
+static NSString *const kQSBDWFirstResultP99 = @"First result p99 (ms)";
+static NSString *const kQSBDWLRUHitRatio = @"LRU cache hits (%)";
+static NSString *const kQSBDWSQLiteHitRatio = @"SQLite cache hits (%)";
+static NSString *const kQSBDWIconHitRatio = @"Icon cache hits (%)";
+static NSString *const kQSBDWMemoryIndexEntries = @"Memory index entries";
+static NSString *const kQSBDWQueueDepth = @"Operation queue depth";
+static NSString *const kQSBDWCancelledWork = @"Cancelled work (ms/sec)";
+
+static NSString *const kQSBDWSnapshotKey = @"Snapshot";
+static NSString *const kQSBDWHistoryKey = @"History";
 
 static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
                                      HGSSearchOperation *op2,
@@ -64,9 +80,34 @@ static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
 - (void)searchOperationDidFinish:(NSNotification *)notification;
 - (void)searchOperationWasCancelled:(NSNotification *)notification;
 - (void)searchOperationDidUpdateResults:(NSNotification *)notification;
+- (void)setUpCountersDrawer;
+- (void)sampleCounters:(NSTimer *)timer;
 
 @end
 
+// Returns the change in |counter| between two snapshots.
+static double QSBDWCounterDelta(NSDictionary *older, NSDictionary *newer, 
+                                HGSPerformanceCounter counter) {
+  NSString *name = HGSPerformanceCounterName(counter);
+  NSDictionary *oldValues 
+    = [older objectForKey:kHGSPerformanceCountersValuesKey];
+  NSDictionary *newValues 
+    = [newer objectForKey:kHGSPerformanceCountersValuesKey];
+  return [[newValues objectForKey:name] doubleValue] 
+    - [[oldValues objectForKey:name] doubleValue];
+}
+
+// Returns the hit percentage over the interval, or nil if there were no
+// lookups so the sparkline holds its last value.
+static NSNumber *QSBDWHitRatio(NSDictionary *older, NSDictionary *newer,
+                               HGSPerformanceCounter hits, 
+                               HGSPerformanceCounter misses) {
+  double hitCount = QSBDWCounterDelta(older, newer, hits);
+  double lookups = hitCount + QSBDWCounterDelta(older, newer, misses);
+  return lookups > 0 ? [NSNumber numberWithDouble:100 * hitCount / lookups] 
+                     : nil;
+}
+
 @implementation QSBDebugWindowController
 
 + (id)sharedWindowController {
@@ -83,6 +124,10 @@ static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
   [searchOperations_ release];
   [updatedResults_ release];
   [queryControllerStartTime_ release];
+  [countersTimer_ invalidate];
+  [countersDrawer_ release];
+  [countersView_ release];
+  [lastCountersSnapshot_ release];
   [super dealloc];
 }
 
@@ -126,6 +171,144 @@ static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
   searchOperations_ = [[NSMutableArray alloc] init];
   updatedResults_ = [[NSMutableArray alloc] init];
   [[self window] center];
+  [self setUpCountersDrawer];
+}
+
+#pragma mark Performance Counters
+
+- (void)setUpCountersDrawer {
+  NSArray *metrics = [NSArray arrayWithObjects:
+                      kQSBDWQueriesPerSecond,
+                      kQSBDWFirstResultMean,
+                      kQSBDWFirstResultP99,
+                      kQSBDWLRUHitRatio,
+                      kQSBDWSQLiteHitRatio,
+                      kQSBDWIconHitRatio,
+                      kQSBDWMemoryIndexEntries,
+                      kQSBDWQueueDepth,
+                      kQSBDWCancelledWork,
+                      nil];
+  NSArray *formats = [NSArray arrayWithObjects:
+                      @"%.1f", @"%.1f", @"%.1f", @"%.0f%%", @"%.0f%%", 
+                      @"%.0f%%", @"%.0f", @"%.0f", @"%.1f", nil];
+  CGFloat countersHeight 
+    = [QSBPerformanceCountersView heightForMetricCount:[metrics count]];
+  CGFloat buttonHeight = 32;
+  NSSize size = NSMakeSize(480, countersHeight + buttonHeight);
+  NSView *contentView 
+    = [[[NSView alloc] initWithFrame:NSMakeRect(0, 0, 
+                                                size.width, 
+                                                size.height)] autorelease];
+  NSRect countersFrame 
+    = NSMakeRect(0, buttonHeight, size.width, countersHeight);
+  countersView_ 
+    = [[QSBPerformanceCountersView alloc] initWithFrame:countersFrame
+                                                metrics:metrics
+                                                formats:formats];
+  [countersView_ setAutoresizingMask:NSViewWidthSizable | NSViewMinYMargin];
+  [contentView addSubview:countersView_];
+  NSButton *exportButton 
+    = [[[NSButton alloc] initWithFrame:NSMakeRect(size.width - 168, 2, 
+                                                  160, 28)] autorelease];
+  [exportButton setTitle:@"Export Snapshot..."];
+  [exportButton setBezelStyle:NSRoundedBezelStyle];
+  [exportButton setFont:[NSFont systemFontOfSize:[NSFont smallSystemFontSize]]];
+  [exportButton setTarget:self];
+  [exportButton setAction:@selector(exportCountersSnapshot:)];
+  [exportButton setAutoresizingMask:NSViewMinXMargin | NSViewMaxYMargin];
+  [contentView addSubview:exportButton];
+
+  countersDrawer_ = [[NSDrawer alloc] initWithContentSize:size
+                                            preferredEdge:NSMinYEdge];
+  [countersDrawer_ setContentView:contentView];
+  [countersDrawer_ setParentWindow:[self window]];
+  [countersDrawer_ setMinContentSize:size];
+  [countersDrawer_ open];
+  
+  lastCountersSnapshot_ = [HGSPerformanceCountersSnapshot() retain];
+  countersTimer_ 
+    = [NSTimer scheduledTimerWithTimeInterval:kQSBDWCountersInterval
+                                       target:self
+                                     selector:@selector(sampleCounters:)
+                                     userInfo:nil
+                                      repeats:YES];
+}
+
+- (void)sampleCounters:(NSTimer *)timer {
+  if (![[self window] isVisible]) return;
+  NSDictionary *snapshot = HGSPerformanceCountersSnapshot();
+  NSDictionary *last = lastCountersSnapshot_;
+  NSTimeInterval elapsed 
+    = [[snapshot objectForKey:kHGSPerformanceCountersDateKey] 
+       timeIntervalSinceDate:[last objectForKey:kHGSPerformanceCountersDateKey]];
+  if (elapsed <= 0) return;
+  NSMutableDictionary *sample = [NSMutableDictionary dictionary];
+  double queries = QSBDWCounterDelta(last, snapshot, eHGSQueryCounter);
+  [sample setObject:[NSNumber numberWithDouble:queries / elapsed]
+             forKey:kQSBDWQueriesPerSecond];
+  double firstResults 
+    = QSBDWCounterDelta(last, snapshot, eHGSFirstResultCounter);
+  if (firstResults > 0) {
+    double nanoseconds 
+      = QSBDWCounterDelta(last, snapshot, eHGSFirstResultNanosecondsCounter);
+    [sample setObject:[NSNumber numberWithDouble:nanoseconds / firstResults 
+                       / NSEC_PER_MSEC]
+               forKey:kQSBDWFirstResultMean];
+  }
+  double p99 
+    = [[snapshot objectForKey:kHGSPerformanceCountersFirstResultP99Key] 
+       doubleValue];
+  [sample setObject:[NSNumber numberWithDouble:p99 / NSEC_PER_MSEC]
+             forKey:kQSBDWFirstResultP99];
+  [sample setValue:QSBDWHitRatio(last, snapshot, 
+                                 eHGSLRUCacheHitCounter, 
+                                 eHGSLRUCacheMissCounter)
+            forKey:kQSBDWLRUHitRatio];
+  [sample setValue:QSBDWHitRatio(last, snapshot, 
+                                 eHGSSQLiteCacheHitCounter, 
+                                 eHGSSQLiteCacheMissCounter)
+            forKey:kQSBDWSQLiteHitRatio];
+  [sample setValue:QSBDWHitRatio(last, snapshot, 
+                                 eHGSIconCacheHitCounter, 
+                                 eHGSIconCacheMissCounter)
+            forKey:kQSBDWIconHitRatio];
+  NSDictionary *values 
+    = [snapshot objectForKey:kHGSPerformanceCountersValuesKey];
+  NSString *entriesName 
+    = HGSPerformanceCounterName(eHGSMemoryIndexEntryCounter);
+  [sample setObject:[values objectForKey:entriesName]
+             forKey:kQSBDWMemoryIndexEntries];
+  [sample setObject:[snapshot objectForKey:kHGSPerformanceCountersQueueDepthKey]
+             forKey:kQSBDWQueueDepth];
+  double cancelled 
+    = QSBDWCounterDelta(last, snapshot, eHGSCancelledWorkNanosecondsCounter);
+  [sample setObject:[NSNumber numberWithDouble:cancelled / elapsed 
+                     / NSEC_PER_MSEC]
+             forKey:kQSBDWCancelledWork];
+  [countersView_ addSample:sample];
+  [lastCountersSnapshot_ release];
+  lastCountersSnapshot_ = [snapshot retain];
+}
+
+- (IBAction)exportCountersSnapshot:(id)sender {
+  NSDictionary *export 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSPerformanceCountersSnapshot(), kQSBDWSnapshotKey,
+       [countersView_ history], kQSBDWHistoryKey,
+       nil];
+  NSSavePanel *savePanel = [NSSavePanel savePanel];
+  [savePanel setRequiredFileType:@"plist"];
+  NSString *desktop 
+    = [NSSearchPathForDirectoriesInDomains(NSDesktopDirectory,
+                                           NSUserDomainMask,
+                                           YES) lastObject];
+  if ([savePanel runModalForDirectory:desktop 
+                                 file:@"QSB Counters.plist"] == NSOKButton) {
+    NSString *path = [savePanel filename];
+    if (![export writeToFile:path atomically:YES]) {
+      HGSLog(@"Unable to write performance counters to %@", path);
+    }
+  }
 }
 
 #pragma mark Notifications
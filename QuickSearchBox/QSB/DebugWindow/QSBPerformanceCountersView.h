@@ -0,0 +1,66 @@
+//
+//  QSBPerformanceCountersView.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import <Cocoa/Cocoa.h>
+
+// Number of samples of history kept and drawn for each metric.
+#define kQSBPerformanceCountersHistoryLength 120
+
+// Draws a row per metric with its name, latest value and a sparkline of
+// its recent history. Used by QSBDebugWindowController to show
+// HGSPerformanceCounters.
+@interface QSBPerformanceCountersView : NSView {
+ @private
+  NSArray *metrics_;
+  NSArray *formats_;
+  NSMutableDictionary *history_;
+}
+
+// |metrics| are the names of the metrics, in display order. |formats| are
+// the matching NSString formats for a double, used for the latest value.
+- (id)initWithFrame:(NSRect)frame
+            metrics:(NSArray *)metrics
+            formats:(NSArray *)formats;
+
+// Appends a sample. |sample| maps metric names to NSNumbers. Metrics missing
+// from |sample| repeat their last value.
+- (void)addSample:(NSDictionary *)sample;
+
+// Metric name to NSArray of NSNumbers, oldest first.
+- (NSDictionary *)history;
+
+// The height needed to show every metric.
++ (CGFloat)heightForMetricCount:(NSUInteger)count;
+
+@end
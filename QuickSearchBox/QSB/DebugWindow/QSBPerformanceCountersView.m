@@ -0,0 +1,169 @@
+//
+//  QSBPerformanceCountersView.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "QSBPerformanceCountersView.h"
+
+static const CGFloat kQSBPCRowHeight = 26.0;
+static const CGFloat kQSBPCMargin = 8.0;
+static const CGFloat kQSBPCNameWidth = 160.0;
+static const CGFloat kQSBPCValueWidth = 80.0;
+
+@interface QSBPerformanceCountersView ()
+- (void)drawSparkline:(NSArray *)values inRect:(NSRect)rect;
+@end
+
+@implementation QSBPerformanceCountersView
+
++ (CGFloat)heightForMetricCount:(NSUInteger)count {
+  return count * kQSBPCRowHeight + 2 * kQSBPCMargin;
+}
+
+- (id)initWithFrame:(NSRect)frame
+            metrics:(NSArray *)metrics
+            formats:(NSArray *)formats {
+  if ((self = [super initWithFrame:frame])) {
+    metrics_ = [metrics copy];
+    formats_ = [formats copy];
+    history_ = [[NSMutableDictionary alloc] init];
+    for (NSString *metric in metrics_) {
+      [history_ setObject:[NSMutableArray array] forKey:metric];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [metrics_ release];
+  [formats_ release];
+  [history_ release];
+  [super dealloc];
+}
+
+- (BOOL)isFlipped {
+  return YES;
+}
+
+- (void)addSample:(NSDictionary *)sample {
+  for (NSString *metric in metrics_) {
+    NSMutableArray *history = [history_ objectForKey:metric];
+    NSNumber *value = [sample objectForKey:metric];
+    if (!value) {
+      value = [history lastObject];
+    }
+    if (!value) {
+      value = [NSNumber numberWithDouble:0];
+    }
+    [history addObject:value];
+    if ([history count] > kQSBPerformanceCountersHistoryLength) {
+      [history removeObjectAtIndex:0];
+    }
+  }
+  [self setNeedsDisplay:YES];
+}
+
+- (NSDictionary *)history {
+  NSMutableDictionary *history 
+    = [NSMutableDictionary dictionaryWithCapacity:[history_ count]];
+  for (NSString *metric in history_) {
+    [history setObject:[NSArray arrayWithArray:[history_ objectForKey:metric]]
+                forKey:metric];
+  }
+  return history;
+}
+
+- (void)drawSparkline:(NSArray *)values inRect:(NSRect)rect {
+  [[NSColor colorWithCalibratedWhite:0.95 alpha:1.0] setFill];
+  NSRectFill(rect);
+  NSUInteger count = [values count];
+  if (count < 2) return;
+  double maximum = 0;
+  for (NSNumber *value in values) {
+    maximum = MAX(maximum, [value doubleValue]);
+  }
+  if (maximum <= 0) {
+    maximum = 1;
+  }
+  // Right aligned, so the newest sample is always at the right edge.
+  CGFloat step = NSWidth(rect) / (kQSBPerformanceCountersHistoryLength - 1);
+  CGFloat x = NSMaxX(rect) - step * (count - 1);
+  NSBezierPath *path = [NSBezierPath bezierPath];
+  for (NSUInteger i = 0; i < count; ++i, x += step) {
+    double value = [[values objectAtIndex:i] doubleValue];
+    CGFloat y = NSMaxY(rect) - (value / maximum) * (NSHeight(rect) - 2) - 1;
+    NSPoint point = NSMakePoint(x, y);
+    if (i == 0) {
+      [path moveToPoint:point];
+    } else {
+      [path lineToPoint:point];
+    }
+  }
+  [path setLineWidth:1.0];
+  [[NSColor colorWithCalibratedRed:0.2 green:0.4 blue:0.8 alpha:1.0] setStroke];
+  [path stroke];
+}
+
+- (void)drawRect:(NSRect)rect {
+  [[NSColor whiteColor] setFill];
+  NSRectFill(rect);
+  NSFont *font = [NSFont systemFontOfSize:[NSFont smallSystemFontSize]];
+  NSDictionary *attributes 
+    = [NSDictionary dictionaryWithObject:font forKey:NSFontAttributeName];
+  NSRect bounds = [self bounds];
+  CGFloat sparklineX = kQSBPCMargin + kQSBPCNameWidth + kQSBPCValueWidth;
+  CGFloat sparklineWidth = NSMaxX(bounds) - sparklineX - kQSBPCMargin;
+  CGFloat y = kQSBPCMargin;
+  NSUInteger count = [metrics_ count];
+  for (NSUInteger i = 0; i < count; ++i, y += kQSBPCRowHeight) {
+    NSString *metric = [metrics_ objectAtIndex:i];
+    NSArray *values = [history_ objectForKey:metric];
+    CGFloat textY = y + (kQSBPCRowHeight - [font defaultLineHeightForFont]) / 2;
+    [metric drawAtPoint:NSMakePoint(kQSBPCMargin, textY) 
+         withAttributes:attributes];
+    NSNumber *latest = [values lastObject];
+    if (latest) {
+      NSString *value 
+        = [NSString stringWithFormat:[formats_ objectAtIndex:i], 
+           [latest doubleValue]];
+      [value drawAtPoint:NSMakePoint(kQSBPCMargin + kQSBPCNameWidth, textY) 
+          withAttributes:attributes];
+    }
+    if (sparklineWidth > 0) {
+      NSRect sparkline = NSMakeRect(sparklineX, y + 3, 
+                                    sparklineWidth, kQSBPCRowHeight - 6);
+      [self drawSparkline:values inRect:sparkline];
+    }
+  }
+}
+
+@end
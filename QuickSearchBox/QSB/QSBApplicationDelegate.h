@@ -87,6 +87,12 @@ extern NSString *const kQSBBeenLaunchedPrefKey;
 // Show the debug window
 - (IBAction)showDebugWindow:(id)sender;
 
+// Turn HGSTracer recording on or off
+- (IBAction)toggleQueryTracing:(id)sender;
+
+// Save what HGSTracer has recorded as Chrome trace-event JSON
+- (IBAction)saveQueryTrace:(id)sender;
+
 // method that is called when the modifier keys are hit and we are inactive
 - (void)modifiersChangedWhileInactive:(NSEvent*)event;
 
@@ -95,6 +95,9 @@ static NSString *const kQSBAccountsPrefAccountsKey
 static NSString *const kQSBHomepageKey = @"QSBHomepageURL";
 static NSString *const kQSBFeedbackKey = @"QSBFeedbackURL";
 
+// Where the startup profile is written, in the user's cache folder.
+static NSString *const kQSBStartupProfileFileName = @"StartupProfile.plist";
+
 // Human-readable growl notification name.
 static NSString *const kGrowlNotificationName = @"QSB User Message";
 
@@ -132,6 +135,10 @@ static NSString *const kGrowlNotificationName = @"QSB User Message";
 // Record all current plugin configuration information.
 - (void)updatePluginsPreferences;
 
+// Logs the startup profile, writes it to the cache folder and stops the
+// profiler. Does nothing unless HGSStartupProfilerEnabled is set.
+- (void)finishStartupProfile;
+
 // Check if the screen saver is running.
 - (BOOL)isScreenSaverActive;
 
@@ -222,6 +229,10 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
                name:kHGSPluginLoaderDidInstallPluginsNotification
              object:[HGSPluginLoader sharedPluginLoader]];
     [QSBPreferences registerDefaults];
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    HGSTracerSetEnabled([defaults boolForKey:kHGSTracerEnabledPrefKey]);
+    HGSStartupProfilerSetEnabled(
+      [defaults boolForKey:kHGSStartupProfilerEnabledPrefKey]);
 
     BOOL iconInDock
       = [[NSUserDefaults standardUserDefaults] boolForKey:kQSBIconInDockKey];
@@ -303,6 +314,12 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   [dockMenu_ addItemWithTitle:@"Show Debug Window"
                        action:@selector(showDebugWindow:)
                 keyEquivalent:@""];
+  [statusItemMenu_ addItemWithTitle:@"Record Query Trace"
+                             action:@selector(toggleQueryTracing:)
+                      keyEquivalent:@""];
+  [statusItemMenu_ addItemWithTitle:@"Save Query Trace..."
+                             action:@selector(saveQueryTrace:)
+                      keyEquivalent:@""];
 #endif
 }
 
@@ -627,6 +644,35 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   [[QSBDebugWindowController sharedWindowController] showWindow:sender];
 }
 
+- (IBAction)toggleQueryTracing:(id)sender {
+  HGSTracerSetEnabled(!HGSTracerIsEnabled());
+}
+
+- (IBAction)saveQueryTrace:(id)sender {
+  NSData *trace = HGSTracerChromeTraceData();
+  NSSavePanel *savePanel = [NSSavePanel savePanel];
+  [savePanel setRequiredFileType:@"json"];
+  NSString *desktop 
+    = [NSSearchPathForDirectoriesInDomains(NSDesktopDirectory,
+                                           NSUserDomainMask,
+                                           YES) lastObject];
+  [NSApp activateIgnoringOtherApps:YES];
+  if ([savePanel runModalForDirectory:desktop 
+                                 file:@"QSB Trace.json"] == NSOKButton) {
+    NSString *path = [savePanel filename];
+    if (![trace writeToFile:path atomically:YES]) {
+      HGSLog(@"Unable to write query trace to %@", path);
+    }
+  }
+}
+
+- (BOOL)validateMenuItem:(NSMenuItem *)menuItem {
+  if ([menuItem action] == @selector(toggleQueryTracing:)) {
+    [menuItem setState:HGSTracerIsEnabled() ? NSOnState : NSOffState];
+  }
+  return YES;
+}
+
 - (IBAction)orderFrontStandardAboutPanel:(id)sender {
   [NSApp activateIgnoringOtherApps:YES];
   [NSApp orderFrontStandardAboutPanelWithOptions:nil];
@@ -696,6 +742,21 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   [pluginLoader installAndEnablePluginsBasedOnPluginsState:pluginsFromPrefs];
 }
 
+- (void)finishStartupProfile {
+  if (!HGSStartupProfilerIsEnabled()) return;
+  HGSStartupProfilerSetEnabled(NO);
+  HGSLog(@"Startup profile:\n%@", HGSStartupProfilerReport());
+  NSString *folder = [hgsDelegate_ userCacheFolderForApp];
+  if (folder) {
+    NSString *path 
+      = [folder stringByAppendingPathComponent:kQSBStartupProfileFileName];
+    if (!HGSStartupProfilerWriteToFile(path)) {
+      HGSLog(@"Unable to write startup profile to %@", path);
+    }
+  }
+  HGSStartupProfilerReset();
+}
+
 - (void)updatePluginsPreferences {
   NSArray *pluginState = [[HGSPluginLoader sharedPluginLoader] pluginsState];
   NSUserDefaults *standardDefaults = [NSUserDefaults standardUserDefaults];
@@ -825,14 +886,20 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 
 - (void)applicationDidFinishLaunching:(NSNotification *)notification {
   // Load the search window
+  HGSStartupProfilerMark windowMark = HGSStartupProfilerBegin();
   [searchWindowController_ window];
+  HGSStartupProfilerEnd(windowMark, kHGSStartupProfilerPhaseCategory,
+                        @"LoadSearchWindow");
 
   if (activateOnStartup_) {
     [searchWindowController_ showSearchWindow:self];
   }
 
   // Inventory and process all plugins and extensions.
+  HGSStartupProfilerMark inventoryMark = HGSStartupProfilerBegin();
   [self inventoryPlugins];
+  HGSStartupProfilerEnd(inventoryMark, kHGSStartupProfilerPhaseCategory,
+                        @"InventoryPlugins");
 
   // Now that all the plugins are loaded, start listening to them. We didn't
   // want to do it earlier as there is a lot of enabled/disabled messages
@@ -864,7 +931,10 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
              name:kHGSExtensionPointDidRemoveExtensionNotification
            object:accountsPoint];
   // Inventory the application and plugin Apple Script sdef files.
+  HGSStartupProfilerMark sdefMark = HGSStartupProfilerBegin();
   [self composeApplicationAEDictionary];
+  HGSStartupProfilerEnd(sdefMark, kHGSStartupProfilerPhaseCategory,
+                        @"ComposeScriptingDictionary");
 
   // Install a custom scripting dictionary event handler.
   NSAppleEventManager *aeManager = [NSAppleEventManager sharedAppleEventManager];
@@ -872,6 +942,7 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
                  andSelector:@selector(handleGetSDEFEvent:withReplyEvent:)
                forEventClass:kASAppleScriptSuite
                   andEventID:'gsdf'];
+  [self finishStartupProfile];
 }
 
 - (BOOL)applicationShouldHandleReopen:(NSApplication *)theApplication
@@ -465,7 +465,7 @@ static NSString *const kWebURLsWithTitlesPboardType
   }
 }
 
-- (NSArray *)sourcesToRunOnMainThread {
+- (NSArray *)sourcesRequiringThreadAffinity {
   return [NSArray arrayWithObjects:
           @"com.google.qsb.shortcuts.source",
           @"com.google.qsb.plugin.Applications",
@@ -78,7 +78,10 @@
 
 - (void)searchControllerDidUpdateResults:(NSNotification *)notification {
   NSTableView *resultsTableView = [self resultsTableView];
+  uint64_t traceStartTime = HGSTracerTimestamp();
   [resultsTableView reloadData];
+  HGSTracerRecordSpan(kHGSTracerUICategory, @"Reload results table",
+                      traceStartTime, HGSTracerTimestamp());
   if ([resultsTableView selectedRow] == -1) {
     [resultsTableView selectRowIndexes:[NSIndexSet indexSetWithIndex:0]
                   byExtendingSelection:NO];
@@ -40,6 +40,8 @@
 @class HGSTokenizedString;
 @class HGSResultArray;
 @class HGSQueryController;
+@class HGSQueryResultCache;
+@class HGSSpeculativeQueryExecutor;
 
 // Interface between QSB and the web suggestor and the desktop query
 // takes a query string and is responsible for turning it into results.
@@ -51,6 +53,8 @@
   HGSResultArray *pivotObjects_;
   NSUInteger currentResultDisplayCount_;
   HGSQueryController *queryController_;
+  HGSQueryResultCache *resultCache_;  // Source results shared across queries.
+  HGSSpeculativeQueryExecutor *speculativeExecutor_;
   QSBActionPresenter *actionPresenter_;
   NSString *categorySummaryString_;
 
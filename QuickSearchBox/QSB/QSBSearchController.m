@@ -70,6 +70,8 @@ const NSTimeInterval kQSBDisplayTimerStages[] = { 0.1, 0.3, 0.7 };
 - (void)queryControllerWillStart:(NSNotification *)notification;
 - (void)queryControllerDidFinish:(NSNotification *)notification;
 - (void)queryControllerDidUpdateResults:(NSNotification *)notification;
+- (void)queryControllerLateOperationsDidFinish:(NSNotification *)notification;
+- (BOOL)isCurrentGeneration:(NSNotification *)notification;
 
 @property(nonatomic, assign, getter=isQueryInProcess) BOOL queryInProcess;
 @property(nonatomic, assign, getter=isQueryFinished) BOOL queryFinished;
@@ -113,6 +115,9 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
     }
     moreResults_ = [moreResults retain];
     actionPresenter_ = [actionPresenter retain];
+    resultCache_ = [[HGSQueryResultCache alloc] init];
+    speculativeExecutor_
+      = [[HGSSpeculativeQueryExecutor alloc] initWithResultCache:resultCache_];
     NSUserDefaults *prefs = [NSUserDefaults standardUserDefaults];
     [prefs gtm_addObserver:self
                 forKeyPath:kQSBResultCountKey
@@ -137,6 +142,9 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   [moreResults_ release];
   [lockedResults_ release];
   [actionPresenter_ release];
+  [speculativeExecutor_ cancel];
+  [speculativeExecutor_ release];
+  [resultCache_ release];
   [categorySummaryString_ release];
   [super dealloc];
 }
@@ -339,6 +347,8 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 
 - (void)setTokenizedQueryString:(HGSTokenizedString *)tokenizedQueryString
                    pivotObjects:(HGSResultArray *)pivotObjects {
+  // Real input trumps anything we were guessing at.
+  [speculativeExecutor_ cancel];
   [self stopQuery];
   HGSTokenizedString *oldString = [self tokenizedQueryString];
   HGSResultArray *oldPivots = [self pivotObjects];
@@ -383,7 +393,8 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
                        autorelease];
 
     [self cancelAndReleaseQueryController];
-    queryController_ = [[HGSQueryController alloc] initWithQuery:query];
+    queryController_ = [[HGSQueryController alloc] initWithQuery:query
+                                                     resultCache:resultCache_];
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc addObserver:self
            selector:@selector(queryControllerWillStart:)
@@ -397,6 +408,13 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
            selector:@selector(queryControllerDidUpdateResults:)
                name:kHGSQueryControllerDidUpdateResultsNotification
              object:queryController_];
+    [nc addObserver:self
+           selector:@selector(queryControllerLateOperationsDidFinish:)
+               name:kHGSQueryControllerLateOperationsDidFinishNotification
+             object:queryController_];
+    // Sources that can't make our first display aren't waited for. Their
+    // results show up under More as they arrive.
+    [queryController_ setFirstStageDeadline:kQSBDisplayTimerStages[0]];
 
     // This became a separate call because some sources come back before
     // this call returns and queryController_ must be set first
@@ -414,7 +432,7 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 }
 
 - (void)stopQuery {
-  if ([self isQueryInProcess]) {
+  if ([self isQueryInProcess] || [queryController_ hasLateQueryOperations]) {
     [displayTimer_ invalidate];
     displayTimer_ = nil;
     [self cancelAndReleaseQueryController];
@@ -455,7 +473,18 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 
 #pragma mark Notifications
 
+// Notifications can be queued up for a query controller that we have since
+// replaced. Anything that isn't about the query we are showing is dropped
+// before we do any work for it.
+- (BOOL)isCurrentGeneration:(NSNotification *)notification {
+  NSNumber *generation
+    = [[notification userInfo] objectForKey:kHGSQueryControllerGenerationKey];
+  return ([notification object] == queryController_
+          && [generation unsignedLongLongValue] == [queryController_ generation]);
+}
+
 - (void)queryControllerWillStart:(NSNotification *)notification {
+  if (![self isCurrentGeneration:notification]) return;
   [self setQueryInProcess:YES];
   resultsNeedUpdating_ = YES;
 }
@@ -465,22 +494,48 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 // possible, but the query has been stopped by the user or by the query
 // reaching a time threshold.
 - (void)queryControllerDidFinish:(NSNotification *)notification {
+  if (![self isCurrentGeneration:notification]) return;
   currentResultDisplayCount_ = [self maximumResultsToCollect];
   [self setQueryInProcess:NO];
   [self updateResults];
   [self setQueryFinished:YES];
   [displayTimer_ invalidate];
   displayTimer_ = nil;
+  // Use the time until the next keystroke to get ahead on likely queries.
+  // If there are late sources still running, wait for them to finish first.
+  if (![queryController_ hasLateQueryOperations]) {
+    [speculativeExecutor_ speculateAfterQuery:[queryController_ query]];
+  }
 }
 
 - (void)queryControllerDidUpdateResults:(NSNotification *)notification {
+  if (![self isCurrentGeneration:notification]) return;
   resultsNeedUpdating_ = YES;
+  // Once the query has finished the display timer is gone, so results from
+  // late sources have to be picked up as they come in. Results that are
+  // already showing in the top section keep their places; late results can
+  // only fill top slots that are still empty, and otherwise go under More.
+  if ([self isQueryFinished]) {
+    [self updateResults];
+  }
+}
+
+- (void)queryControllerLateOperationsDidFinish:(NSNotification *)notification {
+  if (![self isCurrentGeneration:notification]) return;
+  [speculativeExecutor_ speculateAfterQuery:[queryController_ query]];
 }
 
 // called when enough time has elapsed that we want to display some results
 // to the user.
 - (void)displayTimerElapsed:(NSTimer*)timer {
+  uint64_t traceStartTime = HGSTracerTimestamp();
   [self updateResults];
+  if (traceStartTime) {
+    NSString *name 
+      = [NSString stringWithFormat:@"Display stage %u", displayTimerStage_];
+    HGSTracerRecordSpan(kHGSTracerUICategory, name, 
+                        traceStartTime, HGSTracerTimestamp());
+  }
   ++displayTimerStage_;
   NSUInteger stages
     = sizeof(kQSBDisplayTimerStages) / sizeof(kQSBDisplayTimerStages[0]);
@@ -0,0 +1,119 @@
+//
+//  QSBSearchControllerTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+
+#import <OCMock/OCMock.h>
+#import <Vermilion/Vermilion.h>
+
+#import "QSBSearchController.h"
+#import "QSBPreferences.h"
+
+@interface QSBSearchController (QSBSearchControllerTestPrivate)
+- (void)queryControllerDidFinish:(NSNotification *)notification;
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification;
+@end
+
+@interface QSBSearchControllerTest : GTMTestCase {
+ @private
+  NSUInteger updateCount_;
+  NSUInteger lastResultCount_;
+}
+- (void)searchControllerDidUpdateResults:(NSNotification *)notification;
+@end
+
+@implementation QSBSearchControllerTest
+
+- (void)searchControllerDidUpdateResults:(NSNotification *)notification {
+  ++updateCount_;
+  NSNumber *count
+    = [[notification userInfo] objectForKey:kQSBSearchControllerResultCountKey];
+  lastResultCount_ = [count unsignedIntegerValue];
+}
+
+- (void)testResultsAfterQueryFinished {
+  NSDictionary *defaults
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:10]
+                                  forKey:kQSBResultCountKey];
+  [[NSUserDefaults standardUserDefaults] registerDefaults:defaults];
+  QSBSearchController *controller
+    = [[[QSBSearchController alloc] initWithActionPresenter:nil] autorelease];
+  STAssertNotNil(controller, nil);
+
+  // Stand in for a query controller whose query has already stopped, but
+  // which still has a late source adding results.
+  Class queryControllerClass = [HGSQueryController class];
+  id queryController = [OCMockObject niceMockForClass:queryControllerClass];
+  NSUInteger resultCount = 0;
+  [[[queryController stub] andReturnValue:OCMOCK_VALUE(resultCount)]
+   resultCountForFilter:OCMOCK_ANY];
+  [controller setValue:queryController forKey:@"queryController_"];
+
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(searchControllerDidUpdateResults:)
+             name:kQSBSearchControllerDidUpdateResultsNotification
+           object:controller];
+  NSDictionary *userInfo
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedLongLong:0]
+                                  forKey:kHGSQueryControllerGenerationKey];
+  NSNotification *finished
+    = [NSNotification 
+       notificationWithName:kHGSQueryControllerDidFinishNotification
+                     object:queryController
+                   userInfo:userInfo];
+  [controller queryControllerDidFinish:finished];
+  STAssertTrue([controller isQueryFinished], nil);
+  STAssertEquals(updateCount_, (NSUInteger)1, nil);
+  STAssertEquals(lastResultCount_, (NSUInteger)0, nil);
+
+  // The late source delivers its results after the query has finished.
+  // They must be picked up right away, since there is no display timer left.
+  queryController = [OCMockObject niceMockForClass:queryControllerClass];
+  resultCount = 3;
+  [[[queryController stub] andReturnValue:OCMOCK_VALUE(resultCount)]
+   resultCountForFilter:OCMOCK_ANY];
+  [controller setValue:queryController forKey:@"queryController_"];
+  NSNotification *updated
+    = [NSNotification 
+       notificationWithName:kHGSQueryControllerDidUpdateResultsNotification
+                     object:queryController
+                   userInfo:userInfo];
+  STAssertNoThrow([controller queryControllerDidUpdateResults:updated], nil);
+  STAssertEquals(updateCount_, (NSUInteger)2, nil);
+  STAssertEquals(lastResultCount_, (NSUInteger)3, nil);
+
+  [nc removeObserver:self];
+}
+
+@end
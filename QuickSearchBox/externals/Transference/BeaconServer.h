@@ -60,6 +60,9 @@
   // Contains the ranked results from the last search
   NSArray *lastSearchResultsRanked_;
   NSArray *plugins_;              // List of all plugins loaded by QSB
+  NSMutableArray *statsSubscribers_;  // Clients receiving pushed stats
+  NSUInteger statsSequence_;      // Sequence number of the last stats record
+  BOOL statsFlushScheduled_;      // A stats delivery is already queued up
   __weak id delegate_;
   BOOL actionWillBePerformed_;    // Flag set when the QSB performs an action
 }
@@ -90,7 +93,8 @@
 //
 - (void)setPlugins:(NSArray *)plugins;
 
-// Sets how long the last search took to complete
+// Sets how long the last search took to complete, and queues a stats record
+// for the search to every client subscribed to stats.
 //
 // Args:
 //  time - how long the last search took
@@ -98,8 +102,11 @@
 //         argument should be an array of dictionaries.  The dictionaries
 //         should have the following keys (defined in TransferenceConstants.h)
 //         kTransferenceModuleName and kTransferenceModuleTime
+//  query - the query string that was searched for.  May be nil.
 //
-- (void)setLastSearchTime:(NSTimeInterval)searchTime moduleInfo:(NSArray *)info;
+- (void)setLastSearchTime:(NSTimeInterval)searchTime
+               moduleInfo:(NSArray *)info
+                    query:(NSString *)query;
 
 // Sets the last search results that are ranked
 //
@@ -59,6 +59,41 @@ static NSString *const kServerPortKey = @"serverPort";
 static NSString *const kResultHGSResultKey = @"ResultHGSResult";
 static NSString *const kResultActionKey = @"ResultAction";
 
+// How long to collect stats records before pushing them to subscribers.  A
+// burst of searches ends up in a single message instead of one per search.
+static const NSTimeInterval kStatsFlushInterval = 0.25;
+
+// Number of deliveries in a row that can fail before a stats subscriber is
+// assumed to be gone and is removed.
+static const NSUInteger kMaxStatsDeliveryFailures = 3;
+
+// Bookkeeping for a client that subscribed with subscribeToStats:bufferLimit:.
+@interface BeaconStatsSubscriber : NSObject {
+ @private
+  id <TransferenceClientProtocol> client_;
+  NSMutableArray *pendingRecords_;
+  NSUInteger bufferLimit_;
+  NSUInteger droppedCount_;
+  NSUInteger failureCount_;
+}
+
+@property(nonatomic, readonly, retain) id <TransferenceClientProtocol> client;
+@property(nonatomic, assign) NSUInteger bufferLimit;
+@property(nonatomic, readonly, assign) NSUInteger droppedCount;
+
+- (id)initWithClient:(id <TransferenceClientProtocol>)client
+         bufferLimit:(NSUInteger)limit;
+
+// Appends a record, dropping the oldest pending record if the buffer is full.
+- (void)addRecord:(NSDictionary *)record;
+
+- (BOOL)hasPendingRecords;
+
+// Sends all pending records to the client.  Returns NO if the client has
+// failed kMaxStatsDeliveryFailures times in a row and should be removed.
+- (BOOL)deliverPendingRecords;
+@end
+
 @interface BeaconServer ()
 // Returns the general stats dictionary, if it does not exist it is created.
 // The reason for this is we don't want to obtain this information on load.  The
@@ -70,6 +105,85 @@ static NSString *const kResultActionKey = @"ResultAction";
 // be used without access to Vermillion.  The resulting array is what will be
 // sent to the client.
 - (NSArray *)convertResultsToTransferenceResults:(NSArray *)results;
+
+// Returns the stats subscriber record for the passed client or nil.
+- (BeaconStatsSubscriber *)statsSubscriberForClient:(id)client;
+
+// Pushes the buffered stats records to every stats subscriber.
+- (void)flushStatsRecords;
+@end
+
+@implementation BeaconStatsSubscriber
+
+@synthesize client = client_;
+@synthesize bufferLimit = bufferLimit_;
+@synthesize droppedCount = droppedCount_;
+
+- (id)initWithClient:(id <TransferenceClientProtocol>)client
+         bufferLimit:(NSUInteger)limit {
+  if ((self = [super init])) {
+    client_ = [client retain];
+    bufferLimit_ = limit;
+    pendingRecords_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [client_ release];
+  [pendingRecords_ release];
+  [super dealloc];
+}
+
+- (void)setBufferLimit:(NSUInteger)limit {
+  bufferLimit_ = limit;
+  NSUInteger count = [pendingRecords_ count];
+  if (count > bufferLimit_) {
+    NSUInteger excess = count - bufferLimit_;
+    [pendingRecords_ removeObjectsInRange:NSMakeRange(0, excess)];
+    droppedCount_ += excess;
+  }
+}
+
+- (void)addRecord:(NSDictionary *)record {
+  if ([pendingRecords_ count] >= bufferLimit_) {
+    // Keep the newest records, a monitor cares more about what is happening
+    // now than about what happened while it was not keeping up.
+    [pendingRecords_ removeObjectAtIndex:0];
+    ++droppedCount_;
+  }
+  [pendingRecords_ addObject:record];
+}
+
+- (BOOL)hasPendingRecords {
+  return [pendingRecords_ count] > 0;
+}
+
+- (BOOL)deliverPendingRecords {
+  NSArray *records = [NSArray arrayWithArray:pendingRecords_];
+  [pendingRecords_ removeAllObjects];
+  BOOL keep = YES;
+  @try {
+    [client_ statsRecords:records
+                  dropped:[NSNumber numberWithUnsignedInteger:droppedCount_]];
+    failureCount_ = 0;
+  }
+  @catch (NSException *e) {
+    // Put the records back so a client that is only slow gets them on the
+    // next flush.  Anything newer that arrived since takes precedence.
+    NSRange range = NSMakeRange(0, [records count]);
+    [pendingRecords_ insertObjects:records
+                         atIndexes:[NSIndexSet indexSetWithIndexesInRange:range]];
+    [self setBufferLimit:bufferLimit_];
+    ++failureCount_;
+    keep = failureCount_ < kMaxStatsDeliveryFailures;
+    HGSLog(@"Transference Beacon: Exception thrown when sending stats to a "
+           @"client (%lu failures in a row).  Error: %@",
+           (unsigned long)failureCount_, e);
+  }
+  return keep;
+}
+
 @end
 
 @implementation BeaconServer
@@ -174,6 +288,7 @@ static NSString *const kResultActionKey = @"ResultAction";
 
   lastSearchStats_ = [[NSMutableDictionary alloc] init];
   clients_ = [[NSMutableArray alloc] init];
+  statsSubscribers_ = [[NSMutableArray alloc] init];
 
   return self;
 }
@@ -182,7 +297,11 @@ static NSString *const kResultActionKey = @"ResultAction";
   [startupTime_ release];
   [generalStats_ release];
   [lastSearchStats_ release];
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(flushStatsRecords)
+                                             object:nil];
   [clients_ release];
+  [statsSubscribers_ release];
   [lastSearchResultsRanked_ release];
   [super dealloc];
 }
@@ -298,6 +417,41 @@ static NSString *const kResultActionKey = @"ResultAction";
   return returnResults;
 }
 
+- (BeaconStatsSubscriber *)statsSubscriberForClient:(id)client {
+  for (BeaconStatsSubscriber *subscriber in statsSubscribers_) {
+    if ([[subscriber client] isEqual:client]) {
+      return subscriber;
+    }
+  }
+  return nil;
+}
+
+- (void)flushStatsRecords {
+  statsFlushScheduled_ = NO;
+  // Iterate over a copy, a client that has gone away is removed as we go.
+  NSArray *subscribers = [NSArray arrayWithArray:statsSubscribers_];
+  for (BeaconStatsSubscriber *subscriber in subscribers) {
+    if ([subscriber hasPendingRecords]) {
+      if (![subscriber deliverPendingRecords]) {
+        HGSLog(@"Transference Beacon: Removing stats subscriber %@ after "
+               @"repeated delivery failures.  It probably disconnected "
+               @"without unsubscribing.", [subscriber client]);
+        [statsSubscribers_ removeObject:subscriber];
+      }
+    }
+  }
+  for (BeaconStatsSubscriber *subscriber in statsSubscribers_) {
+    if ([subscriber hasPendingRecords]) {
+      // Records that could not be delivered get retried on the next pass.
+      statsFlushScheduled_ = YES;
+      [self performSelector:@selector(flushStatsRecords)
+                 withObject:nil
+                 afterDelay:kStatsFlushInterval];
+      break;
+    }
+  }
+}
+
 #pragma mark -- Public Methods --
 
 - (void)setPlugins:(NSArray *)plugins {
@@ -308,14 +462,43 @@ static NSString *const kResultActionKey = @"ResultAction";
 }
 
 - (void)setLastSearchTime:(NSTimeInterval)searchTime
-               moduleInfo:(NSArray *)info {
-  [lastSearchStats_ setObject:[NSNumber numberWithDouble:searchTime]
-                       forKey:kSearchTimeKey];
+               moduleInfo:(NSArray *)info
+                    query:(NSString *)query {
+  NSNumber *searchTimeNumber = [NSNumber numberWithDouble:searchTime];
+  [lastSearchStats_ setObject:searchTimeNumber forKey:kSearchTimeKey];
 
   if (info) {
     [lastSearchStats_ setObject:info forKey:kSearchModuleTimesKey];
   }
 
+  // Queue a record of this search for everyone subscribed to stats.  The
+  // sequence number lets a client spot gaps on its own.
+  ++statsSequence_;
+  if ([statsSubscribers_ count] > 0) {
+    NSMutableDictionary *record =
+      [NSMutableDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithUnsignedInteger:statsSequence_],
+       kStatsRecordSequenceKey,
+       [NSDate date], kStatsRecordDateKey,
+       searchTimeNumber, kStatsRecordSearchTimeKey,
+       nil];
+    if (query) {
+      [record setObject:query forKey:kStatsRecordQueryKey];
+    }
+    if (info) {
+      [record setObject:info forKey:kStatsRecordModuleTimesKey];
+    }
+    for (BeaconStatsSubscriber *subscriber in statsSubscribers_) {
+      [subscriber addRecord:record];
+    }
+    if (!statsFlushScheduled_) {
+      statsFlushScheduled_ = YES;
+      [self performSelector:@selector(flushStatsRecords)
+                 withObject:nil
+                 afterDelay:kStatsFlushInterval];
+    }
+  }
+
   // A search just completed, tell all registered clients that it is done
   for (id currentClient in clients_) {
     @try {
@@ -446,4 +629,38 @@ static NSString *const kResultActionKey = @"ResultAction";
   [clients_ removeObject:client];
 }
 
+- (bycopy NSNumber *)subscribeToStats:(in byref id <TransferenceClientProtocol>)client
+                          bufferLimit:(in bycopy NSNumber *)limit {
+  NSUInteger bufferLimit = [limit unsignedIntegerValue];
+  if (bufferLimit == 0) {
+    bufferLimit = kStatsDefaultBufferLimit;
+  }
+  BeaconStatsSubscriber *subscriber = [self statsSubscriberForClient:client];
+  if (subscriber) {
+    [subscriber setBufferLimit:bufferLimit];
+  } else {
+    subscriber = [[[BeaconStatsSubscriber alloc] initWithClient:client
+                                                    bufferLimit:bufferLimit]
+                  autorelease];
+    [statsSubscribers_ addObject:subscriber];
+  }
+  return [NSNumber numberWithUnsignedInteger:statsSequence_];
+}
+
+- (void)unsubscribeFromStats:(in byref id <TransferenceClientProtocol>)client {
+  BeaconStatsSubscriber *subscriber = [self statsSubscriberForClient:client];
+  if (subscriber) {
+    [statsSubscribers_ removeObject:subscriber];
+  }
+}
+
+- (bycopy NSNumber *)droppedStatsCountForClient:(in byref id <TransferenceClientProtocol>)client {
+  BeaconStatsSubscriber *subscriber = [self statsSubscriberForClient:client];
+  NSNumber *dropped = nil;
+  if (subscriber) {
+    dropped = [NSNumber numberWithUnsignedInteger:[subscriber droppedCount]];
+  }
+  return dropped;
+}
+
 @end
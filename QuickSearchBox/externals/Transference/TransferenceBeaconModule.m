@@ -276,9 +276,13 @@ NSString *const kUnknownPluginIdentifier = @"Unknown Plugin Identitifer";
     }
   }
 
-  [server_ setLastSearchTime:searchTime moduleInfo:moduleSearchTimes];
-
   HGSQueryController *object = [aNotification object];
+  NSString *queryString
+    = [[[object query] tokenizedQueryString] originalString];
+  [server_ setLastSearchTime:searchTime
+                  moduleInfo:moduleSearchTimes
+                       query:queryString];
+
   HGSTypeFilter *allFilter = [HGSTypeFilter filterAllowingAllTypes];
   NSUInteger count = [object resultCountForFilter:allFilter];
   NSArray *rankedResults = [object rankedResultsInRange:NSMakeRange(0, count)
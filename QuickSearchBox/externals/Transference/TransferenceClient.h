@@ -44,6 +44,13 @@
 //  about the search after this delegate is fired.
 //
 - (void)searchDidComplete;
+
+@optional
+// Called with each batch of stats records pushed by the server after
+// subscribeToStatsWithBufferLimit: has been called.  The records are
+// dictionaries that use the kStatsRecord... keys.
+//
+- (void)didReceiveStatsRecords:(NSArray *)records;
 @end
 
 @interface TransferenceClient : NSObject <TransferenceClientProtocol> {
@@ -59,6 +66,12 @@
 
   // Flag if we are still waiting for results to be processed from the server
   BOOL resultsProcessed_; 
+
+  // Stats subscription bookkeeping
+  NSUInteger statsRecordsReceived_;
+  NSUInteger statsRecordsDropped_;   // Last drop count reported by the server
+  NSUInteger statsRecordsMissing_;   // Sequence numbers we never saw
+  NSUInteger lastStatsSequence_;
 }
 
 // Designated initializer. This creates the object and establishes a connection
@@ -256,6 +269,36 @@
 //
 - (void)unsubscribeFromServer;
 
+// Subscribes the client to stats records that the server pushes for every
+// search that completes.  The delegate's didReceiveStatsRecords: is called as
+// they arrive.  The run loop of the thread that created the client must be
+// running for records to be delivered.
+//
+// Args:
+//  limit - how many undelivered records the server may buffer for us before
+//          it starts dropping the oldest ones.  0 uses the server default.
+//
+- (void)subscribeToStatsWithBufferLimit:(NSUInteger)limit;
+
+// Stops the server from pushing stats records.
+//
+- (void)unsubscribeFromStats;
+
+// Returns the number of stats records received since subscribing.
+//
+- (NSUInteger)statsRecordsReceived;
+
+// Returns the number of stats records the server reported dropping because
+// our buffer was full.
+//
+- (NSUInteger)statsRecordsDropped;
+
+// Returns the number of stats records that were skipped in the sequence of
+// received records.  Once all records in flight are delivered this should
+// equal statsRecordsDropped.
+//
+- (NSUInteger)statsRecordsMissing;
+
 // Sets the delegate for the client.
 //
 // Args:
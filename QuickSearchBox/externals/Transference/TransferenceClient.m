@@ -211,6 +211,25 @@ const NSTimeInterval kProcessingTimeout = 240.0;
   resultsProcessed_ = YES;
 }
 
+- (oneway void)statsRecords:(in bycopy NSArray *)records
+                    dropped:(in bycopy NSNumber *)dropped {
+  for (NSDictionary *record in records) {
+    NSUInteger sequence
+      = [[record objectForKey:kStatsRecordSequenceKey] unsignedIntegerValue];
+    // Records buffered before a resubscribe may come in behind the sequence
+    // number we were handed, they do not open a gap.
+    if (sequence > lastStatsSequence_) {
+      statsRecordsMissing_ += sequence - lastStatsSequence_ - 1;
+      lastStatsSequence_ = sequence;
+    }
+  }
+  statsRecordsReceived_ += [records count];
+  statsRecordsDropped_ = [dropped unsignedIntegerValue];
+  if ([delegate_ respondsToSelector:@selector(didReceiveStatsRecords:)]) {
+    [delegate_ didReceiveStatsRecords:records];
+  }
+}
+
 #pragma mark  -- Public Methods --
 
 - (NSDate *)startupTime {
@@ -307,6 +326,32 @@ const NSTimeInterval kProcessingTimeout = 240.0;
   [proxy_ unsubscribeClient:self];
 }
 
+- (void)subscribeToStatsWithBufferLimit:(NSUInteger)limit {
+  statsRecordsReceived_ = 0;
+  statsRecordsDropped_ = 0;
+  statsRecordsMissing_ = 0;
+  NSNumber *sequence
+    = [proxy_ subscribeToStats:self
+                   bufferLimit:[NSNumber numberWithUnsignedInteger:limit]];
+  lastStatsSequence_ = [sequence unsignedIntegerValue];
+}
+
+- (void)unsubscribeFromStats {
+  [proxy_ unsubscribeFromStats:self];
+}
+
+- (NSUInteger)statsRecordsReceived {
+  return statsRecordsReceived_;
+}
+
+- (NSUInteger)statsRecordsDropped {
+  return statsRecordsDropped_;
+}
+
+- (NSUInteger)statsRecordsMissing {
+  return statsRecordsMissing_;
+}
+
 - (void)setDelegate:(id)delegate {
   delegate_ = delegate;
 }
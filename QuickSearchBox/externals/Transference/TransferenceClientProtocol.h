@@ -41,4 +41,16 @@
 // Called by the server when the ranked results are ready
 //
 - (oneway void)rankedResults:(in bycopy NSArray *)results;
+
+// Called by the server with the stats records collected since the last call
+// for clients that subscribed with subscribeToStats:bufferLimit:.  Records
+// are in the order the searches completed.
+//
+// Args:
+//  records - array of dictionaries keyed with the kStatsRecord... keys
+//  dropped - total number of records the server has thrown away for this
+//            client because its buffer was full
+//
+- (oneway void)statsRecords:(in bycopy NSArray *)records
+                    dropped:(in bycopy NSNumber *)dropped;
 @end
@@ -54,6 +54,18 @@ extern NSString *const kSearchTimeKey;
 extern NSString *const kSearchModuleTimesKey;
 extern NSString *const kSearchTimeAfterRankingKey;
 
+// Keys for the stats records pushed to clients that subscribe with
+// subscribeToStats:bufferLimit:
+extern NSString *const kStatsRecordSequenceKey;
+extern NSString *const kStatsRecordDateKey;
+extern NSString *const kStatsRecordQueryKey;
+extern NSString *const kStatsRecordSearchTimeKey;
+extern NSString *const kStatsRecordModuleTimesKey;
+
+// Number of stats records the server will hold for a subscriber that did not
+// ask for a specific limit.
+extern const NSUInteger kStatsDefaultBufferLimit;
+
 // Keys for the dictionaries returned by lastSearchResultsRanked
 extern NSString *const kResultDisplayNameKey;
 extern NSString *const kResultDisplayPathKey;
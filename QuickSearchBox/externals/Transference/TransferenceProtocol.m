@@ -32,7 +32,7 @@
 
 const unsigned short kTransferencePort = 62000;
 const NSTimeInterval kMaxTimeout = 5.0;
-const int kProtocolVersion = 3;
+const int kProtocolVersion = 4;
 
 NSString *const kQSBVersionKey = @"QSBVersion";
 NSString *const kMacOSXVersionKey = @"MacOSXVersion";
@@ -44,6 +44,14 @@ NSString *const kSearchTimeKey = @"searchTime";
 NSString *const kSearchModuleTimesKey = @"searchModuleTimes";
 NSString *const kSearchTimeAfterRankingKey = @"searchTimeAfterRanking";
 
+NSString *const kStatsRecordSequenceKey = @"statsRecordSequence";
+NSString *const kStatsRecordDateKey = @"statsRecordDate";
+NSString *const kStatsRecordQueryKey = @"statsRecordQuery";
+NSString *const kStatsRecordSearchTimeKey = @"statsRecordSearchTime";
+NSString *const kStatsRecordModuleTimesKey = @"statsRecordModuleTimes";
+
+const NSUInteger kStatsDefaultBufferLimit = 256;
+
 NSString *const kResultDisplayNameKey = @"resultDisplayName";
 NSString *const kResultDisplayPathKey = @"resultDisplayPath";
 NSString *const kResultAvailableActionsKey = @"resultAction";
@@ -133,4 +133,42 @@
 //  client - reference to the client object to be removed
 //
 - (void)unsubscribeClient:(in byref id <TransferenceClientProtocol>)client;
+
+// Registers the client to have a stats record pushed to it for every search
+// that completes, instead of having to poll lastSearchStats and missing the
+// searches in between.  Records are buffered on the server and delivered in
+// batches through statsRecords:dropped:.  If the client falls behind, the
+// oldest records are thrown away once the buffer is full and counted as
+// dropped.  Subscribing again changes the buffer limit.
+//
+// Args:
+//  client - reference to the client object
+//  limit - maximum number of undelivered records to hold for the client.
+//          nil or zero uses kStatsDefaultBufferLimit.
+//
+// Returns:
+//  The sequence number of the last search that completed before the
+//  subscription.  The first record pushed has a higher sequence number, so
+//  the client can account for every search from here on.
+//
+- (bycopy NSNumber *)subscribeToStats:(in byref id <TransferenceClientProtocol>)client
+                          bufferLimit:(in bycopy NSNumber *)limit;
+
+// Stops pushing stats records to the passed client.  Records still buffered
+// for it are discarded.
+//
+// Args:
+//  client - reference to the client object to be removed
+//
+- (void)unsubscribeFromStats:(in byref id <TransferenceClientProtocol>)client;
+
+// Returns the number of stats records dropped for the passed client so far.
+//
+// Args:
+//  client - reference to a client subscribed with subscribeToStats:bufferLimit:
+//
+// Returns:
+//  The number of dropped records, or nil if the client is not subscribed.
+//
+- (bycopy NSNumber *)droppedStatsCountForClient:(in byref id <TransferenceClientProtocol>)client;
 @end
@@ -0,0 +1,169 @@
+//
+//  TransferenceStatsTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+// Command line client that checks stats records pushed by the Transference
+// beacon are delivered under a rapid query load.  It subscribes to stats with
+// a small buffer, fires off a burst of searches in a running QSB, and then
+// verifies that every search the beacon reported is accounted for as either
+// delivered or dropped, and that the dropped count matches the gaps seen in
+// the record sequence numbers.
+//
+// Usage:
+//  TransferenceStatsTest [-host localhost] [-port 62000] [-queries 200]
+//                        [-bufferLimit 16] [-timeout 30]
+//
+// Exits with 0 if delivery checks out, 1 otherwise.
+
+#import <Cocoa/Cocoa.h>
+#import "TransferenceClient.h"
+
+static NSString *const kStatsTestQueries[] = {
+  @"a", @"ap", @"app", @"appl", @"apple",
+  @"s", @"sa", @"saf", @"safa", @"safari",
+  @"t", @"te", @"ter", @"term", @"terminal",
+};
+
+// How long delivery has to be quiet before we assume everything arrived.
+static const NSTimeInterval kStatsTestSettleTime = 2.0;
+
+@interface TransferenceStatsTestDelegate : NSObject {
+ @private
+  NSDate *lastRecordDate_;
+}
+@property(nonatomic, readonly, retain) NSDate *lastRecordDate;
+@end
+
+@implementation TransferenceStatsTestDelegate
+
+@synthesize lastRecordDate = lastRecordDate_;
+
+- (void)dealloc {
+  [lastRecordDate_ release];
+  [super dealloc];
+}
+
+- (void)searchDidComplete {
+}
+
+- (void)didReceiveStatsRecords:(NSArray *)records {
+  [lastRecordDate_ release];
+  lastRecordDate_ = [[NSDate alloc] init];
+}
+
+@end
+
+int main(int argc, const char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSUserDefaults *args = [NSUserDefaults standardUserDefaults];
+  NSString *host = [args stringForKey:@"host"];
+  if (!host) {
+    host = @"localhost";
+  }
+  NSInteger port = [args integerForKey:@"port"];
+  if (port <= 0) {
+    port = kTransferencePort;
+  }
+  NSInteger queryCount = [args integerForKey:@"queries"];
+  if (queryCount <= 0) {
+    queryCount = 200;
+  }
+  NSInteger bufferLimit = [args integerForKey:@"bufferLimit"];
+  if (bufferLimit <= 0) {
+    bufferLimit = 16;
+  }
+  NSTimeInterval timeout = [args doubleForKey:@"timeout"];
+  if (timeout <= 0) {
+    timeout = 30.0;
+  }
+
+  int status = 1;
+  TransferenceClient *client
+    = [TransferenceClient clientWithAddress:host
+                                       port:(unsigned short)port];
+  if (!client) {
+    fprintf(stderr, "Unable to connect to a Transference beacon with a "
+            "matching protocol version at %s:%ld\n", [host UTF8String],
+            (long)port);
+  } else {
+    TransferenceStatsTestDelegate *delegate
+      = [[[TransferenceStatsTestDelegate alloc] init] autorelease];
+    [client setDelegate:delegate];
+    [client subscribeToStatsWithBufferLimit:bufferLimit];
+
+    // Fire the searches back to back without servicing our run loop, so the
+    // beacon has to buffer records for us and drop the ones that overflow.
+    size_t termCount = sizeof(kStatsTestQueries) / sizeof(kStatsTestQueries[0]);
+    NSDate *startDate = [NSDate date];
+    for (NSInteger i = 0; i < queryCount; ++i) {
+      NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
+      [client performSynchronousUnicodeSearch:kStatsTestQueries[i % termCount]];
+      [loopPool release];
+    }
+    NSTimeInterval searchTime = -[startDate timeIntervalSinceNow];
+
+    // Drain the records until nothing new shows up for a while.
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+    while ([deadline timeIntervalSinceNow] > 0) {
+      [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+      NSDate *last = [delegate lastRecordDate];
+      if (last && -[last timeIntervalSinceNow] > kStatsTestSettleTime) {
+        break;
+      }
+    }
+    [client unsubscribeFromStats];
+
+    NSUInteger received = [client statsRecordsReceived];
+    NSUInteger dropped = [client statsRecordsDropped];
+    NSUInteger missing = [client statsRecordsMissing];
+    printf("Issued %ld searches in %.2f seconds\n", (long)queryCount,
+           searchTime);
+    printf("Received %lu stats records, %lu dropped by the beacon, "
+           "%lu missing from the sequence\n", (unsigned long)received,
+           (unsigned long)dropped, (unsigned long)missing);
+    if (received == 0) {
+      fprintf(stderr, "FAIL: no stats records were delivered\n");
+    } else if (missing != dropped) {
+      fprintf(stderr, "FAIL: %lu records are unaccounted for\n",
+              (unsigned long)(missing > dropped ? missing - dropped
+                                                : dropped - missing));
+    } else if (received + dropped > (NSUInteger)queryCount) {
+      fprintf(stderr, "FAIL: more records than searches were reported\n");
+    } else {
+      printf("PASS\n");
+      status = 0;
+    }
+  }
+  [pool release];
+  return status;
+}
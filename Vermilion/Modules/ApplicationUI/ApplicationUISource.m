@@ -224,10 +224,14 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                     pathCellArray:(NSArray *)pathCellArray 
                         operation:(HGSSearchOperation *)operation {
   if (!element) return;
+  // Every attribute we fetch is a round trip to the other application, so
+  // check before each one.
+  HGSCancellationToken *token = [operation cancellationToken];
+  if ([token isCancelled]) return;
   NSArray *children 
     = [element accessibilityAttributeValue:NSAccessibilityChildrenAttribute];
   for (GTMAXUIElement *child in children) {
-    if ([operation isCancelled]) return;
+    if ([token isCancelled]) return;
     NSString *role 
       = [child stringValueForAttribute:NSAccessibilityRoleAttribute];
     NSString *name 
@@ -255,6 +259,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                               toArray:array 
                         pathCellArray:newPathCellArray
                             operation:operation];
+      if ([token isCancelled]) return;
       if (currentCount == [array count]) {
         HGSUnscoredResult *result = [self resultFromElement:child
                                                      role:role
@@ -272,7 +277,8 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                      matching:(HGSTokenizedString *)queryString 
                 pathCellArray:(NSArray *)pathCellArray
                     operation:(HGSSearchOperation *)operation {
-  if (element) {
+  HGSCancellationToken *token = [operation cancellationToken];
+  if (element && ![token isCancelled]) {
     NSArray *children 
       = [element accessibilityAttributeValue:NSAccessibilityChildrenAttribute];
     NSArray *placeHolderRoles = [NSArray arrayWithObjects:
@@ -280,7 +286,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                  NSAccessibilityMenuBarRole,
                                  nil];
     for (GTMAXUIElement *child in children) {
-      if ([operation isCancelled]) return;
+      if ([token isCancelled]) return;
       NSString *role 
         = [child stringValueForAttribute:NSAccessibilityRoleAttribute];
       if ([placeHolderRoles containsObject:role]) {
@@ -324,6 +330,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       element = [GTMAXUIElement elementWithProcessIdentifier:[pid intValue]];
     }     
   }
+  HGSCancellationToken *token = [operation cancellationToken];
   if (element) {
     HGSQuery* query = [operation query];
     HGSTokenizedString *queryString = [query tokenizedQueryString];
@@ -350,13 +357,13 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                 toArray:menuResults 
                           pathCellArray:pathCellArray
                               operation:operation];
-        if (![operation isCancelled]) {
+        if (![token isCancelled]) {
           frontmostAppElement_ = [element retain];
           frontmostMenuResults_ = [menuResults retain];
         }
       }
       for(HGSUnscoredResult *result in frontmostMenuResults_) {
-        if ([operation isCancelled]) break;
+        if ([token isCancelled]) break;
         HGSScoredResult *scoredResult 
           = [self scoredResultFromResult:result queryString:queryString];
         if (scoredResult) {
@@ -365,7 +372,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       }
     }      
   }
-  if (![operation isCancelled]) {
+  if (![token isCancelled]) {
     [results sortUsingFunction:HGSMixerScoredResultSort context:NULL];
   }
   [operation setRankedResults:results];
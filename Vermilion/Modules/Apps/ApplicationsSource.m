@@ -312,7 +312,8 @@ static NSString *const kApplicationSourcePredicateString
                                               selector:@selector(parseResultsOperation:)
                                                 object:query]
          autorelease];
-    [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+    [[HGSOperationQueue sharedOperationQueue] addOperation:op
+                                                      lane:eHGSOperationLaneIndexing];
   }
 }
 
@@ -101,7 +101,8 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                               selector:@selector(loadAddressBookContactsOperation)
                                 object:nil]
                        autorelease];
-    [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+    [[HGSOperationQueue sharedOperationQueue] addOperation:op
+                                                      lane:eHGSOperationLaneIndexing];
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc addObserver:self
            selector:@selector(addressBookChanged:)
@@ -220,7 +221,8 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     = [[[NSInvocationOperation alloc] initWithTarget:self
                                             selector:@selector(loadAddressBookContactsOperation)
                                               object:nil] autorelease];
-  [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+  [[HGSOperationQueue sharedOperationQueue] addOperation:op
+                                                    lane:eHGSOperationLaneIndexing];
 }
 
 - (void)dealloc {
@@ -76,7 +76,8 @@ static NSString *const kiPhoneReferenceDocSetPath
                                                 selector:@selector(indexDocumentationOperation)
                                                   object:nil]
          autorelease];
-      [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+      [[HGSOperationQueue sharedOperationQueue] addOperation:op
+                                                        lane:eHGSOperationLaneIndexing];
       NSWorkspace *ws = [NSWorkspace sharedWorkspace];
       docSetIcon_ = [[ws iconForFileType:@"docset"] retain];
     }
@@ -37,8 +37,10 @@
  @private
   NSString *path_;
   GTMFileSystemKQueue *kQueue_;
+  HGSInvocationOperation *recacheOperation_;
 }
 - (void)recacheContents;
+- (void)recacheContents:(id)unused operation:(NSOperation *)operation;
 - (void)directoryChanged:(GTMFileSystemKQueue *)queue
               eventFlags:(GTMFileSystemKQueueEvents)flags;
 @end
@@ -68,6 +70,8 @@
 }
 
 - (void)dealloc {
+  [recacheOperation_ cancel];
+  [recacheOperation_ release];
   [kQueue_ release];
   kQueue_ = nil;
   [path_ release];
@@ -91,6 +95,19 @@
 }
 
 - (void)recacheContents {
+  // Scanning can be slow for big directories, so do it in the background
+  // where it can't get in the way of queries.
+  [recacheOperation_ cancel];
+  [recacheOperation_ release];
+  recacheOperation_
+    = [[HGSInvocationOperation alloc] initWithTarget:self
+                                            selector:@selector(recacheContents:operation:)
+                                              object:nil];
+  [[HGSOperationQueue sharedOperationQueue] addOperation:recacheOperation_
+                                                    lane:eHGSOperationLaneIndexing];
+}
+
+- (void)recacheContents:(id)unused operation:(NSOperation *)operation {
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
 
   NSFileManager *manager = [NSFileManager defaultManager];
@@ -101,6 +118,7 @@
   }
 
   for (NSString *subpath in array) {
+    if ([operation isCancelled]) return;
     LSItemInfoRecord infoRec;
     subpath = [path_ stringByAppendingPathComponent:subpath];
     NSURL *subURL = [NSURL fileURLWithPath:subpath];
@@ -392,14 +392,14 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
 }
 
 - (void)updateIndexTimerFired:(NSTimer *)timer {
-  NSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
   [updateOperation_ cancel];
   [updateOperation_ release];
   updateOperation_
     = [[HGSInvocationOperation alloc] initWithTarget:self
                                             selector:@selector(updateIndex:operation:)
                                               object:nil];
-  [queue addOperation:updateOperation_];
+  [queue addOperation:updateOperation_ lane:eHGSOperationLaneIndexing];
 }
 
 - (GTMSQLiteDatabase *)createDatabase {
@@ -460,13 +460,16 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     = [NSString stringWithFormat:kPlaylistFromTrackSelectStatement,
        [trackID intValue]];
   @synchronized (self) {
+    HGSCancellationToken *token = [operation cancellationToken];
+    sqlite3 *sqlite = [db_ sqlite3DB];
+    [token installProgressHandlerInDatabase:sqlite];
     int sqliteErr;
     GTMSQLiteStatement *statement
       = [GTMSQLiteStatement statementWithSQL:sqlSelect
                                   inDatabase:db_
                                    errorCode:&sqliteErr];
     if (statement && !sqliteErr) {
-      while ((![operation isCancelled])
+      while ((![token isCancelled])
              && ([statement stepRow] == SQLITE_ROW)) {
         NSString *playlistId = [statement resultStringAtPosition:0];
         NSString *playlist = [statement resultStringAtPosition:1];
@@ -476,6 +479,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       }
     }
     [statement finalizeStatement];
+    [token removeProgressHandlerFromDatabase:sqlite];
   }
 
   [operation setRankedResults:results];
@@ -492,6 +496,9 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     = [NSString stringWithFormat:kTracksFromAlbumSelectStatement,
        pivotObjectAlbum];
   @synchronized (self) {
+    HGSCancellationToken *token = [operation cancellationToken];
+    sqlite3 *sqlite = [db_ sqlite3DB];
+    [token installProgressHandlerInDatabase:sqlite];
     int sqliteErr;
     GTMSQLiteStatement *statement
       = [GTMSQLiteStatement statementWithSQL:sqlSelect
@@ -499,7 +506,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                    errorCode:&sqliteErr];
     NSMutableArray *results = [NSMutableArray array];
     if (statement && !sqliteErr) {
-      while ((![operation isCancelled])
+      while ((![token isCancelled])
              && ([statement stepRow] == SQLITE_ROW)) {
         NSString *track = [statement resultStringAtPosition:1];
         if (![query originalLength]
@@ -526,6 +533,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     }
     [operation setRankedResults:results];
     [statement finalizeStatement];
+    [token removeProgressHandlerFromDatabase:sqlite];
   }
 }
 
@@ -539,6 +547,9 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     = [NSString stringWithFormat:kTracksFromPlaylistSelectStatement,
        pivotObjectPlaylistId];
   @synchronized (self) {
+    HGSCancellationToken *token = [operation cancellationToken];
+    sqlite3 *sqlite = [db_ sqlite3DB];
+    [token installProgressHandlerInDatabase:sqlite];
     int sqliteErr;
     GTMSQLiteStatement *statement
       = [GTMSQLiteStatement statementWithSQL:sqlSelect
@@ -546,7 +557,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                    errorCode:&sqliteErr];
     NSMutableArray *results = [NSMutableArray array];
     if (statement && !sqliteErr) {
-      while ((![operation isCancelled])
+      while ((![token isCancelled])
              && ([statement stepRow] == SQLITE_ROW)) {
         NSString *track = [statement resultStringAtPosition:1];
         if (![query originalLength]
@@ -576,6 +587,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     }
     [operation setRankedResults:results];
     [statement finalizeStatement];
+    [token removeProgressHandlerFromDatabase:sqlite];
   }
 }
 
@@ -604,6 +616,9 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   }
 
   @synchronized (self) {
+    HGSCancellationToken *token = [operation cancellationToken];
+    sqlite3 *sqlite = [db_ sqlite3DB];
+    [token installProgressHandlerInDatabase:sqlite];
     // Synchronized because sqlite allows only single thread access to an
     // in-memory db
     int sqliteErr;
@@ -613,7 +628,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                    errorCode:&sqliteErr];
     NSMutableArray *results = [NSMutableArray array];
     if (statement && !sqliteErr) {
-      while ((![operation isCancelled])
+      while ((![token isCancelled])
              && ([statement stepRow] == SQLITE_ROW)
              && ([results count] < kMaxSearchResults)) {
         NSString *album = [statement resultStringAtPosition:0];
@@ -636,6 +651,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     }
     [operation setRankedResults:results];
     [statement finalizeStatement];
+    [token removeProgressHandlerFromDatabase:sqlite];
   }
 }
 
@@ -678,14 +694,18 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
     NSMutableArray *results = [NSMutableArray array];
     @synchronized (self) {
       // Synchronized because sqlite allows only single thread access to an
-      // in-memory db
+      // in-memory db. The progress handler lets sqlite give up part way
+      // through a statement once the query is stale.
+      HGSCancellationToken *token = [operation cancellationToken];
+      sqlite3 *sqlite = [db_ sqlite3DB];
+      [token installProgressHandlerInDatabase:sqlite];
       int sqliteErr;
       GTMSQLiteStatement *statement
         = [GTMSQLiteStatement statementWithSQL:sqlSelect
                                     inDatabase:db_
                                      errorCode:&sqliteErr];
       if (statement && !sqliteErr) {
-        while ((![operation isCancelled])
+        while ((![token isCancelled])
                && ([statement stepRow] == SQLITE_ROW)
                && ([results count] < kMaxSearchResults)) {
           NSString *track = [statement resultStringAtPosition:1];
@@ -760,7 +780,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
                                             inDatabase:db_
                                              errorCode:&sqliteErr];
       if (statement && !sqliteErr) {
-        while ((![operation isCancelled])
+        while ((![token isCancelled])
                && ([statement stepRow] == SQLITE_ROW)) {
           NSString *playlistId = [statement resultStringAtPosition:0];
           NSString *playlist = [statement resultStringAtPosition:1];
@@ -771,6 +791,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       }
 
       [statement finalizeStatement];
+      [token removeProgressHandlerFromDatabase:sqlite];
     }
 
     // We can get a pile of dupes from above, and our mixer assumes
@@ -73,7 +73,8 @@ static NSString* const kHGSShortcutsVersion = @"0.93";
 // Maximum number of entries per shortcut.
 static const unsigned int kMaxEntriesPerShortcut = 3;
 
-@interface ShortcutsSource : HGSCallbackSearchSource {
+@interface ShortcutsSource : HGSCallbackSearchSource
+    <HGSQueryPredictingSearchSource> {
 @private
   // Shortcuts Data is keyed by shortcut (what the user typed) and
   // each object is an NSMutableArray with up to kMaxEntriesPerShortcut.
@@ -105,15 +106,17 @@ static const unsigned int kMaxEntriesPerShortcut = 3;
 
 @end
 
-static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
-  NSUInteger lengthA = [a length];
-  NSUInteger lengthB = [b length];
-  if (lengthA < lengthB) {
+// Sorts the keystrokes that lead to the most shortcuts first.
+static NSInteger KeystrokeCount(NSString *a, NSString *b, void *c) {
+  NSCountedSet *counts = (NSCountedSet *)c;
+  NSUInteger countA = [counts countForObject:a];
+  NSUInteger countB = [counts countForObject:b];
+  if (countA > countB) {
     return NSOrderedAscending;
-  } else if (lengthA > lengthB) {
+  } else if (countA < countB) {
     return NSOrderedDescending;
   }
-  return NSOrderedSame;
+  return [a compare:b];
 }
 
 @implementation ShortcutsSource
@@ -359,6 +362,61 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   return results;
 }
 
+#pragma mark HGSQueryPredictingSearchSource
+
+// Predict the next keystroke of the shortcuts that the user has used before
+// and is likely to be typing. Results are cached by query, and refined for
+// any longer query, so searching ahead by one keystroke pays off for the rest
+// of the shortcut too; searching for the whole shortcut only pays off if the
+// user types all of it. Keystrokes that lead to more shortcuts come first.
+// Predictions are counted by tokenized prefix, but returned as the shortcut
+// was typed so that they tokenize to the same query the user would make.
+- (NSArray *)predictedQueryStringsForQuery:(HGSQuery *)query
+                              maximumCount:(NSUInteger)maximumCount {
+  HGSTokenizedString *tokenizedQuery = [query tokenizedQueryString];
+  NSString *prefix = [tokenizedQuery tokenizedString];
+  NSUInteger prefixLength = [prefix length];
+  if (!prefixLength || !maximumCount) return nil;
+  unichar separator = [HGSTokenizer tokenizerSeparator];
+  NSCountedSet *keystrokes = [NSCountedSet set];
+  NSMutableDictionary *typedKeystrokes = [NSMutableDictionary dictionary];
+  @synchronized(shortcuts_) {
+    for (HGSTokenizedString *key in shortcuts_) {
+      NSString *tokenizedKey = [key tokenizedString];
+      NSUInteger keyLength = [tokenizedKey length];
+      if (keyLength <= prefixLength || ![tokenizedKey hasPrefix:prefix]) {
+        continue;
+      }
+      // A separator on its own doesn't change the tokenized query, so
+      // take the character after it as well.
+      NSUInteger length = prefixLength + 1;
+      while (length < keyLength
+             && [tokenizedKey characterAtIndex:length - 1] == separator) {
+        ++length;
+      }
+      NSString *keystroke = [tokenizedKey substringToIndex:length];
+      [keystrokes addObject:keystroke];
+      if (![typedKeystrokes objectForKey:keystroke]) {
+        NSUInteger typedIndex
+          = [key mapIndexFromTokenizedToOriginal:length - 1];
+        if (typedIndex == NSNotFound) continue;
+        NSString *typed
+          = [[key originalString] substringToIndex:typedIndex + 1];
+        [typedKeystrokes setObject:typed forKey:keystroke];
+      }
+    }
+  }
+  NSMutableArray *sortedKeystrokes
+    = [NSMutableArray arrayWithArray:[typedKeystrokes allKeys]];
+  [sortedKeystrokes sortUsingFunction:KeystrokeCount context:keystrokes];
+  if ([sortedKeystrokes count] > maximumCount) {
+    NSRange toRemove = NSMakeRange(maximumCount,
+                                   [sortedKeystrokes count] - maximumCount);
+    [sortedKeystrokes removeObjectsInRange:toRemove];
+  }
+  return [typedKeystrokes objectsForKeys:sortedKeystrokes notFoundMarker:@""];
+}
+
 #if TARGET_OS_IPHONE
 - (void)resetHistoryAndCache {
   NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
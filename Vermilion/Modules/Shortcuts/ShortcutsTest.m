@@ -249,6 +249,74 @@
   foundResult_ = YES;
 }
 
+- (void)testPredictions {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  HGSSearchSource *source = [HGSUnitTestingSource sourceWithBundle:bundle];
+  NSString *names[] = { @"predict one", @"predict two", @"prefix" };
+  NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    NSString *uri = [@"test:" stringByAppendingString:names[i]];
+    HGSScoredResult *scoredResult 
+      = [HGSScoredResult resultWithURI:uri
+                                  name:names[i]
+                                  type:@"test"
+                                source:source
+                            attributes:nil
+                                 score:0
+                                 flags:0
+                           matchedTerm:nil 
+                        matchedIndexes:nil];
+    id tableResult = [[[ShortcutTestQSBTableResult alloc] 
+                       initWithRankedResult:scoredResult] autorelease];
+    HGSTokenizedString *queryString = [HGSTokenizer tokenizeString:names[i]];
+    id searchController 
+      = [[[ShortcutTestSearchController alloc] 
+          initWithTokenizedQueryString:queryString] autorelease];
+    id actionPresenter 
+      = [[[ShortcutTestQSBActionPresenter alloc] initWithTableResult:tableResult
+                                                    searchController:searchController]
+         autorelease];
+    [center postNotificationName:kQSBActionPresenterWillPivotNotification
+                          object:actionPresenter
+                        userInfo:nil];
+  }
+  
+  // Predictions are the next keystroke, the one shared by the most
+  // shortcuts first.
+  id<HGSQueryPredictingSearchSource> predictor
+    = (id<HGSQueryPredictingSearchSource>)[self source];
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"pre"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil 
+                                           queryFlags:0] autorelease];
+  NSArray *predictions = [predictor predictedQueryStringsForQuery:query
+                                                     maximumCount:3];
+  NSArray *expected = [NSArray arrayWithObjects:@"pred", @"pref", nil];
+  STAssertEqualObjects(predictions, expected, nil);
+  predictions = [predictor predictedQueryStringsForQuery:query
+                                            maximumCount:1];
+  STAssertEqualObjects(predictions, [NSArray arrayWithObject:@"pred"], nil);
+  
+  // A separator on its own isn't worth predicting. Predictions come back as
+  // the shortcut was typed, and tokenize to the query the user would make.
+  query = [[[HGSQuery alloc] initWithString:@"predict"
+                             actionArgument:nil
+                            actionOperation:nil
+                               pivotObjects:nil 
+                                 queryFlags:0] autorelease];
+  predictions = [predictor predictedQueryStringsForQuery:query
+                                            maximumCount:3];
+  expected = [NSArray arrayWithObjects:@"predict o", @"predict t", nil];
+  STAssertEqualObjects(predictions, expected, nil);
+  NSString *separator = [HGSTokenizer tokenizerSeparatorString];
+  HGSTokenizedString *tokenizedPrediction
+    = [HGSTokenizer tokenizeString:[predictions objectAtIndex:0]];
+  STAssertEqualObjects([tokenizedPrediction tokenizedString],
+                       [NSString stringWithFormat:@"predict%@o", separator],
+                       nil);
+}
+
 // TODO(dmaclach): Add more ShortcutsTests when time is available.
 // - Specifically adding multiple items and pivoting back and forth to
 // see which one stays in the first position.
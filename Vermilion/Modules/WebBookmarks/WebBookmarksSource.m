@@ -136,7 +136,8 @@
     = [[HGSInvocationOperation alloc] initWithTarget:self
                                             selector:@selector(updateIndexForPath:operation:)
                                               object:path_];
-  [[HGSOperationQueue sharedOperationQueue] addOperation:indexingOperation_];
+  [[HGSOperationQueue sharedOperationQueue] addOperation:indexingOperation_
+                                                    lane:eHGSOperationLaneIndexing];
 }
 
 - (NSString *)domainURLForURLString:(NSString *)urlString {
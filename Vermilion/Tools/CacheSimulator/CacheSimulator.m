@@ -0,0 +1,291 @@
+//
+//  CacheSimulator.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+
+
+// Replays icon cache access traces against each HGSLRUCache eviction policy
+// at several cache sizes and prints the hit ratios, so a policy change can
+// be judged on real access patterns before it ships.
+//
+// Record a trace by setting the HGSIconCacheTracePath default for QSB (see
+// kHGSIconCacheTracePathKey) and using it for a while. Without a trace a
+// synthetic one is generated: a small hot set of icons that is shown again
+// and again, broken up by long scrolls through results that are seen once.
+//
+// Options are read through NSUserDefaults, so they are given as
+// "-name value" pairs:
+//   -trace path    Trace to replay.
+//   -sizes list    Comma separated cache sizes in megabytes (1,2.5,5,10).
+//   -shards n      Shards per cache (4, the same as the icon cache).
+//
+// Replay is demand filled: every lookup that misses inserts the icon, using
+// the size recorded for that key, or kCacheSimulatorDefaultSize if the
+// trace has no insert for it. Recorded inserts are only used for sizes,
+// since which lookups miss depends on the policy being simulated.
+
+#import <Foundation/Foundation.h>
+#import <Vermilion/Vermilion.h>
+
+// The size of an icon cached at 96, 32 and 16 pixels square.
+static const size_t kCacheSimulatorDefaultSize 
+  = (96 * 96 + 32 * 32 + 16 * 16) * 4;
+static const NSUInteger kCacheSimulatorDefaultShards = 4;
+static const unsigned kCacheSimulatorSeed = 20100401;
+
+static const void *CacheSimulatorRetain(CFAllocatorRef allocator, 
+                                        const void *value) {
+  return [(id)value retain];
+}
+
+static void CacheSimulatorRelease(CFAllocatorRef allocator, 
+                                  const void *value) {
+  [(id)value release];
+}
+
+static Boolean CacheSimulatorEqual(const void *value1, const void *value2) {
+  return [(id)value1 isEqual:(id)value2];
+}
+
+static CFHashCode CacheSimulatorHash(const void *value) {
+  return [(id)value hash];
+}
+
+static BOOL CacheSimulatorEvict(const void *key, 
+                                const void *value, 
+                                void *context) {
+  return YES;
+}
+
+static HGSLRUCacheCallBacks gCacheSimulatorCallBacks = {
+  0,
+  CacheSimulatorRetain,
+  CacheSimulatorRelease,
+  CacheSimulatorEqual,
+  CacheSimulatorHash,
+  CacheSimulatorRetain,
+  CacheSimulatorRelease,
+  CacheSimulatorEvict
+};
+
+static NSString *CacheSimulatorPolicyName(HGSLRUCachePolicy policy) {
+  switch (policy) {
+    case eHGSLRUCachePolicyLRU:
+      return @"LRU";
+    case eHGSLRUCachePolicy2Q:
+      return @"2Q";
+  }
+  return @"?";  // COV_NF_LINE
+}
+
+// Reads a trace into a dictionary of cache name to array of lookup keys,
+// filling in |sizes| with the last size inserted for each key.
+static NSDictionary *CacheSimulatorReadTrace(NSString *path, 
+                                             NSMutableDictionary *sizes) {
+  NSString *contents = [NSString stringWithContentsOfFile:path
+                                                 encoding:NSUTF8StringEncoding
+                                                    error:NULL];
+  if (!contents) return nil;
+  NSMutableDictionary *traces = [NSMutableDictionary dictionary];
+  NSUInteger lineNumber = 0;
+  for (NSString *line in [contents componentsSeparatedByString:@"\n"]) {
+    ++lineNumber;
+    if (![line length]) continue;
+    NSScanner *scanner = [NSScanner scannerWithString:line];
+    [scanner setCharactersToBeSkipped:nil];
+    NSString *op = nil;
+    NSString *cache = nil;
+    NSString *key = nil;
+    long long size = 0;
+    BOOL isSet = NO;
+    BOOL good 
+      = [scanner scanUpToString:@" " intoString:&op]
+        && [scanner scanString:@" " intoString:NULL]
+        && [scanner scanUpToString:@" " intoString:&cache]
+        && [scanner scanString:@" " intoString:NULL];
+    if (good && [op isEqualToString:@"set"]) {
+      isSet = YES;
+      good = [scanner scanLongLong:&size] 
+        && [scanner scanString:@" " intoString:NULL];
+    } else if (good) {
+      good = [op isEqualToString:@"get"];
+    }
+    if (good) {
+      key = [line substringFromIndex:[scanner scanLocation]];
+      good = [key length] > 0;
+    }
+    if (!good) {
+      fprintf(stderr, "Skipping malformed line %lu\n", 
+              (unsigned long)lineNumber);
+      continue;
+    }
+    NSString *sizeKey = [cache stringByAppendingFormat:@" %@", key];
+    if (isSet) {
+      [sizes setObject:[NSNumber numberWithLongLong:size] forKey:sizeKey];
+    } else {
+      NSMutableArray *trace = [traces objectForKey:cache];
+      if (!trace) {
+        trace = [NSMutableArray array];
+        [traces setObject:trace forKey:cache];
+      }
+      [trace addObject:key];
+    }
+  }
+  return traces;
+}
+
+// A hot set of icons that is looked at over and over, with every fifth
+// query followed by a scroll through results that are never seen again.
+static NSDictionary *CacheSimulatorSyntheticTrace(void) {
+  const NSUInteger kHotCount = 80;
+  const NSUInteger kQueryCount = 2000;
+  const NSUInteger kResultsPerQuery = 10;
+  const NSUInteger kScrollLength = 150;
+  NSMutableArray *trace = [NSMutableArray array];
+  NSUInteger scanned = 0;
+  unsigned seed = kCacheSimulatorSeed;
+  for (NSUInteger query = 0; query < kQueryCount; ++query) {
+    for (NSUInteger i = 0; i < kResultsPerQuery; ++i) {
+      seed = seed * 1103515245 + 12345;
+      // Skew towards the front of the hot set.
+      NSUInteger r = (seed >> 16) & 0x7FFF;
+      NSUInteger hot = (r * r / 0x8000) * kHotCount / 0x8000;
+      [trace addObject:[NSString stringWithFormat:@"hot-%lu", 
+                        (unsigned long)hot]];
+    }
+    if (query % 5 == 4) {
+      for (NSUInteger i = 0; i < kScrollLength; ++i) {
+        [trace addObject:[NSString stringWithFormat:@"scroll-%lu", 
+                          (unsigned long)scanned++]];
+      }
+    }
+  }
+  return [NSDictionary dictionaryWithObject:trace forKey:@"synthetic"];
+}
+
+static double CacheSimulatorHitRatio(NSArray *trace,
+                                     NSString *cacheName,
+                                     NSDictionary *sizes,
+                                     size_t cacheSize,
+                                     NSUInteger shards,
+                                     HGSLRUCachePolicy policy) {
+  HGSShardedLRUCache *cache 
+    = [[[HGSShardedLRUCache alloc] initWithCacheSize:cacheSize
+                                          shardCount:shards
+                                              policy:policy
+                                           callBacks:&gCacheSimulatorCallBacks
+                                        evictContext:NULL] autorelease];
+  if (!cache || ![trace count]) return 0;
+  NSUInteger hits = 0;
+  NSUInteger lookups = 0;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSString *key in trace) {
+    id value = (id)[cache copyValueForKey:key];
+    if (value) {
+      ++hits;
+      [value release];
+    } else {
+      NSString *sizeKey = [cacheName stringByAppendingFormat:@" %@", key];
+      NSNumber *size = [sizes objectForKey:sizeKey];
+      [cache setValue:key 
+               forKey:key 
+                 size:size ? [size unsignedLongValue] 
+                           : kCacheSimulatorDefaultSize];
+    }
+    if (++lookups % 1000 == 0) {
+      [pool release];
+      pool = [[NSAutoreleasePool alloc] init];
+    }
+  }
+  [pool release];
+  return (double)hits / [trace count];
+}
+
+int main(int argc, const char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  int status = 0;
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  
+  NSMutableDictionary *sizes = [NSMutableDictionary dictionary];
+  NSDictionary *traces = nil;
+  NSString *tracePath = [defaults stringForKey:@"trace"];
+  if (tracePath) {
+    traces = CacheSimulatorReadTrace(tracePath, sizes);
+    if (!traces) {
+      fprintf(stderr, "Unable to read trace %s\n", 
+              [tracePath fileSystemRepresentation]);
+      status = 1;
+    }
+  } else {
+    traces = CacheSimulatorSyntheticTrace();
+  }
+  
+  NSString *sizeList = [defaults stringForKey:@"sizes"];
+  if (!sizeList) sizeList = @"1,2.5,5,10";
+  NSArray *megabytes = [sizeList componentsSeparatedByString:@","];
+  NSUInteger shards = kCacheSimulatorDefaultShards;
+  if ([defaults integerForKey:@"shards"] > 0) {
+    shards = [defaults integerForKey:@"shards"];
+  }
+  HGSLRUCachePolicy policies[] = { 
+    eHGSLRUCachePolicyLRU, eHGSLRUCachePolicy2Q 
+  };
+  size_t policyCount = sizeof(policies) / sizeof(policies[0]);
+  
+  NSArray *cacheNames 
+    = [[traces allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  for (NSString *cacheName in cacheNames) {
+    NSArray *trace = [traces objectForKey:cacheName];
+    printf("%s: %lu lookups, %lu shards\n", [cacheName UTF8String], 
+           (unsigned long)[trace count], (unsigned long)shards);
+    printf("  %8s", "MB");
+    for (size_t i = 0; i < policyCount; ++i) {
+      printf(" %8s", [CacheSimulatorPolicyName(policies[i]) UTF8String]);
+    }
+    printf("\n");
+    for (NSString *mb in megabytes) {
+      size_t cacheSize = (size_t)([mb doubleValue] * 1024 * 1024);
+      printf("  %8.2f", [mb doubleValue]);
+      for (size_t i = 0; i < policyCount; ++i) {
+        double ratio = CacheSimulatorHitRatio(trace, cacheName, sizes, 
+                                              cacheSize, shards, 
+                                              policies[i]);
+        printf(" %7.2f%%", ratio * 100);
+      }
+      printf("\n");
+    }
+  }
+  
+  [pool release];
+  return status;
+}
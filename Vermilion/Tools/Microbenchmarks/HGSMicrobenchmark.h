@@ -0,0 +1,152 @@
+//
+//  HGSMicrobenchmark.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header
+ @discussion HGSMicrobenchmark
+
+ A small harness for timing the primitives that sit on the search hot path.
+ Each benchmark is a function that performs a batch of operations against a
+ fixture that was built up front, and returns how many operations it
+ performed. The runner repeats the batch until a sample is long enough to
+ time reliably, takes the median over several samples, and then runs one
+ extra untimed batch with allocation counting on.
+
+ Results and baselines are property lists keyed by benchmark name:
+
+ <pre>
+ {
+   "Tokenizer.ASCII" = { NanosecondsPerOp = 812.4; AllocationsPerOp = 9; };
+ }
+ </pre>
+*/
+
+/*! Number. Median nanoseconds per operation. */
+#define kHGSMicrobenchmarkNanosecondsPerOpKey @"NanosecondsPerOp"
+/*! Number. malloc calls per operation. */
+#define kHGSMicrobenchmarkAllocationsPerOpKey @"AllocationsPerOp"
+
+/*!
+ Runs one batch of a benchmark.
+ @param fixture The object handed to addBenchmarkNamed:function:fixture:.
+ @result The number of operations performed.
+*/
+typedef NSUInteger (*HGSMicrobenchmarkFunction)(id fixture);
+
+/*!
+ The kinds of synthetic strings the corpora are built from.
+*/
+enum {
+  eHGSMicrobenchmarkASCIICorpus = 0,
+  eHGSMicrobenchmarkAccentedLatinCorpus,
+  eHGSMicrobenchmarkCJKCorpus,
+  eHGSMicrobenchmarkFilenameCorpus,
+  eHGSMicrobenchmarkCorpusCount
+};
+typedef NSUInteger HGSMicrobenchmarkCorpus;
+
+/*!
+ Returns a name for a corpus kind, for use in benchmark names.
+*/
+NSString *HGSMicrobenchmarkCorpusName(HGSMicrobenchmarkCorpus corpus);
+
+/*!
+ Generates a deterministic corpus of strings. The same kind, count and seed
+ give the same strings on every machine, so timings can be compared against
+ a stored baseline.
+ @param corpus The kind of strings to generate. Filename corpora are mixed
+        camelCase and underscore names with extensions.
+ @param count The number of strings.
+ @param seed Seed for the generator.
+*/
+NSArray *HGSMicrobenchmarkStrings(HGSMicrobenchmarkCorpus corpus,
+                                  NSUInteger count,
+                                  unsigned seed);
+
+/*!
+ Returns the number of malloc zone allocations made in this process so far.
+ Counting is installed on the default zone the first time this is called.
+*/
+uint64_t HGSMicrobenchmarkAllocationCount(void);
+
+@interface HGSMicrobenchmarkRunner : NSObject {
+ @private
+  NSMutableArray *benchmarks_;
+  NSUInteger sampleCount_;
+  NSTimeInterval minimumSampleTime_;
+  NSString *filter_;
+}
+
+/*! Number of timed samples per benchmark. Defaults to 7. */
+@property (assign) NSUInteger sampleCount;
+/*! Batches are repeated until a sample lasts this long. Defaults to 0.1s. */
+@property (assign) NSTimeInterval minimumSampleTime;
+/*! If set, only benchmarks whose names contain it are run. */
+@property (copy) NSString *filter;
+
+/*!
+ Adds a benchmark. Benchmarks run in the order they were added.
+ @param name Unique name, used as the key in results and baselines.
+ @param function The batch function.
+ @param fixture Retained and passed to every call of function.
+*/
+- (void)addBenchmarkNamed:(NSString *)name
+                 function:(HGSMicrobenchmarkFunction)function
+                  fixture:(id)fixture;
+
+/*!
+ Runs the benchmarks, printing a line for each as it finishes.
+ @result Dictionary of benchmark name to a dictionary with
+         kHGSMicrobenchmarkNanosecondsPerOpKey and
+         kHGSMicrobenchmarkAllocationsPerOpKey.
+*/
+- (NSDictionary *)run;
+
+/*!
+ Compares results against a baseline.
+ @param results Results from run.
+ @param baseline Results from an earlier run. Benchmarks missing from either
+        side are skipped.
+ @param threshold Allowed fractional slowdown, e.g. 0.1 for 10%. Allocation
+        counts are held to the same threshold, but at least one whole
+        allocation per operation is always allowed.
+ @result Array of human readable descriptions of each regression. Empty if
+         nothing regressed.
+*/
++ (NSArray *)regressionsInResults:(NSDictionary *)results
+                     fromBaseline:(NSDictionary *)baseline
+                        threshold:(double)threshold;
+@end
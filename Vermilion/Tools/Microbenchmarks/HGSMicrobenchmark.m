@@ -0,0 +1,434 @@
+//
+//  HGSMicrobenchmark.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "HGSMicrobenchmark.h"
+#import <Vermilion/Vermilion.h>
+#import <libkern/OSAtomic.h>
+#import <malloc/malloc.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+@interface HGSMicrobenchmark : NSObject {
+ @private
+  NSString *name_;
+  HGSMicrobenchmarkFunction function_;
+  id fixture_;
+}
+@property (readonly, copy) NSString *name;
+@property (readonly) HGSMicrobenchmarkFunction function;
+@property (readonly, retain) id fixture;
+- (id)initWithName:(NSString *)name
+          function:(HGSMicrobenchmarkFunction)function
+           fixture:(id)fixture;
+@end
+
+@interface HGSMicrobenchmarkRunner ()
+- (double)nanosecondsPerOpForBenchmark:(HGSMicrobenchmark *)benchmark;
+- (double)allocationsPerOpForBenchmark:(HGSMicrobenchmark *)benchmark;
+@end
+
+#pragma mark Allocation Counting
+
+static volatile int64_t gHGSMicrobenchmarkAllocations = 0;
+static void *(*gHGSMicrobenchmarkMalloc)(malloc_zone_t *, size_t) = NULL;
+static void *(*gHGSMicrobenchmarkCalloc)(malloc_zone_t *, 
+                                         size_t, size_t) = NULL;
+static void *(*gHGSMicrobenchmarkRealloc)(malloc_zone_t *, 
+                                          void *, size_t) = NULL;
+
+static void *HGSMicrobenchmarkMalloc(malloc_zone_t *zone, size_t size) {
+  OSAtomicIncrement64(&gHGSMicrobenchmarkAllocations);
+  return gHGSMicrobenchmarkMalloc(zone, size);
+}
+
+static void *HGSMicrobenchmarkCalloc(malloc_zone_t *zone, 
+                                     size_t count, size_t size) {
+  OSAtomicIncrement64(&gHGSMicrobenchmarkAllocations);
+  return gHGSMicrobenchmarkCalloc(zone, count, size);
+}
+
+static void *HGSMicrobenchmarkRealloc(malloc_zone_t *zone, 
+                                      void *ptr, size_t size) {
+  OSAtomicIncrement64(&gHGSMicrobenchmarkAllocations);
+  return gHGSMicrobenchmarkRealloc(zone, ptr, size);
+}
+
+static void HGSMicrobenchmarkInstallAllocationCounting(void) {
+  malloc_zone_t *zone = malloc_default_zone();
+  // Some systems map the zone structure read only. It is left writable
+  // afterwards because on others the page also holds the zone's own state.
+  vm_address_t page = trunc_page((vm_address_t)zone);
+  vm_size_t size = round_page((vm_address_t)zone + sizeof(*zone)) - page;
+  kern_return_t err = vm_protect(mach_task_self(), page, size, FALSE,
+                                 VM_PROT_READ | VM_PROT_WRITE);
+  if (err != KERN_SUCCESS) {
+    HGSLog(@"Unable to count allocations (%d)", err);
+    return;
+  }
+  gHGSMicrobenchmarkMalloc = zone->malloc;
+  gHGSMicrobenchmarkCalloc = zone->calloc;
+  gHGSMicrobenchmarkRealloc = zone->realloc;
+  zone->malloc = HGSMicrobenchmarkMalloc;
+  zone->calloc = HGSMicrobenchmarkCalloc;
+  zone->realloc = HGSMicrobenchmarkRealloc;
+}
+
+uint64_t HGSMicrobenchmarkAllocationCount(void) {
+  static pthread_once_t sOnce = PTHREAD_ONCE_INIT;
+  pthread_once(&sOnce, HGSMicrobenchmarkInstallAllocationCounting);
+  OSMemoryBarrier();
+  return gHGSMicrobenchmarkAllocations;
+}
+
+#pragma mark Corpora
+
+// A small LCG so a seed gives the same corpus everywhere.
+static NSUInteger HGSMicrobenchmarkRandom(unsigned *state, NSUInteger range) {
+  *state = *state * 1103515245 + 12345;
+  return ((*state >> 16) & 0x7FFF) % range;
+}
+
+static NSString *HGSMicrobenchmarkWord(unsigned *state, BOOL accented) {
+  static const unichar kConsonants[] = {
+    'b', 'c', 'd', 'f', 'g', 'k', 'l', 'm', 'n', 'p', 'r', 's', 't', 'v'
+  };
+  static const unichar kVowels[] = { 'a', 'e', 'i', 'o', 'u' };
+  // é è ê á í ó ö ü å ø ñ ç
+  static const unichar kAccented[] = {
+    0x00E9, 0x00E8, 0x00EA, 0x00E1, 0x00ED, 0x00F3, 
+    0x00F6, 0x00FC, 0x00E5, 0x00F8, 0x00F1, 0x00E7
+  };
+  unichar chars[16];
+  NSUInteger length = 0;
+  NSUInteger syllables = 1 + HGSMicrobenchmarkRandom(state, 4);
+  for (NSUInteger i = 0; i < syllables; ++i) {
+    chars[length++] 
+      = kConsonants[HGSMicrobenchmarkRandom(state, 
+                                            sizeof(kConsonants) 
+                                            / sizeof(kConsonants[0]))];
+    if (accented && HGSMicrobenchmarkRandom(state, 2)) {
+      chars[length++] 
+        = kAccented[HGSMicrobenchmarkRandom(state, 
+                                            sizeof(kAccented) 
+                                            / sizeof(kAccented[0]))];
+    } else {
+      chars[length++] 
+        = kVowels[HGSMicrobenchmarkRandom(state, 
+                                          sizeof(kVowels) 
+                                          / sizeof(kVowels[0]))];
+    }
+  }
+  return [NSString stringWithCharacters:chars length:length];
+}
+
+static NSString *HGSMicrobenchmarkCJKString(unsigned *state) {
+  unichar chars[12];
+  NSUInteger length = 2 + HGSMicrobenchmarkRandom(state, 7);
+  for (NSUInteger i = 0; i < length; ++i) {
+    switch (HGSMicrobenchmarkRandom(state, 4)) {
+      case 0:
+        chars[i] = 0x3041 + HGSMicrobenchmarkRandom(state, 83);  // Hiragana
+        break;
+      case 1:
+        chars[i] = 0x30A1 + HGSMicrobenchmarkRandom(state, 90);  // Katakana
+        break;
+      case 2:
+        chars[i] = 0xAC00 + HGSMicrobenchmarkRandom(state, 2000);  // Hangul
+        break;
+      default:
+        chars[i] = 0x4E00 + HGSMicrobenchmarkRandom(state, 3000);  // Han
+        break;
+    }
+  }
+  NSString *string = [NSString stringWithCharacters:chars length:length];
+  // Titles often mix in a Latin word.
+  if (!HGSMicrobenchmarkRandom(state, 3)) {
+    string = [NSString stringWithFormat:@"%@ %@", 
+              [HGSMicrobenchmarkWord(state, NO) capitalizedString], string];
+  }
+  return string;
+}
+
+static NSString *HGSMicrobenchmarkFilename(unsigned *state) {
+  static NSString *const kSeparators[] = { @"", @"", @"_", @"-", @" " };
+  static NSString *const kExtensions[] = { 
+    @"txt", @"pdf", @"m", @"h", @"JPG", @"app", @"plist", @"tar.gz"
+  };
+  NSMutableString *name = [NSMutableString string];
+  NSString *separator 
+    = kSeparators[HGSMicrobenchmarkRandom(state, 
+                                          sizeof(kSeparators) 
+                                          / sizeof(kSeparators[0]))];
+  NSUInteger words = 2 + HGSMicrobenchmarkRandom(state, 3);
+  for (NSUInteger i = 0; i < words; ++i) {
+    NSString *word = HGSMicrobenchmarkWord(state, NO);
+    if (i > 0) {
+      [name appendString:separator];
+    }
+    if (i > 0 || HGSMicrobenchmarkRandom(state, 2)) {
+      word = [word capitalizedString];
+    }
+    [name appendString:word];
+  }
+  if (!HGSMicrobenchmarkRandom(state, 3)) {
+    [name appendFormat:@"_v%u", HGSMicrobenchmarkRandom(state, 20)];
+  }
+  [name appendFormat:@".%@", 
+   kExtensions[HGSMicrobenchmarkRandom(state, 
+                                       sizeof(kExtensions) 
+                                       / sizeof(kExtensions[0]))]];
+  return name;
+}
+
+NSString *HGSMicrobenchmarkCorpusName(HGSMicrobenchmarkCorpus corpus) {
+  static NSString *const kNames[] = { 
+    @"ASCII", @"AccentedLatin", @"CJK", @"Filenames" 
+  };
+  HGSAssert(corpus < eHGSMicrobenchmarkCorpusCount, nil);
+  return corpus < eHGSMicrobenchmarkCorpusCount ? kNames[corpus] : nil;
+}
+
+NSArray *HGSMicrobenchmarkStrings(HGSMicrobenchmarkCorpus corpus,
+                                  NSUInteger count,
+                                  unsigned seed) {
+  unsigned state = seed;
+  NSMutableArray *strings = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    NSString *string = nil;
+    switch (corpus) {
+      case eHGSMicrobenchmarkASCIICorpus:
+      case eHGSMicrobenchmarkAccentedLatinCorpus: {
+        BOOL accented = corpus == eHGSMicrobenchmarkAccentedLatinCorpus;
+        NSUInteger words = 1 + HGSMicrobenchmarkRandom(&state, 3);
+        NSMutableArray *parts = [NSMutableArray arrayWithCapacity:words];
+        for (NSUInteger j = 0; j < words; ++j) {
+          NSString *word = HGSMicrobenchmarkWord(&state, accented);
+          [parts addObject:[word capitalizedString]];
+        }
+        string = [parts componentsJoinedByString:@" "];
+        // Names from the file system arrive decomposed.
+        if (accented && (i % 2)) {
+          string = [string decomposedStringWithCanonicalMapping];
+        }
+        break;
+      }
+      case eHGSMicrobenchmarkCJKCorpus:
+        string = HGSMicrobenchmarkCJKString(&state);
+        break;
+      case eHGSMicrobenchmarkFilenameCorpus:
+        string = HGSMicrobenchmarkFilename(&state);
+        break;
+      default:
+        HGSAssert(NO, @"Unknown corpus %u", corpus);
+        return nil;
+    }
+    [strings addObject:string];
+  }
+  return strings;
+}
+
+#pragma mark Runner
+
+@implementation HGSMicrobenchmark
+
+@synthesize name = name_;
+@synthesize function = function_;
+@synthesize fixture = fixture_;
+
+- (id)initWithName:(NSString *)name
+          function:(HGSMicrobenchmarkFunction)function
+           fixture:(id)fixture {
+  if ((self = [super init])) {
+    name_ = [name copy];
+    function_ = function;
+    fixture_ = [fixture retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [name_ release];
+  [fixture_ release];
+  [super dealloc];
+}
+
+@end
+
+@implementation HGSMicrobenchmarkRunner
+
+@synthesize sampleCount = sampleCount_;
+@synthesize minimumSampleTime = minimumSampleTime_;
+@synthesize filter = filter_;
+
+- (id)init {
+  if ((self = [super init])) {
+    benchmarks_ = [[NSMutableArray alloc] init];
+    sampleCount_ = 7;
+    minimumSampleTime_ = 0.1;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [benchmarks_ release];
+  [filter_ release];
+  [super dealloc];
+}
+
+- (void)addBenchmarkNamed:(NSString *)name
+                 function:(HGSMicrobenchmarkFunction)function
+                  fixture:(id)fixture {
+  HGSMicrobenchmark *benchmark 
+    = [[[HGSMicrobenchmark alloc] initWithName:name 
+                                      function:function 
+                                       fixture:fixture] autorelease];
+  [benchmarks_ addObject:benchmark];
+}
+
+- (double)nanosecondsPerOpForBenchmark:(HGSMicrobenchmark *)benchmark {
+  HGSMicrobenchmarkFunction function = [benchmark function];
+  id fixture = [benchmark fixture];
+  uint64_t minimumTime 
+    = HGSNanosecondsToMachTime((uint64_t)(minimumSampleTime_ * NSEC_PER_SEC));
+  NSUInteger sampleCount = MAX(sampleCount_, 1U);
+  double *samples = malloc(sampleCount * sizeof(double));
+  for (NSUInteger i = 0; i < sampleCount; ++i) {
+    uint64_t operations = 0;
+    uint64_t start = mach_absolute_time();
+    uint64_t elapsed = 0;
+    do {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      operations += function(fixture);
+      [pool release];
+      elapsed = mach_absolute_time() - start;
+    } while (elapsed < minimumTime);
+    samples[i] = (double)HGSMachTimeToNanoseconds(elapsed) / MAX(operations, 1);
+  }
+  // Insertion sort, there are only a handful of samples.
+  for (NSUInteger i = 1; i < sampleCount; ++i) {
+    double sample = samples[i];
+    NSUInteger j = i;
+    for (; j > 0 && samples[j - 1] > sample; --j) {
+      samples[j] = samples[j - 1];
+    }
+    samples[j] = sample;
+  }
+  double median = samples[sampleCount / 2];
+  free(samples);
+  return median;
+}
+
+- (double)allocationsPerOpForBenchmark:(HGSMicrobenchmark *)benchmark {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  uint64_t start = HGSMicrobenchmarkAllocationCount();
+  NSUInteger operations = [benchmark function]([benchmark fixture]);
+  uint64_t end = HGSMicrobenchmarkAllocationCount();
+  [pool release];
+  return (double)(end - start) / MAX(operations, 1U);
+}
+
+- (NSDictionary *)run {
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  for (HGSMicrobenchmark *benchmark in benchmarks_) {
+    NSString *name = [benchmark name];
+    if (filter_ && [name rangeOfString:filter_].location == NSNotFound) {
+      continue;
+    }
+    // Warm up caches, lazily built tables and the allocation counter.
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [benchmark function]([benchmark fixture]);
+    HGSMicrobenchmarkAllocationCount();
+    [pool release];
+    
+    double nanoseconds = [self nanosecondsPerOpForBenchmark:benchmark];
+    double allocations = [self allocationsPerOpForBenchmark:benchmark];
+    printf("%-36s %12.1f ns/op %10.2f allocs/op\n", 
+           [name UTF8String], nanoseconds, allocations);
+    fflush(stdout);
+    NSDictionary *result 
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble:nanoseconds], 
+         kHGSMicrobenchmarkNanosecondsPerOpKey,
+         [NSNumber numberWithDouble:allocations],
+         kHGSMicrobenchmarkAllocationsPerOpKey,
+         nil];
+    [results setObject:result forKey:name];
+  }
+  return results;
+}
+
++ (NSArray *)regressionsInResults:(NSDictionary *)results
+                     fromBaseline:(NSDictionary *)baseline
+                        threshold:(double)threshold {
+  NSMutableArray *regressions = [NSMutableArray array];
+  NSArray *names 
+    = [[results allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  for (NSString *name in names) {
+    NSDictionary *result = [results objectForKey:name];
+    NSDictionary *base = [baseline objectForKey:name];
+    if (!base) continue;
+    double nanoseconds 
+      = [[result objectForKey:kHGSMicrobenchmarkNanosecondsPerOpKey] 
+         doubleValue];
+    double baseNanoseconds 
+      = [[base objectForKey:kHGSMicrobenchmarkNanosecondsPerOpKey] 
+         doubleValue];
+    if (baseNanoseconds > 0 && nanoseconds > baseNanoseconds * (1 + threshold)) {
+      NSString *regression 
+        = [NSString stringWithFormat:
+           @"%@ takes %.1f ns/op, baseline %.1f ns/op (+%.0f%%)",
+           name, nanoseconds, baseNanoseconds, 
+           (nanoseconds / baseNanoseconds - 1) * 100];
+      [regressions addObject:regression];
+    }
+    double allocations 
+      = [[result objectForKey:kHGSMicrobenchmarkAllocationsPerOpKey] 
+         doubleValue];
+    double baseAllocations 
+      = [[base objectForKey:kHGSMicrobenchmarkAllocationsPerOpKey] 
+         doubleValue];
+    if (allocations > baseAllocations * (1 + threshold) 
+        && allocations - baseAllocations >= 1) {
+      NSString *regression 
+        = [NSString stringWithFormat:
+           @"%@ makes %.2f allocs/op, baseline %.2f allocs/op",
+           name, allocations, baseAllocations];
+      [regressions addObject:regression];
+    }
+  }
+  return regressions;
+}
+
+@end
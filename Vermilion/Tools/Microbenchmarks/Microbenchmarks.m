@@ -0,0 +1,642 @@
+//
+//  Microbenchmarks.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+// Microbenchmarks for the primitives on the search hot path: tokenizing,
+// term scoring, result sorting, the LRU and SQLite caches (including shared
+// reads from several threads) and the memory search source scan. Every
+// corpus is generated from a fixed seed.
+//
+// Options are read through NSUserDefaults, so they are given as
+// "-name value" pairs:
+//   -baseline path       Compare against a stored baseline and exit with 1
+//                        if anything regressed past -threshold.
+//   -threshold fraction  Allowed slowdown before failing (0.15).
+//   -writeBaseline path  Write the results out as a new baseline.
+//   -filter string       Only run benchmarks whose names contain string.
+//   -samples n           Timed samples per benchmark (7).
+//   -sampleTime seconds  Minimum length of each sample (0.1).
+//
+// Timings are only comparable on the same machine and build configuration,
+// so baselines are kept per machine rather than checked in. Run it from the
+// build products directory with DYLD_FRAMEWORK_PATH set to that directory
+// so Vermilion.framework is found.
+
+#import <Foundation/Foundation.h>
+#import <Vermilion/Vermilion.h>
+#import <pthread.h>
+#import "HGSMicrobenchmark.h"
+
+static const unsigned kMicrobenchmarkSeed = 20100401;
+static const NSUInteger kMicrobenchmarkStringCount = 1000;
+static const NSUInteger kMicrobenchmarkTermCount = 16;
+static const NSUInteger kMicrobenchmarkSortCount = 1000;
+static const NSUInteger kMicrobenchmarkLRUKeyCount = 4096;
+static const NSUInteger kMicrobenchmarkMaxReaderThreads = 8;
+static const NSUInteger kMicrobenchmarkSQLiteKeyCount = 200;
+static const NSUInteger kMicrobenchmarkScanCount = 5000;
+
+// Fixture keys.
+#define kMicrobenchmarkStringsKey @"Strings"
+#define kMicrobenchmarkTermsKey @"Terms"
+#define kMicrobenchmarkCacheKey @"Cache"
+#define kMicrobenchmarkKeysKey @"Keys"
+#define kMicrobenchmarkValueKey @"Value"
+#define kMicrobenchmarkSourceKey @"Source"
+#define kMicrobenchmarkQueriesKey @"Queries"
+
+// Owns an HGSLRUCache so it is torn down with the fixture.
+@interface MicrobenchmarkLRUCacheFixture : NSObject {
+ @private
+  HGSLRUCache *cache_;
+  NSArray *keys_;
+}
+@property (readonly, retain) HGSLRUCache *cache;
+@property (readonly, retain) NSArray *keys;
+- (id)initWithCapacity:(NSUInteger)capacity keys:(NSArray *)keys;
+- (id)initWithCapacity:(NSUInteger)capacity 
+                policy:(HGSLRUCachePolicy)policy
+                  keys:(NSArray *)keys;
+@end
+
+// Shares one cache between several reader threads. The cache is either an
+// HGSLRUCache guarded by @synchronized, the way callers used to share one,
+// or an HGSShardedLRUCache.
+@interface MicrobenchmarkThreadedCacheFixture : NSObject {
+ @private
+  id cache_;
+  NSArray *keys_;
+  NSUInteger threadCount_;
+}
+@property (readonly, retain) id cache;
+@property (readonly, retain) NSArray *keys;
+@property (readonly, assign) NSUInteger threadCount;
+- (id)initWithCache:(id)cache 
+               keys:(NSArray *)keys 
+        threadCount:(NSUInteger)threadCount;
+@end
+
+static const void *MicrobenchmarkRetain(CFAllocatorRef allocator, 
+                                        const void *value) {
+  return [(id)value retain];
+}
+
+static void MicrobenchmarkRelease(CFAllocatorRef allocator, 
+                                  const void *value) {
+  [(id)value release];
+}
+
+static Boolean MicrobenchmarkEqual(const void *value1, const void *value2) {
+  return [(id)value1 isEqual:(id)value2];
+}
+
+static CFHashCode MicrobenchmarkHash(const void *value) {
+  return [(id)value hash];
+}
+
+static BOOL MicrobenchmarkEvict(const void *key, 
+                                const void *value, 
+                                void *context) {
+  return YES;
+}
+
+// The caches hold on to the callbacks pointer, so it must outlive them.
+static HGSLRUCacheCallBacks gMicrobenchmarkCallBacks = {
+  0,
+  MicrobenchmarkRetain,
+  MicrobenchmarkRelease,
+  MicrobenchmarkEqual,
+  MicrobenchmarkHash,
+  MicrobenchmarkRetain,
+  MicrobenchmarkRelease,
+  MicrobenchmarkEvict
+};
+
+@implementation MicrobenchmarkLRUCacheFixture
+
+@synthesize cache = cache_;
+@synthesize keys = keys_;
+
+- (id)initWithCapacity:(NSUInteger)capacity keys:(NSArray *)keys {
+  return [self initWithCapacity:capacity 
+                         policy:eHGSLRUCachePolicyLRU 
+                           keys:keys];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity 
+                policy:(HGSLRUCachePolicy)policy
+                  keys:(NSArray *)keys {
+  if ((self = [super init])) {
+    // Every value is accounted as one byte, so the size is an entry count.
+    cache_ = [[HGSLRUCache alloc] initWithCacheSize:capacity
+                                             policy:policy
+                                          callBacks:&gMicrobenchmarkCallBacks
+                                       evictContext:NULL];
+    keys_ = [keys retain];
+    if (!cache_) {
+      [self release];
+      self = nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [cache_ release];
+  [keys_ release];
+  [super dealloc];
+}
+
+@end
+
+@implementation MicrobenchmarkThreadedCacheFixture
+
+@synthesize cache = cache_;
+@synthesize keys = keys_;
+@synthesize threadCount = threadCount_;
+
+- (id)initWithCache:(id)cache 
+               keys:(NSArray *)keys 
+        threadCount:(NSUInteger)threadCount {
+  if ((self = [super init])) {
+    cache_ = [cache retain];
+    keys_ = [keys retain];
+    threadCount_ = threadCount;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [cache_ release];
+  [keys_ release];
+  [super dealloc];
+}
+
+@end
+
+#pragma mark Tokenizer
+
+static NSUInteger MicrobenchmarkTokenize(id fixture) {
+  for (NSString *string in fixture) {
+    [HGSTokenizer tokenizeString:string];
+  }
+  return [fixture count];
+}
+
+#pragma mark Scoring
+
+// Query terms are the start of corpus strings, the way they are typed.
+static NSArray *MicrobenchmarkTerms(NSArray *strings, unsigned seed) {
+  NSMutableArray *terms 
+    = [NSMutableArray arrayWithCapacity:kMicrobenchmarkTermCount];
+  NSUInteger count = [strings count];
+  for (NSUInteger i = 0; i < kMicrobenchmarkTermCount; ++i) {
+    seed = seed * 1103515245 + 12345;
+    NSString *string 
+      = [[strings objectAtIndex:((seed >> 16) & 0x7FFF) % count] 
+         lowercaseString];
+    NSUInteger length = MIN([string length], 1 + i % 4);
+    NSRange range 
+      = [string rangeOfComposedCharacterSequencesForRange:NSMakeRange(0, 
+                                                                      length)];
+    [terms addObject:[HGSTokenizer tokenizeString:
+                      [string substringWithRange:range]]];
+  }
+  return terms;
+}
+
+static NSUInteger MicrobenchmarkScore(id fixture) {
+  NSArray *terms = [fixture objectForKey:kMicrobenchmarkTermsKey];
+  NSArray *strings = [fixture objectForKey:kMicrobenchmarkStringsKey];
+  for (HGSTokenizedString *term in terms) {
+    for (HGSTokenizedString *string in strings) {
+      HGSScoreTermForItem(term, string, NULL);
+    }
+  }
+  return [terms count] * [strings count];
+}
+
+#pragma mark Mixer
+
+static NSUInteger MicrobenchmarkMixerSort(id fixture) {
+  [fixture sortedArrayUsingFunction:HGSMixerScoredResultSort context:NULL];
+  return 1;
+}
+
+#pragma mark LRU Cache
+
+static NSUInteger MicrobenchmarkLRUCacheHit(id fixture) {
+  HGSLRUCache *cache = [fixture cache];
+  NSArray *keys = [fixture keys];
+  for (NSString *key in keys) {
+    [cache valueForKey:key];
+  }
+  return [keys count];
+}
+
+// The working set is twice the cache size, so most lookups miss and insert.
+static NSUInteger MicrobenchmarkLRUCacheChurn(id fixture) {
+  HGSLRUCache *cache = [fixture cache];
+  NSArray *keys = [fixture keys];
+  for (NSString *key in keys) {
+    if (![cache valueForKey:key]) {
+      [cache setValue:key forKey:key size:1];
+    }
+  }
+  return [keys count];
+}
+
+// Each reader thread walks the whole key set starting at its own offset.
+// The batch is timed by wall clock, so ns/op falls as throughput scales with
+// the reader count.
+static void *MicrobenchmarkThreadedCacheRead(void *arg) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  MicrobenchmarkThreadedCacheFixture *fixture = ((void **)arg)[0];
+  NSUInteger offset = (NSUInteger)((void **)arg)[1];
+  id cache = [fixture cache];
+  NSArray *keys = [fixture keys];
+  NSUInteger count = [keys count];
+  BOOL sharded = [cache isKindOfClass:[HGSShardedLRUCache class]];
+  for (NSUInteger i = 0; i < count; ++i) {
+    NSString *key = [keys objectAtIndex:(i + offset) % count];
+    if (sharded) {
+      [(id)[(HGSShardedLRUCache *)cache copyValueForKey:key] release];
+    } else {
+      @synchronized(cache) {
+        [[(id)[(HGSLRUCache *)cache valueForKey:key] retain] release];
+      }
+    }
+  }
+  [pool release];
+  return NULL;
+}
+
+static NSUInteger MicrobenchmarkThreadedCacheHit(id fixture) {
+  NSUInteger threadCount = [fixture threadCount];
+  NSUInteger count = [[fixture keys] count];
+  pthread_t threads[kMicrobenchmarkMaxReaderThreads];
+  void *args[kMicrobenchmarkMaxReaderThreads][2];
+  for (NSUInteger i = 0; i < threadCount; ++i) {
+    args[i][0] = fixture;
+    args[i][1] = (void *)(i * count / threadCount);
+    pthread_create(&threads[i], NULL, MicrobenchmarkThreadedCacheRead, 
+                   args[i]);
+  }
+  for (NSUInteger i = 0; i < threadCount; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  return threadCount * count;
+}
+
+#pragma mark SQLite Cache
+
+// Reads queue up touches, so the flush that writes them is part of the cost.
+static NSUInteger MicrobenchmarkSQLiteCacheRead(id fixture) {
+  HGSSQLiteBackedCache *cache = [fixture objectForKey:kMicrobenchmarkCacheKey];
+  NSArray *keys = [fixture objectForKey:kMicrobenchmarkKeysKey];
+  for (NSString *key in keys) {
+    [cache valueForKey:key];
+  }
+  [cache flush];
+  return [keys count];
+}
+
+// Writes are only queued, so flush to make their group commit part of the
+// cost.
+static NSUInteger MicrobenchmarkSQLiteCacheWrite(id fixture) {
+  HGSSQLiteBackedCache *cache = [fixture objectForKey:kMicrobenchmarkCacheKey];
+  NSArray *keys = [fixture objectForKey:kMicrobenchmarkKeysKey];
+  id value = [fixture objectForKey:kMicrobenchmarkValueKey];
+  for (NSString *key in keys) {
+    [cache setValue:value forKey:key];
+  }
+  [cache flush];
+  return [keys count];
+}
+
+#pragma mark Memory Search Source
+
+static NSUInteger MicrobenchmarkMemoryScan(id fixture) {
+  HGSMemorySearchSource *source 
+    = [fixture objectForKey:kMicrobenchmarkSourceKey];
+  NSArray *queries = [fixture objectForKey:kMicrobenchmarkQueriesKey];
+  for (HGSQuery *query in queries) {
+    HGSCallbackSearchOperation *operation 
+      = [[HGSCallbackSearchOperation alloc] initWithQuery:query 
+                                                   source:source];
+    [source performSearchOperation:operation];
+    [operation release];
+  }
+  return [queries count];
+}
+
+#pragma mark Suite
+
+static void MicrobenchmarkAddCorpusBenchmarks(HGSMicrobenchmarkRunner *runner,
+                                              HGSMicrobenchmarkCorpus corpus) {
+  NSString *corpusName = HGSMicrobenchmarkCorpusName(corpus);
+  NSArray *strings = HGSMicrobenchmarkStrings(corpus, 
+                                              kMicrobenchmarkStringCount,
+                                              kMicrobenchmarkSeed + corpus);
+  [runner addBenchmarkNamed:[@"Tokenizer." stringByAppendingString:corpusName]
+                   function:MicrobenchmarkTokenize
+                    fixture:strings];
+  
+  NSArray *terms = MicrobenchmarkTerms(strings, kMicrobenchmarkSeed);
+  NSDictionary *scoreFixture 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       terms, kMicrobenchmarkTermsKey,
+       [HGSTokenizer tokenizeStrings:strings], kMicrobenchmarkStringsKey,
+       nil];
+  [runner addBenchmarkNamed:[@"ScoreTerm." stringByAppendingString:corpusName]
+                   function:MicrobenchmarkScore
+                    fixture:scoreFixture];
+  
+  NSString *identifier 
+    = [@"com.google.qsb.microbenchmark." stringByAppendingString:corpusName];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSBundle mainBundle], kHGSExtensionBundleKey,
+       identifier, kHGSExtensionIdentifierKey,
+       identifier, kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSMemorySearchSource *source 
+    = [[[HGSMemorySearchSource alloc] initWithConfiguration:config] 
+       autorelease];
+  NSArray *scanStrings = HGSMicrobenchmarkStrings(corpus, 
+                                                  kMicrobenchmarkScanCount,
+                                                  kMicrobenchmarkSeed + corpus);
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  NSUInteger i = 0;
+  for (NSString *name in scanStrings) {
+    NSString *uri 
+      = [NSString stringWithFormat:@"http://bench.example.com/%u", i++];
+    HGSUnscoredResult *result = [HGSUnscoredResult resultWithURI:uri
+                                                            name:name
+                                                            type:kHGSTypeWebpage
+                                                          source:source
+                                                      attributes:nil];
+    [database indexResult:result name:name otherTerm:nil];
+  }
+  [source replaceCurrentDatabaseWith:database];
+  NSMutableArray *queries = [NSMutableArray arrayWithCapacity:[terms count]];
+  for (HGSTokenizedString *term in terms) {
+    HGSQuery *query 
+      = [[[HGSQuery alloc] initWithTokenizedString:term
+                                    actionArgument:nil
+                                   actionOperation:nil
+                                      pivotObjects:nil
+                                        queryFlags:0] autorelease];
+    [queries addObject:query];
+  }
+  NSDictionary *scanFixture 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       source, kMicrobenchmarkSourceKey,
+       queries, kMicrobenchmarkQueriesKey,
+       nil];
+  [runner addBenchmarkNamed:[@"MemoryScan." stringByAppendingString:corpusName]
+                   function:MicrobenchmarkMemoryScan
+                    fixture:scanFixture];
+}
+
+static void MicrobenchmarkAddMixerBenchmarks(HGSMicrobenchmarkRunner *runner) {
+  NSArray *names 
+    = HGSMicrobenchmarkStrings(eHGSMicrobenchmarkASCIICorpus,
+                               kMicrobenchmarkSortCount, 
+                               kMicrobenchmarkSeed);
+  NSMutableArray *results 
+    = [NSMutableArray arrayWithCapacity:kMicrobenchmarkSortCount];
+  unsigned state = kMicrobenchmarkSeed;
+  NSUInteger i = 0;
+  for (NSString *name in names) {
+    state = state * 1103515245 + 12345;
+    unsigned random = (state >> 16) & 0x7FFF;
+    // Coarse scores so the tie breaks get exercised too.
+    CGFloat score = (random % 20) / 20.0;
+    HGSRankFlags flags = 0;
+    if (random % 50 == 0) flags |= eHGSShortcutRankFlag;
+    if (random % 7 == 0) flags |= eHGSBelowFoldRankFlag;
+    NSString *uri 
+      = [NSString stringWithFormat:@"http://bench.example.com/%u", i++];
+    HGSScoredResult *result 
+      = [HGSScoredResult resultWithURI:uri
+                                  name:name
+                                  type:kHGSTypeWebpage
+                                source:nil
+                            attributes:nil
+                                 score:score
+                                 flags:flags
+                           matchedTerm:[HGSTokenizer tokenizeString:name]
+                        matchedIndexes:nil];
+    [results addObject:result];
+  }
+  [runner addBenchmarkNamed:
+   [NSString stringWithFormat:@"MixerSort.%u", kMicrobenchmarkSortCount]
+                   function:MicrobenchmarkMixerSort
+                    fixture:results];
+}
+
+static void MicrobenchmarkAddLRUCacheBenchmarks(HGSMicrobenchmarkRunner *runner) {
+  NSMutableArray *keys 
+    = [NSMutableArray arrayWithCapacity:kMicrobenchmarkLRUKeyCount];
+  for (NSUInteger i = 0; i < kMicrobenchmarkLRUKeyCount; ++i) {
+    [keys addObject:[NSString stringWithFormat:@"key-%u", i]];
+  }
+  MicrobenchmarkLRUCacheFixture *hit 
+    = [[[MicrobenchmarkLRUCacheFixture alloc] 
+        initWithCapacity:kMicrobenchmarkLRUKeyCount keys:keys] autorelease];
+  for (NSString *key in keys) {
+    [[hit cache] setValue:key forKey:key size:1];
+  }
+  [runner addBenchmarkNamed:@"LRUCache.Hit"
+                   function:MicrobenchmarkLRUCacheHit
+                    fixture:hit];
+  MicrobenchmarkLRUCacheFixture *churn 
+    = [[[MicrobenchmarkLRUCacheFixture alloc] 
+        initWithCapacity:kMicrobenchmarkLRUKeyCount / 2 keys:keys] autorelease];
+  [runner addBenchmarkNamed:@"LRUCache.Churn"
+                   function:MicrobenchmarkLRUCacheChurn
+                    fixture:churn];
+  MicrobenchmarkLRUCacheFixture *churn2Q 
+    = [[[MicrobenchmarkLRUCacheFixture alloc] 
+        initWithCapacity:kMicrobenchmarkLRUKeyCount / 2 
+                  policy:eHGSLRUCachePolicy2Q
+                    keys:keys] autorelease];
+  [runner addBenchmarkNamed:@"LRUCache.Churn.2Q"
+                   function:MicrobenchmarkLRUCacheChurn
+                    fixture:churn2Q];
+  
+  HGSShardedLRUCache *sharded 
+    = [[[HGSShardedLRUCache alloc] 
+        initWithCacheSize:kMicrobenchmarkLRUKeyCount
+               shardCount:0
+                callBacks:&gMicrobenchmarkCallBacks
+             evictContext:NULL] autorelease];
+  for (NSString *key in keys) {
+    [sharded setValue:key forKey:key size:1];
+  }
+  for (NSUInteger threads = 1; 
+       threads <= kMicrobenchmarkMaxReaderThreads; 
+       threads *= 2) {
+    MicrobenchmarkThreadedCacheFixture *locked
+      = [[[MicrobenchmarkThreadedCacheFixture alloc] initWithCache:[hit cache]
+                                                              keys:keys
+                                                       threadCount:threads]
+         autorelease];
+    [runner addBenchmarkNamed:
+     [NSString stringWithFormat:@"LRUCache.Locked.Threads%u", threads]
+                     function:MicrobenchmarkThreadedCacheHit
+                      fixture:locked];
+    MicrobenchmarkThreadedCacheFixture *shardedFixture
+      = [[[MicrobenchmarkThreadedCacheFixture alloc] initWithCache:sharded
+                                                              keys:keys
+                                                       threadCount:threads]
+         autorelease];
+    [runner addBenchmarkNamed:
+     [NSString stringWithFormat:@"ShardedLRUCache.Threads%u", threads]
+                     function:MicrobenchmarkThreadedCacheHit
+                      fixture:shardedFixture];
+  }
+}
+
+static void MicrobenchmarkAddSQLiteCacheBenchmarks(HGSMicrobenchmarkRunner *runner,
+                                                   NSString *directory) {
+  NSString *path = [directory stringByAppendingPathComponent:@"cache.db"];
+  HGSSQLiteBackedCache *cache 
+    = [[[HGSSQLiteBackedCache alloc] initWithPath:path version:@"1"] 
+       autorelease];
+  if (!cache) {
+    HGSLog(@"Unable to create SQLite cache at %@", path);
+    return;
+  }
+  NSMutableArray *keys 
+    = [NSMutableArray arrayWithCapacity:kMicrobenchmarkSQLiteKeyCount];
+  for (NSUInteger i = 0; i < kMicrobenchmarkSQLiteKeyCount; ++i) {
+    [keys addObject:[NSString stringWithFormat:@"key-%u", i]];
+  }
+  NSDictionary *value 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       @"Microbenchmark", @"name",
+       [NSNumber numberWithInt:42], @"count",
+       [HGSMicrobenchmarkStrings(eHGSMicrobenchmarkFilenameCorpus, 4, 
+                                 kMicrobenchmarkSeed) lastObject], @"path",
+       nil];
+  for (NSString *key in keys) {
+    [cache setValue:value forKey:key];
+  }
+  [cache flush];
+  NSDictionary *fixture 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       cache, kMicrobenchmarkCacheKey,
+       keys, kMicrobenchmarkKeysKey,
+       value, kMicrobenchmarkValueKey,
+       nil];
+  [runner addBenchmarkNamed:@"SQLiteCache.Read"
+                   function:MicrobenchmarkSQLiteCacheRead
+                    fixture:fixture];
+  [runner addBenchmarkNamed:@"SQLiteCache.Write"
+                   function:MicrobenchmarkSQLiteCacheWrite
+                    fixture:fixture];
+}
+
+int main(int argc, const char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  int status = 0;
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *directory 
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"Microbenchmarks-%d", getpid()]];
+  [fm createDirectoryAtPath:directory
+withIntermediateDirectories:YES
+                 attributes:nil
+                      error:NULL];
+
+  HGSMicrobenchmarkRunner *runner 
+    = [[[HGSMicrobenchmarkRunner alloc] init] autorelease];
+  if ([defaults objectForKey:@"samples"]) {
+    [runner setSampleCount:[defaults integerForKey:@"samples"]];
+  }
+  if ([defaults objectForKey:@"sampleTime"]) {
+    [runner setMinimumSampleTime:[defaults doubleForKey:@"sampleTime"]];
+  }
+  [runner setFilter:[defaults stringForKey:@"filter"]];
+  
+  for (HGSMicrobenchmarkCorpus corpus = 0; 
+       corpus < eHGSMicrobenchmarkCorpusCount; 
+       ++corpus) {
+    MicrobenchmarkAddCorpusBenchmarks(runner, corpus);
+  }
+  MicrobenchmarkAddMixerBenchmarks(runner);
+  MicrobenchmarkAddLRUCacheBenchmarks(runner);
+  MicrobenchmarkAddSQLiteCacheBenchmarks(runner, directory);
+  
+  NSDictionary *results = [runner run];
+  
+  NSString *writePath = [defaults stringForKey:@"writeBaseline"];
+  if (writePath && ![results writeToFile:writePath atomically:YES]) {
+    fprintf(stderr, "Unable to write baseline %s\n", 
+            [writePath fileSystemRepresentation]);
+    status = 1;
+  }
+  
+  NSString *baselinePath = [defaults stringForKey:@"baseline"];
+  if (baselinePath) {
+    NSDictionary *baseline 
+      = [NSDictionary dictionaryWithContentsOfFile:baselinePath];
+    if (baseline) {
+      double threshold = 0.15;
+      if ([defaults objectForKey:@"threshold"]) {
+        threshold = [defaults doubleForKey:@"threshold"];
+      }
+      NSArray *regressions 
+        = [HGSMicrobenchmarkRunner regressionsInResults:results
+                                           fromBaseline:baseline
+                                              threshold:threshold];
+      for (NSString *regression in regressions) {
+        fprintf(stderr, "REGRESSION: %s\n", [regression UTF8String]);
+      }
+      if ([regressions count]) {
+        status = 1;
+      }
+    } else {
+      fprintf(stderr, "Unable to read baseline %s\n", 
+              [baselinePath fileSystemRepresentation]);
+      status = 1;
+    }
+  }
+  
+  [fm removeItemAtPath:directory error:NULL];
+  [pool release];
+  return status;
+}
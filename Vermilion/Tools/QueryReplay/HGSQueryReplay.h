@@ -0,0 +1,189 @@
+//
+//  HGSQueryReplay.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header
+ @discussion HGSQueryReplay
+
+ A headless harness for measuring end-to-end search latency. A corpus of
+ results is loaded into in-memory search sources, and a recorded keystroke
+ stream is replayed through HGSQueryController the way the search field
+ drives it: every keystroke cancels the previous query and starts a new one.
+ For each query it measures the time to the first result, the time until
+ the query reports that it is finished, and how many results are available
+ at each display stage.
+
+ Corpora are plain property lists so they can be recorded, checked in and
+ diffed:
+
+ <pre>
+ {
+   Sources = (
+     {
+       Identifier = "com.example.replay.apps";
+       Latency = 0.02;          // Optional. Seconds to stall each search.
+       Results = (
+         {
+           Name = "Activity Monitor";
+           URI = "file:///Applications/Utilities/Activity%20Monitor.app";
+           Type = "file.application";     // Optional, defaults to webpage.
+           OtherTerms = ("top", "cpu");   // Optional.
+         },
+       );
+     },
+   );
+   Keystrokes = (
+     { Query = "a"; Delay = 0.15; },  // Delay is since the previous key.
+     { Query = "ac"; Delay = 0.12; },
+   );
+ }
+ </pre>
+*/
+
+/*! Array of source dictionaries in a corpus. */
+#define kHGSQueryReplaySourcesKey @"Sources"
+/*! Array of keystroke dictionaries in a corpus. */
+#define kHGSQueryReplayKeystrokesKey @"Keystrokes"
+/*! String. Identifier of a source. */
+#define kHGSQueryReplayIdentifierKey @"Identifier"
+/*! NSNumber. Seconds a source stalls before searching. */
+#define kHGSQueryReplayLatencyKey @"Latency"
+/*! Array of result dictionaries in a source. */
+#define kHGSQueryReplayResultsKey @"Results"
+/*! String. Name of a result. */
+#define kHGSQueryReplayNameKey @"Name"
+/*! String. URI of a result. */
+#define kHGSQueryReplayURIKey @"URI"
+/*! String. Type of a result. Defaults to kHGSTypeWebpage. */
+#define kHGSQueryReplayTypeKey @"Type"
+/*! Array of strings that also match a result. */
+#define kHGSQueryReplayOtherTermsKey @"OtherTerms"
+/*! String. The contents of the search field after a keystroke. */
+#define kHGSQueryReplayQueryKey @"Query"
+/*! NSNumber. Seconds since the previous keystroke. */
+#define kHGSQueryReplayDelayKey @"Delay"
+
+/*! NSNumber. Number of queries started. */
+#define kHGSQueryReplayQueryCountKey @"QueryCount"
+/*! NSNumber. Queries that were replaced before they finished. */
+#define kHGSQueryReplayInterruptedCountKey @"InterruptedCount"
+/*! Distribution of milliseconds until the first result. */
+#define kHGSQueryReplayTimeToFirstResultKey @"TimeToFirstResult"
+/*! Distribution of milliseconds until the query finished. */
+#define kHGSQueryReplayTimeToCompleteKey @"TimeToComplete"
+/*! 
+ Array with one dictionary per display stage, each with a 
+ kHGSQueryReplayStageKey and a kHGSQueryReplayResultCountsKey distribution. 
+*/
+#define kHGSQueryReplayStagesKey @"Stages"
+/*! NSNumber. Seconds after the keystroke the stage is measured at. */
+#define kHGSQueryReplayStageKey @"Stage"
+/*! Distribution of the number of results available at a stage. */
+#define kHGSQueryReplayResultCountsKey @"ResultCounts"
+
+/*! 
+ Keys of a distribution dictionary. Each is an NSNumber; distributions
+ with no samples only have a count.
+*/
+#define kHGSQueryReplayCountKey @"Count"
+#define kHGSQueryReplayMeanKey @"Mean"
+#define kHGSQueryReplayP50Key @"P50"
+#define kHGSQueryReplayP90Key @"P90"
+#define kHGSQueryReplayP99Key @"P99"
+#define kHGSQueryReplayMaxKey @"Max"
+
+@class HGSQueryController;
+
+@interface HGSQueryReplay : NSObject {
+ @private
+  NSArray *sources_;
+  NSArray *keystrokes_;
+  double timeScale_;
+  NSTimeInterval settleTime_;
+  HGSQueryController *controller_;
+  uint64_t startTime_;
+  uint64_t firstResultTime_;
+  uint64_t finishTime_;
+  NSUInteger stage_;
+  NSUInteger queryCount_;
+  NSUInteger interruptedCount_;
+  NSMutableArray *timesToFirstResult_;
+  NSMutableArray *timesToComplete_;
+  NSMutableArray *stageResultCounts_;
+}
+
+/*!
+ Multiplier applied to the recorded delays between keystrokes. 1.0 replays
+ at the recorded speed, 0 types every keystroke back to back. Defaults to
+ 1.0.
+*/
+@property (assign) double timeScale;
+
+/*!
+ How long to wait for the last query to finish. Defaults to 5 seconds.
+*/
+@property (assign) NSTimeInterval settleTime;
+
+/*!
+ Builds a corpus of made-up names spread over |sourceCount| sources, with
+ one source in four stalling for a while, and a keystroke stream that types
+ some of the names at a realistic pace. The same |seed| always gives the
+ same corpus.
+*/
++ (NSDictionary *)syntheticCorpusWithSourceCount:(NSUInteger)sourceCount
+                                     resultCount:(NSUInteger)resultCount
+                                  keystrokeCount:(NSUInteger)keystrokeCount
+                                            seed:(unsigned)seed;
+
+/*!
+ Formats a report returned by -run for people.
+*/
++ (NSString *)summaryOfReport:(NSDictionary *)report;
+
+/*!
+ Creates sources for |corpus|. Returns nil if the corpus has no sources or
+ no keystrokes.
+*/
+- (id)initWithCorpus:(NSDictionary *)corpus;
+
+/*!
+ Installs the sources, replays the keystrokes and uninstalls the sources
+ again. Must be called on the main thread, which it runs the run loop of.
+ @result A report dictionary using the kHGSQueryReplay*Key keys. Suitable
+         for writing out as a property list.
+*/
+- (NSDictionary *)run;
+
+@end
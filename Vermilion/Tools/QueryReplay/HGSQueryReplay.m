@@ -0,0 +1,512 @@
+//
+//  HGSQueryReplay.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSQueryReplay.h"
+#import <Vermilion/Vermilion.h>
+#import <mach/mach_time.h>
+
+// Matches the display timer stages in QSBSearchController, so the result
+// counts line up with what the user would have been shown.
+static const NSTimeInterval kHGSQueryReplayStageTimes[] = { 0.1, 0.3, 0.7 };
+#define kHGSQueryReplayStageCount \
+  (sizeof(kHGSQueryReplayStageTimes) / sizeof(kHGSQueryReplayStageTimes[0]))
+
+// A memory source serving a slice of the corpus.
+@interface HGSQueryReplaySource : HGSMemorySearchSource
+@end
+
+// A memory source that stalls before searching, standing in for sources
+// that go to disk or the network. This is a separate class because
+// overriding performSearchOperation: turns off result refinement in
+// HGSMemorySearchSource, which the fast sources should keep.
+@interface HGSQueryReplaySlowSource : HGSQueryReplaySource {
+ @private
+  NSTimeInterval latency_;
+}
+@property (assign) NSTimeInterval latency;
+@end
+
+@interface HGSQueryReplay ()
+- (void)runUntil:(uint64_t)deadline stopWhenDone:(BOOL)stopWhenDone;
+- (void)measureStagesAt:(uint64_t)now;
+- (void)startQueryWithString:(NSString *)queryString;
+- (void)finishCurrentQuery;
+- (NSUInteger)currentResultCount;
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification;
+- (void)queryControllerDidFinish:(NSNotification *)notification;
+@end
+
+@implementation HGSQueryReplaySource
+@end
+
+@implementation HGSQueryReplaySlowSource
+
+@synthesize latency = latency_;
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  [NSThread sleepForTimeInterval:latency_];
+  [super performSearchOperation:operation];
+}
+
+@end
+
+static double HGSQueryReplayMilliseconds(uint64_t machTime) {
+  return HGSMachTimeToNanoseconds(machTime) / 1000000.0;
+}
+
+static uint64_t HGSQueryReplayMachTime(NSTimeInterval seconds) {
+  return HGSNanosecondsToMachTime((uint64_t)(seconds * NSEC_PER_SEC));
+}
+
+static NSDictionary *HGSQueryReplayDistribution(NSArray *samples) {
+  NSUInteger count = [samples count];
+  NSNumber *nsCount = [NSNumber numberWithUnsignedInteger:count];
+  if (!count) {
+    return [NSDictionary dictionaryWithObject:nsCount
+                                       forKey:kHGSQueryReplayCountKey];
+  }
+  NSArray *sorted = [samples sortedArrayUsingSelector:@selector(compare:)];
+  double total = 0;
+  for (NSNumber *sample in sorted) {
+    total += [sample doubleValue];
+  }
+  double percentiles[] = { 0.5, 0.9, 0.99 };
+  NSNumber *values[3];
+  for (size_t i = 0; i < 3; ++i) {
+    NSUInteger rank = (NSUInteger)ceil(percentiles[i] * count);
+    values[i] = [sorted objectAtIndex:MAX(rank, 1U) - 1];
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          nsCount, kHGSQueryReplayCountKey,
+          [NSNumber numberWithDouble:total / count], kHGSQueryReplayMeanKey,
+          values[0], kHGSQueryReplayP50Key,
+          values[1], kHGSQueryReplayP90Key,
+          values[2], kHGSQueryReplayP99Key,
+          [sorted lastObject], kHGSQueryReplayMaxKey,
+          nil];
+}
+
+static NSString *HGSQueryReplayDistributionSummary(NSDictionary *distribution) {
+  NSUInteger count 
+    = [[distribution objectForKey:kHGSQueryReplayCountKey] unsignedIntValue];
+  if (!count) return @"n=0";
+  return [NSString stringWithFormat:
+          @"n=%u mean=%.1f p50=%.1f p90=%.1f p99=%.1f max=%.1f",
+          count,
+          [[distribution objectForKey:kHGSQueryReplayMeanKey] doubleValue],
+          [[distribution objectForKey:kHGSQueryReplayP50Key] doubleValue],
+          [[distribution objectForKey:kHGSQueryReplayP90Key] doubleValue],
+          [[distribution objectForKey:kHGSQueryReplayP99Key] doubleValue],
+          [[distribution objectForKey:kHGSQueryReplayMaxKey] doubleValue]];
+}
+
+// A small LCG so a seed gives the same corpus everywhere.
+static NSUInteger HGSQueryReplayRandom(unsigned *state, NSUInteger range) {
+  *state = *state * 1103515245 + 12345;
+  return ((*state >> 16) & 0x7FFF) % range;
+}
+
+static NSString *HGSQueryReplayWord(unsigned *state) {
+  static NSString *const kSyllables[] = {
+    @"ka", @"lo", @"mi", @"su", @"te", @"ra", @"no", @"vi", 
+    @"de", @"po", @"ga", @"bu", @"shi", @"an", @"el", @"or",
+  };
+  NSUInteger syllableCount = sizeof(kSyllables) / sizeof(kSyllables[0]);
+  NSMutableString *word = [NSMutableString string];
+  NSUInteger length = 2 + HGSQueryReplayRandom(state, 3);
+  for (NSUInteger i = 0; i < length; ++i) {
+    [word appendString:kSyllables[HGSQueryReplayRandom(state, syllableCount)]];
+  }
+  return word;
+}
+
+@implementation HGSQueryReplay
+
+@synthesize timeScale = timeScale_;
+@synthesize settleTime = settleTime_;
+
++ (NSDictionary *)syntheticCorpusWithSourceCount:(NSUInteger)sourceCount
+                                     resultCount:(NSUInteger)resultCount
+                                  keystrokeCount:(NSUInteger)keystrokeCount
+                                            seed:(unsigned)seed {
+  if (!sourceCount || !resultCount) return nil;
+  unsigned state = seed;
+  NSMutableArray *names = [NSMutableArray arrayWithCapacity:resultCount];
+  NSMutableArray *sources = [NSMutableArray arrayWithCapacity:sourceCount];
+  NSUInteger perSource = (resultCount + sourceCount - 1) / sourceCount;
+  for (NSUInteger i = 0; i < sourceCount; ++i) {
+    NSString *identifier 
+      = [NSString stringWithFormat:@"com.google.qsb.replay.source%u", i];
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:perSource];
+    for (NSUInteger j = 0; j < perSource && [names count] < resultCount; ++j) {
+      NSString *name = [NSString stringWithFormat:@"%@ %@",
+                        [HGSQueryReplayWord(&state) capitalizedString],
+                        HGSQueryReplayWord(&state)];
+      NSString *uri 
+        = [NSString stringWithFormat:@"http://replay.example.com/%u/%u", i, j];
+      NSArray *otherTerms 
+        = [NSArray arrayWithObject:HGSQueryReplayWord(&state)];
+      NSDictionary *result 
+        = [NSDictionary dictionaryWithObjectsAndKeys:
+           name, kHGSQueryReplayNameKey,
+           uri, kHGSQueryReplayURIKey,
+           otherTerms, kHGSQueryReplayOtherTermsKey,
+           nil];
+      [results addObject:result];
+      [names addObject:name];
+    }
+    // One source in four is slow, each a little slower than the last.
+    NSTimeInterval latency = (i % 4 == 3) ? 0.05 * (i / 4 + 1) : 0;
+    NSDictionary *source 
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         identifier, kHGSQueryReplayIdentifierKey,
+         [NSNumber numberWithDouble:latency], kHGSQueryReplayLatencyKey,
+         results, kHGSQueryReplayResultsKey,
+         nil];
+    [sources addObject:source];
+  }
+  
+  // Type the start of names, pausing between them the way people do.
+  NSMutableArray *keystrokes = [NSMutableArray arrayWithCapacity:keystrokeCount];
+  while ([keystrokes count] < keystrokeCount) {
+    NSString *name 
+      = [[names objectAtIndex:HGSQueryReplayRandom(&state, [names count])]
+         lowercaseString];
+    NSUInteger typed = 1 + HGSQueryReplayRandom(&state, MIN([name length], 8U));
+    for (NSUInteger i = 1; 
+         i <= typed && [keystrokes count] < keystrokeCount; 
+         ++i) {
+      NSTimeInterval delay;
+      if (i == 1) {
+        delay = 0.5 + HGSQueryReplayRandom(&state, 1000) / 1000.0;
+      } else {
+        delay = 0.06 + HGSQueryReplayRandom(&state, 140) / 1000.0;
+      }
+      NSDictionary *keystroke 
+        = [NSDictionary dictionaryWithObjectsAndKeys:
+           [name substringToIndex:i], kHGSQueryReplayQueryKey,
+           [NSNumber numberWithDouble:delay], kHGSQueryReplayDelayKey,
+           nil];
+      [keystrokes addObject:keystroke];
+    }
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          sources, kHGSQueryReplaySourcesKey,
+          keystrokes, kHGSQueryReplayKeystrokesKey,
+          nil];
+}
+
++ (NSString *)summaryOfReport:(NSDictionary *)report {
+  NSMutableString *summary = [NSMutableString string];
+  [summary appendFormat:@"Queries: %@ (%@ interrupted)\n",
+   [report objectForKey:kHGSQueryReplayQueryCountKey],
+   [report objectForKey:kHGSQueryReplayInterruptedCountKey]];
+  NSDictionary *distribution 
+    = [report objectForKey:kHGSQueryReplayTimeToFirstResultKey];
+  [summary appendFormat:@"Time to first result (ms): %@\n",
+   HGSQueryReplayDistributionSummary(distribution)];
+  distribution = [report objectForKey:kHGSQueryReplayTimeToCompleteKey];
+  [summary appendFormat:@"Time to complete (ms): %@\n",
+   HGSQueryReplayDistributionSummary(distribution)];
+  for (NSDictionary *stage in [report objectForKey:kHGSQueryReplayStagesKey]) {
+    NSTimeInterval stageTime 
+      = [[stage objectForKey:kHGSQueryReplayStageKey] doubleValue];
+    distribution = [stage objectForKey:kHGSQueryReplayResultCountsKey];
+    [summary appendFormat:@"Results at %.0fms: %@\n",
+     stageTime * 1000, HGSQueryReplayDistributionSummary(distribution)];
+  }
+  return summary;
+}
+
+- (id)initWithCorpus:(NSDictionary *)corpus {
+  if ((self = [super init])) {
+    NSBundle *bundle = [NSBundle mainBundle];
+    NSMutableArray *sources = [NSMutableArray array];
+    for (NSDictionary *sourceDict 
+         in [corpus objectForKey:kHGSQueryReplaySourcesKey]) {
+      NSString *identifier 
+        = [sourceDict objectForKey:kHGSQueryReplayIdentifierKey];
+      if (![identifier length]) {
+        HGSLog(@"Skipping replay source without an identifier: %@", 
+               sourceDict);
+        continue;
+      }
+      NSDictionary *config
+        = [NSDictionary dictionaryWithObjectsAndKeys:
+           bundle, kHGSExtensionBundleKey,
+           identifier, kHGSExtensionIdentifierKey,
+           identifier, kHGSExtensionUserVisibleNameKey,
+           nil];
+      NSTimeInterval latency 
+        = [[sourceDict objectForKey:kHGSQueryReplayLatencyKey] doubleValue];
+      HGSQueryReplaySource *source = nil;
+      if (latency > 0) {
+        HGSQueryReplaySlowSource *slowSource
+          = [[[HGSQueryReplaySlowSource alloc] initWithConfiguration:config] 
+             autorelease];
+        [slowSource setLatency:latency];
+        source = slowSource;
+      } else {
+        source = [[[HGSQueryReplaySource alloc] initWithConfiguration:config] 
+                  autorelease];
+      }
+      if (!source) continue;
+      HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+      for (NSDictionary *resultDict 
+           in [sourceDict objectForKey:kHGSQueryReplayResultsKey]) {
+        NSString *name = [resultDict objectForKey:kHGSQueryReplayNameKey];
+        NSString *uri = [resultDict objectForKey:kHGSQueryReplayURIKey];
+        if (![name length] || ![uri length]) continue;
+        NSString *type = [resultDict objectForKey:kHGSQueryReplayTypeKey];
+        if (!type) type = kHGSTypeWebpage;
+        HGSUnscoredResult *result 
+          = [HGSUnscoredResult resultWithURI:uri
+                                        name:name
+                                        type:type
+                                      source:source
+                                  attributes:nil];
+        NSArray *otherTerms 
+          = [resultDict objectForKey:kHGSQueryReplayOtherTermsKey];
+        [database indexResult:result name:name otherTerms:otherTerms];
+      }
+      [source replaceCurrentDatabaseWith:database];
+      [sources addObject:source];
+    }
+    sources_ = [sources copy];
+    keystrokes_ 
+      = [[corpus objectForKey:kHGSQueryReplayKeystrokesKey] copy];
+    if (![sources_ count] || ![keystrokes_ count]) {
+      HGSLog(@"Replay corpus needs sources and keystrokes");
+      [self release];
+      return nil;
+    }
+    timeScale_ = 1.0;
+    settleTime_ = 5.0;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [controller_ cancel];
+  [controller_ release];
+  [sources_ release];
+  [keystrokes_ release];
+  [timesToFirstResult_ release];
+  [timesToComplete_ release];
+  [stageResultCounts_ release];
+  [super dealloc];
+}
+
+- (NSDictionary *)run {
+  HGSAssert([NSThread isMainThread], nil);
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  for (HGSSearchSource *source in sources_) {
+    [sourcesPoint extendWithObject:source];
+  }
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidUpdateResults:)
+             name:kHGSQueryControllerDidUpdateResultsNotification
+           object:nil];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidFinish:)
+             name:kHGSQueryControllerDidFinishNotification
+           object:nil];
+  // Without an input source the run loop returns immediately instead of
+  // waiting for the next notification or deadline.
+  NSPort *port = [NSPort port];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  [runLoop addPort:port forMode:NSDefaultRunLoopMode];
+  
+  queryCount_ = 0;
+  interruptedCount_ = 0;
+  [timesToFirstResult_ release];
+  timesToFirstResult_ = [[NSMutableArray alloc] init];
+  [timesToComplete_ release];
+  timesToComplete_ = [[NSMutableArray alloc] init];
+  [stageResultCounts_ release];
+  stageResultCounts_ = [[NSMutableArray alloc] init];
+  for (NSUInteger i = 0; i < kHGSQueryReplayStageCount; ++i) {
+    [stageResultCounts_ addObject:[NSMutableArray array]];
+  }
+
+  uint64_t keyTime = mach_absolute_time();
+  for (NSDictionary *keystroke in keystrokes_) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSTimeInterval delay 
+      = [[keystroke objectForKey:kHGSQueryReplayDelayKey] doubleValue];
+    keyTime += HGSQueryReplayMachTime(delay * timeScale_);
+    [self runUntil:keyTime stopWhenDone:NO];
+    [self finishCurrentQuery];
+    NSString *queryString = [keystroke objectForKey:kHGSQueryReplayQueryKey];
+    if ([queryString length]) {
+      [self startQueryWithString:queryString];
+    }
+    [pool release];
+  }
+  uint64_t settleDeadline 
+    = mach_absolute_time() + HGSQueryReplayMachTime(settleTime_);
+  [self runUntil:settleDeadline stopWhenDone:YES];
+  [self finishCurrentQuery];
+
+  [runLoop removePort:port forMode:NSDefaultRunLoopMode];
+  [nc removeObserver:self];
+  for (HGSSearchSource *source in sources_) {
+    [sourcesPoint removeExtension:source];
+  }
+  
+  NSMutableArray *stages = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kHGSQueryReplayStageCount; ++i) {
+    NSArray *counts = [stageResultCounts_ objectAtIndex:i];
+    NSDictionary *stage
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble:kHGSQueryReplayStageTimes[i]],
+         kHGSQueryReplayStageKey,
+         HGSQueryReplayDistribution(counts), kHGSQueryReplayResultCountsKey,
+         nil];
+    [stages addObject:stage];
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithUnsignedInteger:queryCount_], 
+          kHGSQueryReplayQueryCountKey,
+          [NSNumber numberWithUnsignedInteger:interruptedCount_],
+          kHGSQueryReplayInterruptedCountKey,
+          HGSQueryReplayDistribution(timesToFirstResult_),
+          kHGSQueryReplayTimeToFirstResultKey,
+          HGSQueryReplayDistribution(timesToComplete_),
+          kHGSQueryReplayTimeToCompleteKey,
+          stages, kHGSQueryReplayStagesKey,
+          nil];
+}
+
+- (void)runUntil:(uint64_t)deadline stopWhenDone:(BOOL)stopWhenDone {
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  while (YES) {
+    uint64_t now = mach_absolute_time();
+    [self measureStagesAt:now];
+    if (now >= deadline) break;
+    if (stopWhenDone 
+        && (!controller_ 
+            || (finishTime_ && stage_ == kHGSQueryReplayStageCount))) {
+      break;
+    }
+    uint64_t wakeTime = deadline;
+    if (controller_ && stage_ < kHGSQueryReplayStageCount) {
+      uint64_t stageTime 
+        = startTime_ + HGSQueryReplayMachTime(kHGSQueryReplayStageTimes[stage_]);
+      wakeTime = MIN(wakeTime, stageTime);
+    }
+    NSTimeInterval wait 
+      = HGSMachTimeToNanoseconds(wakeTime - now) / (double)NSEC_PER_SEC;
+    [runLoop runMode:NSDefaultRunLoopMode
+          beforeDate:[NSDate dateWithTimeIntervalSinceNow:wait]];
+  }
+}
+
+- (void)measureStagesAt:(uint64_t)now {
+  if (!controller_) return;
+  while (stage_ < kHGSQueryReplayStageCount) {
+    uint64_t stageTime 
+      = startTime_ + HGSQueryReplayMachTime(kHGSQueryReplayStageTimes[stage_]);
+    if (now < stageTime) break;
+    NSNumber *count 
+      = [NSNumber numberWithUnsignedInteger:[self currentResultCount]];
+    [[stageResultCounts_ objectAtIndex:stage_] addObject:count];
+    ++stage_;
+  }
+}
+
+- (void)startQueryWithString:(NSString *)queryString {
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:queryString
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  controller_ = [[HGSQueryController alloc] initWithQuery:query];
+  [controller_ setFirstStageDeadline:kHGSQueryReplayStageTimes[0]];
+  startTime_ = mach_absolute_time();
+  firstResultTime_ = 0;
+  finishTime_ = 0;
+  stage_ = 0;
+  ++queryCount_;
+  [controller_ startQuery];
+}
+
+- (void)finishCurrentQuery {
+  if (!controller_) return;
+  if (finishTime_) {
+    // Nothing more is coming, so the stages we didn't get to would have 
+    // shown what we have now.
+    NSNumber *count 
+      = [NSNumber numberWithUnsignedInteger:[self currentResultCount]];
+    for (; stage_ < kHGSQueryReplayStageCount; ++stage_) {
+      [[stageResultCounts_ objectAtIndex:stage_] addObject:count];
+    }
+    double ms = HGSQueryReplayMilliseconds(finishTime_ - startTime_);
+    [timesToComplete_ addObject:[NSNumber numberWithDouble:ms]];
+  } else {
+    ++interruptedCount_;
+  }
+  if (firstResultTime_) {
+    double ms = HGSQueryReplayMilliseconds(firstResultTime_ - startTime_);
+    [timesToFirstResult_ addObject:[NSNumber numberWithDouble:ms]];
+  }
+  [controller_ cancel];
+  [controller_ release];
+  controller_ = nil;
+}
+
+- (NSUInteger)currentResultCount {
+  HGSTypeFilter *allTypes = [HGSTypeFilter filterAllowingAllTypes];
+  return [controller_ resultCountForFilter:allTypes];
+}
+
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification {
+  if ([notification object] != controller_) return;
+  if (!firstResultTime_ && [self currentResultCount]) {
+    firstResultTime_ = mach_absolute_time();
+  }
+}
+
+- (void)queryControllerDidFinish:(NSNotification *)notification {
+  if ([notification object] != controller_) return;
+  uint64_t now = mach_absolute_time();
+  if (!firstResultTime_ && [self currentResultCount]) {
+    firstResultTime_ = now;
+  }
+  if (!finishTime_) {
+    finishTime_ = now;
+  }
+}
+
+@end
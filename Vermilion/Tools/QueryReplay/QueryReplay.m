@@ -0,0 +1,208 @@
+//
+//  QueryReplay.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+// Command line driver for HGSQueryReplay.
+//
+// Options are read through NSUserDefaults, so they are given as
+// "-name value" pairs:
+//   -corpus path      Replay a corpus property list (see HGSQueryReplay.h).
+//                     Without it a synthetic corpus is generated from
+//                     -sources (8), -results (5000), -keystrokes (500) and
+//                     -seed (1).
+//   -timeScale n      Multiplier for the recorded keystroke delays (1.0).
+//   -settle seconds   How long to wait for the last query (5.0).
+//   -warmup YES       Replay once untimed first, so the source ranker and
+//                     caches are in a steady state (NO).
+//   -writeCorpus path Write out the corpus that is replayed.
+//   -output path      Write the report as a property list for tracking.
+//
+// Run it from the build products directory with
+// DYLD_FRAMEWORK_PATH set to that directory so Vermilion.framework is found.
+
+#import <Foundation/Foundation.h>
+#import <Vermilion/Vermilion.h>
+#import "HGSQueryReplay.h"
+
+// Keeps anything the replay writes out of the user's QSB folders.
+@interface HGSQueryReplayDelegate : NSObject <HGSDelegate> {
+ @private
+  NSString *path_;
+}
+@end
+
+@implementation HGSQueryReplayDelegate
+
+- (id)init {
+  if ((self = [super init])) {
+    NSString *name 
+      = [NSString stringWithFormat:@"QueryReplay-%d", getpid()];
+    path_ 
+      = [[NSTemporaryDirectory() stringByAppendingPathComponent:name] retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [[NSFileManager defaultManager] removeItemAtPath:path_ error:NULL];
+  [path_ release];
+  [super dealloc];
+}
+
+- (NSString *)userFolderNamed:(NSString *)name {
+  NSString *path = [path_ stringByAppendingPathComponent:name];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  if (![fm fileExistsAtPath:path] 
+      && ![fm createDirectoryAtPath:path
+        withIntermediateDirectories:YES
+                         attributes:nil
+                              error:NULL]) {
+    path = nil;
+  }
+  return path;
+}
+
+- (NSString *)userApplicationSupportFolderForApp {
+  return [self userFolderNamed:@"Application Support"];
+}
+
+- (NSString *)userCacheFolderForApp {
+  return [self userFolderNamed:@"Cache"];
+}
+
+- (NSArray *)pluginFolders {
+  return [NSArray array];
+}
+
+- (NSString *)suggestLanguage {
+  return @"en_US";
+}
+
+- (NSString *)clientID {
+  return @"qsb_mac_query_replay";
+}
+
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result {
+  return nil;
+}
+
+- (NSDictionary *)getActionSaveAsInfoFor:(NSDictionary *)request {
+  return nil;
+}
+
+- (NSArray *)sourcesRequiringThreadAffinity {
+  return nil;
+}
+
+@end
+
+static NSInteger QueryReplayIntegerOption(NSString *key, NSInteger value) {
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  if ([defaults objectForKey:key]) {
+    value = [defaults integerForKey:key];
+  }
+  return value;
+}
+
+static double QueryReplayDoubleOption(NSString *key, double value) {
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  if ([defaults objectForKey:key]) {
+    value = [defaults doubleForKey:key];
+  }
+  return value;
+}
+
+int main(int argc, const char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  int status = 0;
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  HGSQueryReplayDelegate *delegate 
+    = [[[HGSQueryReplayDelegate alloc] init] autorelease];
+  [[HGSPluginLoader sharedPluginLoader] setDelegate:delegate];
+
+  NSDictionary *corpus = nil;
+  NSString *corpusPath = [defaults stringForKey:@"corpus"];
+  if (corpusPath) {
+    corpus = [NSDictionary dictionaryWithContentsOfFile:corpusPath];
+    if (!corpus) {
+      fprintf(stderr, "Unable to read corpus %s\n", 
+              [corpusPath fileSystemRepresentation]);
+      status = 1;
+    }
+  } else {
+    NSUInteger sources = QueryReplayIntegerOption(@"sources", 8);
+    NSUInteger results = QueryReplayIntegerOption(@"results", 5000);
+    NSUInteger keystrokes = QueryReplayIntegerOption(@"keystrokes", 500);
+    unsigned seed = QueryReplayIntegerOption(@"seed", 1);
+    corpus = [HGSQueryReplay syntheticCorpusWithSourceCount:sources
+                                                resultCount:results
+                                             keystrokeCount:keystrokes
+                                                       seed:seed];
+  }
+  
+  NSString *writeCorpusPath = [defaults stringForKey:@"writeCorpus"];
+  if (corpus && writeCorpusPath) {
+    if (![corpus writeToFile:writeCorpusPath atomically:YES]) {
+      fprintf(stderr, "Unable to write corpus %s\n", 
+              [writeCorpusPath fileSystemRepresentation]);
+      status = 1;
+    }
+  }
+
+  HGSQueryReplay *replay = nil;
+  if (corpus && !status) {
+    replay = [[[HGSQueryReplay alloc] initWithCorpus:corpus] autorelease];
+    if (!replay) {
+      fprintf(stderr, "Corpus has no sources or keystrokes\n");
+      status = 1;
+    }
+  }
+  
+  if (replay) {
+    [replay setTimeScale:QueryReplayDoubleOption(@"timeScale", 1.0)];
+    [replay setSettleTime:QueryReplayDoubleOption(@"settle", 5.0)];
+    if ([defaults boolForKey:@"warmup"]) {
+      [replay run];
+    }
+    NSDictionary *report = [replay run];
+    printf("%s", [[HGSQueryReplay summaryOfReport:report] UTF8String]);
+    NSString *outputPath = [defaults stringForKey:@"output"];
+    if (outputPath && ![report writeToFile:outputPath atomically:YES]) {
+      fprintf(stderr, "Unable to write report %s\n", 
+              [outputPath fileSystemRepresentation]);
+      status = 1;
+    }
+  }
+  
+  [pool release];
+  return status;
+}
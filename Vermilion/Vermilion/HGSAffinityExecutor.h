@@ -0,0 +1,79 @@
+//
+//  HGSAffinityExecutor.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header
+ @discussion HGSAffinityExecutor
+*/
+
+/*!
+ A serial executor with a thread and run loop of its own. Work performed on an
+ executor always runs on the same thread, one piece at a time, so code that
+ isn't thread safe, or that needs a run loop to deliver callbacks (fetchers,
+ timers), gets the same guarantees it would get from the main thread without
+ competing with the UI for it.
+
+ Executors are looked up by identifier, usually a source identifier, and live
+ for the life of the process, so only a handful of identifiers should ever be
+ used. The thread is created the first time work is performed.
+*/
+@interface HGSAffinityExecutor : NSObject {
+ @private
+  NSString *identifier_;
+  NSThread *thread_;
+  NSCondition *startCondition_;
+}
+
+/*!
+ Returns the executor for |identifier|, creating it if needed.
+*/
++ (HGSAffinityExecutor *)executorWithIdentifier:(NSString *)identifier;
+
+- (NSString *)identifier;
+
+/*!
+ Performs |selector| on |target| with |arg| on the executor's thread. Returns
+ immediately. Work is run in the order it is performed.
+*/
+- (void)performSelector:(SEL)selector
+               onTarget:(id)target
+             withObject:(id)arg;
+
+/*!
+ Is the current thread the executor's thread.
+*/
+- (BOOL)isCurrentThread;
+
+@end
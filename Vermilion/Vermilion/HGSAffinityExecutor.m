@@ -0,0 +1,150 @@
+//
+//  HGSAffinityExecutor.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSAffinityExecutor.h"
+#import "HGSLog.h"
+
+static NSMutableDictionary *gHGSAffinityExecutors = nil;
+
+@interface HGSAffinityExecutor ()
+- (id)initWithIdentifier:(NSString *)identifier;
+- (NSThread *)thread;
+- (void)threadMain:(id)ignored;
+@end
+
+@implementation HGSAffinityExecutor
+
++ (HGSAffinityExecutor *)executorWithIdentifier:(NSString *)identifier {
+  HGSAffinityExecutor *executor = nil;
+  @synchronized (self) {
+    if (!gHGSAffinityExecutors) {
+      gHGSAffinityExecutors = [[NSMutableDictionary alloc] init];
+    }
+    executor = [gHGSAffinityExecutors objectForKey:identifier];
+    if (!executor) {
+      executor
+        = [[[HGSAffinityExecutor alloc] initWithIdentifier:identifier]
+           autorelease];
+      [gHGSAffinityExecutors setObject:executor forKey:identifier];
+    }
+  }
+  return executor;
+}
+
+- (id)initWithIdentifier:(NSString *)identifier {
+  if ((self = [super init])) {
+    identifier_ = [identifier copy];
+    startCondition_ = [[NSCondition alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // Executors are never released once they are registered, and the thread
+  // retains us, so this is only reached if init failed.
+  [identifier_ release];
+  [startCondition_ release];
+  [super dealloc];
+}
+
+- (NSString *)identifier {
+  return identifier_;
+}
+
+- (NSThread *)thread {
+  NSThread *thread = nil;
+  [startCondition_ lock];
+  if (!thread_) {
+    [NSThread detachNewThreadSelector:@selector(threadMain:)
+                             toTarget:self
+                           withObject:nil];
+    // performSelector:onThread: needs the run loop to be up before it can be
+    // used, so wait for the thread to tell us it is ready.
+    while (!thread_) {
+      [startCondition_ wait];
+    }
+  }
+  thread = thread_;
+  [startCondition_ unlock];
+  return thread;
+}
+
+- (void)threadMain:(id)ignored {
+  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
+  NSThread *thread = [NSThread currentThread];
+  [thread setName:[NSString stringWithFormat:@"HGSAffinityExecutor %@",
+                   identifier_]];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  // A run loop with no sources returns immediately, so give it a port that
+  // never fires to keep it alive between pieces of work.
+  [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+  [startCondition_ lock];
+  thread_ = [thread retain];
+  [startCondition_ broadcast];
+  [startCondition_ unlock];
+  while (YES) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    @try {
+      [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+    }
+    @catch(NSException *e) {
+      HGSLog(@"Exception %@ thrown on affinity executor: %@", e, self);
+    }
+    [pool release];
+  }
+  [outerPool release];
+}
+
+- (void)performSelector:(SEL)selector
+               onTarget:(id)target
+             withObject:(id)arg {
+  [target performSelector:selector
+                 onThread:[self thread]
+               withObject:arg
+            waitUntilDone:NO];
+}
+
+- (BOOL)isCurrentThread {
+  BOOL isCurrent = NO;
+  [startCondition_ lock];
+  isCurrent = thread_ && thread_ == [NSThread currentThread];
+  [startCondition_ unlock];
+  return isCurrent;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p> %@",
+          [self class], self, identifier_];
+}
+
+@end
@@ -0,0 +1,109 @@
+//
+//  HGSAffinityExecutorTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+
+#import "HGSAffinityExecutor.h"
+
+@interface HGSAffinityExecutorTest : GTMTestCase {
+ @private
+  NSCondition *condition_;
+  NSMutableArray *threads_;
+  NSMutableArray *order_;
+}
+@end
+
+@implementation HGSAffinityExecutorTest
+
+- (void)setUp {
+  condition_ = [[NSCondition alloc] init];
+  threads_ = [[NSMutableArray alloc] init];
+  order_ = [[NSMutableArray alloc] init];
+}
+
+- (void)tearDown {
+  [condition_ release];
+  [threads_ release];
+  [order_ release];
+}
+
+- (void)recordThread:(NSNumber *)index {
+  [condition_ lock];
+  [threads_ addObject:[NSThread currentThread]];
+  [order_ addObject:index];
+  [condition_ signal];
+  [condition_ unlock];
+}
+
+- (void)testExecutorWithIdentifier {
+  HGSAffinityExecutor *executor
+    = [HGSAffinityExecutor executorWithIdentifier:@"test.identifier"];
+  STAssertNotNil(executor, nil);
+  STAssertEqualObjects([executor identifier], @"test.identifier", nil);
+  STAssertEquals(executor,
+                 [HGSAffinityExecutor executorWithIdentifier:@"test.identifier"],
+                 nil);
+  HGSAffinityExecutor *executor2
+    = [HGSAffinityExecutor executorWithIdentifier:@"test.identifier2"];
+  STAssertNotEquals(executor, executor2, nil);
+  STAssertFalse([executor isCurrentThread], nil);
+}
+
+- (void)testSerialExecution {
+  HGSAffinityExecutor *executor
+    = [HGSAffinityExecutor executorWithIdentifier:@"test.serial"];
+  const NSUInteger kCount = 20;
+  for (NSUInteger i = 0; i < kCount; ++i) {
+    [executor performSelector:@selector(recordThread:)
+                     onTarget:self
+                   withObject:[NSNumber numberWithUnsignedInteger:i]];
+  }
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  [condition_ lock];
+  while ([order_ count] < kCount) {
+    if (![condition_ waitUntilDate:timeout]) break;
+  }
+  NSUInteger count = [order_ count];
+  [condition_ unlock];
+  STAssertEquals(count, (NSUInteger)kCount,
+                 @"Timed out waiting for the executor");
+  if (count < kCount) return;
+  NSThread *thread = [threads_ objectAtIndex:0];
+  STAssertNotEquals(thread, [NSThread mainThread], nil);
+  for (NSUInteger i = 0; i < kCount; ++i) {
+    STAssertEquals([threads_ objectAtIndex:i], thread, nil);
+    STAssertEquals([[order_ objectAtIndex:i] unsignedIntegerValue], i, nil);
+  }
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  HGSCancellationToken.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import <Foundation/Foundation.h>
+#import <sqlite3.h>
+
+/*!
+ @header
+ @discussion HGSCancellationToken
+*/
+
+/*!
+ A cheap, thread safe way of telling work that it is no longer wanted.
+
+ Checking a token is a single read of an atomic flag, so it can be done on
+ every pass through a tight loop. Code that blocks somewhere a flag can't be
+ checked (a long SQLite statement, a wait on another thread) can register to
+ be told when the token is cancelled instead.
+*/
+@interface HGSCancellationToken : NSObject {
+ @private
+  volatile int32_t cancelled_;
+  NSMutableArray *callbacks_;
+  NSMutableArray *children_;
+}
+
+/*!
+ Has the token been cancelled. Safe to call from any thread.
+*/
+- (BOOL)isCancelled;
+
+/*!
+ Cancels the token, its children and calls the registered callbacks. The
+ callbacks are called once, on the thread that cancels the token. Calling
+ cancel on a token that is already cancelled does nothing.
+*/
+- (void)cancel;
+
+/*!
+ Arranges for |selector| to be called on |target| when the token is cancelled.
+ |selector| takes the token as its only argument. |target| is not retained,
+ so it must remove itself before it goes away. If the token has already been
+ cancelled |selector| is called immediately.
+*/
+- (void)addCancellationTarget:(id)target selector:(SEL)selector;
+
+/*!
+ Removes all of |target|'s callbacks.
+*/
+- (void)removeCancellationTarget:(id)target;
+
+/*!
+ Cancelling the receiver will cancel |child|. |child| is retained until then.
+*/
+- (void)addChildToken:(HGSCancellationToken *)child;
+
+/*!
+ Installs a progress handler on |db| so that statements running against it
+ fail with SQLITE_INTERRUPT shortly after the token is cancelled. The token
+ must outlive the handler; remove it with removeProgressHandlerFromDatabase:
+ when the statements are done.
+*/
+- (void)installProgressHandlerInDatabase:(sqlite3 *)db;
+
+/*!
+ Removes the handler installed by installProgressHandlerInDatabase:.
+*/
+- (void)removeProgressHandlerFromDatabase:(sqlite3 *)db;
+
+@end
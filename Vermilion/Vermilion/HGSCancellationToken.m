@@ -0,0 +1,155 @@
+//
+//  HGSCancellationToken.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSCancellationToken.h"
+#import <libkern/OSAtomic.h>
+#import "HGSLog.h"
+
+// Number of SQLite virtual machine instructions between checks of the token.
+// A few microseconds of work on current hardware.
+static const int kHGSCancellationTokenSQLiteProgressInstructions = 1000;
+
+static int HGSCancellationTokenSQLiteProgress(void *context) {
+  HGSCancellationToken *token = (HGSCancellationToken *)context;
+  return [token isCancelled] ? 1 : 0;
+}
+
+@implementation HGSCancellationToken
+
+- (id)init {
+  if ((self = [super init])) {
+    callbacks_ = [[NSMutableArray alloc] init];
+    children_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [callbacks_ release];
+  [children_ release];
+  [super dealloc];
+}
+
+- (BOOL)isCancelled {
+  return cancelled_ != 0;
+}
+
+- (void)cancel {
+  if (!OSAtomicCompareAndSwap32Barrier(0, 1, &cancelled_)) return;
+  NSArray *callbacks = nil;
+  NSArray *children = nil;
+  @synchronized (self) {
+    callbacks = [[callbacks_ copy] autorelease];
+    children = [[children_ copy] autorelease];
+    [callbacks_ removeAllObjects];
+    [children_ removeAllObjects];
+  }
+  [children makeObjectsPerformSelector:@selector(cancel)];
+  for (NSInvocation *invocation in callbacks) {
+    @try {
+      [invocation invoke];
+    }
+    @catch (NSException *e) {
+      HGSLog(@"Exception %@ thrown in cancellation callback %@ of %@",
+             e, NSStringFromSelector([invocation selector]), self);
+    }
+  }
+}
+
+- (void)addCancellationTarget:(id)target selector:(SEL)selector {
+  NSMethodSignature *signature = [target methodSignatureForSelector:selector];
+  HGSAssert(signature, @"%@ does not respond to %@",
+            target, NSStringFromSelector(selector));
+  if (!signature) return;
+  NSInvocation *invocation
+    = [NSInvocation invocationWithMethodSignature:signature];
+  [invocation setTarget:target];
+  [invocation setSelector:selector];
+  if ([signature numberOfArguments] > 2) {
+    [invocation setArgument:&self atIndex:2];
+  }
+  BOOL callNow = NO;
+  @synchronized (self) {
+    if ([self isCancelled]) {
+      callNow = YES;
+    } else {
+      [callbacks_ addObject:invocation];
+    }
+  }
+  if (callNow) {
+    [invocation invoke];
+  }
+}
+
+- (void)removeCancellationTarget:(id)target {
+  @synchronized (self) {
+    for (NSUInteger i = [callbacks_ count]; i > 0; --i) {
+      NSInvocation *invocation = [callbacks_ objectAtIndex:i - 1];
+      if ([invocation target] == target) {
+        [callbacks_ removeObjectAtIndex:i - 1];
+      }
+    }
+  }
+}
+
+- (void)addChildToken:(HGSCancellationToken *)child {
+  BOOL cancelNow = NO;
+  @synchronized (self) {
+    if ([self isCancelled]) {
+      cancelNow = YES;
+    } else {
+      [children_ addObject:child];
+    }
+  }
+  if (cancelNow) {
+    [child cancel];
+  }
+}
+
+- (void)installProgressHandlerInDatabase:(sqlite3 *)db {
+  sqlite3_progress_handler(db,
+                           kHGSCancellationTokenSQLiteProgressInstructions,
+                           HGSCancellationTokenSQLiteProgress,
+                           self);
+}
+
+- (void)removeProgressHandlerFromDatabase:(sqlite3 *)db {
+  sqlite3_progress_handler(db, 0, NULL, NULL);
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p>%@",
+          [self class], self, [self isCancelled] ? @" cancelled" : @""];
+}
+
+@end
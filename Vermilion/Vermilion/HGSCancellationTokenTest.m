@@ -0,0 +1,128 @@
+//
+//  HGSCancellationTokenTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+
+#import "HGSCancellationToken.h"
+
+@interface HGSCancellationTokenTest : GTMTestCase {
+ @private
+  NSUInteger callbackCount_;
+  HGSCancellationToken *callbackToken_;
+}
+@end
+
+@implementation HGSCancellationTokenTest
+
+- (void)tokenCancelled:(HGSCancellationToken *)token {
+  ++callbackCount_;
+  callbackToken_ = token;
+}
+
+- (void)testCancel {
+  HGSCancellationToken *token = [[[HGSCancellationToken alloc] init] autorelease];
+  STAssertFalse([token isCancelled], nil);
+  [token addCancellationTarget:self selector:@selector(tokenCancelled:)];
+  STAssertEquals(callbackCount_, (NSUInteger)0, nil);
+  [token cancel];
+  STAssertTrue([token isCancelled], nil);
+  STAssertEquals(callbackCount_, (NSUInteger)1, nil);
+  STAssertEquals(callbackToken_, token, nil);
+
+  // Callbacks only happen once.
+  [token cancel];
+  STAssertEquals(callbackCount_, (NSUInteger)1, nil);
+
+  // Registering after the fact calls straight away.
+  [token addCancellationTarget:self selector:@selector(tokenCancelled:)];
+  STAssertEquals(callbackCount_, (NSUInteger)2, nil);
+}
+
+- (void)testRemoveTarget {
+  HGSCancellationToken *token = [[[HGSCancellationToken alloc] init] autorelease];
+  [token addCancellationTarget:self selector:@selector(tokenCancelled:)];
+  [token removeCancellationTarget:self];
+  [token cancel];
+  STAssertEquals(callbackCount_, (NSUInteger)0, nil);
+}
+
+- (void)testChildren {
+  HGSCancellationToken *parent
+    = [[[HGSCancellationToken alloc] init] autorelease];
+  HGSCancellationToken *child = [[[HGSCancellationToken alloc] init] autorelease];
+  HGSCancellationToken *grandChild
+    = [[[HGSCancellationToken alloc] init] autorelease];
+  [parent addChildToken:child];
+  [child addChildToken:grandChild];
+  [child cancel];
+  STAssertFalse([parent isCancelled], nil);
+  STAssertTrue([grandChild isCancelled], nil);
+
+  HGSCancellationToken *child2
+    = [[[HGSCancellationToken alloc] init] autorelease];
+  [parent addChildToken:child2];
+  [parent cancel];
+  STAssertTrue([child2 isCancelled], nil);
+
+  // Adding to a cancelled parent cancels straight away.
+  HGSCancellationToken *child3
+    = [[[HGSCancellationToken alloc] init] autorelease];
+  [parent addChildToken:child3];
+  STAssertTrue([child3 isCancelled], nil);
+}
+
+- (void)testProgressHandler {
+  sqlite3 *db = NULL;
+  STAssertEquals(sqlite3_open(":memory:", &db), SQLITE_OK, nil);
+  HGSCancellationToken *token = [[[HGSCancellationToken alloc] init] autorelease];
+  [token installProgressHandlerInDatabase:db];
+  STAssertEquals(sqlite3_exec(db, "CREATE TABLE t (x);", NULL, NULL, NULL),
+                 SQLITE_OK, nil);
+  for (int i = 0; i < 10; ++i) {
+    sqlite3_exec(db, "INSERT INTO t VALUES (1);", NULL, NULL, NULL);
+  }
+  // A statement that would run for a very long time if not interrupted.
+  const char *sql
+    = "SELECT count(*) FROM t a, t b, t c, t d, t e, t f, t g, t h;";
+  sqlite3_stmt *statement = NULL;
+  int err = sqlite3_prepare_v2(db, sql, -1, &statement, NULL);
+  if (err == SQLITE_OK) {
+    [token cancel];
+    STAssertEquals(sqlite3_step(statement), SQLITE_INTERRUPT, nil);
+    sqlite3_finalize(statement);
+  }
+  [token removeProgressHandlerFromDatabase:db];
+  sqlite3_close(db);
+}
+
+@end
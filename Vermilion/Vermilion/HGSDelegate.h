@@ -68,10 +68,11 @@
 - (id)provideValueForKey:(NSString *)key result:(HGSResult *)result;
 
 /*!
-  Return a set of identifiers for highspeed sources that we want to run on the
-  mainthread for queries.
+  Return a set of identifiers for sources that want all of their searches run
+  on the same thread. Each of them gets a serial executor with its own thread
+  and run loop instead of going through the shared operation queue.
 */
-- (NSArray *)sourcesToRunOnMainThread;
+- (NSArray *)sourcesRequiringThreadAffinity;
 
 /*!
  Provide client-specific action save-as information to HGS.
@@ -210,7 +210,8 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
     = [[HGSInvocationOperation alloc] initWithTarget:self
                                             selector:@selector(asyncFetch:operation:)
                                               object:service_];
-  [[HGSOperationQueue sharedOperationQueue] addOperation:indexOp_];
+  [[HGSOperationQueue sharedOperationQueue] addOperation:indexOp_
+                                                    lane:eHGSOperationLaneIndexing];
 
   [self setUpPeriodicRefresh];
 }
@@ -37,7 +37,15 @@
  @discussion HGSIconProvider
  */
 
-@class HGSLRUCache;
+/*!
+ Default key holding a path to record icon cache accesses to, for replaying
+ with the CacheSimulator tool. Each line is "get <cache> <key>" for a
+ lookup or "set <cache> <size> <key>" for an insert, where cache is
+ "advanced" or "basic". Read at startup; unset by default.
+*/
+#define kHGSIconCacheTracePathKey @"HGSIconCacheTracePath"
+
+@class HGSShardedLRUCache;
 @class HGSResult;
 
 @interface HGSIconProvider : NSObject {
@@ -59,10 +67,11 @@
 @interface HGSIconCache : NSObject {
  @private
   NSOperationQueue *iconOperationQueue_;
-  HGSLRUCache *advancedCache_;
-  HGSLRUCache *basicCache_;
+  HGSShardedLRUCache *advancedCache_;
+  HGSShardedLRUCache *basicCache_;
   NSImage *placeHolderIcon_;
   NSImage *compoundPlaceHolderIcon_;
+  FILE *traceFile_;
 }
 
 /*!
@@ -32,7 +32,7 @@
 
 #import <QuickLook/QuickLook.h>
 #import "HGSIconProvider.h"
-#import "HGSLRUCache.h"
+#import "HGSShardedLRUCache.h"
 #import "HGSResult.h"
 #import "HGSSearchSource.h"
 #import "HGSOperation.h"
@@ -42,6 +42,8 @@
 #import "GTMNSBezierPath+CGPath.h"
 #import <GData/GTMHTTPFetcher.h>
 #import "HGSLog.h"
+#import "HGSDTrace.h"
+#import "HGSPerformanceCounters.h"
 #import "GTMDebugThreadValidation.h"
 #import "GTMGarbageCollection.h"
 #import "GTMSystemVersion.h"
@@ -52,6 +54,9 @@ static Boolean LRUEqual(const void *value1, const void *value2);
 static CFHashCode LRUHash(const void *value);
 
 const size_t kIconCacheSize = 5 * 1024 * 1024; // bytes
+// Icons are ~40k each, so more shards would leave each 2Q probation queue
+// room for only a handful of icons.
+static const NSUInteger kIconCacheShardCount = 4;
 static HGSLRUCacheCallBacks kLRUCacheCallbacks = {
   0,           // version
   LRURetain,   // keyRetain
@@ -168,10 +173,11 @@ static NSImage *FileSystemImageForURL(NSURL *url) {
 @interface HGSIconCache ()
 // Remove an operation from our list of pending icon fetch operations.
 - (void)setValueOnMainThread:(NSDictionary *)args;
-- (NSImage *)cachedIconForKey:(NSString *)key fromCache:(HGSLRUCache *)cache;
+- (NSImage *)cachedIconForKey:(NSString *)key
+                     fromCache:(HGSShardedLRUCache *)cache;
 - (void)cacheIcon:(NSImage *)icon
            forKey:(NSString *)key
-            cache:(HGSLRUCache *)cache;
+            cache:(HGSShardedLRUCache *)cache;
 - (void)cacheBasicIcon:(NSImage *)icon forResult:(HGSResult *)result;
 - (NSOperationQueue *)iconOperationQueue;
 @end
@@ -201,12 +207,26 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
     if ([GTMSystemVersion isSnowLeopardOrGreater]) {
       [iconOperationQueue_ setName:@"com.google.qsb.hgsiconcache"];
     }
-    advancedCache_ = [[HGSLRUCache alloc] initWithCacheSize:kIconCacheSize
-                                                  callBacks:&kLRUCacheCallbacks
-                                               evictContext:self];
-    basicCache_ = [[HGSLRUCache alloc] initWithCacheSize:kIconCacheSize
-                                               callBacks:&kLRUCacheCallbacks
-                                            evictContext:self];
+    advancedCache_ 
+      = [[HGSShardedLRUCache alloc] initWithCacheSize:kIconCacheSize
+                                           shardCount:kIconCacheShardCount
+                                               policy:eHGSLRUCachePolicy2Q
+                                            callBacks:&kLRUCacheCallbacks
+                                         evictContext:self];
+    basicCache_ 
+      = [[HGSShardedLRUCache alloc] initWithCacheSize:kIconCacheSize
+                                           shardCount:kIconCacheShardCount
+                                               policy:eHGSLRUCachePolicy2Q
+                                            callBacks:&kLRUCacheCallbacks
+                                         evictContext:self];
+    NSString *tracePath = [[NSUserDefaults standardUserDefaults]
+                           stringForKey:kHGSIconCacheTracePathKey];
+    if ([tracePath length]) {
+      traceFile_ = fopen([tracePath fileSystemRepresentation], "a");
+      if (!traceFile_) {
+        HGSLog(@"Unable to open icon cache trace %@", tracePath);
+      }
+    }
     placeHolderIcon_ = [[NSImage imageNamed:@"blue-placeholder"] retain];
     compoundPlaceHolderIcon_
       = [[NSImage imageNamed:NSImageNameMultipleDocuments] retain];
@@ -222,6 +242,7 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
   [advancedCache_ release];
   [basicCache_ release];
   [placeHolderIcon_ release];
+  if (traceFile_) fclose(traceFile_);
 
   [super dealloc];
 }
@@ -253,12 +274,26 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
                                   skipPlaceholder:skipPlaceholder] autorelease];
 }
 
-- (NSImage *)cachedIconForKey:(NSString *)key fromCache:(HGSLRUCache *)cache {
-  NSImage *icon = nil;
-  @synchronized(cache) {
-    icon = (NSImage *)[cache valueForKey:key];
+- (NSImage *)cachedIconForKey:(NSString *)key
+                     fromCache:(HGSShardedLRUCache *)cache {
+  NSImage *icon = (NSImage *)[cache copyValueForKey:key];
+  if (traceFile_) {
+    // stdio locks the file for each call, so lines don't interleave.
+    fprintf(traceFile_, "get %s %s\n", 
+            cache == basicCache_ ? "basic" : "advanced", [key UTF8String]);
+  }
+  if (icon) {
+    if (VERMILION_ICON_CACHE_HIT_ENABLED()) {
+      VERMILION_ICON_CACHE_HIT((char *)[key UTF8String]);
+    }
+    HGSPerformanceCounterAdd(eHGSIconCacheHitCounter, 1);
+  } else {
+    if (VERMILION_ICON_CACHE_MISS_ENABLED()) {
+      VERMILION_ICON_CACHE_MISS((char *)[key UTF8String]);
+    }
+    HGSPerformanceCounterAdd(eHGSIconCacheMissCounter, 1);
   }
-  return [[icon retain] autorelease];
+  return [icon autorelease];
 }
 
 - (NSImage *)cachedIconForKey:(NSString *)key {
@@ -267,7 +302,7 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
 
 - (void)cacheIcon:(NSImage *)icon
            forKey:(NSString *)key
-            cache:(HGSLRUCache *)cache {
+            cache:(HGSShardedLRUCache *)cache {
   if (icon) {
     // Create up cached values in the sizes we care about
     NSImage *newIcon
@@ -305,8 +340,11 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
                              * [imageRep bitsPerSample] * 4 / 8);
       totalSize += repImageSize;
     }
-    @synchronized(cache) {
-      [cache setValue:newIcon forKey:key size:totalSize];
+    [cache setValue:newIcon forKey:key size:totalSize];
+    if (traceFile_) {
+      fprintf(traceFile_, "set %s %lu %s\n", 
+              cache == basicCache_ ? "basic" : "advanced", 
+              (unsigned long)totalSize, [key UTF8String]);
     }
   }
 }
@@ -3,8 +3,6 @@
 //
 //  LRU caching container with CF-container-like callback semantics.
 //
-//  TODO(aharper): Consider implementing LRU-SP (Kai Cheng, Yahiko Kambayashi).
-//
 //  Copyright (c) 2008 Google Inc. All rights reserved.
 //
 //  Redistribution and use in source and binary forms, with or without
@@ -64,6 +62,30 @@ typedef struct {
 } HGSLRUCacheCallBacks;
 
 
+//////////////////////////////////////////////////////////////////////////
+#pragma mark Eviction Policies
+//////////////////////////////////////////////////////////////////////////
+
+// How a cache picks what to evict. Both policies share the same size
+// accounting and eviction callbacks.
+//
+// eHGSLRUCachePolicyLRU: Plain least recently used.
+//
+// eHGSLRUCachePolicy2Q: 2Q (Theodore Johnson, Dennis Shasha). New values go
+//   on a probationary FIFO that holds a quarter of the cache, and a hit
+//   there does not promote them. Keys evicted from probation are remembered
+//   without their values, and only a value whose key is set again while
+//   remembered goes on the main LRU list. A single pass over many keys, such
+//   as scrolling through a long result list, then only churns the probation
+//   queue and leaves frequently used values alone.
+//
+enum {
+  eHGSLRUCachePolicyLRU = 0,
+  eHGSLRUCachePolicy2Q,
+};
+typedef NSUInteger HGSLRUCachePolicy;
+
+
 //////////////////////////////////////////////////////////////////////////
 #pragma mark Basic Cache Interface
 //////////////////////////////////////////////////////////////////////////
@@ -71,21 +93,37 @@ typedef struct {
 // LRU cache implementation where the caller supplies the needed callbacks.
 // Similar semantics to a CF container.
 //
+// Entries are kept in an open addressing table inside the cache and carved
+// out of slabs that are recycled through a free list, so once the cache has
+// grown to its working size, setting, getting and evicting values does not
+// allocate.
+//
 // NOTE: Cache deallocation does _not_ trigger eviction callbacks.
 //
 @interface HGSLRUCache : NSObject {
  @protected
   size_t                        cacheSize_;
+  HGSLRUCachePolicy             policy_;
   HGSLRUCacheCallBacks          *callBacks_;
-  CFDictionaryKeyCallBacks      dictKeyCallBacks_;
-  CFMutableDictionaryRef        cache_;  // strong
+  void                          *slots_;  // strong
+  size_t                        slotCount_;
+  size_t                        entryCount_;  // resident and ghost
+  CFIndex                       residentCount_;
+  CFIndex                       ghostCount_;
+  void                          *freeEntries_;  // weak, lives in slabs_
+  void                          *slabs_;  // strong
   void                          *lruHead_,
                                 *lruTail_;  // weak
+  void                          *probationHead_,
+                                *probationTail_;  // weak
+  void                          *ghostHead_,
+                                *ghostTail_;  // weak
   size_t                        currentSize_;
+  size_t                        probationSize_;
   void                          *evictContext_;  // weak
 }
 
-// Designated initializer
+// Create an LRU policy cache.
 //
 // Args:
 //   size: Number of bytes to hold in the cache. Note that this limit
@@ -101,6 +139,19 @@ typedef struct {
               callBacks:(HGSLRUCacheCallBacks *)callBacks
            evictContext:(void *)evictContext;
 
+// Designated initializer
+//
+// Args:
+//   size: See initWithCacheSize:callBacks:evictContext:.
+//   policy: The eviction policy.
+//   callBacks: A properly filled in HGSLRUCacheCallBacks structure.
+//   evictContext: Context pointer passed to the eviction callback.
+//
+- (id)initWithCacheSize:(size_t)size
+                 policy:(HGSLRUCachePolicy)policy
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext;
+
 // Obtain a value from the cache (if the cache contains that value). If the
 // cache does not contain the value its up to the caller to obtain the value
 // and populate the cache using the setCacheValue:... methods.
@@ -154,10 +205,16 @@ typedef struct {
 //
 - (CFIndex)count;
 
+// Returns the eviction policy.
+//
+- (HGSLRUCachePolicy)policy;
+
 // Populate caller supplied arrays with pointers to all cache keys and values.
 //
 // Note: Arrays are filled in eviction order from least-likely to evict to
-//       most-likely to evict.
+//       most-likely to evict. For 2Q the main list comes before the
+//       probation queue, which is an approximation since probation is
+//       evicted first only while it is over its share.
 //
 // Args:
 //   keys: Caller-supplied pointer array, or NULL if no keys are desired.
@@ -32,57 +32,115 @@
 
 #import "HGSLRUCache.h"
 #import "HGSLog.h"
+#import "HGSDTrace.h"
+#import "HGSPerformanceCounters.h"
 
 // Although the cache looks like a dictionary to the caller, internally
-// it is actually one (or more for future implementations like LRU-SP)
-// linked lists where list members are also placed in a dictionary for
-// keyed access. These structures and routines support the linked list and
-// dictionary usage.
+// it is actually one (or more for policies like 2Q) linked lists where list
+// members are also placed in a hash table for keyed access. These structures
+// and routines support the linked list and table usage.
+//
+// The table is open addressing with linear probing, and removal shifts
+// later members of a probe run back instead of leaving tombstones, so a
+// table that has stopped growing never needs rebuilding. Entries come from
+// slabs and go back on a free list when removed.
+
+// Which list an entry is on.
+typedef enum {
+  kHGSLRUCacheMainQueue = 0,
+  kHGSLRUCacheProbationQueue,  // 2Q A1in
+  kHGSLRUCacheGhostQueue,  // 2Q A1out, keys only
+} HGSLRUCacheQueue;
+
+// 2Q sizing. The probation queue is allowed a quarter of the cache bytes, and
+// ghost keys are kept for about as many keys as the cache holds.
+static const size_t kHGSLRUCacheProbationDivisor = 4;
+static const CFIndex kHGSLRUCacheMinimumGhostCount = 16;
+
+// Table and slab sizing. The table is kept at most half full.
+static const size_t kHGSLRUCacheInitialSlotCount = 16;
+static const size_t kHGSLRUCacheSlabEntryCount = 64;
 
 typedef struct HGSLRUCacheEntryStruct {
-  int                             retainCount;
-  HGSLRUCacheCallBacks            *callbacks;
   size_t                          size;
+  CFHashCode                      hash;
+  HGSLRUCacheQueue                queue;
   const void                      *key;
   const void                      *value;
   struct HGSLRUCacheEntryStruct   *previous;
-  struct HGSLRUCacheEntryStruct   *next;
+  struct HGSLRUCacheEntryStruct   *next;  // Also links the free list
 } HGSLRUCacheEntry;
 
-static const void * HGSLRUCacheEntryRetain(CFAllocatorRef allocator,
-                                            const void *value) {
-
-  // Don't null check value, we'd rather crash
-  ((HGSLRUCacheEntry *)value)->retainCount++;
-  return value;
+typedef struct HGSLRUCacheSlabStruct {
+  struct HGSLRUCacheSlabStruct    *next;
+  HGSLRUCacheEntry                entries[kHGSLRUCacheSlabEntryCount];
+} HGSLRUCacheSlab;
 
-} // HGSLRUCacheEntryRetain
+static void HGSLRUCacheListRemove(void **head, void **tail,
+                                  HGSLRUCacheEntry *entry) {
 
-static void HGSLRUCacheEntryRelease(CFAllocatorRef allocator,
-                                    const void *value) {
+  // Remove from head
+  if (*head == entry) {
+    assert(!entry->previous);
+    *head = entry->next;
+  }
 
-  HGSLRUCacheEntry *cacheEntry = (HGSLRUCacheEntry *)value;
-  // Don't null check value, we'd rather crash
-  cacheEntry->retainCount--;
-  if (cacheEntry->retainCount < 1) {
-    // Free key and value (both are always present in LRU)
-    cacheEntry->callbacks->keyRelease(allocator, cacheEntry->key);
-    cacheEntry->callbacks->valueRelease(allocator, cacheEntry->value);
-    // Don't clean up link list here, if we have a bug that leaves them
-    // wrong we want a bad access later
-    CFAllocatorDeallocate(allocator, cacheEntry);
+  // Remove from tail
+  if (*tail == entry) {
+    assert(!entry->next);
+    *tail = entry->previous;
   }
 
-} // HGSLRuCacheEntryRelease
+  // Remove from list middle
+  if (entry->previous) entry->previous->next = entry->next;
+  if (entry->next) entry->next->previous = entry->previous;
+  entry->previous = NULL;
+  entry->next = NULL;
 
-static CFDictionaryValueCallBacks gHGSLRUCacheEntryDictionaryValueCallBacks = {
-  0,
-  &HGSLRUCacheEntryRetain,
-  &HGSLRUCacheEntryRelease,
-  NULL,
-  NULL
-}; // gHGSLRUCacheEntryDictionaryValueCallBacks
+} // HGSLRUCacheListRemove
 
+static void HGSLRUCacheListPushHead(void **head, void **tail,
+                                    HGSLRUCacheEntry *entry) {
+
+  entry->previous = NULL;
+  entry->next = *head;
+  if (*head) ((HGSLRUCacheEntry *)*head)->previous = entry;
+  *head = entry;
+
+  // Fix tail if this is the first insert
+  if (!*tail) *tail = entry;
+
+} // HGSLRUCacheListPushHead
+
+// Returns the slot holding |key|, or the empty slot that ends its probe run.
+static size_t HGSLRUCacheFindSlot(HGSLRUCacheEntry **slots, size_t slotCount,
+                                  HGSLRUCacheCallBacks *callBacks,
+                                  const void *key, CFHashCode hash) {
+
+  size_t mask = slotCount - 1;
+  size_t slot = hash & mask;
+  while (slots[slot]) {
+    HGSLRUCacheEntry *entry = slots[slot];
+    if (entry->hash == hash 
+        && (entry->key == key || callBacks->keyEqual(entry->key, key))) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+
+} // HGSLRUCacheFindSlot
+
+@interface HGSLRUCache ()
+- (HGSLRUCacheEntry *)entryForKey:(const void *)key hash:(CFHashCode)hash;
+- (BOOL)insertEntry:(HGSLRUCacheEntry *)cacheEntry;
+- (void)removeSlotForEntry:(HGSLRUCacheEntry *)cacheEntry;
+- (HGSLRUCacheEntry *)allocateEntry;
+- (void)unlinkEntry:(HGSLRUCacheEntry *)cacheEntry;
+- (void)removeEntry:(HGSLRUCacheEntry *)cacheEntry;
+- (HGSLRUCacheEntry *)evictionCandidate;
+- (void)makeGhostOfEntry:(HGSLRUCacheEntry *)cacheEntry;
+@end
 
 @implementation HGSLRUCache
 
@@ -90,79 +148,277 @@ static CFDictionaryValueCallBacks gHGSLRUCacheEntryDictionaryValueCallBacks = {
               callBacks:(HGSLRUCacheCallBacks *)callBacks
            evictContext:(void *)evictContext {
 
+  return [self initWithCacheSize:size
+                          policy:eHGSLRUCachePolicyLRU
+                       callBacks:callBacks
+                    evictContext:evictContext];
+
+} // initWithCacheSize:callBacks:evictContext:
+
+- (id)initWithCacheSize:(size_t)size
+                 policy:(HGSLRUCachePolicy)policy
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext {
+
   self = [super init];
   if (!self) return nil;
 
   // Sanity
-  if (!callBacks || (callBacks->version != 0) || !size) {
+  if (!callBacks || (callBacks->version != 0) || !size
+      || policy > eHGSLRUCachePolicy2Q) {
     [self release];
     return nil;
   }
 
   // Copy setup
   cacheSize_ = size;
+  policy_ = policy;
   callBacks_ = callBacks;
   evictContext_ = evictContext;
 
-  // Set up the dictionary key callbacks. Since the cache keys are
-  // direct-access only we have no intermediate structure.
-  dictKeyCallBacks_.version = 0;
-  dictKeyCallBacks_.retain = callBacks_->keyRetain;
-  dictKeyCallBacks_.release = callBacks_->keyRelease;
-  dictKeyCallBacks_.copyDescription = NULL;
-  dictKeyCallBacks_.equal = callBacks_->keyEqual;
-  dictKeyCallBacks_.hash = callBacks_->keyHash;
-
-  // Create the cache dictionary and set
-  cache_ = CFDictionaryCreateMutable(kCFAllocatorDefault,
-                                     0,
-                                     &dictKeyCallBacks_,
-                                     &gHGSLRUCacheEntryDictionaryValueCallBacks);
-  if (!cache_) {
+  // Create the table
+  slotCount_ = kHGSLRUCacheInitialSlotCount;
+  slots_ = CFAllocatorAllocate(kCFAllocatorDefault,
+                               slotCount_ * sizeof(HGSLRUCacheEntry *), 0);
+  if (!slots_) {
     // COV_NF_START
     [self release];
     return nil;
     // COV_NF_END
   }
+  bzero(slots_, slotCount_ * sizeof(HGSLRUCacheEntry *));
 
   return self;
 
-} // initWithCacheSize:callBacks:
+} // initWithCacheSize:policy:callBacks:evictContext:
 
 - (void)dealloc {
 
-  if (cache_) CFRelease(cache_);
+  if (slots_) {
+    HGSLRUCacheEntry **slots = slots_;
+    for (size_t i = 0; i < slotCount_; ++i) {
+      HGSLRUCacheEntry *entry = slots[i];
+      if (!entry) continue;
+      callBacks_->keyRelease(kCFAllocatorDefault, entry->key);
+      if (entry->value) {
+        callBacks_->valueRelease(kCFAllocatorDefault, entry->value);
+      }
+    }
+    CFAllocatorDeallocate(kCFAllocatorDefault, slots_);
+  }
+  HGSLRUCacheSlab *slab = slabs_;
+  while (slab) {
+    HGSLRUCacheSlab *next = slab->next;
+    CFAllocatorDeallocate(kCFAllocatorDefault, slab);
+    slab = next;
+  }
   [super dealloc];
 
 } // dealloc
 
+- (HGSLRUCacheEntry *)entryForKey:(const void *)key hash:(CFHashCode)hash {
+
+  HGSLRUCacheEntry **slots = slots_;
+  return slots[HGSLRUCacheFindSlot(slots, slotCount_, callBacks_, key, hash)];
+
+} // entryForKey:hash:
+
+- (BOOL)insertEntry:(HGSLRUCacheEntry *)cacheEntry {
+
+  // Grow before the table gets over half full. Growth is the only time the
+  // table allocates.
+  if ((entryCount_ + 1) * 2 > slotCount_) {
+    size_t newSlotCount = slotCount_ * 2;
+    HGSLRUCacheEntry **newSlots 
+      = CFAllocatorAllocate(kCFAllocatorDefault,
+                            newSlotCount * sizeof(HGSLRUCacheEntry *), 0);
+    if (!newSlots) return NO;  // COV_NF_LINE
+    bzero(newSlots, newSlotCount * sizeof(HGSLRUCacheEntry *));
+    HGSLRUCacheEntry **oldSlots = slots_;
+    size_t mask = newSlotCount - 1;
+    for (size_t i = 0; i < slotCount_; ++i) {
+      HGSLRUCacheEntry *entry = oldSlots[i];
+      if (!entry) continue;
+      size_t slot = entry->hash & mask;
+      while (newSlots[slot]) slot = (slot + 1) & mask;
+      newSlots[slot] = entry;
+    }
+    CFAllocatorDeallocate(kCFAllocatorDefault, oldSlots);
+    slots_ = newSlots;
+    slotCount_ = newSlotCount;
+  }
+
+  HGSLRUCacheEntry **slots = slots_;
+  size_t slot = HGSLRUCacheFindSlot(slots, slotCount_, callBacks_, 
+                                    cacheEntry->key, cacheEntry->hash);
+  assert(!slots[slot]);
+  slots[slot] = cacheEntry;
+  entryCount_++;
+  return YES;
+
+} // insertEntry:
+
+- (void)removeSlotForEntry:(HGSLRUCacheEntry *)cacheEntry {
+
+  HGSLRUCacheEntry **slots = slots_;
+  size_t mask = slotCount_ - 1;
+  size_t hole = cacheEntry->hash & mask;
+  while (slots[hole] != cacheEntry) {
+    assert(slots[hole]);
+    hole = (hole + 1) & mask;
+  }
+  slots[hole] = NULL;
+  entryCount_--;
+
+  // Shift back later members of the probe run that can no longer be
+  // reached past the hole.
+  size_t slot = hole;
+  for (;;) {
+    slot = (slot + 1) & mask;
+    HGSLRUCacheEntry *entry = slots[slot];
+    if (!entry) break;
+    size_t home = entry->hash & mask;
+    // The entry stays put if its home is cyclically in (hole, slot]
+    BOOL reachable = (hole <= slot) 
+      ? (hole < home && home <= slot) 
+      : (hole < home || home <= slot);
+    if (!reachable) {
+      slots[hole] = entry;
+      slots[slot] = NULL;
+      hole = slot;
+    }
+  }
+
+} // removeSlotForEntry:
+
+- (HGSLRUCacheEntry *)allocateEntry {
+
+  if (!freeEntries_) {
+    HGSLRUCacheSlab *slab = CFAllocatorAllocate(kCFAllocatorDefault, 
+                                                sizeof(HGSLRUCacheSlab), 0);
+    if (!slab) return NULL;  // COV_NF_LINE
+    slab->next = slabs_;
+    slabs_ = slab;
+    for (size_t i = 0; i < kHGSLRUCacheSlabEntryCount; ++i) {
+      slab->entries[i].next = freeEntries_;
+      freeEntries_ = &slab->entries[i];
+    }
+  }
+  HGSLRUCacheEntry *entry = freeEntries_;
+  freeEntries_ = entry->next;
+  return entry;
+
+} // allocateEntry
+
+- (void)unlinkEntry:(HGSLRUCacheEntry *)cacheEntry {
+
+  switch (cacheEntry->queue) {
+    case kHGSLRUCacheMainQueue:
+      HGSLRUCacheListRemove(&lruHead_, &lruTail_, cacheEntry);
+      break;
+    case kHGSLRUCacheProbationQueue:
+      HGSLRUCacheListRemove(&probationHead_, &probationTail_, cacheEntry);
+      assert(probationSize_ >= cacheEntry->size);
+      probationSize_ -= cacheEntry->size;
+      break;
+    case kHGSLRUCacheGhostQueue:
+      HGSLRUCacheListRemove(&ghostHead_, &ghostTail_, cacheEntry);
+      break;
+  }
+
+} // unlinkEntry:
+
+- (void)removeEntry:(HGSLRUCacheEntry *)cacheEntry {
+
+  [self unlinkEntry:cacheEntry];
+  [self removeSlotForEntry:cacheEntry];
+
+  // Fix size and counts
+  if (cacheEntry->queue == kHGSLRUCacheGhostQueue) {
+    ghostCount_--;
+  } else {
+    assert(currentSize_ >= cacheEntry->size);
+    currentSize_ -= cacheEntry->size;
+    residentCount_--;
+  }
+
+  // Free key and value (ghost entries have no value), then recycle the
+  // entry. |cacheEntry| is invalid from here on.
+  callBacks_->keyRelease(kCFAllocatorDefault, cacheEntry->key);
+  if (cacheEntry->value) {
+    callBacks_->valueRelease(kCFAllocatorDefault, cacheEntry->value);
+  }
+  cacheEntry->key = NULL;
+  cacheEntry->value = NULL;
+  cacheEntry->next = freeEntries_;
+  freeEntries_ = cacheEntry;
+
+} // removeEntry:
+
+- (HGSLRUCacheEntry *)evictionCandidate {
+
+  // Probation is evicted first while it is over its share, or when there
+  // is nothing else to evict.
+  if (probationTail_ 
+      && (probationSize_ > cacheSize_ / kHGSLRUCacheProbationDivisor 
+          || !lruTail_)) {
+    return probationTail_;
+  }
+  return lruTail_;
+
+} // evictionCandidate
+
+- (void)makeGhostOfEntry:(HGSLRUCacheEntry *)cacheEntry {
+
+  // The entry keeps its key and its slot in the table, and only drops its
+  // value.
+  [self unlinkEntry:cacheEntry];
+  assert(currentSize_ >= cacheEntry->size);
+  currentSize_ -= cacheEntry->size;
+  residentCount_--;
+  callBacks_->valueRelease(kCFAllocatorDefault, cacheEntry->value);
+  cacheEntry->value = NULL;
+  cacheEntry->size = 0;
+  cacheEntry->queue = kHGSLRUCacheGhostQueue;
+  HGSLRUCacheListPushHead(&ghostHead_, &ghostTail_, cacheEntry);
+  ghostCount_++;
+
+  // Forget the oldest ghosts
+  CFIndex limit = MAX(residentCount_ + 1, kHGSLRUCacheMinimumGhostCount);
+  while (ghostCount_ > limit) {
+    [self removeEntry:ghostTail_];
+  }
+
+} // makeGhostOfEntry:
+
 - (const void *)valueForKey:(const void *)key {
 
   // Look for the value in the cache
-  HGSLRUCacheEntry *cacheEntry = (HGSLRUCacheEntry *)CFDictionaryGetValue(cache_, key);
-  if (!cacheEntry) return NULL;  // no cache hit
+  HGSLRUCacheEntry *cacheEntry 
+    = [self entryForKey:key hash:callBacks_->keyHash(key)];
+  if (!cacheEntry || cacheEntry->queue == kHGSLRUCacheGhostQueue) {
+    // no cache hit
+    if (VERMILION_LRU_CACHE_MISS_ENABLED()) {
+      VERMILION_LRU_CACHE_MISS(self);
+    }
+    HGSPerformanceCounterAdd(eHGSLRUCacheMissCounter, 1);
+    return NULL;
+  }
+  if (VERMILION_LRU_CACHE_HIT_ENABLED()) {
+    VERMILION_LRU_CACHE_HIT(self);
+  }
+  HGSPerformanceCounterAdd(eHGSLRUCacheHitCounter, 1);
+
+  // Hits on probation don't promote, a second set while the key is a
+  // ghost does
+  if (cacheEntry->queue != kHGSLRUCacheMainQueue) return cacheEntry->value;
 
   // If its already at the head assume everything is already OK
   if (lruHead_ == cacheEntry) return cacheEntry->value;
 
-  // Remove from list middle, previous must exist (else we would have
-  // been at head above)
-  assert(cacheEntry->previous);
-  cacheEntry->previous->next = cacheEntry->next;
-  if (cacheEntry->next) cacheEntry->next->previous = cacheEntry->previous;
-
-  // Remove from tail if its there (single element case where head == tail not
-  // possible because head check above would have short-circuited above)
-  assert(lruTail_);
-  assert(lruTail_ != lruHead_);
-  if (lruTail_ == cacheEntry) lruTail_ = cacheEntry->previous;
-
-  // Move hit to head, head must already exist so it can become our next
-  assert(lruHead_);
-  cacheEntry->previous = NULL;
-  cacheEntry->next = lruHead_;
-  cacheEntry->next->previous = cacheEntry;
-  lruHead_ = cacheEntry;
+  // Move hit to head
+  HGSLRUCacheListRemove(&lruHead_, &lruTail_, cacheEntry);
+  HGSLRUCacheListPushHead(&lruHead_, &lruTail_, cacheEntry);
 
   return cacheEntry->value;
 
@@ -170,90 +426,92 @@ static CFDictionaryValueCallBacks gHGSLRUCacheEntryDictionaryValueCallBacks = {
 
 - (void)removeValueForKey:(const void *)key {
 
+  // Ghosts are removed too, erasing all knowledge of the key
   HGSLRUCacheEntry *cacheEntry 
-    = (HGSLRUCacheEntry *)CFDictionaryGetValue(cache_, key);
+    = [self entryForKey:key hash:callBacks_->keyHash(key)];
   if (!cacheEntry) return;  // No bookkeeping
 
-  // Remove from head
-  if (lruHead_ == cacheEntry) {
-    assert(!cacheEntry->previous);
-    lruHead_ = cacheEntry->next;
-  }
-
-  // Remove from tail
-  if (lruTail_ == cacheEntry) {
-    assert(!cacheEntry->next);
-    lruTail_ = cacheEntry->previous;
-  }
-
-  // Remove from list middle
-  if (cacheEntry->previous) cacheEntry->previous->next = cacheEntry->next;
-  if (cacheEntry->next) cacheEntry->next->previous = cacheEntry->previous;
-
-  // Fix size
-  assert(currentSize_ >= cacheEntry->size);
-  currentSize_ -= cacheEntry->size;
-
-  // Remove from dictionary (this releases the entry, |cacheEntry| invalid
-  // from here on)
-  CFDictionaryRemoveValue(cache_, key);
+  [self removeEntry:cacheEntry];
 
 } // removeValueForKey:
 
 - (BOOL)setValue:(const void *)value forKey:(const void *)key size:(size_t)size {
 
+  CFHashCode hash = callBacks_->keyHash(key);
+  HGSLRUCacheEntry *oldEntry = [self entryForKey:key hash:hash];
+
+  // A key that was recently evicted from probation has now been asked for
+  // twice, so it goes straight on the main list. A key that is already on
+  // the main list stays there, at the head, rather than being demoted to
+  // probation where a scan could push it out.
+  BOOL wasGhost = oldEntry && oldEntry->queue == kHGSLRUCacheGhostQueue;
+  BOOL wasMain = oldEntry && oldEntry->queue == kHGSLRUCacheMainQueue;
+
   // Remove any prior value for this key. Doing this before even checking
   // whether the new object fits in cache is correct. We should interpret
   // the new value for the key as an indication that our old value for that
   // key is bad, so remove the old cache value before signaling failure.
-  [self removeValueForKey:key];
+  if (oldEntry) [self removeEntry:oldEntry];
 
   // Too big to fit at all?
   if (size > cacheSize_) return NO;
 
   // Remove from tail till there is space
   while (currentSize_ > (cacheSize_ - size)) {
-    assert(lruTail_);
+    HGSLRUCacheEntry *victim = [self evictionCandidate];
+    assert(victim);
     // Evict
     if (callBacks_->evict) {
-      if (!callBacks_->evict(((HGSLRUCacheEntry *)lruTail_)->key,
-                             ((HGSLRUCacheEntry *)lruTail_)->value,
-                             evictContext_)) {
+      if (!callBacks_->evict(victim->key, victim->value, evictContext_)) {
         HGSLog(@"HGSLRUCache eviction failure.");
         return NO;
       }
     }
-    // Remove
-    [self removeValueForKey:((HGSLRUCacheEntry *)lruTail_)->key];
+    if (VERMILION_LRU_CACHE_EVICT_ENABLED()) {
+      VERMILION_LRU_CACHE_EVICT(self);
+    }
+    // Remove, remembering keys evicted from probation
+    if (victim->queue == kHGSLRUCacheProbationQueue) {
+      [self makeGhostOfEntry:victim];
+    } else {
+      [self removeEntry:victim];
+    }
   }
 
   // Create a new cache entry
-  HGSLRUCacheEntry *newEntry = CFAllocatorAllocate(kCFAllocatorDefault, 
-                                                   sizeof(HGSLRUCacheEntry), 0);
+  HGSLRUCacheEntry *newEntry = [self allocateEntry];
   if (!newEntry) return NO;
-  newEntry->retainCount = 1;  // Creation just to be proper about it.
-  newEntry->callbacks = callBacks_;
   newEntry->size = size;
+  newEntry->hash = hash;
   newEntry->key = callBacks_->keyRetain(kCFAllocatorDefault, key);
   newEntry->value = callBacks_->valueRetain(kCFAllocatorDefault, value);
   newEntry->previous = NULL;
-  newEntry->next = lruHead_;
+  newEntry->next = NULL;
 
-  // Add to the dict
-  CFDictionarySetValue(cache_, key, newEntry);
-
-  // Dict has it now, release
-  newEntry->retainCount--;
-
-  // Fix head
-  if (lruHead_) ((HGSLRUCacheEntry *)lruHead_)->previous = newEntry;
-  lruHead_ = newEntry;
+  // Add to the table
+  if (![self insertEntry:newEntry]) {
+    // COV_NF_START
+    callBacks_->keyRelease(kCFAllocatorDefault, newEntry->key);
+    callBacks_->valueRelease(kCFAllocatorDefault, newEntry->value);
+    newEntry->next = freeEntries_;
+    freeEntries_ = newEntry;
+    return NO;
+    // COV_NF_END
+  }
 
-  // Fix tail if this is the first insert
-  if (!lruTail_) lruTail_ = newEntry;
+  // Link in at the head of its list
+  if (policy_ == eHGSLRUCachePolicy2Q && !wasGhost && !wasMain) {
+    newEntry->queue = kHGSLRUCacheProbationQueue;
+    HGSLRUCacheListPushHead(&probationHead_, &probationTail_, newEntry);
+    probationSize_ += size;
+  } else {
+    newEntry->queue = kHGSLRUCacheMainQueue;
+    HGSLRUCacheListPushHead(&lruHead_, &lruTail_, newEntry);
+  }
 
   // Update size
   currentSize_ += size;
+  residentCount_++;
 
   // Success
   return YES;
@@ -262,23 +520,32 @@ static CFDictionaryValueCallBacks gHGSLRUCacheEntryDictionaryValueCallBacks = {
 
 - (CFIndex)count {
 
-  return CFDictionaryGetCount(cache_);
+  return residentCount_;
 
 } // count
 
+- (HGSLRUCachePolicy)policy {
+
+  return policy_;
+
+} // policy
+
 - (void)getKeys:(const void **)keys values:(const void **)values {
   if (keys || values) {
-    HGSLRUCacheEntry *current = (HGSLRUCacheEntry *)lruHead_;
-    while (current) {
-      if (keys) {
-        *keys = current->key;
-        keys++;
-      }
-      if (values) {
-        *values = current->value;
-        values++;
+    HGSLRUCacheEntry *lists[] = { lruHead_, probationHead_ };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i) {
+      HGSLRUCacheEntry *current = lists[i];
+      while (current) {
+        if (keys) {
+          *keys = current->key;
+          keys++;
+        }
+        if (values) {
+          *values = current->value;
+          values++;
+        }
+        current = current->next;
       }
-      current = current->next;
     }
   } 
 } // getKeys:values:
@@ -195,4 +195,190 @@ static BOOL HGSLRUCacheTestEvict(const void *key,
   [cache release];
 }
 
+- (void)testTableChurn {
+  HGSLRUCacheCallBacks callbacks = {
+    0,
+    HGSLRUCacheTestKeyRetain,
+    HGSLRUCacheTestKeyRelease,
+    HGSLRUCacheTestKeyEqual,
+    HGSLRUCacheTestKeyHash,
+    HGSLRUCacheTestValueRetain,
+    HGSLRUCacheTestValueRelease,
+    HGSLRUCacheTestEvict
+  };
+  BOOL evict = YES;
+  HGSLRUCache *cache 
+    = [[[HGSLRUCache alloc] initWithCacheSize:300
+                                    callBacks:&callbacks 
+                                 evictContext:&evict] autorelease];
+  NSMutableArray *keys = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 1000; ++i) {
+    [keys addObject:[NSString stringWithFormat:@"key-%u", i]];
+  }
+  // Grow the table well past its initial size, then punch holes in it.
+  for (NSUInteger i = 0; i < 300; ++i) {
+    NSString *key = [keys objectAtIndex:i];
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  for (NSUInteger i = 0; i < 300; i += 2) {
+    [cache removeValueForKey:[keys objectAtIndex:i]];
+  }
+  STAssertEquals([cache count], (CFIndex)150, nil);
+  for (NSUInteger i = 0; i < 300; ++i) {
+    NSString *key = [keys objectAtIndex:i];
+    id value = (id)[cache valueForKey:key];
+    if (i % 2) {
+      STAssertEqualObjects(value, key, nil);
+    } else {
+      STAssertNil(value, nil);
+    }
+  }
+  // Churn through the rest, so entries and slots are recycled. The most
+  // recent 300 keys must always be found.
+  for (NSUInteger i = 300; i < 1000; ++i) {
+    NSString *key = [keys objectAtIndex:i];
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  STAssertEquals([cache count], (CFIndex)300, nil);
+  for (NSUInteger i = 700; i < 1000; ++i) {
+    NSString *key = [keys objectAtIndex:i];
+    STAssertEqualObjects((id)[cache valueForKey:key], key, nil);
+  }
+  STAssertNULL([cache valueForKey:[keys objectAtIndex:699]], nil);
+}
+
+- (NSUInteger)residentHotKeysAfterScanWithPolicy:(HGSLRUCachePolicy)policy {
+  HGSLRUCacheCallBacks callbacks = {
+    0,
+    HGSLRUCacheTestKeyRetain,
+    HGSLRUCacheTestKeyRelease,
+    HGSLRUCacheTestKeyEqual,
+    HGSLRUCacheTestKeyHash,
+    HGSLRUCacheTestValueRetain,
+    HGSLRUCacheTestValueRelease,
+    HGSLRUCacheTestEvict
+  };
+  BOOL evict = YES;
+  HGSLRUCache *cache 
+    = [[[HGSLRUCache alloc] initWithCacheSize:100
+                                       policy:policy
+                                    callBacks:&callbacks 
+                                 evictContext:&evict] autorelease];
+  STAssertNotNil(cache, nil);
+  STAssertEquals([cache policy], policy, nil);
+  NSMutableArray *hot = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 10; ++i) {
+    [hot addObject:[NSString stringWithFormat:@"hot-%u", i]];
+  }
+  // Load the hot keys, push them out with a short scan, then load them
+  // again so they have been asked for twice.
+  for (NSString *key in hot) {
+    STAssertTrue([cache setValue:key forKey:key size:5], nil);
+  }
+  for (NSUInteger i = 0; i < 20; ++i) {
+    NSString *key = [NSString stringWithFormat:@"warm-%u", i];
+    STAssertTrue([cache setValue:key forKey:key size:5], nil);
+  }
+  for (NSString *key in hot) {
+    if (![cache valueForKey:key]) {
+      STAssertTrue([cache setValue:key forKey:key size:5], nil);
+    }
+  }
+  // A long scan of keys that are only seen once.
+  for (NSUInteger i = 0; i < 100; ++i) {
+    NSString *key = [NSString stringWithFormat:@"scan-%u", i];
+    STAssertTrue([cache setValue:key forKey:key size:5], nil);
+  }
+  STAssertLessThanOrEqual([cache count], (CFIndex)20, nil);
+  NSUInteger resident = 0;
+  for (NSString *key in hot) {
+    if ([cache valueForKey:key]) ++resident;
+  }
+  return resident;
+}
+
+- (void)testScanResistance {
+  STAssertEquals([self residentHotKeysAfterScanWithPolicy:
+                  eHGSLRUCachePolicyLRU], (NSUInteger)0, nil);
+  STAssertEquals([self residentHotKeysAfterScanWithPolicy:
+                  eHGSLRUCachePolicy2Q], (NSUInteger)10, nil);
+}
+
+- (void)test2QOrderAndRemoval {
+  HGSLRUCacheCallBacks callbacks = {
+    0,
+    HGSLRUCacheTestKeyRetain,
+    HGSLRUCacheTestKeyRelease,
+    HGSLRUCacheTestKeyEqual,
+    HGSLRUCacheTestKeyHash,
+    HGSLRUCacheTestValueRetain,
+    HGSLRUCacheTestValueRelease,
+    HGSLRUCacheTestEvict
+  };
+  BOOL evict = YES;
+  HGSLRUCache *cache 
+    = [[[HGSLRUCache alloc] initWithCacheSize:4
+                                       policy:eHGSLRUCachePolicy2Q
+                                    callBacks:&callbacks 
+                                 evictContext:&evict] autorelease];
+  STAssertNil([[[HGSLRUCache alloc] initWithCacheSize:4
+                                               policy:eHGSLRUCachePolicy2Q + 1
+                                            callBacks:&callbacks 
+                                         evictContext:&evict] autorelease], 
+              nil);
+  for (NSString *key in [NSArray arrayWithObjects:@"a", @"b", @"c", @"d", 
+                         @"e", nil]) {
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  // "a" was evicted from probation, so setting it again promotes it.
+  STAssertNULL([cache valueForKey:@"a"], nil);
+  STAssertTrue([cache setValue:@"a" forKey:@"a" size:1], nil);
+  // Removing "b" forgets that it was promoted, so it comes back on
+  // probation behind "a".
+  STAssertTrue([cache setValue:@"b" forKey:@"b" size:1], nil);
+  [cache removeValueForKey:@"b"];
+  STAssertTrue([cache setValue:@"b" forKey:@"b" size:1], nil);
+  CFIndex count = [cache count];
+  STAssertEquals(count, (CFIndex)4, nil);
+  id keys[4];
+  [cache getKeys:(const void **)keys values:NULL];
+  STAssertEqualObjects(keys[0], @"a", nil);
+  STAssertEqualObjects(keys[1], @"b", nil);
+}
+
+- (void)test2QUpdateOfMainEntry {
+  HGSLRUCacheCallBacks callbacks = {
+    0,
+    HGSLRUCacheTestKeyRetain,
+    HGSLRUCacheTestKeyRelease,
+    HGSLRUCacheTestKeyEqual,
+    HGSLRUCacheTestKeyHash,
+    HGSLRUCacheTestValueRetain,
+    HGSLRUCacheTestValueRelease,
+    HGSLRUCacheTestEvict
+  };
+  BOOL evict = YES;
+  HGSLRUCache *cache 
+    = [[[HGSLRUCache alloc] initWithCacheSize:4
+                                       policy:eHGSLRUCachePolicy2Q
+                                    callBacks:&callbacks 
+                                 evictContext:&evict] autorelease];
+  for (NSString *key in [NSArray arrayWithObjects:@"a", @"b", @"c", @"d", 
+                         @"e", nil]) {
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  // Promote "a" to the main list, then give it a new value.
+  STAssertTrue([cache setValue:@"a" forKey:@"a" size:1], nil);
+  STAssertTrue([cache setValue:@"a2" forKey:@"a" size:1], nil);
+  id keys[4];
+  [cache getKeys:(const void **)keys values:NULL];
+  STAssertEqualObjects(keys[0], @"a", nil);
+  // The update kept it on the main list, so a scan doesn't push it out.
+  for (NSUInteger i = 0; i < 20; ++i) {
+    NSString *key = [NSString stringWithFormat:@"scan-%u", i];
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  STAssertEqualObjects((id)[cache valueForKey:@"a"], @"a2", nil);
+}
+
 @end
@@ -0,0 +1,117 @@
+//
+//  HGSLatencyHistogram.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header
+ @discussion HGSLatencyHistogram
+*/
+
+/*!
+ A compact histogram of latencies, in the style of HdrHistogram.
+
+ Values are bucketed by powers of two, and each power of two is split into
+ 16 linear sub-buckets, so any value can be read back to within about 6%
+ however large it is, in a fixed 464 counters. Values are tracked with
+ microsecond resolution from 1 microsecond up to a bit over an hour; anything
+ larger is counted as the largest value.
+
+ To keep the histogram representative of recent behavior, all of the counts
+ are halved whenever the total reaches kHGSLatencyHistogramDecayCount.
+
+ Not thread safe. Callers are expected to provide their own locking.
+*/
+@interface HGSLatencyHistogram : NSObject {
+ @private
+  UInt32 *counts_;
+  UInt64 count_;
+}
+
+/*!
+ Recreates a histogram from data returned by -data. Returns an empty
+ histogram if |data| is nil or can't be decoded.
+*/
+- (id)initWithData:(NSData *)data;
+
+/*!
+ A compact encoding of the histogram, suitable for storing in a plist.
+*/
+- (NSData *)data;
+
+/*!
+ Recreates a histogram from counters returned by -getCounts:.
+ @param counts kHGSLatencyHistogramCountsLength counters.
+*/
+- (id)initWithCounts:(const UInt16 *)counts;
+
+/*!
+ Copies out the raw counters, for callers that want a fixed size
+ representation. Counters never exceed kHGSLatencyHistogramDecayCount, so
+ they fit in 16 bits.
+ @param counts Room for kHGSLatencyHistogramCountsLength counters.
+*/
+- (void)getCounts:(UInt16 *)counts;
+
+/*!
+ Records a single latency.
+ @param nanoseconds The latency in nanoseconds.
+*/
+- (void)recordValue:(UInt64)nanoseconds;
+
+/*!
+ The number of values in the histogram.
+*/
+- (UInt64)count;
+
+/*!
+ Returns the value, in nanoseconds, below which |percentile| percent of the
+ recorded values fall. The value returned is the top of the bucket the
+ percentile falls in, so it errs on the slow side. Returns 0 if the
+ histogram is empty.
+ @param percentile Between 0 and 100.
+*/
+- (UInt64)valueAtPercentile:(double)percentile;
+
+@end
+
+/*!
+ Total count at which all of the counts in a histogram are halved.
+*/
+#define kHGSLatencyHistogramDecayCount 4096
+
+/*!
+ Number of counters in a histogram.
+*/
+#define kHGSLatencyHistogramCountsLength 464
@@ -0,0 +1,177 @@
+//
+//  HGSLatencyHistogram.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "HGSLatencyHistogram.h"
+
+// Each power of two is split into 2^kHGSLatencyHistogramSubBucketBits
+// sub-buckets. Bucket 0 covers 0 to 2^(bits + 1) - 1 linearly, and every
+// bucket after it covers the next power of two.
+static const int kHGSLatencyHistogramSubBucketBits = 4;
+static const NSUInteger kHGSLatencyHistogramSubBucketHalfCount = 16;
+static const UInt64 kHGSLatencyHistogramSubBucketMask = 31;
+static const UInt64 kHGSLatencyHistogramMaximumValue = 0xFFFFFFFFULL;
+
+// Version of the encoding returned by -data.
+static const UInt32 kHGSLatencyHistogramDataVersion = 1;
+
+static NSUInteger HGSLatencyHistogramIndexForValue(UInt64 value) {
+  if (value > kHGSLatencyHistogramMaximumValue) {
+    value = kHGSLatencyHistogramMaximumValue;
+  }
+  int highestBit
+    = 63 - __builtin_clzll(value | kHGSLatencyHistogramSubBucketMask);
+  int bucket = highestBit - kHGSLatencyHistogramSubBucketBits;
+  UInt64 subBucket = value >> bucket;
+  return bucket * kHGSLatencyHistogramSubBucketHalfCount + (NSUInteger)subBucket;
+}
+
+// The largest value that lands in the bucket at |index|.
+static UInt64 HGSLatencyHistogramValueForIndex(NSUInteger index) {
+  NSUInteger bucket = 0;
+  if (index >= 2 * kHGSLatencyHistogramSubBucketHalfCount) {
+    bucket = index / kHGSLatencyHistogramSubBucketHalfCount - 1;
+  }
+  UInt64 subBucket = index - bucket * kHGSLatencyHistogramSubBucketHalfCount;
+  return ((subBucket + 1) << bucket) - 1;
+}
+
+@implementation HGSLatencyHistogram
+
+- (id)init {
+  return [self initWithData:nil];
+}
+
+- (id)initWithData:(NSData *)data {
+  if ((self = [super init])) {
+    counts_ = calloc(kHGSLatencyHistogramCountsLength, sizeof(UInt32));
+    if (!counts_) {
+      [self release];
+      return nil;
+    }
+    // The data is a version followed by (index, count) pairs for the
+    // buckets that aren't empty, all little endian UInt32s.
+    NSUInteger length = [data length] / sizeof(UInt32);
+    const UInt32 *words = [data bytes];
+    if (length > 0
+        && CFSwapInt32LittleToHost(words[0]) == kHGSLatencyHistogramDataVersion) {
+      for (NSUInteger i = 1; i + 1 < length; i += 2) {
+        UInt32 index = CFSwapInt32LittleToHost(words[i]);
+        UInt32 count = CFSwapInt32LittleToHost(words[i + 1]);
+        if (index < kHGSLatencyHistogramCountsLength) {
+          counts_[index] += count;
+          count_ += count;
+        }
+      }
+    }
+  }
+  return self;
+}
+
+- (id)initWithCounts:(const UInt16 *)counts {
+  if ((self = [self initWithData:nil])) {
+    for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+      counts_[i] = counts[i];
+      count_ += counts[i];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  free(counts_);
+  [super dealloc];
+}
+
+- (NSData *)data {
+  NSMutableData *data = [NSMutableData data];
+  UInt32 word = CFSwapInt32HostToLittle(kHGSLatencyHistogramDataVersion);
+  [data appendBytes:&word length:sizeof(word)];
+  for (UInt32 i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+    if (counts_[i]) {
+      word = CFSwapInt32HostToLittle(i);
+      [data appendBytes:&word length:sizeof(word)];
+      word = CFSwapInt32HostToLittle(counts_[i]);
+      [data appendBytes:&word length:sizeof(word)];
+    }
+  }
+  return data;
+}
+
+- (void)getCounts:(UInt16 *)counts {
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+    counts[i] = (UInt16)MIN(counts_[i], (UInt32)UINT16_MAX);
+  }
+}
+
+- (void)recordValue:(UInt64)nanoseconds {
+  NSUInteger index = HGSLatencyHistogramIndexForValue(nanoseconds / 1000);
+  counts_[index] += 1;
+  count_ += 1;
+  if (count_ >= kHGSLatencyHistogramDecayCount) {
+    count_ = 0;
+    for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+      counts_[i] /= 2;
+      count_ += counts_[i];
+    }
+  }
+}
+
+- (UInt64)count {
+  return count_;
+}
+
+- (UInt64)valueAtPercentile:(double)percentile {
+  if (count_ == 0) return 0;
+  percentile = MIN(MAX(percentile, 0.0), 100.0);
+  UInt64 target = (UInt64)ceil(percentile / 100.0 * count_);
+  if (target == 0) {
+    target = 1;
+  }
+  UInt64 total = 0;
+  NSUInteger index = 0;
+  for (; index < kHGSLatencyHistogramCountsLength; ++index) {
+    total += counts_[index];
+    if (total >= target) break;
+  }
+  return HGSLatencyHistogramValueForIndex(index) * 1000;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p> count: %llu p50: %llu "
+          @"p90: %llu p99: %llu", [self class], self, count_,
+          [self valueAtPercentile:50], [self valueAtPercentile:90],
+          [self valueAtPercentile:99]];
+}
+
+@end
@@ -0,0 +1,154 @@
+//
+//  HGSLatencyHistogramTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "GTMSenTestCase.h"
+#import "HGSLatencyHistogram.h"
+
+@interface HGSLatencyHistogramTest : GTMTestCase
+@end
+
+@implementation HGSLatencyHistogramTest
+
+- (void)testEmpty {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  STAssertNotNil(histogram, nil);
+  STAssertEquals([histogram count], (UInt64)0, nil);
+  STAssertEquals([histogram valueAtPercentile:50], (UInt64)0, nil);
+}
+
+- (void)testPercentiles {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  // 1ms to 1000ms in 1ms steps.
+  for (UInt64 i = 1; i <= 1000; ++i) {
+    [histogram recordValue:i * 1000000];
+  }
+  STAssertEquals([histogram count], (UInt64)1000, nil);
+  UInt64 p50 = [histogram valueAtPercentile:50];
+  UInt64 p90 = [histogram valueAtPercentile:90];
+  UInt64 p99 = [histogram valueAtPercentile:99];
+  UInt64 p100 = [histogram valueAtPercentile:100];
+  // Values are never under reported, and are within 1/16th over.
+  STAssertTrue(p50 >= 500000000 && p50 <= 500000000 / 16 * 17,
+               @"%llu", p50);
+  STAssertTrue(p90 >= 900000000 && p90 <= 900000000 / 16 * 17,
+               @"%llu", p90);
+  STAssertTrue(p99 >= 990000000 && p99 <= 990000000 / 16 * 17,
+               @"%llu", p99);
+  STAssertTrue(p100 >= 1000000000 && p100 <= 1000000000 / 16 * 17,
+               @"%llu", p100);
+}
+
+- (void)testTails {
+  // The difference between a steady source and a bimodal one with the same
+  // average shows up in the tail.
+  HGSLatencyHistogram *steady
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  HGSLatencyHistogram *bimodal
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  for (int i = 0; i < 100; ++i) {
+    [steady recordValue:50000000];
+    [bimodal recordValue:(i % 2) ? 5000000 : 95000000];
+  }
+  STAssertLessThan([steady valueAtPercentile:90],
+                   [bimodal valueAtPercentile:90], nil);
+  STAssertGreaterThan([steady valueAtPercentile:10],
+                      [bimodal valueAtPercentile:10], nil);
+}
+
+- (void)testSmallAndLargeValues {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  [histogram recordValue:0];
+  STAssertEquals([histogram valueAtPercentile:100], (UInt64)0, nil);
+  [histogram recordValue:31000];
+  STAssertEquals([histogram valueAtPercentile:100], (UInt64)31000, nil);
+  // Clamped to the largest value we track.
+  [histogram recordValue:UINT64_MAX];
+  STAssertEquals([histogram valueAtPercentile:100],
+                 (UInt64)0xFFFFFFFFULL * 1000, nil);
+}
+
+- (void)testData {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  for (UInt64 i = 1; i <= 100; ++i) {
+    [histogram recordValue:i * i * 1000];
+  }
+  NSData *data = [histogram data];
+  STAssertNotNil(data, nil);
+  HGSLatencyHistogram *restored
+    = [[[HGSLatencyHistogram alloc] initWithData:data] autorelease];
+  STAssertEquals([restored count], [histogram count], nil);
+  for (double percentile = 0; percentile <= 100; percentile += 5) {
+    STAssertEquals([restored valueAtPercentile:percentile],
+                   [histogram valueAtPercentile:percentile],
+                   @"%f", percentile);
+  }
+  UInt16 counts[kHGSLatencyHistogramCountsLength];
+  [histogram getCounts:counts];
+  restored
+    = [[[HGSLatencyHistogram alloc] initWithCounts:counts] autorelease];
+  STAssertEquals([restored count], [histogram count], nil);
+  STAssertEquals([restored valueAtPercentile:75],
+                 [histogram valueAtPercentile:75], nil);
+  HGSLatencyHistogram *garbage
+    = [[[HGSLatencyHistogram alloc]
+        initWithData:[@"garbage" dataUsingEncoding:NSUTF8StringEncoding]]
+       autorelease];
+  STAssertNotNil(garbage, nil);
+  STAssertEquals([garbage count], (UInt64)0, nil);
+}
+
+- (void)testDecay {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  for (int i = 0; i < kHGSLatencyHistogramDecayCount - 1; ++i) {
+    [histogram recordValue:1000000];
+  }
+  STAssertEquals([histogram count],
+                 (UInt64)kHGSLatencyHistogramDecayCount - 1, nil);
+  [histogram recordValue:1000000];
+  STAssertEquals([histogram count],
+                 (UInt64)kHGSLatencyHistogramDecayCount / 2, nil);
+  // After enough slow runs the old fast ones no longer dominate.
+  for (int i = 0; i < kHGSLatencyHistogramDecayCount; ++i) {
+    [histogram recordValue:100000000];
+  }
+  STAssertGreaterThanOrEqual([histogram valueAtPercentile:50],
+                             (UInt64)100000000, nil);
+}
+
+@end
@@ -60,7 +60,8 @@
  get sent to the pre and post filter methods, the subclass then has the
  responsibility to filter based on the pivot object.
 */
-@interface HGSMemorySearchSource : HGSCallbackSearchSource {
+@interface HGSMemorySearchSource : HGSCallbackSearchSource 
+    <HGSRefinableSearchSource> {
  @private
   HGSMemorySearchSourceDB* resultsDatabase_;
   NSUInteger cacheHash_;
@@ -137,6 +138,8 @@
 @interface HGSMemorySearchSourceDB : NSObject <NSCopying> {
  @private
   NSMutableArray* storage_;
+  // Entries in storage_ keyed by result URI. Built on demand for refining.
+  NSMutableDictionary *objectsByURI_;
 }
 
 /*!
@@ -31,6 +31,7 @@
 //
 
 #import "HGSMemorySearchSource.h"
+#import "HGSCancellationToken.h"
 #import "HGSResult.h"
 #import "HGSQuery.h"
 #import "HGSTokenizer.h"
@@ -38,7 +39,11 @@
 #import "HGSDelegate.h"
 #import "HGSPluginLoader.h"
 #import "HGSLog.h"
+#import "HGSDTrace.h"
+#import "HGSPerformanceCounters.h"
 #import "HGSSearchTermScorer.h"
+#import "HGSStartupProfiler.h"
+#import "NSNotificationCenter+MainThread.h"
 
 static NSString* const kHGSMemorySourceResultKey = @"HGSMSResultObject";
 static NSString* const kHGSMemorySourceNameKey = @"HGSMSName";
@@ -68,12 +73,16 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 
 @interface HGSMemorySearchSource ()
 - (NSArray *)rankedResultsFromPreparedDatabase:(HGSMemorySearchSourceDB *)database 
-                               forOperation:(HGSCallbackSearchOperation *)operation;
+                                  forOperation:(HGSSearchOperation *)operation
+                                 candidateURIs:(NSSet *)candidateURIs;
 @end
 
 @interface HGSMemorySearchSourceDB ()
 @property (copy, readonly) NSMutableArray *storage;
 
+// Returns the entries whose results have one of |uris|.
+- (NSArray *)objectsWithURIs:(NSSet *)uris;
+
 - (void)indexResult:(HGSResult *)hgsResult
       tokenizedName:(HGSTokenizedString *)name
          otherTerms:(NSArray *)otherTerms;
@@ -119,6 +128,8 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 }
 
 - (void)dealloc {
+  HGSPerformanceCounterAdd(eHGSMemoryIndexEntryCounter, 
+                           -(int64_t)[[resultsDatabase_ storage] count]);
   [resultsDatabase_ release];
   [cachePath_ release];
   [super dealloc];
@@ -128,7 +139,8 @@ static NSString* const kHGSMemorySourceVersion = @"1";
   NSArray *rankedResults = nil;
   @synchronized(self) {
     rankedResults = [self rankedResultsFromPreparedDatabase:resultsDatabase_ 
-                                               forOperation:operation];
+                                               forOperation:operation
+                                              candidateURIs:nil];
   }
   [operation setRankedResults:rankedResults];
 }
@@ -136,7 +148,10 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 - (NSArray *)rankedResultsFromArray:(NSArray *)results
                        forOperation:(HGSCallbackSearchOperation *)operation {
   HGSMemorySearchSourceDB *preparedDB = [HGSMemorySearchSourceDB database];
+  HGSCancellationToken *token = [operation cancellationToken];
   for (HGSResult *result in results) {
+    // Tokenizing is the expensive part, so don't do any more than we must.
+    if ([token isCancelled]) break;
     NSString *name = [result displayName];
     HGSTokenizedString *tokenizedName = [HGSTokenizer tokenizeString:name];
     NSString *snippet = [result valueForKey:kHGSObjectAttributeSnippetKey];
@@ -150,24 +165,37 @@ static NSString* const kHGSMemorySourceVersion = @"1";
                  otherTerms:otherTerms];
   }
   return [self rankedResultsFromPreparedDatabase:preparedDB
-                                    forOperation:operation];
+                                    forOperation:operation
+                                   candidateURIs:nil];
 }
 
+// If |candidateURIs| is non-nil only entries with URIs in the set are
+// considered.
 - (NSArray *)rankedResultsFromPreparedDatabase:(HGSMemorySearchSourceDB *)database
-                                  forOperation:(HGSCallbackSearchOperation *)operation {
+                                  forOperation:(HGSSearchOperation *)operation
+                                 candidateURIs:(NSSet *)candidateURIs {
   HGSQuery* query = [operation query];
   NSMutableArray* rankedResults = [NSMutableArray array];
   HGSTokenizedString *tokenizedQuery = [query tokenizedQueryString];
   NSUInteger queryLength = [tokenizedQuery originalLength];
   HGSResultArray *pivotObjects = [query pivotObjects];
+  HGSCancellationToken *token = [operation cancellationToken];
+  NSArray *indexObjects = [database storage];
+  if (candidateURIs) {
+    indexObjects = [database objectsWithURIs:candidateURIs];
+  }
+  if (VERMILION_MEMORY_SCAN_START_ENABLED()) {
+    VERMILION_MEMORY_SCAN_START((char *)[[self identifier] UTF8String],
+                                (int)[indexObjects count]);
+  }
     
   if ((queryLength == 0) && [pivotObjects count]) {
     // Per the note above this class in the header, if we get a pivot w/o
     // any query terms, we match everything so the subclass can filter it
     // w/in pre/postFilterResult:matchesForQuery:pivotObject
     
-    for (HGSMemorySearchSourceObject *indexObject in [database storage]) {
-      if ([operation isCancelled]) break;
+    for (HGSMemorySearchSourceObject *indexObject in indexObjects) {
+      if ([token isCancelled]) break;
       HGSResult* result = [self preFilterResult:[indexObject result] 
                                 matchesForQuery:query 
                                    pivotObjects:pivotObjects];
@@ -187,8 +215,8 @@ static NSString* const kHGSMemorySourceVersion = @"1";
       }
     }
   } else if (queryLength > 0) {
-    for (HGSMemorySearchSourceObject *indexObject in [database storage]) {
-      if ([operation isCancelled]) break;
+    for (HGSMemorySearchSourceObject *indexObject in indexObjects) {
+      if ([token isCancelled]) break;
       HGSResult* result = [self preFilterResult:[indexObject result] 
                                 matchesForQuery:query 
                                    pivotObjects:pivotObjects];
@@ -221,6 +249,46 @@ static NSString* const kHGSMemorySourceVersion = @"1";
       }
     }
   }
+  if (VERMILION_MEMORY_SCAN_FINISH_ENABLED()) {
+    VERMILION_MEMORY_SCAN_FINISH((char *)[[self identifier] UTF8String],
+                                 (int)[rankedResults count]);
+  }
+  return rankedResults;
+}
+
+#pragma mark HGSRefinableSearchSource
+
+- (BOOL)canRefineResultsOfQuery:(HGSQuery *)oldQuery
+                        toQuery:(HGSQuery *)newQuery {
+  // Anything that matches a query also matches every prefix of it, so the
+  // results for a prefix are a superset of the results for the full query.
+  // Extending an empty query doesn't work, because we only match everything
+  // for an empty query when there is a pivot.
+  // Subclasses that do their own work in performSearchOperation: (waiting
+  // on indexing, rebuilding their index, etc.) don't get refined.
+  SEL performSel = @selector(performSearchOperation:);
+  IMP ourPerform = [HGSMemorySearchSource instanceMethodForSelector:performSel];
+  if ([self methodForSelector:performSel] != ourPerform) return NO;
+  NSString *oldString = [[oldQuery tokenizedQueryString] tokenizedString];
+  NSString *newString = [[newQuery tokenizedQueryString] tokenizedString];
+  return [oldString length] && [newString hasPrefix:oldString];
+}
+
+- (NSArray *)resultsByRefiningResults:(NSArray *)results
+                              ofQuery:(HGSQuery *)oldQuery
+                         forOperation:(HGSSearchOperation *)operation {
+  // Rescore just the entries that matched last time.
+  NSMutableSet *candidateURIs
+    = [NSMutableSet setWithCapacity:[results count]];
+  for (HGSResult *result in results) {
+    [candidateURIs addObject:[result uri]];
+  }
+  NSArray *rankedResults = nil;
+  @synchronized(self) {
+    rankedResults = [self rankedResultsFromPreparedDatabase:resultsDatabase_
+                                               forOperation:operation
+                                              candidateURIs:candidateURIs];
+  }
   return rankedResults;
 }
 
@@ -274,6 +342,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 }
 
 - (BOOL)loadResultsCache {
+  HGSStartupProfilerMark profilerMark = HGSStartupProfilerBegin();
   cacheHash_ = 0;
   // This routine can allocate a lot of temporary objects, so we wrap it
   // in an autorelease pool to keep our memory usage down.
@@ -318,14 +387,26 @@ static NSString* const kHGSMemorySourceVersion = @"1";
     cacheHash_ = 0;
   }
   [pool release];
+  HGSStartupProfilerEnd(profilerMark, kHGSStartupProfilerCacheCategory,
+                        [self identifier]);
   return cacheHash_ != 0;
 }
 
 - (void)replaceCurrentDatabaseWith:(HGSMemorySearchSourceDB *)database {
   @synchronized (self) {
+    int64_t oldCount = [[resultsDatabase_ storage] count];
     [resultsDatabase_ autorelease];
     resultsDatabase_ = [database copy];
+    HGSPerformanceCounterAdd(eHGSMemoryIndexEntryCounter,
+                             (int64_t)[[resultsDatabase_ storage] count] 
+                             - oldCount);
   }
+  // Anything we returned before may now be missing newly indexed results,
+  // so it can't be refined any more.
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc hgs_postOnMainThreadNotificationName:
+        kHGSRefinableSearchSourceResultsInvalidatedNotification
+                                    object:self];
 }
 
 @end
@@ -369,6 +450,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 
 - (void)dealloc {
   [storage_ release];
+  [objectsByURI_ release];
   [super dealloc];
 }
 
@@ -387,8 +469,36 @@ static NSString* const kHGSMemorySourceVersion = @"1";
     if (object) {
       [storage_ addObject:object];
       [object release];
+      [objectsByURI_ release];
+      objectsByURI_ = nil;
+    }
+  }
+}
+
+- (NSArray *)objectsWithURIs:(NSSet *)uris {
+  if (!objectsByURI_) {
+    // A result can be indexed more than once (under different names), so
+    // each URI maps to an array of entries.
+    objectsByURI_
+      = [[NSMutableDictionary alloc] initWithCapacity:[storage_ count]];
+    for (HGSMemorySearchSourceObject *object in storage_) {
+      NSString *uri = [[object result] uri];
+      NSMutableArray *objects = [objectsByURI_ objectForKey:uri];
+      if (!objects) {
+        objects = [NSMutableArray arrayWithCapacity:1];
+        [objectsByURI_ setObject:objects forKey:uri];
+      }
+      [objects addObject:object];
+    }
+  }
+  NSMutableArray *objects = [NSMutableArray arrayWithCapacity:[uris count]];
+  for (NSString *uri in uris) {
+    NSArray *objectsForURI = [objectsByURI_ objectForKey:uri];
+    if (objectsForURI) {
+      [objects addObjectsFromArray:objectsForURI];
     }
   }
+  return objects;
 }
 
 - (void)indexResult:(HGSResult *)hgsResult
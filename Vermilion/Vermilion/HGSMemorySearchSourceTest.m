@@ -37,9 +37,13 @@
 #import "HGSSearchOperation.h"
 #import "HGSQuery.h"
 #import "HGSTokenizer.h"
+#import "HGSBundle.h"
 #import <OCMock/OCMock.h>
 
-@interface HGSMemorySearchSourceTest : GTMTestCase 
+@interface HGSMemorySearchSourceTest : GTMTestCase {
+ @private
+  NSUInteger invalidations_;
+}
 @end
 
 @implementation HGSMemorySearchSourceTest
@@ -142,4 +146,78 @@
   [memSource replaceCurrentDatabaseWith:database];
   [memSource performSearchOperation:op];
 }
+
+- (void)resultsInvalidated:(NSNotification *)notification {
+  ++invalidations_;
+}
+
+- (void)testRefinement {
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       @"com.google.qsb.memorysearchsourcetest.source", 
+       kHGSExtensionIdentifierKey,
+       @"HGSMemorySearchSourceTest", kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSMemorySearchSource *memSource 
+    = [[[HGSMemorySearchSource alloc] initWithConfiguration:config] autorelease];
+  STAssertNotNil(memSource, nil);
+  HGSUnscoredResult *apple
+    = [HGSUnscoredResult resultWithURI:@"test:apple"
+                                  name:@"apple"
+                                  type:@"test"
+                                source:memSource
+                            attributes:nil];
+  HGSUnscoredResult *apricot
+    = [HGSUnscoredResult resultWithURI:@"test:apricot"
+                                  name:@"apricot"
+                                  type:@"test"
+                                source:memSource
+                            attributes:nil];
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  [database indexResult:apple];
+  [database indexResult:apricot];
+  
+  // Replacing the database tells any caches to drop our old results.
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(resultsInvalidated:)
+             name:kHGSRefinableSearchSourceResultsInvalidatedNotification
+           object:memSource];
+  invalidations_ = 0;
+  [memSource replaceCurrentDatabaseWith:database];
+  [nc removeObserver:self];
+  STAssertEquals(invalidations_, (NSUInteger)1, nil);
+  
+  HGSQuery *aQuery = [[[HGSQuery alloc] initWithString:@"a"
+                                        actionArgument:nil
+                                       actionOperation:nil
+                                          pivotObjects:nil
+                                            queryFlags:0] autorelease];
+  HGSQuery *apQuery = [[[HGSQuery alloc] initWithString:@"ap"
+                                         actionArgument:nil
+                                        actionOperation:nil
+                                           pivotObjects:nil
+                                             queryFlags:0] autorelease];
+  STAssertTrue([memSource canRefineResultsOfQuery:aQuery toQuery:apQuery], nil);
+  HGSCallbackSearchOperation *op 
+    = [[[HGSCallbackSearchOperation alloc] initWithQuery:apQuery
+                                                  source:memSource] autorelease];
+  
+  // Only the entries that matched last time get looked at, even though
+  // apricot matches "ap" as well.
+  NSArray *results
+    = [memSource resultsByRefiningResults:[NSArray arrayWithObject:apple]
+                                  ofQuery:aQuery
+                             forOperation:op];
+  STAssertEquals([results count], (NSUInteger)1, nil);
+  STAssertEqualObjects([[results objectAtIndex:0] uri], @"test:apple", nil);
+  
+  results
+    = [memSource resultsByRefiningResults:[NSArray arrayWithObjects:
+                                           apple, apricot, nil]
+                                  ofQuery:aQuery
+                             forOperation:op];
+  STAssertEquals([results count], (NSUInteger)2, nil);
+}
 @end
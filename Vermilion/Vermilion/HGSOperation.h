@@ -90,12 +90,84 @@
    didFinishSelector:(SEL)didFinishSel;
 @end
 
+/*!
+ The lanes that HGSOperationQueue schedules work in. Lanes are serviced in
+ order of importance, and the background lanes are never allowed to take
+ every worker, so that there is always a thread free for the sources that are
+ serving the current query.
+ @constant eHGSOperationLaneInteractive Work that somebody is waiting on, such
+           as search operations and actions. The default.
+ @constant eHGSOperationLaneFetcher Network fetches. Mostly spend their time
+           blocked waiting for data.
+ @constant eHGSOperationLaneIndexing Background (re)indexing of source
+           databases. Runs at a reduced thread priority.
+ @constant eHGSOperationLaneSpeculative Searches for queries the user hasn't
+           typed yet. Only run when nothing more important is waiting, at a
+           reduced thread priority.
+*/
+typedef enum {
+  eHGSOperationLaneInteractive = 0,
+  eHGSOperationLaneFetcher,
+  eHGSOperationLaneIndexing,
+  eHGSOperationLaneSpeculative,
+  eHGSOperationLaneCount
+} HGSOperationLane;
+
 /*!
  Shared operation queue that can be used so we don't have multiple unnecessary
  operation queues created.
+
+ Each worker thread owns a deque per lane. Operations added from a worker go
+ on that worker's own deque, other operations are spread across the workers.
+ Operations with a queuePriority above NSOperationQueuePriorityNormal go on a
+ shared urgent deque instead, which every worker checks first, so they never
+ wait behind less important work on some other worker. A worker then runs the
+ oldest operation from its own deque and, when that is empty, steals the
+ newest operation from another worker. Cancelled operations are retired as
+ soon as they are picked up, without tying up a worker.
+
+ Operations with dependencies are not supported.
 */
-@interface HGSOperationQueue : NSOperationQueue
+@interface HGSOperationQueue : NSObject {
+ @private
+  NSArray *workers_;
+  // Not run by any thread, just holds the urgent deques.
+  id urgentOperations_;
+  NSCondition *condition_;  // Guards everything below.
+  NSUInteger addCount_;
+  NSUInteger queuedCount_[eHGSOperationLaneCount];
+  NSUInteger runningCount_[eHGSOperationLaneCount];
+  NSUInteger outstandingCount_;
+  NSUInteger nextWorker_;
+}
 
 + (HGSOperationQueue *)sharedOperationQueue;
 
+/*!
+ Adds |operation| to the interactive lane, unless it is an HGSFetcherOperation
+ in which case it goes to the fetcher lane.
+*/
+- (void)addOperation:(NSOperation *)operation;
+
+/*!
+ Adds |operation| to |lane|.
+*/
+- (void)addOperation:(NSOperation *)operation lane:(HGSOperationLane)lane;
+
+/*!
+ The number of operations that have been added and not yet finished.
+*/
+- (NSUInteger)operationCount;
+
+/*!
+ Cancels all queued and running operations.
+*/
+- (void)cancelAllOperations;
+
+/*!
+ Blocks until every operation has finished. Must not be called from an
+ operation running on the queue.
+*/
+- (void)waitUntilAllOperationsAreFinished;
+
 @end
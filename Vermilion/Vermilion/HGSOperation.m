@@ -31,9 +31,47 @@
 //
 
 #import "HGSOperation.h"
+#import <libkern/OSAtomic.h>
 #import <GTM/GTMDebugSelectorValidation.h>
 #import <GTM/GTMObjectSingleton.h>
 #import <GData/GTMHTTPFetcher.h>
+#import "HGSLog.h"
+#import "HGSDTrace.h"
+
+// Key in a worker thread's threadDictionary for its HGSOperationQueueWorker.
+static NSString *const kHGSOperationQueueWorkerKey
+  = @"HGSOperationQueueWorker";
+
+// Most of our operations spend their time blocked on the disk, the network
+// or another process, so we run more workers than we have cores.
+static const NSUInteger kHGSOperationQueueWorkersPerCore = 2;
+
+// Thread priority for operations in the indexing and speculative lanes.
+static const double kHGSOperationQueueBackgroundThreadPriority = 0.2;
+
+// A worker thread and its deques. The deques are only ever touched with lock_
+// held. The owning worker takes operations from the front of its deques,
+// thieves take them from the back.
+@interface HGSOperationQueueWorker : NSObject {
+ @private
+  OSSpinLock lock_;
+  NSMutableArray *deques_[eHGSOperationLaneCount];
+  NSOperation *currentOperation_;
+}
+- (void)pushOperation:(NSOperation *)operation lane:(HGSOperationLane)lane;
+- (NSOperation *)popOperationInLane:(HGSOperationLane)lane;
+- (NSOperation *)stealOperationInLane:(HGSOperationLane)lane;
+- (void)setCurrentOperation:(NSOperation *)operation;
+- (void)cancelAllOperations;
+@end
+
+@interface HGSOperationQueue ()
+- (void)runWorker:(HGSOperationQueueWorker *)worker;
+- (BOOL)reserveLane:(HGSOperationLane *)lane;
+- (NSOperation *)takeOperationInLane:(HGSOperationLane)lane
+                           forWorker:(HGSOperationQueueWorker *)worker
+                            addCount:(NSUInteger)addCount;
+@end
 
 @interface HGSFetcherOperation ()
 - (void)httpFetcher:(GTMHTTPFetcher *)fetcher
@@ -110,9 +148,16 @@
 @end
 
 
+static char *HGSFetcherOperationProbeURL(GTMHTTPFetcher *fetcher) {
+  return (char *)[[[[fetcher request] URL] absoluteString] UTF8String];
+}
+
 static void HGSFetcherOperationStartFetch(void *info) {
   HGSFetcherOperation *op = (HGSFetcherOperation *)info;
   GTMHTTPFetcher *fetcher = [op fetcher];
+  if (VERMILION_FETCHER_START_ENABLED()) {
+    VERMILION_FETCHER_START(HGSFetcherOperationProbeURL(fetcher), op);
+  }
   [fetcher beginFetchWithDelegate:op
                 didFinishSelector:@selector(httpFetcher:finishedWithData:error:)];
 }
@@ -147,6 +192,9 @@ static void HGSFetcherOperationStartFetch(void *info) {
 }
 
 - (void)cancel {
+  if (VERMILION_FETCHER_CANCEL_ENABLED()) {
+    VERMILION_FETCHER_CANCEL(HGSFetcherOperationProbeURL(fetcher_), self);
+  }
   [self setTarget:nil];
   [fetcher_ stopFetching];
   [super cancel];
@@ -201,6 +249,11 @@ static void HGSFetcherOperationStartFetch(void *info) {
 - (void)httpFetcher:(GTMHTTPFetcher *)fetcher
    finishedWithData:(NSData *)retrievedData
               error:(NSError *)error {
+  if (VERMILION_FETCHER_FINISH_ENABLED()) {
+    int status = error ? (int)[error code] : (int)[fetcher statusCode];
+    VERMILION_FETCHER_FINISH(HGSFetcherOperationProbeURL(fetcher), self, 
+                             status);
+  }
   id target = [self target];
   if (target) {
     NSMethodSignature *sig = [target_ methodSignatureForSelector:didFinishSel_];
@@ -217,8 +270,302 @@ static void HGSFetcherOperationStartFetch(void *info) {
 
 @end
 
+@implementation HGSOperationQueueWorker
+
+- (id)init {
+  if ((self = [super init])) {
+    lock_ = OS_SPINLOCK_INIT;
+    for (NSUInteger i = 0; i < eHGSOperationLaneCount; ++i) {
+      deques_[i] = [[NSMutableArray alloc] init];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (NSUInteger i = 0; i < eHGSOperationLaneCount; ++i) {
+    [deques_[i] release];
+  }
+  [currentOperation_ release];
+  [super dealloc];
+}
+
+- (void)pushOperation:(NSOperation *)operation lane:(HGSOperationLane)lane {
+  OSSpinLockLock(&lock_);
+  NSMutableArray *deque = deques_[lane];
+  if ([operation queuePriority] > NSOperationQueuePriorityNormal) {
+    // Go in behind any other urgent operations, but ahead of the rest.
+    NSUInteger idx = 0;
+    NSUInteger count = [deque count];
+    while (idx < count
+           && ([[deque objectAtIndex:idx] queuePriority]
+               > NSOperationQueuePriorityNormal)) {
+      ++idx;
+    }
+    [deque insertObject:operation atIndex:idx];
+  } else {
+    [deque addObject:operation];
+  }
+  OSSpinLockUnlock(&lock_);
+}
+
+- (NSOperation *)popOperationInLane:(HGSOperationLane)lane {
+  NSOperation *operation = nil;
+  OSSpinLockLock(&lock_);
+  NSMutableArray *deque = deques_[lane];
+  if ([deque count]) {
+    operation = [[[deque objectAtIndex:0] retain] autorelease];
+    [deque removeObjectAtIndex:0];
+  }
+  OSSpinLockUnlock(&lock_);
+  return operation;
+}
+
+- (NSOperation *)stealOperationInLane:(HGSOperationLane)lane {
+  NSOperation *operation = nil;
+  OSSpinLockLock(&lock_);
+  NSMutableArray *deque = deques_[lane];
+  if ([deque count]) {
+    operation = [[[deque lastObject] retain] autorelease];
+    [deque removeLastObject];
+  }
+  OSSpinLockUnlock(&lock_);
+  return operation;
+}
+
+- (void)setCurrentOperation:(NSOperation *)operation {
+  OSSpinLockLock(&lock_);
+  [currentOperation_ autorelease];
+  currentOperation_ = [operation retain];
+  OSSpinLockUnlock(&lock_);
+}
+
+- (void)cancelAllOperations {
+  NSMutableArray *operations = [NSMutableArray array];
+  OSSpinLockLock(&lock_);
+  for (NSUInteger i = 0; i < eHGSOperationLaneCount; ++i) {
+    [operations addObjectsFromArray:deques_[i]];
+  }
+  if (currentOperation_) {
+    [operations addObject:currentOperation_];
+  }
+  OSSpinLockUnlock(&lock_);
+  // Cancel outside of the lock, cancel can call back into arbitrary code.
+  [operations makeObjectsPerformSelector:@selector(cancel)];
+}
+
+@end
+
 @implementation HGSOperationQueue
 
 GTMOBJECT_SINGLETON_BOILERPLATE(HGSOperationQueue, sharedOperationQueue);
 
+- (id)init {
+  if ((self = [super init])) {
+    NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+    // We need at least two workers so that the background lanes can always
+    // be held back from one of them.
+    NSUInteger workerCount = MAX(cores * kHGSOperationQueueWorkersPerCore, 2U);
+    NSMutableArray *workers = [NSMutableArray arrayWithCapacity:workerCount];
+    for (NSUInteger i = 0; i < workerCount; ++i) {
+      HGSOperationQueueWorker *worker
+        = [[[HGSOperationQueueWorker alloc] init] autorelease];
+      [workers addObject:worker];
+    }
+    workers_ = [workers copy];
+    urgentOperations_ = [[HGSOperationQueueWorker alloc] init];
+    condition_ = [[NSCondition alloc] init];
+    for (HGSOperationQueueWorker *worker in workers_) {
+      [NSThread detachNewThreadSelector:@selector(runWorker:)
+                               toTarget:self
+                             withObject:worker];
+    }
+  }
+  return self;
+}
+
+- (void)addOperation:(NSOperation *)operation {
+  HGSOperationLane lane = eHGSOperationLaneInteractive;
+  if ([operation isKindOfClass:[HGSFetcherOperation class]]) {
+    lane = eHGSOperationLaneFetcher;
+  }
+  [self addOperation:operation lane:lane];
+}
+
+- (void)addOperation:(NSOperation *)operation lane:(HGSOperationLane)lane {
+  HGSAssert(operation, nil);
+  HGSAssert(lane < eHGSOperationLaneCount, nil);
+  HGSAssert([[operation dependencies] count] == 0,
+            @"HGSOperationQueue does not support dependencies %@", operation);
+  // Urgent work goes where every worker will look for it first. Other work
+  // spawned by a worker stays with that worker while it can.
+  NSThread *thread = [NSThread currentThread];
+  HGSOperationQueueWorker *worker
+    = [[thread threadDictionary] objectForKey:kHGSOperationQueueWorkerKey];
+  if ([operation queuePriority] > NSOperationQueuePriorityNormal) {
+    worker = urgentOperations_;
+  } else if (![workers_ containsObject:worker]) {
+    [condition_ lock];
+    worker = [workers_ objectAtIndex:nextWorker_];
+    nextWorker_ = (nextWorker_ + 1) % [workers_ count];
+    [condition_ unlock];
+  }
+  // The operation has to be in a deque before it is counted, so that a worker
+  // that reserves it is guaranteed to find it.
+  [worker pushOperation:operation lane:lane];
+  [condition_ lock];
+  ++addCount_;
+  ++queuedCount_[lane];
+  ++outstandingCount_;
+  [condition_ broadcast];
+  [condition_ unlock];
+}
+
+- (NSUInteger)operationCount {
+  [condition_ lock];
+  NSUInteger count = outstandingCount_;
+  [condition_ unlock];
+  return count;
+}
+
+- (void)cancelAllOperations {
+  [urgentOperations_ cancelAllOperations];
+  [workers_ makeObjectsPerformSelector:@selector(cancelAllOperations)];
+}
+
+- (void)waitUntilAllOperationsAreFinished {
+  NSThread *thread = [NSThread currentThread];
+  HGSAssert(![[thread threadDictionary] objectForKey:kHGSOperationQueueWorkerKey],
+            @"Waiting for the queue from one of its own operations");
+  [condition_ lock];
+  while (outstandingCount_) {
+    [condition_ wait];
+  }
+  [condition_ unlock];
+}
+
+// Picks the most important lane that has work we are allowed to start, and
+// claims one of its operations. Must be called with condition_ locked.
+- (BOOL)reserveLane:(HGSOperationLane *)lane {
+  NSUInteger workerCount = [workers_ count];
+  NSUInteger backgroundRunning = 0;
+  NSUInteger backgroundQueued = 0;
+  for (NSUInteger i = eHGSOperationLaneInteractive + 1;
+       i < eHGSOperationLaneCount;
+       ++i) {
+    backgroundRunning += runningCount_[i];
+    backgroundQueued += queuedCount_[i];
+  }
+  // Background work can never have every worker, so interactive work always
+  // has somewhere to run. Likewise, if background work is waiting and none is
+  // running, keep a worker back for it so that a source that is blocked
+  // waiting on its own indexing can't deadlock us.
+  NSUInteger interactiveLimit = workerCount;
+  if (backgroundQueued && !backgroundRunning) {
+    interactiveLimit = workerCount - 1;
+  }
+  NSUInteger backgroundLimit = workerCount - 1;
+  for (NSUInteger i = 0; i < eHGSOperationLaneCount; ++i) {
+    if (!queuedCount_[i]) continue;
+    if (i == eHGSOperationLaneInteractive) {
+      if (runningCount_[i] >= interactiveLimit) continue;
+    } else if (backgroundRunning >= backgroundLimit) {
+      continue;
+    }
+    --queuedCount_[i];
+    ++runningCount_[i];
+    *lane = i;
+    return YES;
+  }
+  return NO;
+}
+
+// |addCount| is the value of addCount_ when the lane was reserved.
+- (NSOperation *)takeOperationInLane:(HGSOperationLane)lane
+                           forWorker:(HGSOperationQueueWorker *)worker
+                            addCount:(NSUInteger)addCount {
+  NSUInteger count = [workers_ count];
+  NSUInteger start = [workers_ indexOfObjectIdenticalTo:worker];
+  NSOperation *operation = nil;
+  while (YES) {
+    operation = [urgentOperations_ popOperationInLane:lane];
+    if (!operation) {
+      operation = [worker popOperationInLane:lane];
+    }
+    for (NSUInteger i = 1; i <= count && !operation; ++i) {
+      HGSOperationQueueWorker *victim
+        = [workers_ objectAtIndex:(start + i) % count];
+      operation = [victim stealOperationInLane:lane];
+    }
+    if (operation) break;
+    // We have a reservation, so there is an operation for us, but another
+    // worker can take the one we would have found and leave us one that is
+    // only pushed into a deque we have already looked in. That push is
+    // followed by an add being counted, so sleep until then rather than
+    // spinning on the deque locks.
+    [condition_ lock];
+    while (addCount_ == addCount) {
+      [condition_ wait];
+    }
+    addCount = addCount_;
+    [condition_ unlock];
+  }
+  return operation;
+}
+
+- (void)runWorker:(HGSOperationQueueWorker *)worker {
+  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
+  NSThread *thread = [NSThread currentThread];
+  [[thread threadDictionary] setObject:worker
+                                forKey:kHGSOperationQueueWorkerKey];
+  NSUInteger workerIndex = [workers_ indexOfObjectIdenticalTo:worker];
+  [thread setName:[NSString stringWithFormat:@"HGSOperationQueue worker %u",
+                   workerIndex]];
+  double defaultPriority = [NSThread threadPriority];
+  while (YES) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    HGSOperationLane lane = eHGSOperationLaneInteractive;
+    [condition_ lock];
+    while (![self reserveLane:&lane]) {
+      [condition_ wait];
+    }
+    NSUInteger addCount = addCount_;
+    [condition_ unlock];
+    NSOperation *operation = [self takeOperationInLane:lane
+                                             forWorker:worker
+                                              addCount:addCount];
+    // Cancelled operations still have to be started so that they get
+    // marked as finished, but they don't run their main.
+    BOOL lowerPriority = (lane == eHGSOperationLaneIndexing
+                          || lane == eHGSOperationLaneSpeculative);
+    if (![operation isCancelled]) {
+      [worker setCurrentOperation:operation];
+      if (lowerPriority) {
+        [NSThread setThreadPriority:kHGSOperationQueueBackgroundThreadPriority];
+      }
+    }
+    @try {
+      [operation start];
+    }
+    @catch(NSException *e) {
+      HGSLog(@"Exception %@ thrown in operation: %@", e, operation);
+    }
+    @catch(...) {
+      HGSLog(@"Unknown Exception thrown in operation: %@", operation);
+      // Do not rethrow exceptions.
+    }
+    if (lowerPriority) {
+      [NSThread setThreadPriority:defaultPriority];
+    }
+    [worker setCurrentOperation:nil];
+    [condition_ lock];
+    --runningCount_[lane];
+    --outstandingCount_;
+    [condition_ broadcast];
+    [condition_ unlock];
+    [pool release];
+  }
+  [outerPool release];
+}
+
 @end
@@ -33,6 +33,7 @@
 #import <Foundation/Foundation.h>
 #import "GTMSenTestCase.h"
 #import "HGSOperation.h"
+#import <libkern/OSAtomic.h>
 #import <GData/GDataHTTPFetcher.h>
 
 static const useconds_t kNetworkOperationLength = 500000; // microseconds
@@ -119,7 +120,7 @@ static NSString * const kGoogleNonExistentUrl = @"http://sgdfgsdfsewfgsd.corp.go
 }
 
 - (void)testNetworkOperations {
-  NSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
   NSCondition *condition = [[[NSCondition alloc] init] autorelease];
 
   // Request Google's home page
@@ -188,3 +189,83 @@ static NSString * const kGoogleNonExistentUrl = @"http://sgdfgsdfsewfgsd.corp.go
 // TODO(dmaclach): Flesh this out.
 @end
 
+
+@interface HGSOperationQueueTest : GTMTestCase {
+ @private
+  int32_t runCount_;
+}
+@end
+
+@implementation HGSOperationQueueTest
+
+- (void)countOperation:(id)ignored operation:(NSOperation *)operation {
+  OSAtomicIncrement32Barrier(&runCount_);
+}
+
+- (void)spawnOperation:(id)ignored operation:(NSOperation *)operation {
+  // Operations added from a worker go on that worker's own deque.
+  NSOperation *op
+    = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                             selector:@selector(countOperation:operation:)
+                                               object:nil] autorelease];
+  [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+  OSAtomicIncrement32Barrier(&runCount_);
+}
+
+- (void)testLanes {
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  STAssertNotNil(queue, nil);
+  const int32_t kOperationsPerLane = 50;
+  for (int32_t i = 0; i < kOperationsPerLane; ++i) {
+    for (NSUInteger lane = 0; lane < eHGSOperationLaneCount; ++lane) {
+      NSOperation *op
+        = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                                 selector:@selector(countOperation:operation:)
+                                                   object:nil] autorelease];
+      if (i % 2) {
+        [op setQueuePriority:NSOperationQueuePriorityVeryHigh];
+      }
+      [queue addOperation:op lane:lane];
+    }
+  }
+  [queue waitUntilAllOperationsAreFinished];
+  STAssertEquals(runCount_, kOperationsPerLane * (int32_t)eHGSOperationLaneCount,
+                 nil);
+  STAssertEquals([queue operationCount], (NSUInteger)0, nil);
+}
+
+- (void)testSpawnedOperations {
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  NSOperation *op
+    = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                             selector:@selector(spawnOperation:operation:)
+                                               object:nil] autorelease];
+  [queue addOperation:op];
+  // The spawned operation may not have been added when the first wait
+  // returns, so wait until both have run.
+  while (runCount_ < 2) {
+    [queue waitUntilAllOperationsAreFinished];
+  }
+  STAssertEquals(runCount_, (int32_t)2, nil);
+}
+
+- (void)testCancelledOperations {
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  NSMutableArray *ops = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 20; ++i) {
+    NSOperation *op
+      = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                               selector:@selector(countOperation:operation:)
+                                                 object:nil] autorelease];
+    [op cancel];
+    [ops addObject:op];
+    [queue addOperation:op lane:eHGSOperationLaneIndexing];
+  }
+  [queue waitUntilAllOperationsAreFinished];
+  STAssertEquals(runCount_, (int32_t)0, nil);
+  for (NSOperation *op in ops) {
+    STAssertTrue([op isFinished], nil);
+  }
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  HGSPerformanceCounters.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import <Foundation/Foundation.h>
+#import <GTM/GTMDefines.h>
+
+/*!
+ @header
+ @discussion HGSPerformanceCounters
+
+ Always-on counters for the health of the search machinery: how many queries
+ are run, how quickly they show their first results, how well the caches
+ are doing, how big the in-memory indexes are and how much work is thrown
+ away by cancellation.
+
+ Each thread adds into its own block of counters, so counting is a plain
+ add with no locks or atomics. The blocks are only summed when somebody
+ asks for a value or a snapshot, which is expected to be at most a few
+ times a second. Blocks of threads that exit are folded into a shared total.
+ Values read while other threads are counting may be a count or two behind.
+*/
+
+/*!
+ The counters. Counters only ever grow, except for
+ eHGSMemoryIndexEntryCounter which is a level.
+*/
+enum {
+  /*! Queries started by HGSQueryController. */
+  eHGSQueryCounter = 0,
+  /*! Queries that reported results. */
+  eHGSFirstResultCounter,
+  /*! Total time from query start to first results, in nanoseconds. */
+  eHGSFirstResultNanosecondsCounter,
+  eHGSLRUCacheHitCounter,
+  eHGSLRUCacheMissCounter,
+  eHGSSQLiteCacheHitCounter,
+  eHGSSQLiteCacheMissCounter,
+  eHGSIconCacheHitCounter,
+  eHGSIconCacheMissCounter,
+  /*! Entries currently held by HGSMemorySearchSource indexes. */
+  eHGSMemoryIndexEntryCounter,
+  /*! Search operations that started running. */
+  eHGSOperationStartedCounter,
+  /*! Search operations that finished after being cancelled. */
+  eHGSOperationCancelledCounter,
+  /*! Time spent running operations that were cancelled, in nanoseconds. */
+  eHGSCancelledWorkNanosecondsCounter,
+  eHGSPerformanceCounterCount
+};
+typedef NSUInteger HGSPerformanceCounter;
+
+/*!
+ NSDate. When the snapshot was taken.
+*/
+#define kHGSPerformanceCountersDateKey @"Date"
+/*!
+ NSDictionary of counter name (see HGSPerformanceCounterName) to NSNumber.
+*/
+#define kHGSPerformanceCountersValuesKey @"Values"
+/*!
+ NSNumber. Median time to first results of recent queries, in nanoseconds.
+*/
+#define kHGSPerformanceCountersFirstResultP50Key @"FirstResultP50"
+/*!
+ NSNumber. 99th percentile time to first results of recent queries, in
+ nanoseconds.
+*/
+#define kHGSPerformanceCountersFirstResultP99Key @"FirstResultP99"
+/*!
+ NSNumber. Operations added to HGSOperationQueue that have not finished.
+*/
+#define kHGSPerformanceCountersQueueDepthKey @"OperationQueueDepth"
+
+/*!
+ Adds |delta| to |counter| for the current thread.
+*/
+GTM_EXTERN void HGSPerformanceCounterAdd(HGSPerformanceCounter counter,
+                                         int64_t delta);
+
+/*!
+ Records the time a query took to report its first results. Adds to
+ eHGSFirstResultCounter and eHGSFirstResultNanosecondsCounter and to the
+ histogram the snapshot percentiles come from.
+*/
+GTM_EXTERN void HGSPerformanceCountersRecordFirstResult(uint64_t nanoseconds);
+
+/*!
+ Returns the current value of |counter|, summed across all threads.
+*/
+GTM_EXTERN int64_t HGSPerformanceCounterValue(HGSPerformanceCounter counter);
+
+/*!
+ Returns a stable name for |counter|, used as its key in snapshots.
+*/
+GTM_EXTERN NSString *HGSPerformanceCounterName(HGSPerformanceCounter counter);
+
+/*!
+ Returns all of the counters, the recent first result percentiles and the
+ operation queue depth. See the kHGSPerformanceCounters*Key keys. Snapshots
+ are property lists, so they can be written out as they are. Rates such as
+ queries per second come from the difference between two snapshots.
+*/
+GTM_EXTERN NSDictionary *HGSPerformanceCountersSnapshot(void);
@@ -0,0 +1,195 @@
+//
+//  HGSPerformanceCounters.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "HGSPerformanceCounters.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import "HGSLatencyHistogram.h"
+#import "HGSLog.h"
+#import "HGSOperation.h"
+
+// One thread's counters. Only the owning thread writes |values|; anyone
+// holding gHGSPerformanceCountersLock may read them or walk the list.
+// |values| are only ever touched atomically, because the i386 and ppc
+// slices can't load or store 64 bits in one go, and a reader seeing half an
+// update to a nanosecond counter would be off by seconds.
+typedef struct HGSPerformanceCounterBlock {
+  volatile int64_t values[eHGSPerformanceCounterCount];
+  struct HGSPerformanceCounterBlock *next;
+} HGSPerformanceCounterBlock;
+
+static pthread_key_t gHGSPerformanceCountersKey;
+static pthread_once_t gHGSPerformanceCountersOnce = PTHREAD_ONCE_INIT;
+// Guards the block list, the retired totals and the histogram.
+static OSSpinLock gHGSPerformanceCountersLock = OS_SPINLOCK_INIT;
+static HGSPerformanceCounterBlock *gHGSPerformanceCounterBlocks = NULL;
+static int64_t gHGSPerformanceCountersRetired[eHGSPerformanceCounterCount];
+static HGSLatencyHistogram *gHGSPerformanceCountersFirstResults = nil;
+
+static inline int64_t HGSPerformanceCounterLoad(volatile int64_t *value) {
+  return OSAtomicAdd64(0, value);
+}
+
+static void HGSPerformanceCountersThreadExited(void *value) {
+  HGSPerformanceCounterBlock *block = value;
+  OSSpinLockLock(&gHGSPerformanceCountersLock);
+  HGSPerformanceCounterBlock **link = &gHGSPerformanceCounterBlocks;
+  while (*link && *link != block) {
+    link = &(*link)->next;
+  }
+  if (*link) {
+    *link = block->next;
+  }
+  for (NSUInteger i = 0; i < eHGSPerformanceCounterCount; ++i) {
+    gHGSPerformanceCountersRetired[i] 
+      += HGSPerformanceCounterLoad(&block->values[i]);
+  }
+  OSSpinLockUnlock(&gHGSPerformanceCountersLock);
+  free(block);
+}
+
+static void HGSPerformanceCountersInitialize(void) {
+  pthread_key_create(&gHGSPerformanceCountersKey,
+                     HGSPerformanceCountersThreadExited);
+  gHGSPerformanceCountersFirstResults = [[HGSLatencyHistogram alloc] init];
+}
+
+static HGSPerformanceCounterBlock *HGSPerformanceCountersCurrentBlock(void) {
+  pthread_once(&gHGSPerformanceCountersOnce, HGSPerformanceCountersInitialize);
+  HGSPerformanceCounterBlock *block 
+    = pthread_getspecific(gHGSPerformanceCountersKey);
+  if (!block) {
+    block = calloc(1, sizeof(HGSPerformanceCounterBlock));
+    if (!block) return NULL;
+    OSSpinLockLock(&gHGSPerformanceCountersLock);
+    block->next = gHGSPerformanceCounterBlocks;
+    gHGSPerformanceCounterBlocks = block;
+    OSSpinLockUnlock(&gHGSPerformanceCountersLock);
+    pthread_setspecific(gHGSPerformanceCountersKey, block);
+  }
+  return block;
+}
+
+// Must be called with gHGSPerformanceCountersLock held.
+static void HGSPerformanceCountersSumLocked(int64_t *values) {
+  for (NSUInteger i = 0; i < eHGSPerformanceCounterCount; ++i) {
+    values[i] = gHGSPerformanceCountersRetired[i];
+  }
+  for (HGSPerformanceCounterBlock *block = gHGSPerformanceCounterBlocks; 
+       block; 
+       block = block->next) {
+    for (NSUInteger i = 0; i < eHGSPerformanceCounterCount; ++i) {
+      values[i] += HGSPerformanceCounterLoad(&block->values[i]);
+    }
+  }
+}
+
+void HGSPerformanceCounterAdd(HGSPerformanceCounter counter, int64_t delta) {
+  HGSAssert(counter < eHGSPerformanceCounterCount, nil);
+  if (counter >= eHGSPerformanceCounterCount) return;
+  HGSPerformanceCounterBlock *block = HGSPerformanceCountersCurrentBlock();
+  if (block) {
+    OSAtomicAdd64(delta, &block->values[counter]);
+  }
+}
+
+void HGSPerformanceCountersRecordFirstResult(uint64_t nanoseconds) {
+  HGSPerformanceCounterAdd(eHGSFirstResultCounter, 1);
+  HGSPerformanceCounterAdd(eHGSFirstResultNanosecondsCounter, nanoseconds);
+  OSSpinLockLock(&gHGSPerformanceCountersLock);
+  [gHGSPerformanceCountersFirstResults recordValue:nanoseconds];
+  OSSpinLockUnlock(&gHGSPerformanceCountersLock);
+}
+
+int64_t HGSPerformanceCounterValue(HGSPerformanceCounter counter) {
+  HGSAssert(counter < eHGSPerformanceCounterCount, nil);
+  if (counter >= eHGSPerformanceCounterCount) return 0;
+  pthread_once(&gHGSPerformanceCountersOnce, HGSPerformanceCountersInitialize);
+  int64_t values[eHGSPerformanceCounterCount];
+  OSSpinLockLock(&gHGSPerformanceCountersLock);
+  HGSPerformanceCountersSumLocked(values);
+  OSSpinLockUnlock(&gHGSPerformanceCountersLock);
+  return values[counter];
+}
+
+NSString *HGSPerformanceCounterName(HGSPerformanceCounter counter) {
+  static NSString *const kNames[] = {
+    @"Queries",
+    @"FirstResults",
+    @"FirstResultNanoseconds",
+    @"LRUCacheHits",
+    @"LRUCacheMisses",
+    @"SQLiteCacheHits",
+    @"SQLiteCacheMisses",
+    @"IconCacheHits",
+    @"IconCacheMisses",
+    @"MemoryIndexEntries",
+    @"OperationsStarted",
+    @"OperationsCancelled",
+    @"CancelledWorkNanoseconds",
+  };
+  HGSAssert(sizeof(kNames) / sizeof(kNames[0]) == eHGSPerformanceCounterCount,
+            @"Every counter needs a name");
+  HGSAssert(counter < eHGSPerformanceCounterCount, nil);
+  return counter < eHGSPerformanceCounterCount ? kNames[counter] : nil;
+}
+
+NSDictionary *HGSPerformanceCountersSnapshot(void) {
+  pthread_once(&gHGSPerformanceCountersOnce, HGSPerformanceCountersInitialize);
+  int64_t values[eHGSPerformanceCounterCount];
+  OSSpinLockLock(&gHGSPerformanceCountersLock);
+  HGSPerformanceCountersSumLocked(values);
+  UInt64 p50 = [gHGSPerformanceCountersFirstResults valueAtPercentile:50];
+  UInt64 p99 = [gHGSPerformanceCountersFirstResults valueAtPercentile:99];
+  OSSpinLockUnlock(&gHGSPerformanceCountersLock);
+  
+  NSMutableDictionary *counters 
+    = [NSMutableDictionary dictionaryWithCapacity:eHGSPerformanceCounterCount];
+  for (NSUInteger i = 0; i < eHGSPerformanceCounterCount; ++i) {
+    [counters setObject:[NSNumber numberWithLongLong:values[i]]
+                 forKey:HGSPerformanceCounterName(i)];
+  }
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  NSUInteger queueDepth = [queue operationCount];
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSDate date], kHGSPerformanceCountersDateKey,
+          counters, kHGSPerformanceCountersValuesKey,
+          [NSNumber numberWithUnsignedLongLong:p50], 
+          kHGSPerformanceCountersFirstResultP50Key,
+          [NSNumber numberWithUnsignedLongLong:p99], 
+          kHGSPerformanceCountersFirstResultP99Key,
+          [NSNumber numberWithUnsignedInteger:queueDepth], 
+          kHGSPerformanceCountersQueueDepthKey,
+          nil];
+}
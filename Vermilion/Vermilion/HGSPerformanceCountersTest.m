@@ -0,0 +1,119 @@
+//
+//  HGSPerformanceCountersTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "GTMSenTestCase.h"
+#import "HGSPerformanceCounters.h"
+
+@interface HGSPerformanceCountersTest : GTMTestCase
+- (void)countOnThread:(NSNumber *)count;
+@end
+
+@implementation HGSPerformanceCountersTest
+
+- (void)countOnThread:(NSNumber *)count {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSUInteger i = 0; i < [count unsignedIntegerValue]; ++i) {
+    HGSPerformanceCounterAdd(eHGSIconCacheMissCounter, 1);
+  }
+  [pool release];
+}
+
+- (void)testNames {
+  NSMutableSet *names = [NSMutableSet set];
+  for (NSUInteger i = 0; i < eHGSPerformanceCounterCount; ++i) {
+    NSString *name = HGSPerformanceCounterName(i);
+    STAssertNotNil(name, @"Counter %u", i);
+    [names addObject:name];
+  }
+  STAssertEquals([names count], (NSUInteger)eHGSPerformanceCounterCount, nil);
+}
+
+- (void)testAdd {
+  int64_t start = HGSPerformanceCounterValue(eHGSLRUCacheHitCounter);
+  HGSPerformanceCounterAdd(eHGSLRUCacheHitCounter, 3);
+  HGSPerformanceCounterAdd(eHGSLRUCacheHitCounter, -1);
+  STAssertEquals(HGSPerformanceCounterValue(eHGSLRUCacheHitCounter), 
+                 start + 2, nil);
+}
+
+- (void)testThreads {
+  // Threads that have exited must still be counted.
+  int64_t start = HGSPerformanceCounterValue(eHGSIconCacheMissCounter);
+  NSUInteger threadCount = 4;
+  NSUInteger perThread = 1000;
+  NSMutableArray *threads = [NSMutableArray array];
+  for (NSUInteger i = 0; i < threadCount; ++i) {
+    NSThread *thread 
+      = [[[NSThread alloc] initWithTarget:self
+                                 selector:@selector(countOnThread:)
+                                   object:[NSNumber numberWithUnsignedInteger:
+                                           perThread]] autorelease];
+    [threads addObject:thread];
+    [thread start];
+  }
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+  for (NSThread *thread in threads) {
+    while (![thread isFinished] && [deadline timeIntervalSinceNow] > 0) {
+      [NSThread sleepForTimeInterval:0.01];
+    }
+    STAssertTrue([thread isFinished], nil);
+  }
+  STAssertEquals(HGSPerformanceCounterValue(eHGSIconCacheMissCounter),
+                 start + (int64_t)(threadCount * perThread), nil);
+}
+
+- (void)testSnapshot {
+  HGSPerformanceCountersRecordFirstResult(5000000);
+  NSDictionary *snapshot = HGSPerformanceCountersSnapshot();
+  STAssertNotNil([snapshot objectForKey:kHGSPerformanceCountersDateKey], nil);
+  STAssertNotNil([snapshot objectForKey:kHGSPerformanceCountersQueueDepthKey], 
+                 nil);
+  NSDictionary *values 
+    = [snapshot objectForKey:kHGSPerformanceCountersValuesKey];
+  STAssertEquals([values count], (NSUInteger)eHGSPerformanceCounterCount, nil);
+  NSString *name = HGSPerformanceCounterName(eHGSFirstResultCounter);
+  STAssertGreaterThan([[values objectForKey:name] longLongValue], 0LL, nil);
+  UInt64 p99 
+    = [[snapshot objectForKey:kHGSPerformanceCountersFirstResultP99Key] 
+       unsignedLongLongValue];
+  STAssertGreaterThan(p99, (UInt64)0, nil);
+  NSString *error = nil;
+  NSData *data 
+    = [NSPropertyListSerialization dataFromPropertyList:snapshot
+                                                 format:NSPropertyListXMLFormat_v1_0
+                                       errorDescription:&error];
+  STAssertNotNil(data, @"%@", error);
+}
+
+@end
@@ -37,7 +37,9 @@
 #import "HGSCoreExtensionPoints.h"
 #import "HGSDelegate.h"
 #import "HGSLog.h"
+#import "HGSDTrace.h"
 #import "HGSPlugin.h"
+#import "HGSStartupProfiler.h"
 
 @interface HGSPluginLoader()
 // Returns an array containing the full paths for all bundles
@@ -137,6 +139,7 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
 }
 
 - (void)loadPluginsWithErrors:(NSArray **)errors {
+  HGSStartupProfilerMark loadMark = HGSStartupProfilerBegin();
   NSArray *pluginPaths = [[self delegate] pluginFolders];
   NSMutableArray *allErrors = nil;
   NSMutableArray *sdefPaths = [NSMutableArray array];
@@ -168,18 +171,27 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
   //   4. Install all non-account type extensions.
   
   // Step 1: Install the account type extensions.
+  HGSStartupProfilerMark accountTypesMark = HGSStartupProfilerBegin();
   [factorablePlugins makeObjectsPerformSelector:@selector(installAccountTypes)];
+  HGSStartupProfilerEnd(accountTypesMark, kHGSStartupProfilerPhaseCategory,
+                        @"InstallAccountTypes");
   
   [self setPlugins:factorablePlugins];
   pluginsSDEFPaths_ = [sdefPaths retain];
+  HGSStartupProfilerEnd(loadMark, kHGSStartupProfilerPhaseCategory,
+                        @"LoadPlugins");
 }
 
 - (void)installAndEnablePluginsBasedOnPluginsState:(NSArray *)state {
   NSArray *plugins = [self plugins];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  HGSStartupProfilerMark installMark = HGSStartupProfilerBegin();
 
   // Step 3: Factor the new extensions now that we know all available accounts.
+  HGSStartupProfilerMark factorMark = HGSStartupProfilerBegin();
   [plugins makeObjectsPerformSelector:@selector(factorProtoExtensions)];
+  HGSStartupProfilerEnd(factorMark, kHGSStartupProfilerPhaseCategory,
+                        @"FactorExtensions");
   
   // Step 4: Go through our plugins and set enabled states based on what
   // the user has saved off in their prefs.
@@ -244,6 +256,8 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
       
     }
   }
+  HGSStartupProfilerEnd(installMark, kHGSStartupProfilerPhaseCategory,
+                        @"InstallPlugins");
   [nc postNotificationName:kHGSPluginLoaderDidInstallPluginsNotification 
                     object:self];
 }
@@ -291,14 +305,23 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
                     userInfo:nil];
     NSMutableArray *ourErrors = [NSMutableArray array];
     for (NSString *fullPath in bundlePaths) {
+      HGSStartupProfilerMark pluginMark = HGSStartupProfilerBegin();
+      if (VERMILION_PLUGIN_LOAD_START_ENABLED()) {
+        VERMILION_PLUGIN_LOAD_START((char *)[fullPath fileSystemRepresentation]);
+      }
       NSString *errorType = nil;
       NSString *extension = [fullPath pathExtension];
       Class pluginClass = [extensionMap_ objectForKey:extension];
       NSString *pluginName = [fullPath lastPathComponent];
+      NSString *profileName = pluginName;
       HGSPlugin *plugin = nil;
       if (pluginClass) {
         fullPath = [fullPath stringByResolvingSymlinksAndAliases];
         NSBundle *pluginBundle = [NSBundle bundleWithPath:fullPath];
+        NSString *bundleIdentifier = [pluginBundle bundleIdentifier];
+        if (bundleIdentifier) {
+          profileName = bundleIdentifier;
+        }
         // Get the name.
         NSString *betterPluginName 
           = [pluginBundle objectForInfoDictionaryKey:@"CFBundleDisplayName"];
@@ -363,6 +386,12 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
       [nc postNotificationName:kHGSPluginLoaderDidLoadPluginNotification 
                         object:self 
                       userInfo:didLoadUserInfo];
+      if (VERMILION_PLUGIN_LOAD_FINISH_ENABLED()) {
+        VERMILION_PLUGIN_LOAD_FINISH((char *)[fullPath fileSystemRepresentation],
+                                     plugin ? 1 : 0);
+      }
+      HGSStartupProfilerEnd(pluginMark, kHGSStartupProfilerPluginCategory,
+                            profileName);
     }
     NSDictionary *didLoadsUserInfo = nil;
     if ([ourErrors count]) {
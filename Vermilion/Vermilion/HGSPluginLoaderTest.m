@@ -79,7 +79,7 @@
   return nil;
 }
 
-- (NSArray *)sourcesToRunOnMainThread {
+- (NSArray *)sourcesRequiringThreadAffinity {
   return nil;
 }
 
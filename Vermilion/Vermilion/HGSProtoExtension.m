@@ -39,6 +39,7 @@
 #import "HGSPlugin.h"
 #import "HGSPythonAction.h"
 #import "HGSPythonSource.h"
+#import "HGSStartupProfiler.h"
 
 @interface HGSProtoExtension ()
 
@@ -250,6 +251,7 @@
   }
   
   NSDate *startDate = [NSDate date];
+  HGSStartupProfilerMark profilerMark = HGSStartupProfilerBegin();
   NSBundle *bundle = [configuration_ objectForKey:kHGSExtensionBundleKey];
   HGSExtension *extension = nil;
   
@@ -262,6 +264,9 @@
       // bundle if it has no active sources/actions.
       if (![bundle load]) {
         HGSLog(@"Unable to load bundle %@", bundle);
+        HGSStartupProfilerEnd(profilerMark, 
+                              kHGSStartupProfilerExtensionCategory,
+                              [self identifier]);
         return;
       }
     }
@@ -311,6 +316,8 @@
     HGSLog(@"Unable to instantiate extension %@ in %@",
            className, bundle);
   }
+  HGSStartupProfilerEnd(profilerMark, kHGSStartupProfilerExtensionCategory,
+                        [self identifier]);
   NSTimeInterval loadTime = -[startDate timeIntervalSinceNow];
   if (loadTime > 0.1f) {
     HGSLogDebug(@"Loading %@ took %3.0fms", [self displayName], loadTime * 1000);
@@ -67,6 +67,7 @@ typedef NSUInteger HGSQueryFlags;
   HGSActionOperation *actionOperation_;
   HGSQuery *parent_;
   HGSQueryFlags flags_;
+  UInt64 generation_;
 }
 
 /*! 
@@ -103,6 +104,13 @@ typedef NSUInteger HGSQueryFlags;
 */
 @property (readonly, retain) HGSActionOperation *actionOperation;
 
+/*!
+ Every query is given a generation when it is created. Generations only ever
+ go up, so anything tagged with an older generation than the query a client
+ is currently showing is stale and can be dropped without looking at it.
+*/
+@property (readonly, assign) UInt64 generation;
+
 /*! 
  Designated Initializer.
 */
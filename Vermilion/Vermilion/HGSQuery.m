@@ -32,6 +32,9 @@
 
 #import "HGSQuery.h"
 #import "HGSTokenizer.h"
+#import <libkern/OSAtomic.h>
+
+static volatile int64_t gHGSQueryGeneration = 0;
 
 @implementation HGSQuery
 
@@ -40,6 +43,7 @@
 @synthesize actionArgument = actionArgument_;
 @synthesize flags = flags_;
 @synthesize actionOperation = actionOperation_;
+@synthesize generation = generation_;
 
 - (id)initWithTokenizedString:(HGSTokenizedString *)query 
                actionArgument:(HGSActionArgument *)actionArgument
@@ -51,6 +55,7 @@
     flags_ = flags;
     actionArgument_ = [actionArgument retain];
     actionOperation_ = [actionOperation retain];
+    generation_ = OSAtomicIncrement64Barrier(&gHGSQueryGeneration);
     
     // If we got nil for a query, but had a pivot, turn it into an empty query.
     if (!query && pivotObjects) {
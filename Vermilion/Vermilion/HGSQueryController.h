@@ -34,7 +34,9 @@
 #import <Foundation/Foundation.h>
 #import <GTM/GTMDefines.h>
 
+@class HGSCancellationToken;
 @class HGSQuery;
+@class HGSQueryResultCache;
 @class HGSTypeFilter;
 
 /*!
@@ -64,25 +66,133 @@
   __weak NSTimer* slowSourceTimer_;
   NSMutableDictionary *conformingResultsCache_;
   NSSet *emptySet_;
+  /*!
+   Operations that have updated their results since we last told our
+   observers. Updates are batched up and delivered together.
+  */
+  NSMutableSet *updatedQueryOperations_;
+  BOOL updateNotificationPending_;
+  HGSQueryResultCache *resultCache_;
+  /*!
+   Unfinished operations that we don't expect to make the first stage
+   deadline. The query is reported as finished without waiting for them.
+  */
+  NSMutableSet *lateQueryOperations_;
+  /*!
+   Sources that HGSSearchSourceRanker thinks aren't worth running for this
+   query unless the first wave comes up short or the user stops typing.
+  */
+  NSMutableArray *deferredSources_;
+  __weak NSTimer *secondWaveTimer_;
+  /*!
+   When each pending operation should be cancelled for taking too long, as
+   NSNumbers of NSTimeIntervals since the reference date, keyed by
+   NSValues of the operations. Until an operation starts this is the slow
+   source timeout from when it was queued. Once it starts, its source's own
+   timeout is measured from then, so time spent in the queue doesn't count
+   against it.
+  */
+  NSMutableDictionary *operationDeadlines_;
+  /*!
+   NSValues of the pending operations that have started running.
+  */
+  NSMutableSet *startedQueryOperations_;
+  /*!
+   NSValues of the pending operations that have been cancelled for taking
+   too long. An operation that ignores the cancel stays pending, and must not
+   be cancelled and reported to the ranker again.
+  */
+  NSMutableSet *timedOutQueryOperations_;
+  NSTimeInterval firstStageDeadline_;
+  BOOL didPostFinish_;
+  HGSCancellationToken *cancellationToken_;
+  /*!
+   When the query started, for HGSTracer. 0 if tracing was off.
+  */
+  uint64_t traceStartTime_;
+  /*!
+   When the query started, until it first tells observers about results.
+   For HGSPerformanceCounters.
+  */
+  uint64_t firstResultStartTime_;
 }
 
 - (id)initWithQuery:(HGSQuery*)query;
 
+/*!
+ Designated initializer.
+ @param query The query to run.
+ @param resultCache Results from earlier queries. Sources that have results in
+        the cache that can be refined for |query| will use them instead of
+        searching again, and results of this query will be added to the cache
+        as sources finish. Usually shared by all of the queries that a single
+        search field generates. May be nil.
+*/
+- (id)initWithQuery:(HGSQuery*)query
+        resultCache:(HGSQueryResultCache *)resultCache;
+
 - (HGSQuery *)query;
 
+/*!
+ The time, in seconds, that the client would like to have its first results
+ by. Sources whose history says they will take longer than this are run at a
+ lower priority after the other sources have been started, and the query is
+ reported as finished without waiting for them. If every source is expected
+ to be late none of them are treated as late. Must be set before startQuery.
+ Defaults to 0, which gives every source as long as it needs.
+*/
+@property (readwrite, assign) NSTimeInterval firstStageDeadline;
+
 /*!
   Ask information about the completion status for the queries to each source.
+  Sources that were judged to be late are not waited for.
 */
 - (BOOL)queriesFinished;
 
+/*!
+ Are any of the late sources still running, or are there deferred sources
+ that haven't been run yet. Late sources continue to update results after
+ kHGSQueryControllerDidFinishNotification has been sent.
+*/
+- (BOOL)hasLateQueryOperations;
+
+/*!
+ Number of search operations, across all query controllers, that have been
+ run as part of a second wave.
+*/
++ (UInt64)secondWaveOperationCount;
+
+/*!
+ Number of deferred sources, across all query controllers, that were never
+ run because their query was cancelled first.
+*/
++ (UInt64)skippedDeferredSourceCount;
+
 /*!
   Has the query been cancelled.
 */
 - (BOOL)isCancelled;
 
+/*!
+ The generation of the query. See -[HGSQuery generation].
+*/
+- (UInt64)generation;
+
+/*!
+ Cancelled when the query is cancelled. The cancellation tokens of all of the
+ query's search operations are children of it, so cancelling the query stops
+ them all at once.
+*/
+- (HGSCancellationToken *)cancellationToken;
+
 /*!
   Start the query by creating a HGSSearchOperation for each search source.
   These hide whether or not they are threaded.
+ 
+  Sources that HGSSearchSourceRanker decides to defer are held back to a
+  second wave. The second wave runs, as late operations, if the first wave
+  finishes with too few results or if the query hasn't been cancelled after
+  a short delay (i.e. the user has stopped typing).
 */
 - (void)startQuery;
   
@@ -112,6 +222,8 @@
 
 /*!
   Sent when the query will start.  Object is the QueryController.
+  All of the query controller notifications have
+  kHGSQueryControllerGenerationKey in their userInfo.
 */
 GTM_EXTERN NSString *const kHGSQueryControllerWillStartNotification;
 
@@ -122,7 +234,29 @@ GTM_EXTERN NSString *const kHGSQueryControllerWillStartNotification;
 */
 GTM_EXTERN NSString *const kHGSQueryControllerDidFinishNotification;
 
+/*!
+ Sent when the last of the late sources has completed, after
+ kHGSQueryControllerDidFinishNotification. Only sent if late sources were
+ still running when the query finished. Object is the QueryController.
+*/
+GTM_EXTERN NSString *const kHGSQueryControllerLateOperationsDidFinishNotification;
+
 /*!
  Sent when there are new results available. Object is the QueryController.
+ Updates from operations arriving close together are coalesced into a single
+ notification, delivered on a frame boundary.
+ UserInfo contains kHGSQueryControllerUpdatedOperationsKey.
 */
 GTM_EXTERN NSString *const kHGSQueryControllerDidUpdateResultsNotification;
+
+/*!
+ Key for the NSSet of HGSSearchOperations whose results changed since the
+ last kHGSQueryControllerDidUpdateResultsNotification.
+*/
+GTM_EXTERN NSString *const kHGSQueryControllerUpdatedOperationsKey;
+
+/*!
+ Key for an NSNumber (unsigned long long) holding the generation of the query
+ that a notification is about.
+*/
+GTM_EXTERN NSString *const kHGSQueryControllerGenerationKey;
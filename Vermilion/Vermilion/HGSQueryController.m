@@ -31,7 +31,10 @@
 //
 
 #import "HGSQueryController.h"
+#import "HGSAffinityExecutor.h"
+#import "HGSCancellationToken.h"
 #import "HGSQuery.h"
+#import "HGSQueryResultCache.h"
 #import "HGSResult.h"
 #import "HGSAction.h"
 #import "HGSSearchSource.h"
@@ -42,22 +45,38 @@
 #import "HGSLog.h"
 #import "HGSTypeFilter.h"
 #import "HGSDTrace.h"
+#import "HGSTracer.h"
+#import "HGSPerformanceCounters.h"
 #import "HGSOperation.h"
-#import "HGSMemorySearchSource.h"
-#import "HGSBundle.h"
 #import "HGSTokenizer.h"
 #import "HGSPluginLoader.h"
 #import "HGSDelegate.h"
+#import <libkern/OSAtomic.h>
 #import <mach/mach_time.h>
 
 NSString *const kHGSQueryControllerWillStartNotification
   = @"HGSQueryControllerWillStartNotification";
 NSString *const kHGSQueryControllerDidFinishNotification
   = @"HGSQueryControllerDidFinishNotification";
+NSString *const kHGSQueryControllerLateOperationsDidFinishNotification
+  = @"HGSQueryControllerLateOperationsDidFinishNotification";
 NSString *const kHGSQueryControllerDidUpdateResultsNotification
   = @"HGSQueryControllerDidUpdateResultsNotification";
 
+NSString *const kHGSQueryControllerUpdatedOperationsKey
+  = @"HGSQueryControllerUpdatedOperationsKey";
+NSString *const kHGSQueryControllerGenerationKey
+  = @"HGSQueryControllerGenerationKey";
+
 NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
+NSString *const kQueryUpdateCoalescingIntervalPrefKey
+  = @"queryUpdateCoalescingInterval";
+NSString *const kQuerySecondWaveDelayPrefKey = @"querySecondWaveDelay";
+NSString *const kQuerySecondWaveResultThresholdPrefKey
+  = @"querySecondWaveResultThreshold";
+
+static volatile int64_t gHGSSecondWaveOperationCount = 0;
+static volatile int64_t gHGSSkippedDeferredSourceCount = 0;
 
 // These are stored in an NSDictionary keyed by HGSTypeFilters.
 // There is one per type filter.
@@ -76,33 +95,72 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 @end
 
 @interface HGSQueryController()
+- (void)addSearchOperation:(HGSSearchOperation *)operation;
+- (void)setDeadlinesForOperations:(NSArray *)operations;
+- (void)setDeadline:(NSTimeInterval)deadline
+       forOperation:(HGSSearchOperation *)operation;
+- (void)startSlowSourceTimer;
 - (void)cancelPendingSearchOperations:(NSTimer*)timer;
 - (void)invalidateSlowSourceTimer;
+- (void)secondWaveTimerFired:(NSTimer *)timer;
+- (void)invalidateSecondWaveTimer;
+- (void)runSecondWaveIfFirstWaveCameUpShort;
+- (void)runSecondWave;
 - (void)searchOperationWillStart:(NSNotification *)notification;
 - (void)searchOperationDidFinish:(NSNotification *)notification;
 - (void)searchOperationDidUpdateResults:(NSNotification *)notification;
+- (void)scheduleUpdateNotification;
+- (void)postUpdateNotification;
+- (void)cancelUpdateNotification;
+- (void)markLateOperationsExcluding:(NSArray *)excludedOperations;
+- (void)postDidFinishNotification;
+- (NSDictionary *)notificationUserInfo;
 @end
 
 @implementation HGSQueryController
 
+@synthesize firstStageDeadline = firstStageDeadline_;
+
 + (void)initialize {
   if (self == [HGSQueryController class]) {
+    // Default update interval is one display frame at 60Hz.
     NSDictionary *defaultsDict
-      = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:60.0]
-                                    forKey:kQuerySlowSourceTimeoutSecondsPrefKey];
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble:60.0],
+         kQuerySlowSourceTimeoutSecondsPrefKey,
+         [NSNumber numberWithDouble:1.0 / 60.0],
+         kQueryUpdateCoalescingIntervalPrefKey,
+         [NSNumber numberWithDouble:0.4],
+         kQuerySecondWaveDelayPrefKey,
+         [NSNumber numberWithInt:5],
+         kQuerySecondWaveResultThresholdPrefKey,
+         nil];
     NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
     [sd registerDefaults:defaultsDict];
   }
 }
 
 - (id)initWithQuery:(HGSQuery*)query {
+  return [self initWithQuery:query resultCache:nil];
+}
+
+- (id)initWithQuery:(HGSQuery*)query
+        resultCache:(HGSQueryResultCache *)resultCache {
   if ((self = [super init])) {
+    resultCache_ = [resultCache retain];
     queryOperations_ = [[NSMutableArray alloc] init];
     pendingQueryOperations_ = [[NSMutableArray alloc] init];
     queryOperationsWithResults_ = [[NSMutableSet alloc] init];
     parsedQuery_ = [query retain];
     conformingResultsCache_ = [[NSMutableDictionary alloc] init];
     emptySet_ = [[NSSet alloc] init];
+    updatedQueryOperations_ = [[NSMutableSet alloc] init];
+    lateQueryOperations_ = [[NSMutableSet alloc] init];
+    deferredSources_ = [[NSMutableArray alloc] init];
+    operationDeadlines_ = [[NSMutableDictionary alloc] init];
+    startedQueryOperations_ = [[NSMutableSet alloc] init];
+    timedOutQueryOperations_ = [[NSMutableSet alloc] init];
+    cancellationToken_ = [[HGSCancellationToken alloc] init];
   }
   return self;
 }
@@ -117,77 +175,303 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
   [pendingQueryOperations_ release];
   [queryOperationsWithResults_ release];
   [emptySet_ release];
+  [updatedQueryOperations_ release];
+  [resultCache_ release];
+  [lateQueryOperations_ release];
+  [deferredSources_ release];
+  [operationDeadlines_ release];
+  [startedQueryOperations_ release];
+  [timedOutQueryOperations_ release];
+  [cancellationToken_ release];
   [super dealloc];
 }
 
 - (void)startQuery {
   // Spin through the Sources checking to see if they are valid for the source
   // and kick off the SearchOperations.
+  traceStartTime_ = HGSTracerTimestamp();
+  firstResultStartTime_ = mach_absolute_time();
+  HGSPerformanceCounterAdd(eHGSQueryCounter, 1);
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-  [nc postNotificationName:kHGSQueryControllerWillStartNotification object:self];
+  [nc postNotificationName:kHGSQueryControllerWillStartNotification
+                    object:self
+                  userInfo:[self notificationUserInfo]];
   HGSSearchSourceRanker *sourceRanker
     = [HGSSearchSourceRanker sharedSearchSourceRanker];
   for (HGSSearchSource *source in [sourceRanker orderedSourcesByPerformance]) {
     // Check if the source likes the query string
     if ([source isValidSourceForQuery:parsedQuery_]) {
-      HGSSearchOperation* operation;
-      operation = [source searchOperationForQuery:parsedQuery_];
-      if (operation) {
-        [nc addObserver:self
-               selector:@selector(searchOperationWillStart:)
-                   name:kHGSSearchOperationWillStartNotification
-                 object:operation];
-        [nc addObserver:self
-               selector:@selector(searchOperationDidFinish:)
-                   name:kHGSSearchOperationDidFinishNotification
-                 object:operation];
-        [nc addObserver:self
-               selector:@selector(searchOperationDidUpdateResults:)
-                   name:kHGSSearchOperationDidUpdateResultsNotification
-                 object:operation];
-        [queryOperations_ addObject:operation];
-        [pendingQueryOperations_ addObject:operation];
+      // Reuse the results of an earlier query if the source lets us.
+      HGSSearchOperation* operation
+        = [resultCache_ searchOperationForSource:source query:parsedQuery_];
+      if (!operation) {
+        // Expensive sources that rarely give us anything that gets used for
+        // this kind of query wait for the second wave.
+        if ([sourceRanker shouldDeferSource:source forQuery:parsedQuery_]) {
+          [deferredSources_ addObject:source];
+          continue;
+        }
+        operation = [source searchOperationForQuery:parsedQuery_];
       }
+      [self addSearchOperation:operation];
     }
   }
-  NSArray *sourceIdentifiersToRunOnMainThread 
-    = [[[HGSPluginLoader sharedPluginLoader] delegate] sourcesToRunOnMainThread];
-  NSUInteger sourceCount = [sourceIdentifiersToRunOnMainThread count];
-  NSMutableArray *operationsToRunOnMainThread 
+  // If everybody is deferred, nobody is.
+  if ([queryOperations_ count] == 0 && [deferredSources_ count]) {
+    for (HGSSearchSource *source in deferredSources_) {
+      [self addSearchOperation:[source searchOperationForQuery:parsedQuery_]];
+    }
+    [deferredSources_ removeAllObjects];
+  }
+  NSArray *sourceIdentifiersRequiringThreadAffinity
+    = [[[HGSPluginLoader sharedPluginLoader] delegate]
+       sourcesRequiringThreadAffinity];
+  NSUInteger sourceCount = [sourceIdentifiersRequiringThreadAffinity count];
+  NSMutableArray *operationsRequiringThreadAffinity
     = [NSMutableArray arrayWithCapacity:sourceCount];
   for (HGSSearchOperation *operation in queryOperations_) {
     NSString *identifier = [[operation source] identifier];
-    if ([sourceIdentifiersToRunOnMainThread containsObject:identifier]) {
-      [operationsToRunOnMainThread addObject:operation];
-    } else {
+    if ([sourceIdentifiersRequiringThreadAffinity containsObject:identifier]) {
+      [operationsRequiringThreadAffinity addObject:operation];
+    }
+  }
+  // Work out who is going to be late before anything runs, because fast
+  // operations can finish before we get to the end of this method.
+  [self markLateOperationsExcluding:operationsRequiringThreadAffinity];
+  NSMutableArray *lateOperations
+    = [NSMutableArray arrayWithCapacity:[lateQueryOperations_ count]];
+  for (HGSSearchOperation *operation in queryOperations_) {
+    if ([lateQueryOperations_ containsObject:operation]) {
+      [lateOperations addObject:operation];
+    } else if (![operationsRequiringThreadAffinity containsObject:operation]) {
       [operation runOnCurrentThread:NO];
     }
   }
-  for (HGSSearchOperation *operation in operationsToRunOnMainThread) {
-    [operation runOnCurrentThread:YES];
+  // Late operations go to the back of the queue so that they don't hold up
+  // the sources that can make the deadline.
+  for (HGSSearchOperation *operation in lateOperations) {
+    [operation runWithQueuePriority:NSOperationQueuePriorityLow];
+  }
+  // Sources that need thread affinity each have a serial executor of their
+  // own, which keeps them off both the main thread and the shared queue.
+  for (HGSSearchOperation *operation in operationsRequiringThreadAffinity) {
+    NSString *identifier = [[operation source] identifier];
+    HGSAffinityExecutor *executor
+      = [HGSAffinityExecutor executorWithIdentifier:identifier];
+    [operation runOnAffinityExecutor:executor];
   }
   // Normally we inform the observer that we are done when the last source
   // reports in; if we don't have any sources that will never happen, so just
   // call the query done immediately.
   if ([queryOperations_ count] == 0) {
-    [nc postNotificationName:kHGSQueryControllerDidFinishNotification
-                      object:self];
-  } else {
+    [self postDidFinishNotification];
+  } else if ([pendingQueryOperations_ count]) {
     // we kick off a timer to pull the plug on any really slow sources.
+    [self setDeadlinesForOperations:queryOperations_];
+    [self startSlowSourceTimer];
+  }
+  // If we are still around after a short while the user has stopped typing,
+  // so it's worth running the deferred sources.
+  if ([deferredSources_ count] && !cancelled_ && !secondWaveTimer_) {
     NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
-    NSTimeInterval slowSourceTimeout
-      = [sd doubleForKey:kQuerySlowSourceTimeoutSecondsPrefKey];
-    HGSAssert(!slowSourceTimer_,
-              @"We shouldn't start a timer without it having been invalidated");
-    slowSourceTimer_
-      = [NSTimer scheduledTimerWithTimeInterval:slowSourceTimeout
+    NSTimeInterval delay = [sd doubleForKey:kQuerySecondWaveDelayPrefKey];
+    secondWaveTimer_
+      = [NSTimer scheduledTimerWithTimeInterval:delay
                                          target:self
-                                       selector:@selector(cancelPendingSearchOperations:)
+                                       selector:@selector(secondWaveTimerFired:)
                                        userInfo:nil
                                         repeats:NO];
   }
 }
 
+- (void)addSearchOperation:(HGSSearchOperation *)operation {
+  if (!operation) return;
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(searchOperationWillStart:)
+             name:kHGSSearchOperationWillStartNotification
+           object:operation];
+  [nc addObserver:self
+         selector:@selector(searchOperationDidFinish:)
+             name:kHGSSearchOperationDidFinishNotification
+           object:operation];
+  [nc addObserver:self
+         selector:@selector(searchOperationDidUpdateResults:)
+             name:kHGSSearchOperationDidUpdateResultsNotification
+           object:operation];
+  [cancellationToken_ addChildToken:[operation cancellationToken]];
+  [queryOperations_ addObject:operation];
+  [pendingQueryOperations_ addObject:operation];
+}
+
+// Every source gets the slow source timeout at most, counting from when it
+// was queued. Sources with enough history also get a timeout based on how
+// long they usually take, so that one that has hung is noticed long before
+// the slow source timeout. That one only starts counting once the operation
+// is running (see -searchOperationWillStart:), so that a backed up queue
+// doesn't cancel sources before they have had a chance to run.
+- (void)setDeadlinesForOperations:(NSArray *)operations {
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSTimeInterval slowSourceTimeout
+    = [sd doubleForKey:kQuerySlowSourceTimeoutSecondsPrefKey];
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  for (HGSSearchOperation *operation in operations) {
+    [self setDeadline:now + slowSourceTimeout forOperation:operation];
+  }
+}
+
+// Sets |operation|'s deadline to |deadline| unless it already has an
+// earlier one.
+- (void)setDeadline:(NSTimeInterval)deadline
+       forOperation:(HGSSearchOperation *)operation {
+  NSValue *key = [NSValue valueWithNonretainedObject:operation];
+  NSNumber *current = [operationDeadlines_ objectForKey:key];
+  if (!current || deadline < [current doubleValue]) {
+    [operationDeadlines_ setObject:[NSNumber numberWithDouble:deadline]
+                            forKey:key];
+  }
+}
+
+// Schedules the slow source timer for the earliest deadline of the pending
+// operations.
+- (void)startSlowSourceTimer {
+  HGSAssert(!slowSourceTimer_,
+            @"We shouldn't start a timer without it having been invalidated");
+  NSTimeInterval earliest = DBL_MAX;
+  for (HGSSearchOperation *operation in pendingQueryOperations_) {
+    NSValue *key = [NSValue valueWithNonretainedObject:operation];
+    NSNumber *deadline = [operationDeadlines_ objectForKey:key];
+    if (deadline) {
+      earliest = MIN(earliest, [deadline doubleValue]);
+    }
+  }
+  if (earliest == DBL_MAX) return;
+  NSTimeInterval interval
+    = MAX(earliest - [NSDate timeIntervalSinceReferenceDate], 0);
+  slowSourceTimer_
+    = [NSTimer scheduledTimerWithTimeInterval:interval
+                                       target:self
+                                     selector:@selector(cancelPendingSearchOperations:)
+                                     userInfo:nil
+                                      repeats:NO];
+}
+
+- (void)secondWaveTimerFired:(NSTimer *)timer {
+  [self invalidateSecondWaveTimer];
+  if ([deferredSources_ count]) {
+    HGSLogDebug(@"Query %@ still current after a pause. Running %lu deferred "
+                @"sources.", parsedQuery_, [deferredSources_ count]);
+    [self runSecondWave];
+  }
+}
+
+- (void)invalidateSecondWaveTimer {
+  // See invalidateSlowSourceTimer.
+  if (secondWaveTimer_) {
+    [[self retain] autorelease];
+    [secondWaveTimer_ invalidate];
+    secondWaveTimer_ = nil;
+  }
+}
+
+- (void)runSecondWaveIfFirstWaveCameUpShort {
+  if (![deferredSources_ count]) return;
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSInteger threshold
+    = [sd integerForKey:kQuerySecondWaveResultThresholdPrefKey];
+  HGSTypeFilter *allTypes = [HGSTypeFilter filterAllowingAllTypes];
+  NSUInteger resultCount = [self resultCountForFilter:allTypes];
+  if ((NSInteger)resultCount < threshold) {
+    HGSLogDebug(@"Query %@ only got %lu results from the first wave. Running "
+                @"%lu deferred sources.",
+                parsedQuery_, resultCount, [deferredSources_ count]);
+    [self runSecondWave];
+  }
+}
+
+- (void)runSecondWave {
+  [self invalidateSecondWaveTimer];
+  if (cancelled_) return;
+  NSArray *sources = [NSArray arrayWithArray:deferredSources_];
+  [deferredSources_ removeAllObjects];
+  NSMutableArray *operations
+    = [NSMutableArray arrayWithCapacity:[sources count]];
+  for (HGSSearchSource *source in sources) {
+    HGSSearchOperation *operation
+      = [source searchOperationForQuery:parsedQuery_];
+    if (operation) {
+      [self addSearchOperation:operation];
+      // The second wave never holds up the query finishing.
+      [lateQueryOperations_ addObject:operation];
+      [operations addObject:operation];
+    }
+  }
+  if (![operations count]) return;
+  OSAtomicAdd64Barrier([operations count], &gHGSSecondWaveOperationCount);
+  [self setDeadlinesForOperations:operations];
+  [self invalidateSlowSourceTimer];
+  [self startSlowSourceTimer];
+  NSArray *sourceIdentifiersRequiringThreadAffinity
+    = [[[HGSPluginLoader sharedPluginLoader] delegate]
+       sourcesRequiringThreadAffinity];
+  for (HGSSearchOperation *operation in operations) {
+    NSString *identifier = [[operation source] identifier];
+    if ([sourceIdentifiersRequiringThreadAffinity containsObject:identifier]) {
+      HGSAffinityExecutor *executor
+        = [HGSAffinityExecutor executorWithIdentifier:identifier];
+      [operation runOnAffinityExecutor:executor];
+    } else {
+      [operation runWithQueuePriority:NSOperationQueuePriorityLow];
+    }
+  }
+}
+
++ (UInt64)secondWaveOperationCount {
+  return gHGSSecondWaveOperationCount;
+}
+
++ (UInt64)skippedDeferredSourceCount {
+  return gHGSSkippedDeferredSourceCount;
+}
+
+- (void)markLateOperationsExcluding:(NSArray *)excludedOperations {
+  if (firstStageDeadline_ <= 0) return;
+  HGSSearchSourceRanker *sourceRanker
+    = [HGSSearchSourceRanker sharedSearchSourceRanker];
+  NSMutableArray *lateOperations = [NSMutableArray array];
+  for (HGSSearchOperation *operation in queryOperations_) {
+    // Sources with thread affinity have a thread to themselves, so there is
+    // nothing to gain by holding them back.
+    if ([excludedOperations containsObject:operation]) continue;
+    HGSSearchSource *source = [operation source];
+    NSTimeInterval expected = [sourceRanker expectedRunTimeForSource:source];
+    if (expected > firstStageDeadline_) {
+      HGSLogDebug(@"Source %@ expected to take %.3fs, deadline is %.3fs. "
+                  @"Running it late.",
+                  [source identifier], expected, firstStageDeadline_);
+      [lateOperations addObject:operation];
+    }
+  }
+  // If everybody is going to be late, nobody is.
+  if ([lateOperations count] < [queryOperations_ count]) {
+    [lateQueryOperations_ addObjectsFromArray:lateOperations];
+  }
+}
+
+- (void)postDidFinishNotification {
+  if (didPostFinish_) return;
+  didPostFinish_ = YES;
+  if (traceStartTime_) {
+    NSString *name = [[parsedQuery_ tokenizedQueryString] originalString];
+    HGSTracerRecordAsyncSpan(kHGSTracerQueryCategory, name, self,
+                             traceStartTime_, HGSTracerTimestamp());
+  }
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc postNotificationName:kHGSQueryControllerDidFinishNotification
+                    object:self
+                  userInfo:[self notificationUserInfo]];
+}
+
 - (void)invalidateSlowSourceTimer {
   // There are cases where slowSourceTimer_ is the last object holding
   // onto self. We don't want to disappear immediately when slowSourceTimer
@@ -202,15 +486,24 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 
 - (void)cancelPendingSearchOperations:(NSTimer*)timer {
   [self invalidateSlowSourceTimer];
-  if ([self queriesFinished]) return;
+  if ([pendingQueryOperations_ count] == 0) return;
 
   NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
   BOOL doLog = [sd boolForKey:kHGSValidateSearchSourceBehaviorsPrefKey];
+  NSTimeInterval slowSourceTimeout
+    = [sd doubleForKey:kQuerySlowSourceTimeoutSecondsPrefKey];
+  HGSSearchSourceRanker *sourceRanker
+    = [HGSSearchSourceRanker sharedSearchSourceRanker];
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
 
   // Loop back to front so we can remove things as we go
   for (NSUInteger idx = [pendingQueryOperations_ count]; idx > 0; --idx) {
     HGSSearchOperation *operation
       = [pendingQueryOperations_ objectAtIndex:(idx - 1)];
+    NSValue *key = [NSValue valueWithNonretainedObject:operation];
+    if ([timedOutQueryOperations_ containsObject:key]) continue;
+    NSNumber *deadline = [operationDeadlines_ objectForKey:key];
+    if (deadline && [deadline doubleValue] > now) continue;
 
     // If it thinks it's finished, but in our pending list, it means we have yet
     // to get our notification, so we won't cancel it since we should get that
@@ -220,8 +513,26 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
         HGSLog(@"Took too much time, canceling SearchOperation %@", operation);
       }
       [operation cancel];
+      [timedOutQueryOperations_ addObject:key];
+      // Let the ranker know, so that a source that has slowed down gets a
+      // longer timeout next time instead of being cancelled forever. It has
+      // been going for at least as long as its own timeout. Sources that hit
+      // the overall limit have nothing more to tell it.
+      // Operations that never got to run don't say anything about how long
+      // the source takes.
+      HGSSearchSource *source = [operation source];
+      NSTimeInterval sourceTimeout = [sourceRanker timeoutForSource:source];
+      if ([startedQueryOperations_ containsObject:key]
+          && sourceTimeout > 0 && sourceTimeout < slowSourceTimeout) {
+        NSTimeInterval overdue = deadline ? now - [deadline doubleValue] : 0;
+        [sourceRanker recordTimeoutOfSource:source
+                              afterInterval:sourceTimeout + overdue];
+      }
     }
+    [operationDeadlines_ removeObjectForKey:key];
   }
+  // Others may have later deadlines.
+  [self startSlowSourceTimer];
 }
 
 - (HGSQuery *)query {
@@ -230,23 +541,53 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 
 // stops the query
 - (void)cancel {
+  // Tell everything that is running to stop before we get into the
+  // comparatively slow business of unhooking and notifying.
+  [cancellationToken_ cancel];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   for (HGSSearchOperation* operation in queryOperations_) {
     [nc removeObserver:self name:nil object:operation];
     [operation cancel];
   }
   [self invalidateSlowSourceTimer];
+  [self invalidateSecondWaveTimer];
+  if ([deferredSources_ count]) {
+    OSAtomicAdd64Barrier([deferredSources_ count],
+                         &gHGSSkippedDeferredSourceCount);
+    [deferredSources_ removeAllObjects];
+  }
+  [self cancelUpdateNotification];
   cancelled_ = YES;
 }
 
 - (BOOL)queriesFinished {
-  return ([pendingQueryOperations_ count] == 0) ? YES : NO;
+  // Late operations are always a subset of the pending operations.
+  return ([pendingQueryOperations_ count] == [lateQueryOperations_ count]);
+}
+
+- (BOOL)hasLateQueryOperations {
+  return [lateQueryOperations_ count] > 0 || [deferredSources_ count] > 0;
 }
 
 - (BOOL)isCancelled {
   return cancelled_;
 }
 
+- (HGSCancellationToken *)cancellationToken {
+  return cancellationToken_;
+}
+
+- (UInt64)generation {
+  return [parsedQuery_ generation];
+}
+
+- (NSDictionary *)notificationUserInfo {
+  NSNumber *generation
+    = [NSNumber numberWithUnsignedLongLong:[parsedQuery_ generation]];
+  return [NSDictionary dictionaryWithObject:generation
+                                     forKey:kHGSQueryControllerGenerationKey];
+}
+
 - (NSUInteger)resultCountForFilter:(HGSTypeFilter *)typeFilter {
   NSUInteger count = 0;
   for(HGSSearchOperation *op in queryOperationsWithResults_) {
@@ -286,6 +627,10 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
         = [queryOperationsWithResults_ allObjects];
       NSUInteger opsCount = [queryOperationsWithResults count];
       NSUInteger *opsMaxIndexes = malloc(sizeof(NSUInteger) * opsCount);
+      uint64_t mergeStartTime = HGSTracerTimestamp();
+      if (VERMILION_MERGE_START_ENABLED()) {
+        VERMILION_MERGE_START((int)opsCount, (int)(maxRange - rankedCount));
+      }
       NSUInteger j = 0;
       for (HGSSearchOperation *op in queryOperationsWithResults) {
         HGSSearchSource *source = [op source];
@@ -360,6 +705,11 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
         }
       }
       free(opsMaxIndexes);
+      if (VERMILION_MERGE_FINISH_ENABLED()) {
+        VERMILION_MERGE_FINISH((int)rankedCount);
+      }
+      HGSTracerRecordSpan(kHGSTracerMergeCategory, @"Merge", 
+                          mergeStartTime, HGSTracerTimestamp());
     }
     if (range.location < rankedCount) {
       NSUInteger totalLength = rankedCount - range.location;
@@ -379,6 +729,24 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 
 - (void)searchOperationWillStart:(NSNotification *)notification {
   HGSSearchOperation *operation = [notification object];
+  if ([pendingQueryOperations_ containsObject:operation]) {
+    NSValue *key = [NSValue valueWithNonretainedObject:operation];
+    [startedQueryOperations_ addObject:key];
+    HGSSearchSourceRanker *sourceRanker
+      = [HGSSearchSourceRanker sharedSearchSourceRanker];
+    NSTimeInterval sourceTimeout
+      = [sourceRanker timeoutForSource:[operation source]];
+    if (sourceTimeout > 0) {
+      NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+      [self setDeadline:now + sourceTimeout forOperation:operation];
+      // The timer may now be due sooner. If there is no timer yet, the one
+      // startQuery is about to start will take this deadline into account.
+      if (slowSourceTimer_) {
+        [self invalidateSlowSourceTimer];
+        [self startSlowSourceTimer];
+      }
+    }
+  }
   if (VERMILION_SEARCH_START_ENABLED()) {
     HGSSearchSource *source = [operation source];
     HGSQuery *query = [operation query];
@@ -405,15 +773,39 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
             [operation description]);
 
   [pendingQueryOperations_ removeObject:operation];
+  NSValue *operationKey = [NSValue valueWithNonretainedObject:operation];
+  [operationDeadlines_ removeObjectForKey:operationKey];
+  [startedQueryOperations_ removeObject:operationKey];
+  [timedOutQueryOperations_ removeObject:operationKey];
+  BOOL wasLate = [lateQueryOperations_ containsObject:operation];
+  [lateQueryOperations_ removeObject:operation];
   HGSSearchSource *source = [operation source];
-
-  // If this is the last query operation to complete then report as overall
-  // query completion and cancel our timer.
-  if ([self queriesFinished]) {
+  [resultCache_ cacheResultsOfOperation:operation];
+
+  // If this is the last query operation that we are waiting on then report
+  // as overall query completion. The timer keeps running until the late
+  // operations are done as well.
+  if ([self queriesFinished] && !didPostFinish_) {
+    [self runSecondWaveIfFirstWaveCameUpShort];
+    if ([pendingQueryOperations_ count] == 0) {
+      [self invalidateSlowSourceTimer];
+    }
+    // Flush any batched updates so observers see them before the finish.
+    if (updateNotificationPending_) {
+      [self cancelUpdateNotification];
+      [self postUpdateNotification];
+    }
+    [self postDidFinishNotification];
+  } else if (wasLate && [pendingQueryOperations_ count] == 0) {
     [self invalidateSlowSourceTimer];
+    if (updateNotificationPending_) {
+      [self cancelUpdateNotification];
+      [self postUpdateNotification];
+    }
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-    [nc postNotificationName:kHGSQueryControllerDidFinishNotification
-                      object:self];
+    [nc postNotificationName:kHGSQueryControllerLateOperationsDidFinishNotification
+                      object:self
+                    userInfo:[self notificationUserInfo]];
   }
   if (VERMILION_SEARCH_FINISH_ENABLED()) {
     HGSQuery *query = [operation query];
@@ -428,19 +820,87 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 //
 // -searchOperationDidUpdateResults:
 //
-// Called when a source has added more results.
+// Called when a source has added more results. Rather than telling our
+// observers about every single update, we remember which operations changed
+// and tell them once per frame.
 //
 - (void)searchOperationDidUpdateResults:(NSNotification *)notification {
   HGSSearchOperation *operation = [notification object];
+  // Results from a query other than ours, or arriving after we have been
+  // cancelled, are stale. Drop them before invalidating anything.
+  if (cancelled_ || [operation generation] != [parsedQuery_ generation]) {
+    return;
+  }
   @synchronized (self) {
     [queryOperationsWithResults_ addObject:operation];
   }
   @synchronized (conformingResultsCache_) {
     [conformingResultsCache_ removeAllObjects];
   }
+  [updatedQueryOperations_ addObject:operation];
+  [self scheduleUpdateNotification];
+}
+
+- (void)scheduleUpdateNotification {
+  if (updateNotificationPending_ || cancelled_) return;
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSTimeInterval interval
+    = [sd doubleForKey:kQueryUpdateCoalescingIntervalPrefKey];
+  NSTimeInterval delay = 0;
+  if (interval > 0) {
+    // Align delivery with the next frame boundary so that all of the updates
+    // that land within a frame are seen by the UI at the same time.
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    delay = interval - fmod(now, interval);
+  }
+  updateNotificationPending_ = YES;
+  [self performSelector:@selector(postUpdateNotification)
+             withObject:nil
+             afterDelay:delay];
+}
+
+- (void)cancelUpdateNotification {
+  if (updateNotificationPending_) {
+    // The perform request retains us, so hang on until the end of the pool.
+    [[self retain] autorelease];
+    [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                             selector:@selector(postUpdateNotification)
+                                               object:nil];
+    updateNotificationPending_ = NO;
+  }
+}
+
+- (void)postUpdateNotification {
+  updateNotificationPending_ = NO;
+  if (cancelled_ || ![updatedQueryOperations_ count]) return;
+  if (firstResultStartTime_) {
+    // An update can just be a source saying that it found nothing, which
+    // doesn't put anything in front of the user.
+    HGSTypeFilter *allTypes = [HGSTypeFilter filterAllowingAllTypes];
+    for (HGSSearchOperation *operation in updatedQueryOperations_) {
+      if ([operation resultCountForFilter:allTypes]) {
+        uint64_t elapsed = mach_absolute_time() - firstResultStartTime_;
+        uint64_t nanoseconds = HGSMachTimeToNanoseconds(elapsed);
+        HGSPerformanceCountersRecordFirstResult(nanoseconds);
+        firstResultStartTime_ = 0;
+        break;
+      }
+    }
+  }
+  NSSet *updatedOperations
+    = [NSSet setWithSet:updatedQueryOperations_];
+  [updatedQueryOperations_ removeAllObjects];
+  NSNumber *generation
+    = [NSNumber numberWithUnsignedLongLong:[parsedQuery_ generation]];
+  NSDictionary *userInfo
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       updatedOperations, kHGSQueryControllerUpdatedOperationsKey,
+       generation, kHGSQueryControllerGenerationKey,
+       nil];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   [nc postNotificationName:kHGSQueryControllerDidUpdateResultsNotification
-                    object:self];
+                    object:self
+                  userInfo:userInfo];
 }
 
 @end
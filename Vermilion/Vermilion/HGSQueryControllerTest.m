@@ -33,9 +33,338 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSQueryController.h"
+#import "HGSCallbackSearchSource.h"
+#import "HGSCallbackSearchOperation.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSExtensionPoint.h"
+#import "HGSPerformanceCounters.h"
+#import "HGSQuery.h"
+#import "HGSResult.h"
+#import "HGSSearchTermScorer.h"
+#import "HGSTokenizer.h"
+#import "HGSType.h"
+#import "HGSTypeFilter.h"
 
-@interface HGSQueryControllerTest : GTMTestCase 
+static const NSUInteger kHGSQueryControllerTestKeystrokes = 1000;
+
+// Defined in HGSQueryController.m.
+extern NSString *const kQueryUpdateCoalescingIntervalPrefKey;
+
+// Returns five results for |name| from |source|.
+static NSArray *HGSQueryControllerTestResults(HGSSearchSource *source,
+                                              NSString *name) {
+  NSMutableArray *results = [NSMutableArray arrayWithCapacity:5];
+  for (NSUInteger i = 0; i < 5; ++i) {
+    NSString *uri
+      = [NSString stringWithFormat:@"test://%@/%lu", name, (unsigned long)i];
+    HGSScoredResult *result
+      = [HGSScoredResult resultWithURI:uri
+                                  name:name
+                                  type:kHGSTypeFile
+                                source:source
+                            attributes:nil
+                                 score:HGSCalibratedScore(kHGSCalibratedModerateScore)
+                                 flags:0
+                           matchedTerm:nil
+                        matchedIndexes:nil];
+    [results addObject:result];
+  }
+  return results;
+}
+
+@interface HGSQueryControllerTestSource : HGSCallbackSearchSource
+@end
+
+@implementation HGSQueryControllerTestSource
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  NSString *queryString
+    = [[[operation query] tokenizedQueryString] originalString];
+  [operation setRankedResults:HGSQueryControllerTestResults(self, queryString)];
+}
+
+- (BOOL)isSearchConcurrent {
+  return YES;
+}
+
+@end
+
+// A concurrent source that hangs on to its operation, so that the test can
+// deliver results and finish it whenever it wants to.
+@interface HGSQueryControllerHeldSource : HGSCallbackSearchSource {
+ @private
+  HGSCallbackSearchOperation *operation_;
+}
+- (HGSCallbackSearchOperation *)operation;
+@end
+
+@implementation HGSQueryControllerHeldSource
+
+- (void)dealloc {
+  [operation_ release];
+  [super dealloc];
+}
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  @synchronized(self) {
+    [operation_ autorelease];
+    operation_ = [operation retain];
+  }
+}
+
+- (HGSCallbackSearchOperation *)operation {
+  @synchronized(self) {
+    return [[operation_ retain] autorelease];
+  }
+  return nil;
+}
+
+- (BOOL)isSearchConcurrent {
+  return YES;
+}
+
+@end
+
+@interface HGSQueryControllerTest : GTMTestCase {
+ @private
+  HGSQueryController *currentController_;
+  NSUInteger updateCount_;
+  NSUInteger staleUpdateCount_;
+  NSUInteger updatesAtFinish_;
+  BOOL didFinish_;
+}
 @end
 
 @implementation HGSQueryControllerTest
+
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification {
+  NSNumber *generation
+    = [[notification userInfo] objectForKey:kHGSQueryControllerGenerationKey];
+  STAssertNotNil(generation, nil);
+  ++updateCount_;
+  if ([notification object] != currentController_
+      || [generation unsignedLongLongValue] != [currentController_ generation]) {
+    ++staleUpdateCount_;
+  }
+}
+
+- (void)queryControllerDidFinish:(NSNotification *)notification {
+  didFinish_ = YES;
+  updatesAtFinish_ = updateCount_;
+}
+
+// Delivers several batches of results within one coalescing window and
+// checks that observers hear about them once, and that a batch that is still
+// pending when the query finishes is posted before the finish.
+- (void)testUpdatesAreCoalesced {
+  // Touch the class so that its defaults are registered before ours.
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  [HGSQueryController class];
+  NSTimeInterval oldInterval
+    = [sd doubleForKey:kQueryUpdateCoalescingIntervalPrefKey];
+  NSDictionary *defaults
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:0.25]
+                                  forKey:kQueryUpdateCoalescingIntervalPrefKey];
+  [sd registerDefaults:defaults];
+
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundle, kHGSExtensionBundleKey,
+       @"com.google.qsb.querycontrollertest.heldsource",
+       kHGSExtensionIdentifierKey,
+       nil];
+  HGSQueryControllerHeldSource *source
+    = [[[HGSQueryControllerHeldSource alloc] initWithConfiguration:config]
+       autorelease];
+  STAssertNotNil(source, nil);
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertTrue([sourcesPoint extendWithObject:source], nil);
+
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"coalesce"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  currentController_ = [[HGSQueryController alloc] initWithQuery:query];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidUpdateResults:)
+             name:kHGSQueryControllerDidUpdateResultsNotification
+           object:currentController_];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidFinish:)
+             name:kHGSQueryControllerDidFinishNotification
+           object:currentController_];
+  [currentController_ startQuery];
+
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (![source operation] && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  HGSCallbackSearchOperation *operation = [source operation];
+  STAssertNotNil(operation, nil);
+  STAssertEquals(updateCount_, (NSUInteger)0, nil);
+
+  // Three batches in a row, all within the same window.
+  for (NSUInteger i = 0; i < 3; ++i) {
+    NSString *name = [NSString stringWithFormat:@"batch%lu", (unsigned long)i];
+    [operation setRankedResults:HGSQueryControllerTestResults(source, name)];
+  }
+  STAssertEquals(updateCount_, (NSUInteger)0, 
+                 @"Updates should wait for the end of the window");
+  [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.6]];
+  STAssertEquals(updateCount_, (NSUInteger)1, nil);
+  STAssertFalse(didFinish_, nil);
+
+  // One more batch, and then finish before its window is up.
+  [operation setRankedResults:HGSQueryControllerTestResults(source, @"last")];
+  [operation finishQuery];
+  timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (!didFinish_ && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertTrue(didFinish_, nil);
+  STAssertEquals(updatesAtFinish_, (NSUInteger)2,
+                 @"The pending update should be flushed before the finish");
+  [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.6]];
+  STAssertEquals(updateCount_, (NSUInteger)2, nil);
+  STAssertEquals(staleUpdateCount_, (NSUInteger)0, nil);
+
+  [nc removeObserver:self];
+  [currentController_ cancel];
+  [currentController_ release];
+  currentController_ = nil;
+  [sourcesPoint removeExtension:source];
+  defaults
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:oldInterval]
+                                  forKey:kQueryUpdateCoalescingIntervalPrefKey];
+  [sd registerDefaults:defaults];
+}
+
+// The time to the first result is only recorded once there is a result to
+// show, not when a source reports that it found nothing.
+- (void)testFirstResultNeedsResults {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundle, kHGSExtensionBundleKey,
+       @"com.google.qsb.querycontrollertest.firstresultsource",
+       kHGSExtensionIdentifierKey,
+       nil];
+  HGSQueryControllerHeldSource *source
+    = [[[HGSQueryControllerHeldSource alloc] initWithConfiguration:config]
+       autorelease];
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertTrue([sourcesPoint extendWithObject:source], nil);
+
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"first"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  currentController_ = [[HGSQueryController alloc] initWithQuery:query];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidUpdateResults:)
+             name:kHGSQueryControllerDidUpdateResultsNotification
+           object:currentController_];
+  [currentController_ startQuery];
+
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (![source operation] && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  HGSCallbackSearchOperation *operation = [source operation];
+  STAssertNotNil(operation, nil);
+
+  int64_t firstResults = HGSPerformanceCounterValue(eHGSFirstResultCounter);
+  // setRankedResults: drops empty results, so announce an update without
+  // any the way other kinds of operation can.
+  [operation postDidUpdateResultsNotification];
+  [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+  STAssertEquals(updateCount_, (NSUInteger)1, nil);
+  STAssertEquals(HGSPerformanceCounterValue(eHGSFirstResultCounter),
+                 firstResults, nil);
+  [operation setRankedResults:HGSQueryControllerTestResults(source, @"first")];
+  [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+  STAssertEquals(updateCount_, (NSUInteger)2, nil);
+  STAssertEquals(HGSPerformanceCounterValue(eHGSFirstResultCounter),
+                 firstResults + 1, nil);
+
+  [nc removeObserver:self];
+  [currentController_ cancel];
+  [currentController_ release];
+  currentController_ = nil;
+  [sourcesPoint removeExtension:source];
+}
+
+// Types a query a keystroke at a time, throwing away the previous query on
+// each keystroke the way the search field does, and checks that no results
+// from a query that has been replaced make it out of the query controller.
+- (void)testKeystrokeStorm {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundle, kHGSExtensionBundleKey,
+       @"com.google.qsb.querycontrollertest.source", kHGSExtensionIdentifierKey,
+       nil];
+  HGSQueryControllerTestSource *source
+    = [[[HGSQueryControllerTestSource alloc] initWithConfiguration:config]
+       autorelease];
+  STAssertNotNil(source, nil);
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertTrue([sourcesPoint extendWithObject:source], nil);
+
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidUpdateResults:)
+             name:kHGSQueryControllerDidUpdateResultsNotification
+           object:nil];
+
+  UInt64 lastGeneration = 0;
+  NSMutableString *typed = [NSMutableString string];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  for (NSUInteger i = 0; i < kHGSQueryControllerTestKeystrokes; ++i) {
+    [typed appendFormat:@"%c", (char)('a' + i % 26)];
+    [currentController_ cancel];
+    [currentController_ release];
+    HGSQuery *query = [[[HGSQuery alloc] initWithString:typed
+                                         actionArgument:nil
+                                        actionOperation:nil
+                                           pivotObjects:nil
+                                             queryFlags:0] autorelease];
+    STAssertGreaterThan([query generation], lastGeneration, nil);
+    lastGeneration = [query generation];
+    currentController_ = [[HGSQueryController alloc] initWithQuery:query];
+    STAssertEquals([currentController_ generation], lastGeneration, nil);
+    [currentController_ startQuery];
+    // Let some of the notifications from the queries we are about to cancel
+    // arrive, as they would between keystrokes.
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+  }
+
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+  while (![currentController_ queriesFinished]
+         && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertTrue([currentController_ queriesFinished], nil);
+  STAssertEquals(staleUpdateCount_, (NSUInteger)0,
+                 @"%lu of %lu updates were for replaced queries",
+                 (unsigned long)staleUpdateCount_,
+                 (unsigned long)updateCount_);
+  HGSTypeFilter *allTypes = [HGSTypeFilter filterAllowingAllTypes];
+  STAssertGreaterThan([currentController_ resultCountForFilter:allTypes],
+                      (NSUInteger)0, nil);
+
+  [nc removeObserver:self];
+  [currentController_ cancel];
+  [currentController_ release];
+  currentController_ = nil;
+  [sourcesPoint removeExtension:source];
+}
+
 @end
@@ -0,0 +1,113 @@
+//
+//  HGSQueryResultCache.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+/*!
+ @header
+ @discussion HGSQueryResultCache
+*/
+
+#import <Foundation/Foundation.h>
+
+@class HGSQuery;
+@class HGSSearchSource;
+@class HGSSearchOperation;
+
+/*!
+ Remembers the results that sources returned for recent queries so that a
+ following query (typically the next keystroke) can reuse them instead of
+ running the source again. Results are keyed by source, tokenized query,
+ pivot objects and action argument. Only sources that adopt
+ HGSRefinableSearchSource are cached, and they get to decide if (and how)
+ cached results can be turned into results for a new query.
+ 
+ Results are held for |maximumAge| seconds, and at most |maximumEntries| are
+ held at once. Not thread safe; expected to be used from the main thread
+ by HGSQueryController.
+*/
+@interface HGSQueryResultCache : NSObject {
+ @private
+  NSMutableDictionary *entries_;
+  NSMutableArray *keysByAge_;
+  NSUInteger maximumEntries_;
+  NSTimeInterval maximumAge_;
+}
+
+/*!
+ Creates a cache with sizes taken from the defaults.
+*/
+- (id)init;
+
+/*!
+ Designated initializer.
+*/
+- (id)initWithMaximumEntries:(NSUInteger)maximumEntries
+                  maximumAge:(NSTimeInterval)maximumAge;
+
+/*!
+ Returns an operation that will produce the results for |query| from cached
+ results, or nil if there isn't anything usable in the cache for |source|.
+*/
+- (HGSSearchOperation *)searchOperationForSource:(HGSSearchSource *)source
+                                           query:(HGSQuery *)query;
+
+/*!
+ Remembers the results of a finished operation. Does nothing if the operation
+ was cancelled or its source doesn't adopt HGSRefinableSearchSource.
+*/
+- (void)cacheResultsOfOperation:(HGSSearchOperation *)operation;
+
+/*!
+ Forget everything.
+*/
+- (void)removeAllResults;
+
+/*!
+ Forget everything cached for |source|. Called automatically when |source|
+ posts kHGSRefinableSearchSourceResultsInvalidatedNotification.
+*/
+- (void)removeResultsForSource:(HGSSearchSource *)source;
+
+@end
+
+/*!
+ Integer preference for the maximum number of source results held by a
+ cache created with -init.
+*/
+#define kHGSQueryResultCacheMaximumEntriesPrefKey \
+  @"HGSQueryResultCacheMaximumEntries"
+
+/*!
+ Double preference for the number of seconds that a cache created with -init
+ holds on to results.
+*/
+#define kHGSQueryResultCacheMaximumAgePrefKey @"HGSQueryResultCacheMaximumAge"
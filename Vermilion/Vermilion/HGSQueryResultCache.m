@@ -0,0 +1,288 @@
+//
+//  HGSQueryResultCache.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSQueryResultCache.h"
+#import "HGSQuery.h"
+#import "HGSResult.h"
+#import "HGSActionArgument.h"
+#import "HGSSearchSource.h"
+#import "HGSSimpleArraySearchOperation.h"
+#import "HGSTokenizer.h"
+#import "HGSLog.h"
+
+// What we keep for each source/query pair.
+@interface HGSQueryResultCacheEntry : NSObject {
+ @private
+  HGSQuery *query_;
+  NSArray *results_;
+  NSTimeInterval timeStamp_;
+}
+@property (readonly, retain) HGSQuery *query;
+@property (readonly, retain) NSArray *results;
+@property (readonly, assign) NSTimeInterval timeStamp;
+
+- (id)initWithQuery:(HGSQuery *)query results:(NSArray *)results;
+@end
+
+// Operation that hands the cached results back to the source to be refined
+// for the new query.
+@interface HGSRefinedResultsSearchOperation : HGSSimpleArraySearchOperation {
+ @private
+  HGSQueryResultCacheEntry *entry_;
+}
+- (id)initWithQuery:(HGSQuery *)query
+             source:(HGSSearchSource<HGSRefinableSearchSource> *)source
+              entry:(HGSQueryResultCacheEntry *)entry;
+@end
+
+@interface HGSQueryResultCache ()
+- (HGSQueryResultCacheEntry *)entryForKey:(NSString *)key;
+- (void)sourceResultsInvalidated:(NSNotification *)notification;
+@end
+
+// Builds up the key we store results under. |queryString| is passed
+// separately so that we can look up prefixes of the query.
+static NSString *HGSQueryResultCacheKey(HGSSearchSource *source,
+                                        HGSQuery *query,
+                                        NSString *queryString) {
+  NSMutableString *key
+    = [NSMutableString stringWithFormat:@"%@\n%@\n%lu\n%@",
+       [source identifier],
+       [[query actionArgument] identifier],
+       (unsigned long)[query flags],
+       queryString];
+  for (HGSResult *pivot in [query pivotObjects]) {
+    [key appendFormat:@"\n%@", [pivot uri]];
+  }
+  return key;
+}
+
+@implementation HGSQueryResultCacheEntry
+
+@synthesize query = query_;
+@synthesize results = results_;
+@synthesize timeStamp = timeStamp_;
+
+- (id)initWithQuery:(HGSQuery *)query results:(NSArray *)results {
+  if ((self = [super init])) {
+    query_ = [query retain];
+    results_ = [results copy];
+    timeStamp_ = [NSDate timeIntervalSinceReferenceDate];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [query_ release];
+  [results_ release];
+  [super dealloc];
+}
+
+@end
+
+@implementation HGSRefinedResultsSearchOperation
+
+- (id)initWithQuery:(HGSQuery *)query
+             source:(HGSSearchSource<HGSRefinableSearchSource> *)source
+              entry:(HGSQueryResultCacheEntry *)entry {
+  if ((self = [super initWithQuery:query source:source])) {
+    entry_ = [entry retain];
+    // Refining is much cheaper than a real search, so it says nothing about
+    // how long the source takes.
+    [self setRecordsRunTime:NO];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [entry_ release];
+  [super dealloc];
+}
+
+- (void)main {
+  HGSSearchSource<HGSRefinableSearchSource> *source
+    = (HGSSearchSource<HGSRefinableSearchSource> *)[self source];
+  NSArray *results = [source resultsByRefiningResults:[entry_ results]
+                                              ofQuery:[entry_ query]
+                                         forOperation:self];
+  [self setRankedResults:results];
+}
+
+- (NSString *)displayName {
+  return [[self source] displayName];
+}
+
+@end
+
+@implementation HGSQueryResultCache
+
+- (id)init {
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSInteger maximumEntries
+    = [defaults integerForKey:kHGSQueryResultCacheMaximumEntriesPrefKey];
+  if (maximumEntries <= 0) {
+    maximumEntries = 256;
+  }
+  NSTimeInterval maximumAge
+    = [defaults doubleForKey:kHGSQueryResultCacheMaximumAgePrefKey];
+  if (maximumAge <= 0) {
+    maximumAge = 30.0;
+  }
+  return [self initWithMaximumEntries:maximumEntries maximumAge:maximumAge];
+}
+
+- (id)initWithMaximumEntries:(NSUInteger)maximumEntries
+                  maximumAge:(NSTimeInterval)maximumAge {
+  if ((self = [super init])) {
+    entries_ = [[NSMutableDictionary alloc] init];
+    keysByAge_ = [[NSMutableArray alloc] init];
+    maximumEntries_ = maximumEntries;
+    maximumAge_ = maximumAge;
+    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    [nc addObserver:self
+           selector:@selector(sourceResultsInvalidated:)
+               name:kHGSRefinableSearchSourceResultsInvalidatedNotification
+             object:nil];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [entries_ release];
+  [keysByAge_ release];
+  [super dealloc];
+}
+
+- (HGSQueryResultCacheEntry *)entryForKey:(NSString *)key {
+  HGSQueryResultCacheEntry *entry = [entries_ objectForKey:key];
+  if (entry) {
+    NSTimeInterval age
+      = [NSDate timeIntervalSinceReferenceDate] - [entry timeStamp];
+    if (age > maximumAge_) {
+      [entries_ removeObjectForKey:key];
+      [keysByAge_ removeObject:key];
+      entry = nil;
+    }
+  }
+  return entry;
+}
+
+- (HGSSearchOperation *)searchOperationForSource:(HGSSearchSource *)source
+                                           query:(HGSQuery *)query {
+  if (![source conformsToProtocol:@protocol(HGSRefinableSearchSource)]) {
+    return nil;
+  }
+  HGSSearchSource<HGSRefinableSearchSource> *refinableSource
+    = (HGSSearchSource<HGSRefinableSearchSource> *)source;
+  // Look for the results of this query, or failing that the longest prefix
+  // of it that we have results for.
+  NSString *queryString = [[query tokenizedQueryString] tokenizedString];
+  if (!queryString) {
+    queryString = @"";
+  }
+  HGSSearchOperation *operation = nil;
+  for (NSUInteger length = [queryString length]; ; --length) {
+    NSString *prefix = [queryString substringToIndex:length];
+    NSString *key = HGSQueryResultCacheKey(source, query, prefix);
+    HGSQueryResultCacheEntry *entry = [self entryForKey:key];
+    if (entry
+        && [refinableSource canRefineResultsOfQuery:[entry query]
+                                            toQuery:query]) {
+      operation
+        = [[[HGSRefinedResultsSearchOperation alloc] initWithQuery:query
+                                                            source:refinableSource
+                                                             entry:entry]
+           autorelease];
+      break;
+    }
+    if (length == 0) break;
+  }
+  return operation;
+}
+
+- (void)cacheResultsOfOperation:(HGSSearchOperation *)operation {
+  if ([operation isCancelled]) return;
+  if (![operation isKindOfClass:[HGSSimpleArraySearchOperation class]]) return;
+  HGSSearchSource *source = [operation source];
+  if (![source conformsToProtocol:@protocol(HGSRefinableSearchSource)]) {
+    return;
+  }
+  HGSQuery *query = [operation query];
+  NSString *queryString = [[query tokenizedQueryString] tokenizedString];
+  if (!queryString) {
+    queryString = @"";
+  }
+  NSArray *results
+    = [(HGSSimpleArraySearchOperation *)operation sourceResults];
+  if (!results) {
+    results = [NSArray array];
+  }
+  NSString *key = HGSQueryResultCacheKey(source, query, queryString);
+  HGSQueryResultCacheEntry *entry
+    = [[[HGSQueryResultCacheEntry alloc] initWithQuery:query
+                                               results:results] autorelease];
+  [keysByAge_ removeObject:key];
+  [keysByAge_ addObject:key];
+  [entries_ setObject:entry forKey:key];
+  while ([keysByAge_ count] > maximumEntries_) {
+    NSString *oldestKey = [keysByAge_ objectAtIndex:0];
+    [entries_ removeObjectForKey:oldestKey];
+    [keysByAge_ removeObjectAtIndex:0];
+  }
+}
+
+- (void)removeAllResults {
+  [entries_ removeAllObjects];
+  [keysByAge_ removeAllObjects];
+}
+
+- (void)removeResultsForSource:(HGSSearchSource *)source {
+  // Every key starts with the source identifier, see HGSQueryResultCacheKey.
+  NSString *keyPrefix
+    = [NSString stringWithFormat:@"%@\n", [source identifier]];
+  NSMutableArray *keysToRemove = [NSMutableArray array];
+  for (NSString *key in keysByAge_) {
+    if ([key hasPrefix:keyPrefix]) {
+      [keysToRemove addObject:key];
+    }
+  }
+  [entries_ removeObjectsForKeys:keysToRemove];
+  [keysByAge_ removeObjectsInArray:keysToRemove];
+}
+
+- (void)sourceResultsInvalidated:(NSNotification *)notification {
+  [self removeResultsForSource:[notification object]];
+}
+
+@end
@@ -0,0 +1,187 @@
+//
+//  HGSQueryResultCacheTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+
+#import "HGSQueryResultCache.h"
+#import "HGSSimpleArraySearchOperation.h"
+#import "HGSSearchSource.h"
+#import "HGSQuery.h"
+#import "HGSTokenizer.h"
+#import "HGSExtension.h"
+#import "HGSBundle.h"
+
+@interface HGSQueryResultCacheTest : GTMTestCase
+@end
+
+@interface HGSQueryResultCacheTestSource : HGSSearchSource
+    <HGSRefinableSearchSource>
+@end
+
+@interface HGSQueryResultCacheTestOperation : HGSSimpleArraySearchOperation
+@end
+
+@implementation HGSQueryResultCacheTestSource
+
+- (BOOL)canRefineResultsOfQuery:(HGSQuery *)oldQuery
+                        toQuery:(HGSQuery *)newQuery {
+  NSString *oldString = [[oldQuery tokenizedQueryString] tokenizedString];
+  NSString *newString = [[newQuery tokenizedQueryString] tokenizedString];
+  return [newString hasPrefix:oldString];
+}
+
+- (NSArray *)resultsByRefiningResults:(NSArray *)results
+                              ofQuery:(HGSQuery *)oldQuery
+                         forOperation:(HGSSearchOperation *)operation {
+  return results;
+}
+
+@end
+
+@implementation HGSQueryResultCacheTestOperation
+
+- (void)main {
+}
+
+@end
+
+@implementation HGSQueryResultCacheTest
+
+- (HGSQuery *)queryWithString:(NSString *)string {
+  return [[[HGSQuery alloc] initWithString:string
+                            actionArgument:nil
+                           actionOperation:nil
+                              pivotObjects:nil
+                                queryFlags:0] autorelease];
+}
+
+- (void)testRefinement {
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       @"com.google.qsb.queryresultcachetest.source", 
+       kHGSExtensionIdentifierKey,
+       @"HGSQueryResultCacheTestSource", kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSQueryResultCacheTestSource *source
+    = [[[HGSQueryResultCacheTestSource alloc] initWithConfiguration:config]
+       autorelease];
+  STAssertNotNil(source, nil);
+  HGSQueryResultCache *cache
+    = [[[HGSQueryResultCache alloc] initWithMaximumEntries:2
+                                                maximumAge:60] autorelease];
+  STAssertNotNil(cache, nil);
+  HGSQuery *abQuery = [self queryWithString:@"ab"];
+  STAssertNil([cache searchOperationForSource:source query:abQuery], nil);
+
+  HGSSimpleArraySearchOperation *operation
+    = [[[HGSQueryResultCacheTestOperation alloc] initWithQuery:abQuery
+                                                        source:source]
+       autorelease];
+  [cache cacheResultsOfOperation:operation];
+  STAssertNotNil([cache searchOperationForSource:source query:abQuery], nil);
+  HGSQuery *abcQuery = [self queryWithString:@"abc"];
+  STAssertNotNil([cache searchOperationForSource:source query:abcQuery], nil);
+  HGSQuery *xbcQuery = [self queryWithString:@"xbc"];
+  STAssertNil([cache searchOperationForSource:source query:xbcQuery], nil);
+  
+  // Cancelled operations don't get cached.
+  operation
+    = [[[HGSQueryResultCacheTestOperation alloc] initWithQuery:xbcQuery
+                                                        source:source]
+       autorelease];
+  [operation cancel];
+  [cache cacheResultsOfOperation:operation];
+  STAssertNil([cache searchOperationForSource:source query:xbcQuery], nil);
+  
+  // Oldest entries get pushed out.
+  HGSQuery *queries[] = { xbcQuery, [self queryWithString:@"xyz"] };
+  for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+    operation
+      = [[[HGSQueryResultCacheTestOperation alloc] initWithQuery:queries[i]
+                                                          source:source]
+         autorelease];
+    [cache cacheResultsOfOperation:operation];
+  }
+  STAssertNil([cache searchOperationForSource:source query:abcQuery], nil);
+  STAssertNotNil([cache searchOperationForSource:source query:xbcQuery], nil);
+  
+  [cache removeAllResults];
+  STAssertNil([cache searchOperationForSource:source query:xbcQuery], nil);
+}
+
+- (void)testInvalidation {
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       @"com.google.qsb.queryresultcachetest.source", 
+       kHGSExtensionIdentifierKey,
+       @"HGSQueryResultCacheTestSource", kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSQueryResultCacheTestSource *source
+    = [[[HGSQueryResultCacheTestSource alloc] initWithConfiguration:config]
+       autorelease];
+  config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       @"com.google.qsb.queryresultcachetest.othersource", 
+       kHGSExtensionIdentifierKey,
+       @"HGSQueryResultCacheTestSource", kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSQueryResultCacheTestSource *otherSource
+    = [[[HGSQueryResultCacheTestSource alloc] initWithConfiguration:config]
+       autorelease];
+  HGSQueryResultCache *cache
+    = [[[HGSQueryResultCache alloc] initWithMaximumEntries:10
+                                                maximumAge:60] autorelease];
+  HGSQuery *query = [self queryWithString:@"ab"];
+  HGSSearchSource *sources[] = { source, otherSource };
+  for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); ++i) {
+    HGSSimpleArraySearchOperation *operation
+      = [[[HGSQueryResultCacheTestOperation alloc] initWithQuery:query
+                                                          source:sources[i]]
+         autorelease];
+    [cache cacheResultsOfOperation:operation];
+    STAssertNotNil([cache searchOperationForSource:sources[i] query:query],
+                   nil);
+  }
+  
+  // Only the source that posted loses its results.
+  NSString *name = kHGSRefinableSearchSourceResultsInvalidatedNotification;
+  [[NSNotificationCenter defaultCenter] postNotificationName:name
+                                                      object:source];
+  STAssertNil([cache searchOperationForSource:source query:query], nil);
+  STAssertNotNil([cache searchOperationForSource:otherSource query:query], nil);
+}
+
+@end
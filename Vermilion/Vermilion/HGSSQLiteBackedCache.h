@@ -38,13 +38,21 @@
 */
 
 @class GTMSQLiteDatabase;
+@class HGSSQLiteCacheWriter;
 
 /*!
   A limited sized cache backed by SQLite.
 */
 @interface HGSSQLiteBackedCache : NSObject {
  @private
+  /*!
+    The connection used for reads. All writes are queued on writer_, which
+    commits them in batches on its own thread and connection. The database
+    uses WAL journaling where SQLite supports it, so reads don't wait for
+    those commits.
+  */
   GTMSQLiteDatabase* db_;
+  HGSSQLiteCacheWriter *writer_;
   NSString* dbPath_;
 
   NSUInteger hardMaximumEntries_;  
@@ -53,11 +61,18 @@
   __weak NSTimer *flushTimer_;
   
   /*!
-    Stores a list of keys that were touched. Since writes are expensive,
-    we batch all the accesses for a fixed time period and then write them all
-    in one go.
+    Maps each key read since the last flush to the last time it was read,
+    in whole seconds since 1970, stored directly as the value. Since writes
+    are expensive, we batch all the accesses for a fixed time period and
+    then write them all in one go. Guarded by @synchronized(self), since
+    reads can come from any thread.
+  */
+  CFMutableDictionaryRef pendingTouches_;
+  /*!
+    Prepared statements for db_, keyed by their SQL. They are reset after
+    each use instead of being finalized, so each is only compiled once.
   */
-  NSMutableArray *pendingTouches_;
+  NSMutableDictionary *statements_;
   BOOL useNSArchiver_;
 }
 
@@ -71,7 +86,7 @@
 @property (readwrite, assign, nonatomic) NSUInteger softMaximumEntries;
 @property (readwrite, assign, nonatomic) NSTimeInterval maximumAge;
 /*!
-  Number of entries
+  Number of entries. Waits for queued writes to be committed first.
 */
 @property (readonly, nonatomic) NSUInteger count;
 
@@ -92,11 +107,13 @@
 /*!
   Writes any pending writes into the database, and performs cleanup of the
   database to ensure the size does not exceed the maximumEntries_ size.
+  Blocks until the writer thread has committed them.
 */
 - (void)flush;
 
 /*!
-  Remove all the entries.
+  Remove all the entries. Blocks until the writer thread has committed the
+  removal.
 */
 - (void)removeAllObjects;
 @end
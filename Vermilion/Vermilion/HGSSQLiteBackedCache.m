@@ -32,6 +32,8 @@
 
 #import "HGSSQLiteBackedCache.h"
 #import "HGSLog.h"
+#import "HGSDTrace.h"
+#import "HGSPerformanceCounters.h"
 
 #import "GTMSQLite.h"
 
@@ -39,8 +41,13 @@ static NSTimeInterval const kCacheDefaultFlushInterval = 60.0; // once a minute
 static NSTimeInterval const kCacheDefaultMaximumAge = 3600 * 24 * 7 * 2; // 2 weeks
 static NSUInteger const kCacheDefaultMaxEntries = 10000;
 static float const kCacheDefaultSoftMaxEntries = 8000;
-static NSString* const kCachePendingTouchKey = @"key";
-static NSString* const kCachePendingTouchTimestamp = @"timestamp";
+// Number of keys a single touch statement updates. Must match the number of
+// placeholders in the IN list of kCacheTouchSQL.
+static NSUInteger const kCacheTouchBatchSize = 32;
+// How long a connection waits for another connection's lock.
+static int const kCacheBusyTimeoutMS = 2000;
+// WAL journaling first shipped in SQLite 3.7.0.
+static int const kCacheWALMinimumSQLiteVersion = 3007000;
 
 static NSString* const kCacheSchema = @"CREATE TABLE IF NOT EXISTS cache ("
   @"  key TEXT PRIMARY KEY,"
@@ -48,22 +55,506 @@ static NSString* const kCacheSchema = @"CREATE TABLE IF NOT EXISTS cache ("
   @"  accessed INT64,"
   @"  modified INT64)";
 
+static NSString* const kCacheSelectSQL 
+  = @"SELECT value FROM cache WHERE key = ?";
+static NSString* const kCacheInsertSQL 
+  = @"INSERT OR REPLACE INTO cache VALUES (?, ?, ?, ?)";
+static NSString* const kCacheDeleteSQL = @"DELETE FROM cache WHERE key = ?";
+static NSString* const kCacheDeleteAllSQL = @"DELETE FROM cache";
+static NSString* const kCacheDeleteByDateSQL 
+  = @"DELETE FROM cache WHERE accessed < ?";
+static NSString* const kCacheDeleteLeastRecentlyUsedSQL
+  = @"DELETE FROM cache WHERE key IN "
+    @" (SELECT key FROM cache ORDER BY accessed LIMIT ?)";
+// Never moves an entry's access time backwards. Unused key slots are bound
+// to NULL, which matches nothing.
+static NSString* const kCacheTouchSQL 
+  = @"UPDATE cache SET accessed = MAX(accessed, ?) WHERE key IN ("
+    @"?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+    @"?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+static NSString* const kCacheCountSQL = @"SELECT COUNT(*) FROM cache";
+static NSString* const kCacheJournalModeSQL = @"PRAGMA journal_mode";
+static NSString* const kCacheJournalModeWALSQL = @"PRAGMA journal_mode = WAL";
+static NSString* const kCacheSynchronousNormalSQL 
+  = @"PRAGMA synchronous = NORMAL";
+
 static NSString* const kMetaDataVersionKey = @"version";
 static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata ("
   @"  key TEXT PRIMARY KEY,"
   @"  value TEXT)";
 
+typedef enum {
+  eHGSSQLiteCacheWriteInsert = 0,
+  eHGSSQLiteCacheWriteDelete,
+  eHGSSQLiteCacheWriteDeleteAll,
+  eHGSSQLiteCacheWriteTouch,
+  eHGSSQLiteCacheWriteExpire,
+  eHGSSQLiteCacheWriteTrim,
+} HGSSQLiteCacheWriteType;
+
+// One deduplicated touch, as the writer sorts them.
+typedef struct {
+  CFStringRef key;
+  uint32_t accessed;
+} HGSSQLiteCacheTouch;
+
+// A single change queued for the writer thread. Which fields are used
+// depends on the type: inserts use key, data and timestamp, deletes use key,
+// touches use touches, expiries use timestamp and trims use limit and target.
+@interface HGSSQLiteCacheWrite : NSObject {
+ @private
+  HGSSQLiteCacheWriteType type_;
+  NSString *key_;
+  NSData *data_;
+  CFDictionaryRef touches_;
+  long long timestamp_;
+  NSUInteger limit_;
+  NSUInteger target_;
+}
+@property (readonly, nonatomic) HGSSQLiteCacheWriteType type;
+@property (readonly, retain, nonatomic) NSString *key;
+@property (readonly, retain, nonatomic) NSData *data;
+@property (readonly, nonatomic) CFDictionaryRef touches;
+@property (readonly, nonatomic) long long timestamp;
+@property (readonly, nonatomic) NSUInteger limit;
+@property (readonly, nonatomic) NSUInteger target;
+
++ (id)insertWriteWithKey:(NSString *)key
+                    data:(NSData *)data
+               timestamp:(long long)timestamp;
++ (id)deleteWriteWithKey:(NSString *)key;
++ (id)deleteAllWrite;
+// |touches| maps keys to the time they were last read, in whole seconds
+// since 1970, stored directly as the value rather than as an object.
++ (id)touchWriteWithTouches:(CFDictionaryRef)touches;
++ (id)expireWriteWithTimestamp:(long long)timestamp;
++ (id)trimWriteWithLimit:(NSUInteger)limit target:(NSUInteger)target;
+- (id)initWithType:(HGSSQLiteCacheWriteType)type;
+@end
+
+// Owns the only connection that writes to the cache table, and a thread that
+// drains a queue of HGSSQLiteCacheWrites into it. Everything queued while the
+// previous batch was committing goes into a single transaction, so a burst of
+// writes costs one commit instead of one each. Until its batch commits, the
+// latest insert or delete for each key is kept in |pendingWrites_| so readers
+// never see an older value than the one they just set.
+@interface HGSSQLiteCacheWriter : NSObject {
+ @private
+  GTMSQLiteDatabase *db_;
+  // Prepared statements for db_, keyed by their SQL. Only touched on the
+  // writer thread.
+  NSMutableDictionary *statements_;
+  // Guards everything below.
+  NSCondition *condition_;
+  NSMutableArray *queue_;
+  NSMutableDictionary *pendingWrites_;
+  BOOL writing_;
+  BOOL stopping_;
+  BOOL running_;
+}
+
+- (id)initWithPath:(NSString *)path;
+- (void)enqueueWrite:(HGSSQLiteCacheWrite *)write;
+// Returns YES if a write for |key| is queued or being committed, and sets
+// |data| to its value, or to nil if the key is being deleted.
+- (BOOL)getPendingData:(NSData **)data forKey:(NSString *)key;
+// Blocks until everything queued so far is committed.
+- (void)waitUntilIdle;
+// Commits what is queued and stops the thread.
+- (void)stop;
+@end
+
+@interface HGSSQLiteCacheWriter ()
+- (void)writerThread:(id)ignored;
+- (void)commitBatch:(NSArray *)batch;
+- (void)performWrite:(HGSSQLiteCacheWrite *)write;
+- (void)performTouches:(CFDictionaryRef)touches;
+- (GTMSQLiteStatement *)statementForSQL:(NSString *)sql;
+@end
+
 @interface HGSSQLiteBackedCache ()
 - (BOOL)initDatabaseWithVersion:(NSString *)version;
+- (GTMSQLiteStatement *)statementForSQL:(NSString *)sql;
 - (void)addPendingTouch:(NSString *)key;
-- (void)commitPendingTouches:(NSMutableArray *)touches;
+- (void)scheduleMaintenance;
 
 - (void)invalidateEntriesNotAccessedAfter:(NSDate *)date;
-- (void)invalidateLeastRecentlyUsedFrom:(NSUInteger)currentRows
-                                     to:(NSUInteger)decreasedRows;
 - (void)flushTimer:(NSTimer *)ignored;
 @end
 
+// Returns the journal mode reported by |sql|, which must be a
+// journal_mode pragma.
+static NSString *HGSSQLiteCacheJournalMode(GTMSQLiteDatabase *db,
+                                           NSString *sql) {
+  int errorCode;
+  GTMSQLiteStatement *statement
+    = [GTMSQLiteStatement statementWithSQL:sql
+                                inDatabase:db
+                                 errorCode:&errorCode];
+  if (errorCode != SQLITE_OK) return nil;
+  NSString *mode = nil;
+  if ([statement stepRow] == SQLITE_ROW) {
+    mode = [[statement resultStringAtPosition:0] lowercaseString];
+  }
+  [statement finalizeStatement];
+  return mode;
+}
+
+@implementation HGSSQLiteCacheWrite
+@synthesize type = type_;
+@synthesize key = key_;
+@synthesize data = data_;
+@synthesize touches = touches_;
+@synthesize timestamp = timestamp_;
+@synthesize limit = limit_;
+@synthesize target = target_;
+
++ (id)insertWriteWithKey:(NSString *)key
+                    data:(NSData *)data
+               timestamp:(long long)timestamp {
+  HGSSQLiteCacheWrite *write
+    = [[[self alloc] initWithType:eHGSSQLiteCacheWriteInsert] autorelease];
+  write->key_ = [key copy];
+  write->data_ = [data retain];
+  write->timestamp_ = timestamp;
+  return write;
+}
+
++ (id)deleteWriteWithKey:(NSString *)key {
+  HGSSQLiteCacheWrite *write
+    = [[[self alloc] initWithType:eHGSSQLiteCacheWriteDelete] autorelease];
+  write->key_ = [key copy];
+  return write;
+}
+
++ (id)deleteAllWrite {
+  return [[[self alloc] initWithType:eHGSSQLiteCacheWriteDeleteAll]
+          autorelease];
+}
+
++ (id)touchWriteWithTouches:(CFDictionaryRef)touches {
+  HGSSQLiteCacheWrite *write
+    = [[[self alloc] initWithType:eHGSSQLiteCacheWriteTouch] autorelease];
+  write->touches_ = CFRetain(touches);
+  return write;
+}
+
++ (id)expireWriteWithTimestamp:(long long)timestamp {
+  HGSSQLiteCacheWrite *write
+    = [[[self alloc] initWithType:eHGSSQLiteCacheWriteExpire] autorelease];
+  write->timestamp_ = timestamp;
+  return write;
+}
+
++ (id)trimWriteWithLimit:(NSUInteger)limit target:(NSUInteger)target {
+  HGSSQLiteCacheWrite *write
+    = [[[self alloc] initWithType:eHGSSQLiteCacheWriteTrim] autorelease];
+  write->limit_ = limit;
+  write->target_ = target;
+  return write;
+}
+
+- (id)initWithType:(HGSSQLiteCacheWriteType)type {
+  if ((self = [super init])) {
+    type_ = type;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [key_ release];
+  [data_ release];
+  if (touches_) {
+    CFRelease(touches_);
+  }
+  [super dealloc];
+}
+@end
+
+@implementation HGSSQLiteCacheWriter
+
+- (id)initWithPath:(NSString *)path {
+  if ((self = [super init])) {
+    int errorCode;
+    db_ = [[GTMSQLiteDatabase alloc] initWithPath:path
+                                  withCFAdditions:NO
+                                             utf8:YES
+                                        errorCode:&errorCode];
+    if (errorCode != SQLITE_OK && errorCode != SQLITE_DONE) {
+      HGSLog(@"Unable to open cache writer database: %d", errorCode);
+      [self release];
+      return nil;
+    }
+    [db_ setBusyTimeoutMS:kCacheBusyTimeoutMS];
+    // With a write-ahead log a crash can only lose the last few commits,
+    // never corrupt the file, which is an easy trade for a cache.
+    NSString *mode = HGSSQLiteCacheJournalMode(db_, kCacheJournalModeSQL);
+    if ([mode isEqualToString:@"wal"]) {
+      [db_ executeSQL:kCacheSynchronousNormalSQL];
+    }
+    statements_ = [[NSMutableDictionary alloc] init];
+    condition_ = [[NSCondition alloc] init];
+    queue_ = [[NSMutableArray alloc] init];
+    pendingWrites_ = [[NSMutableDictionary alloc] init];
+    running_ = YES;
+    [NSThread detachNewThreadSelector:@selector(writerThread:)
+                             toTarget:self
+                           withObject:nil];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // The thread retains us until it exits, and closes db_ on the way out.
+  [statements_ release];
+  [db_ release];
+  [condition_ release];
+  [queue_ release];
+  [pendingWrites_ release];
+  [super dealloc];
+}
+
+- (void)enqueueWrite:(HGSSQLiteCacheWrite *)write {
+  [condition_ lock];
+  if (running_) {
+    [queue_ addObject:write];
+    HGSSQLiteCacheWriteType type = [write type];
+    if (type == eHGSSQLiteCacheWriteInsert
+        || type == eHGSSQLiteCacheWriteDelete) {
+      [pendingWrites_ setObject:write forKey:[write key]];
+    } else if (type == eHGSSQLiteCacheWriteDeleteAll) {
+      [pendingWrites_ removeAllObjects];
+    }
+    [condition_ signal];
+  } else {
+    HGSLog(@"Dropping cache write after the writer stopped");
+  }
+  [condition_ unlock];
+}
+
+- (BOOL)getPendingData:(NSData **)data forKey:(NSString *)key {
+  BOOL isPending = NO;
+  [condition_ lock];
+  HGSSQLiteCacheWrite *write = [pendingWrites_ objectForKey:key];
+  if (write) {
+    isPending = YES;
+    *data = [[[write data] retain] autorelease];
+  }
+  [condition_ unlock];
+  return isPending;
+}
+
+- (void)waitUntilIdle {
+  [condition_ lock];
+  while (running_ && ([queue_ count] || writing_)) {
+    [condition_ wait];
+  }
+  [condition_ unlock];
+}
+
+- (void)stop {
+  [condition_ lock];
+  stopping_ = YES;
+  [condition_ signal];
+  while (running_) {
+    [condition_ wait];
+  }
+  [condition_ unlock];
+}
+
+- (void)writerThread:(id)ignored {
+  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
+  [condition_ lock];
+  while (YES) {
+    while (![queue_ count] && !stopping_) {
+      [condition_ wait];
+    }
+    if (![queue_ count]) break;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSArray *batch = [[queue_ copy] autorelease];
+    [queue_ removeAllObjects];
+    writing_ = YES;
+    [condition_ unlock];
+
+    [self commitBatch:batch];
+
+    [condition_ lock];
+    for (HGSSQLiteCacheWrite *write in batch) {
+      NSString *key = [write key];
+      if (key && [pendingWrites_ objectForKey:key] == write) {
+        [pendingWrites_ removeObjectForKey:key];
+      }
+    }
+    writing_ = NO;
+    [condition_ broadcast];
+    [pool release];
+  }
+  for (GTMSQLiteStatement *statement in [statements_ allValues]) {
+    [statement finalizeStatement];
+  }
+  [statements_ removeAllObjects];
+  [db_ release];
+  db_ = nil;
+  running_ = NO;
+  [condition_ broadcast];
+  [condition_ unlock];
+  [outerPool release];
+}
+
+- (void)commitBatch:(NSArray *)batch {
+  BOOL inTransaction = [db_ beginDeferredTransaction];
+  if (!inTransaction) {
+    HGSLog(@"Unable to begin cache transaction: %@", [db_ lastErrorString]);
+  }
+  for (HGSSQLiteCacheWrite *write in batch) {
+    [self performWrite:write];
+  }
+  if (inTransaction && ![db_ commit]) {
+    HGSLog(@"Unable to commit cache writes: %@", [db_ lastErrorString]);
+    [db_ rollback];
+  }
+}
+
+- (void)performWrite:(HGSSQLiteCacheWrite *)write {
+  GTMSQLiteStatement *statement = nil;
+  int result = SQLITE_DONE;
+  switch ([write type]) {
+    case eHGSSQLiteCacheWriteInsert:
+      statement = [self statementForSQL:kCacheInsertSQL];
+      [statement bindStringAtPosition:1 string:[write key]];
+      [statement bindBlobAtPosition:2 data:[write data]];
+      [statement bindLongLongAtPosition:3 value:[write timestamp]];
+      [statement bindLongLongAtPosition:4 value:[write timestamp]];
+      result = [statement stepRow];
+      break;
+
+    case eHGSSQLiteCacheWriteDelete:
+      statement = [self statementForSQL:kCacheDeleteSQL];
+      [statement bindStringAtPosition:1 string:[write key]];
+      result = [statement stepRow];
+      break;
+
+    case eHGSSQLiteCacheWriteDeleteAll:
+      statement = [self statementForSQL:kCacheDeleteAllSQL];
+      result = [statement stepRow];
+      break;
+
+    case eHGSSQLiteCacheWriteTouch:
+      [self performTouches:[write touches]];
+      break;
+
+    case eHGSSQLiteCacheWriteExpire:
+      statement = [self statementForSQL:kCacheDeleteByDateSQL];
+      [statement bindLongLongAtPosition:1 value:[write timestamp]];
+      result = [statement stepRow];
+      break;
+
+    case eHGSSQLiteCacheWriteTrim: {
+      // If our size still exceeds our maximum entries, get rid of least
+      // recently accessed entries.
+      NSUInteger count = 0;
+      statement = [self statementForSQL:kCacheCountSQL];
+      if ([statement stepRow] == SQLITE_ROW) {
+        count = [statement resultInt32AtPosition:0];
+      }
+      [statement reset];
+      if (count > [write limit]) {
+        statement = [self statementForSQL:kCacheDeleteLeastRecentlyUsedSQL];
+        long long toRemove = count - [write target];
+        [statement bindLongLongAtPosition:1 value:toRemove];
+        result = [statement stepRow];
+      } else {
+        statement = nil;
+      }
+      break;
+    }
+  }
+  if (result == SQLITE_ERROR) {
+    HGSLog(@"Unable to write to cache: %@", [db_ lastErrorString]);
+  }
+  [statement reset];
+}
+
+static int HGSSQLiteCacheTouchCompare(const void *a, const void *b) {
+  uint32_t accessedA = ((const HGSSQLiteCacheTouch *)a)->accessed;
+  uint32_t accessedB = ((const HGSSQLiteCacheTouch *)b)->accessed;
+  if (accessedA < accessedB) return -1;
+  if (accessedA > accessedB) return 1;
+  return 0;
+}
+
+// Sorts the touches by time so that keys read in the same second share an
+// UPDATE, kCacheTouchBatchSize keys at a time.
+- (void)performTouches:(CFDictionaryRef)touches {
+  CFIndex count = CFDictionaryGetCount(touches);
+  if (!count) return;
+  GTMSQLiteStatement *statement = [self statementForSQL:kCacheTouchSQL];
+  if (!statement) return;
+
+  const void **keys = malloc(count * sizeof(void *));
+  const void **values = malloc(count * sizeof(void *));
+  HGSSQLiteCacheTouch *sorted = malloc(count * sizeof(HGSSQLiteCacheTouch));
+  if (!keys || !values || !sorted) {
+    HGSLog(@"Unable to allocate %d cache touches", (int)count);
+    free(keys);
+    free(values);
+    free(sorted);
+    return;
+  }
+  CFDictionaryGetKeysAndValues(touches, keys, values);
+  for (CFIndex i = 0; i < count; ++i) {
+    sorted[i].key = keys[i];
+    sorted[i].accessed = (uint32_t)(uintptr_t)values[i];
+  }
+  qsort(sorted, count, sizeof(HGSSQLiteCacheTouch),
+        HGSSQLiteCacheTouchCompare);
+
+  CFIndex start = 0;
+  while (start < count) {
+    uint32_t accessed = sorted[start].accessed;
+    [statement bindLongLongAtPosition:1 value:accessed];
+    CFIndex used = 0;
+    for (NSUInteger slot = 0; slot < kCacheTouchBatchSize; ++slot) {
+      int position = (int)slot + 2;
+      CFIndex index = start + used;
+      if (index < count && sorted[index].accessed == accessed) {
+        [statement bindStringAtPosition:position
+                                 string:(NSString *)sorted[index].key];
+        ++used;
+      } else {
+        [statement bindSQLNullAtPosition:position];
+      }
+    }
+    if ([statement stepRow] == SQLITE_ERROR) {
+      HGSLog(@"Unable to record cache accesses: %@", [db_ lastErrorString]);
+    }
+    [statement reset];
+    start += used;
+  }
+  free(keys);
+  free(values);
+  free(sorted);
+}
+
+// Returns the prepared statement for |sql|, compiling it on first use.
+- (GTMSQLiteStatement *)statementForSQL:(NSString *)sql {
+  GTMSQLiteStatement *statement = [statements_ objectForKey:sql];
+  if (!statement) {
+    int errorCode;
+    statement = [GTMSQLiteStatement statementWithSQL:sql
+                                          inDatabase:db_
+                                           errorCode:&errorCode];
+    if (errorCode != SQLITE_OK) {
+      HGSLog(@"Unable to create SQLite statement: %@", [db_ lastErrorString]);
+      statement = nil;
+    } else {
+      [statements_ setObject:statement forKey:sql];
+    }
+  }
+  return statement;
+}
+@end
+
 @implementation HGSSQLiteBackedCache
 @synthesize hardMaximumEntries = hardMaximumEntries_;
 @synthesize softMaximumEntries = softMaximumEntries_;
@@ -79,7 +570,11 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
   self = [super init];
   if (self) {
     dbPath_ = [path retain];
-    pendingTouches_ = [[NSMutableArray alloc] init];
+    // Values are timestamps, not objects, so they get no callbacks.
+    pendingTouches_ = CFDictionaryCreateMutable(NULL, 0,
+                                                &kCFTypeDictionaryKeyCallBacks,
+                                                NULL);
+    statements_ = [[NSMutableDictionary alloc] init];
     flushTimer_
       = [NSTimer scheduledTimerWithTimeInterval:kCacheDefaultFlushInterval
                                          target:self
@@ -101,11 +596,19 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
 }
 
 - (void)dealloc {
-  [self flush];
   [flushTimer_ invalidate];
+  [self flush];
+  [writer_ stop];
+  [writer_ release];
   [dbPath_ release];
+  for (GTMSQLiteStatement *statement in [statements_ allValues]) {
+    [statement finalizeStatement];
+  }
+  [statements_ release];
   [db_ release];
-  [pendingTouches_ release];
+  if (pendingTouches_) {
+    CFRelease(pendingTouches_);
+  }
   [super dealloc];
 }
 
@@ -140,6 +643,19 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
       HGSLog(@"Unable to initialise database: %d", errorCode);
       return NO;
     }
+    [db_ setBusyTimeoutMS:kCacheBusyTimeoutMS];
+
+    // The journal mode is stored in the file, so this only has to happen
+    // once, before the writer opens its own connection. Older SQLites
+    // don't know about WAL and keep the rollback journal, which still
+    // works, but readers may then wait on the writer's commits.
+    if ([GTMSQLiteDatabase sqliteVersionNumber]
+        >= kCacheWALMinimumSQLiteVersion) {
+      NSString *mode = HGSSQLiteCacheJournalMode(db_, kCacheJournalModeWALSQL);
+      if (![mode isEqualToString:@"wal"]) {
+        HGSLog(@"Unable to switch cache to WAL journaling: %@", mode);
+      }
+    }
   }
 
   // Create the table if it does not exist.
@@ -153,6 +669,10 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
     HGSLog(@"Unable to create metadata table: %@", [db_ lastErrorString]);
     return NO;
   }
+  if (!writer_) {
+    writer_ = [[HGSSQLiteCacheWriter alloc] initWithPath:dbPath_];
+    if (!writer_) return NO;
+  }
   NSString *getVersionStatement = @"SELECT value FROM metadata WHERE key = ?";
   GTMSQLiteStatement *statement
     = [GTMSQLiteStatement statementWithSQL:getVersionStatement
@@ -202,183 +722,165 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
   return YES;
 }
 
+// Returns the prepared statement for |sql|, compiling it on first use.
+// Callers hold @synchronized on the statement while they bind and step it,
+// and reset it when done so that it doesn't keep a read lock on the
+// database. Only reads go through db_; writes go to writer_.
+- (GTMSQLiteStatement *)statementForSQL:(NSString *)sql {
+  GTMSQLiteStatement *statement = nil;
+  @synchronized(statements_) {
+    statement = [statements_ objectForKey:sql];
+    if (!statement) {
+      int errorCode;
+      statement = [GTMSQLiteStatement statementWithSQL:sql
+                                            inDatabase:db_
+                                             errorCode:&errorCode];
+      if (errorCode != SQLITE_OK) {
+        HGSLog(@"Unable to create SQLite statement: %@",
+               [db_ lastErrorString]);
+        statement = nil;
+      } else {
+        [statements_ setObject:statement forKey:sql];
+      }
+    }
+  }
+  return statement;
+}
+
 - (NSUInteger)count {
-  int errorCode;
-  NSString *countStatement = @"SELECT COUNT(*) FROM cache";
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:countStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  int result = [statement stepRow];
+  // Count what has been written so far, not what was committed so far.
+  [writer_ waitUntilIdle];
+  GTMSQLiteStatement *statement = [self statementForSQL:kCacheCountSQL];
   NSUInteger count = 0;
-  if (result == SQLITE_ROW) {
-    count = [[statement resultNumberAtPosition:0] unsignedIntValue];
-  } else {
-    HGSLog(@"Unable to get count of cache: %@", [db_ lastErrorString]);
+  @synchronized(statement) {
+    int result = [statement stepRow];
+    if (result == SQLITE_ROW) {
+      count = [statement resultInt32AtPosition:0];
+    } else {
+      HGSLog(@"Unable to get count of cache: %@", [db_ lastErrorString]);
+    }
+    [statement reset];
   }
-  [statement finalizeStatement];
   return count;
 }
 
 #pragma mark Maintenance
 
-// Adds a value to |pendingTouches_| to mark certain entries as accesses.
-// The pendingTouches_ are regularly flushed to the database. This avoids
-// a write penalty for each read.
+// Records in |pendingTouches_| that |key| was read now. Reading a key again
+// before the next flush only moves its time forward, so the buffer holds one
+// entry per key however often it is read. The pendingTouches_ are regularly
+// flushed to the database. This avoids a write penalty for each read.
 - (void)addPendingTouch:(NSString *)key {
-  NSTimeInterval touch = [[NSDate date] timeIntervalSince1970];
-  [pendingTouches_ addObject:[NSDictionary dictionaryWithObjectsAndKeys:
-    key,
-    kCachePendingTouchKey,
-    [NSNumber numberWithLongLong:(long long)touch],
-    kCachePendingTouchTimestamp,
-    nil]];
-}
-
-- (void)commitPendingTouches:(NSMutableArray *)touches {
-  int errorCode;
-  NSString* touchStatement = @"UPDATE cache SET accessed = ? WHERE key = ?";
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:touchStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  if (errorCode != SQLITE_OK) {
-    HGSLog(@"Error create statement: %@", [db_ lastErrorString]);
-    return;
-  }
-
-  [db_ beginDeferredTransaction];
-  {
-    // TODO(altse): Needs testing.
-    for (NSDictionary *touch in touches) {
-      NSString *pendingTouch = [touch objectForKey:kCachePendingTouchKey];
-      NSNumber *timeStamp = [touch objectForKey:kCachePendingTouchTimestamp];
-      [statement bindStringAtPosition:1 string:pendingTouch];
-      [statement bindLongLongAtPosition:2 value:[timeStamp longLongValue]];
-      [statement stepRow];
+  uint32_t touch = (uint32_t)[[NSDate date] timeIntervalSince1970];
+  NSString *touchKey = [key copy];
+  @synchronized(self) {
+    const void *value = NULL;
+    if (!CFDictionaryGetValueIfPresent(pendingTouches_, touchKey, &value)
+        || (uint32_t)(uintptr_t)value < touch) {
+      CFDictionarySetValue(pendingTouches_, touchKey,
+                           (const void *)(uintptr_t)touch);
     }
-    [statement finalizeStatement];
   }
-  [db_ commit];
-  [touches removeAllObjects];
+  [touchKey release];
 }
 
 #pragma mark Compressing
 
 - (void)removeAllObjects {
-  static NSString* const kDeleteStatement = @"DELETE FROM cache";
-  int errorCode;
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:kDeleteStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  [statement stepRow];
-  [statement finalizeStatement];
+  [writer_ enqueueWrite:[HGSSQLiteCacheWrite deleteAllWrite]];
+  [writer_ waitUntilIdle];
 }
 
 - (void)invalidateEntriesNotAccessedAfter:(NSDate *)date {
   NSTimeInterval unixTimestamp = [date timeIntervalSince1970];
-  static NSString* const kDeleteByDateStatement =
-  @"DELETE FROM cache WHERE accessed < ?";
-  int errorCode;
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:kDeleteByDateStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  if (errorCode != SQLITE_OK) {
-    HGSLog(@"Unable to create SQLite statement: %@", [db_ lastErrorString]);
-    return;
-  }
-
-  [statement bindLongLongAtPosition:1 value:(long long)unixTimestamp];
-  if ([statement stepRow] == SQLITE_ERROR) {
-    HGSLog(@"Unable to delete by date: %@", [db_ lastErrorString]);
-  }
-  [statement finalizeStatement];
-}
-
-- (void)invalidateLeastRecentlyUsedFrom:(NSUInteger)currentRows
-                                     to:(NSUInteger)decreasedRows {
-  int errorCode;
-  NSUInteger toRemove = currentRows - decreasedRows;
-  NSString *sql = [NSString stringWithFormat:@"DELETE FROM cache WHERE key IN "
-                   @" (SELECT key FROM cache ORDER BY accessed LIMIT %d)",
-                   toRemove];
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:sql
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  if (errorCode != SQLITE_OK) {
-    HGSLog(@"Unable to create SQLite statement: %@", [db_ lastErrorString]);
-    return;
-  }
-
-  [statement stepRow];
-  [statement finalizeStatement];
+  HGSSQLiteCacheWrite *write
+    = [HGSSQLiteCacheWrite expireWriteWithTimestamp:(long long)unixTimestamp];
+  [writer_ enqueueWrite:write];
 }
 
 #pragma mark Flushing
 
 - (void)flushTimer:(NSTimer *)ignored {
-  [self flush];
+  [self scheduleMaintenance];
 }
 
-// A regular method that's called to clean up cache entries. Expected to be
-// called on the main thread.
-- (void)flush {
+// Hands the pending touches, and the cleanup they make necessary, to the
+// writer. Never blocks on the database.
+- (void)scheduleMaintenance {
   // Do nothing, including removing the old and/or excess entries, unless
   // the cache has some new entries to process.  Otherwise, we'll prevent
   // the machine from going to sleep.
-  if ([pendingTouches_ count]) {
-    [self commitPendingTouches:pendingTouches_];
-
-    NSDate *oldestEntryDate
-      = [NSDate dateWithTimeIntervalSinceNow:(-1 * maximumAge_)];
-    [self invalidateEntriesNotAccessedAfter:oldestEntryDate];
-
-    // If our size still exceeds our maximum entries, get rid of least recently
-    // accessed entries.
-    NSUInteger count = [self count];
-    if (count > hardMaximumEntries_) {
-      [self invalidateLeastRecentlyUsedFrom:count to:softMaximumEntries_];
+  CFDictionaryRef touches = NULL;
+  @synchronized(self) {
+    if (CFDictionaryGetCount(pendingTouches_)) {
+      touches = CFDictionaryCreateCopy(NULL, pendingTouches_);
+      CFDictionaryRemoveAllValues(pendingTouches_);
     }
   }
+  if (!touches) return;
+
+  [writer_ enqueueWrite:[HGSSQLiteCacheWrite touchWriteWithTouches:touches]];
+  CFRelease(touches);
+  NSDate *oldestEntryDate
+    = [NSDate dateWithTimeIntervalSinceNow:(-1 * maximumAge_)];
+  [self invalidateEntriesNotAccessedAfter:oldestEntryDate];
+  HGSSQLiteCacheWrite *trim
+    = [HGSSQLiteCacheWrite trimWriteWithLimit:hardMaximumEntries_
+                                       target:softMaximumEntries_];
+  [writer_ enqueueWrite:trim];
+}
+
+- (void)flush {
+  [self scheduleMaintenance];
+  [writer_ waitUntilIdle];
 }
 
 #pragma mark NSKeyValueCoding
 
-// Read value from an SQL backend.
+// Read value from an SQL backend, or from the writer if the key has a write
+// that hasn't been committed yet.
 - (id)valueForKey:(NSString *)key {
-  NSString* selectStatement = @"SELECT value FROM cache WHERE key = ?";
-  int errorCode;
-  GTMSQLiteStatement *statement =
-    [GTMSQLiteStatement statementWithSQL:selectStatement
-                              inDatabase:db_
-                               errorCode:&errorCode];
-  if (errorCode != SQLITE_OK) {
-    HGSLog(@"Unable to create SQLite statement: %@", [db_ lastErrorString]);
-    return nil;
-  }
-
-  if ([statement bindStringAtPosition:1 string:key] != SQLITE_OK) {
-    HGSLog(@"Unable to bind key: %@", [db_ lastErrorString]);
-    return nil;
+  int result = SQLITE_DONE;
+  NSData *valueData = nil;
+  if ([writer_ getPendingData:&valueData forKey:key]) {
+    if (valueData) {
+      result = SQLITE_ROW;
+    }
+  } else {
+    GTMSQLiteStatement *statement = [self statementForSQL:kCacheSelectSQL];
+    if (!statement) return nil;
+
+    @synchronized(statement) {
+      if ([statement bindStringAtPosition:1 string:key] != SQLITE_OK) {
+        HGSLog(@"Unable to bind key: %@", [db_ lastErrorString]);
+        [statement reset];
+        return nil;
+      }
+      // Execute
+      result = [statement stepRow];
+      if (result == SQLITE_ROW) {
+        valueData = [statement resultBlobDataAtPosition:0];
+      }
+      [statement reset];
+    }
   }
-  // Execute
-  int result = [statement stepRow];
   if (result == SQLITE_ERROR) {
-    [statement finalizeStatement];
     HGSLog(@"Error occurred executing statement: %@", [db_ lastErrorString]);
     return nil;
   }
   if (result != SQLITE_ROW) {
     // Not found.
-    [statement finalizeStatement];
+    if (VERMILION_SQLITE_CACHE_MISS_ENABLED()) {
+      VERMILION_SQLITE_CACHE_MISS((char *)[key UTF8String]);
+    }
+    HGSPerformanceCounterAdd(eHGSSQLiteCacheMissCounter, 1);
     return nil;
   }
+  if (VERMILION_SQLITE_CACHE_HIT_ENABLED()) {
+    VERMILION_SQLITE_CACHE_HIT((char *)[key UTF8String]);
+  }
+  HGSPerformanceCounterAdd(eHGSSQLiteCacheHitCounter, 1);
 
-  NSData *valueData = [statement resultBlobDataAtPosition:0];
-  [statement finalizeStatement];
   if (!valueData) {
     HGSLog(@"Unable to retrieve value: nil returned.");
     return nil;
@@ -410,6 +912,8 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
   return theValue;
 }
 
+// Serializes |value| on the calling thread and queues the insert; the
+// writer commits it in the background.
 - (void)setValue:(id)value forKey:(NSString *)key {
   NSString* errorString = nil;
   NSData* valueData = nil;
@@ -428,35 +932,14 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
   }
 
   NSTimeInterval unixTimestamp = [[NSDate date] timeIntervalSince1970];
-
-  NSString* insertStatement = @"INSERT OR REPLACE INTO cache VALUES (?, ?, ?, ?)";
-  int errorCode;
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:insertStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  [statement bindStringAtPosition:1 string:key];
-  [statement bindBlobAtPosition:2 data:valueData];
-  [statement bindLongLongAtPosition:3 value:(long long)unixTimestamp];
-  [statement bindLongLongAtPosition:4 value:(long long)unixTimestamp];
-  // execute
-  int insertResult = [statement stepRow];
-  if (insertResult == SQLITE_ERROR) {
-    HGSLog(@"Unable to add row: %@", [db_ lastErrorString]);
-  }
-  // finalize
-  [statement finalizeStatement];
+  HGSSQLiteCacheWrite *write
+    = [HGSSQLiteCacheWrite insertWriteWithKey:key
+                                         data:valueData
+                                    timestamp:(long long)unixTimestamp];
+  [writer_ enqueueWrite:write];
 }
 
 - (void)setNilValueForKey:(NSString *)key {
-  NSString* deleteStatement = @"DELETE FROM cache WHERE key = ?";
-  int errorCode;
-  GTMSQLiteStatement *statement
-    = [GTMSQLiteStatement statementWithSQL:deleteStatement
-                                inDatabase:db_
-                                 errorCode:&errorCode];
-  [statement bindStringAtPosition:1 string:key];
-  [statement stepRow];
-  [statement finalizeStatement];
+  [writer_ enqueueWrite:[HGSSQLiteCacheWrite deleteWriteWithKey:key]];
 }
 @end
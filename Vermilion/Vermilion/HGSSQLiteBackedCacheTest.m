@@ -32,6 +32,7 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSSQLiteBackedCache.h"
+#import "GTMSQLite.h"
 
 @class HGSSQLiteBackendCache;
 
@@ -40,6 +41,8 @@
 }
 
 - (NSString*)tempDbPath;
+- (void)removeTempDb;
+- (void)writeValues:(NSNumber *)thread;
 @end
 
 @interface HGSSQLiteBackedCache ()
@@ -55,16 +58,30 @@
   return result;
 }
 
-- (void)setUp {
-  NSError* error = nil;
+// Removes the database along with any write-ahead log and shared memory
+// file, so that a stale log is never replayed into the next test's database.
+- (void)removeTempDb {
   NSFileManager *fm = [NSFileManager defaultManager];
-  if ([fm fileExistsAtPath:[self tempDbPath]]) {
-    [fm removeItemAtPath:[self tempDbPath] error:&error];
-    STAssertNil(error,
-                @"Unable to delete file: %@: %@",
-                [self tempDbPath],
-                [error localizedDescription]);
+  NSString *path = [self tempDbPath];
+  NSArray *paths = [NSArray arrayWithObjects:
+                    path,
+                    [path stringByAppendingString:@"-wal"],
+                    [path stringByAppendingString:@"-shm"],
+                    nil];
+  for (NSString *file in paths) {
+    if ([fm fileExistsAtPath:file]) {
+      NSError* error = nil;
+      [fm removeItemAtPath:file error:&error];
+      STAssertNil(error,
+                  @"Unable to delete file: %@: %@",
+                  file,
+                  [error localizedDescription]);
+    }
   }
+}
+
+- (void)setUp {
+  [self removeTempDb];
   cache_ = [[HGSSQLiteBackedCache alloc] initWithPath:[self tempDbPath]
                                               version:@"1.0"];
   STAssertNotNil(cache_, @"Unable to create DB");
@@ -116,6 +133,131 @@
   }
 }
 
+- (void)testStatementReuse {
+  // Every call reuses the same prepared statements, so interleave them and
+  // make sure none is left holding stale bindings or an open read.
+  for (NSUInteger pass = 0; pass < 3; ++pass) {
+    for (NSUInteger i = 0; i < 50; ++i) {
+      NSString *key = [NSString stringWithFormat:@"%u", i];
+      [cache_ setValue:[NSString stringWithFormat:@"%u-%u", pass, i] 
+                forKey:key];
+    }
+    STAssertEquals([cache_ count], (NSUInteger)50, nil);
+    for (NSUInteger i = 0; i < 50; ++i) {
+      NSString *key = [NSString stringWithFormat:@"%u", i];
+      NSString *expected = [NSString stringWithFormat:@"%u-%u", pass, i];
+      STAssertEqualStrings([cache_ valueForKey:key], expected, nil);
+    }
+    STAssertNil([cache_ valueForKey:@"missing"], nil);
+    [cache_ setNilValueForKey:@"0"];
+    STAssertNil([cache_ valueForKey:@"0"], nil);
+    STAssertEquals([cache_ count], (NSUInteger)49, nil);
+    [cache_ flush];
+    [cache_ removeAllObjects];
+    STAssertEquals([cache_ count], (NSUInteger)0, nil);
+  }
+}
+
+- (void)writeValues:(NSNumber *)thread {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSUInteger i = 0; i < 100; ++i) {
+    NSString *key = [NSString stringWithFormat:@"%@-%u", thread, i];
+    [cache_ setValue:key forKey:key];
+  }
+  [pool release];
+}
+
+- (void)testConcurrentWriters {
+  NSMutableArray *threads = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 4; ++i) {
+    NSThread *thread
+      = [[[NSThread alloc] initWithTarget:self
+                                 selector:@selector(writeValues:)
+                                   object:[NSNumber numberWithUnsignedInt:i]]
+         autorelease];
+    [threads addObject:thread];
+    [thread start];
+  }
+  for (NSThread *thread in threads) {
+    while (![thread isFinished]) {
+      [NSThread sleepForTimeInterval:0.01];
+    }
+  }
+  [cache_ flush];
+  STAssertEquals([cache_ count], (NSUInteger)400, nil);
+  for (NSUInteger i = 0; i < 4; ++i) {
+    NSString *key = [NSString stringWithFormat:@"%u-99", i];
+    STAssertEqualStrings([cache_ valueForKey:key], key, nil);
+  }
+}
+
+- (void)testWritesAreVisibleBeforeTheyCommit {
+  // Overwrite the same key many times in a row; every read must see the
+  // last value set, whether or not the writer has committed it yet.
+  for (NSUInteger i = 0; i < 200; ++i) {
+    NSString *value = [NSString stringWithFormat:@"%u", i];
+    [cache_ setValue:value forKey:@"key"];
+    STAssertEqualStrings([cache_ valueForKey:@"key"], value, nil);
+  }
+  [cache_ setNilValueForKey:@"key"];
+  STAssertNil([cache_ valueForKey:@"key"], nil);
+  STAssertEquals([cache_ count], (NSUInteger)0, nil);
+}
+
+- (void)testJournalMode {
+  if ([GTMSQLiteDatabase sqliteVersionNumber] < 3007000) return;
+  int errorCode;
+  GTMSQLiteDatabase *db
+    = [[[GTMSQLiteDatabase alloc] initWithPath:[self tempDbPath]
+                               withCFAdditions:NO
+                                          utf8:YES
+                                     errorCode:&errorCode] autorelease];
+  STAssertEquals(errorCode, SQLITE_OK, nil);
+  GTMSQLiteStatement *statement
+    = [GTMSQLiteStatement statementWithSQL:@"PRAGMA journal_mode"
+                                inDatabase:db
+                                 errorCode:&errorCode];
+  STAssertEquals(errorCode, SQLITE_OK, nil);
+  STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  STAssertEqualStrings([[statement resultStringAtPosition:0] lowercaseString],
+                       @"wal", nil);
+  [statement finalizeStatement];
+}
+
+- (void)testEvictionFollowsAccessOrder {
+  [cache_ setHardMaximumEntries:9];
+  [cache_ setSoftMaximumEntries:5];
+  for (NSUInteger i = 0; i < 10; ++i) {
+    NSString *key = [NSString stringWithFormat:@"%u", i];
+    [cache_ setValue:key forKey:key];
+  }
+  STAssertEquals([cache_ count], (NSUInteger)10, nil);
+
+  // Access times are kept in whole seconds, so make sure the reads land in
+  // a later second than the inserts. Read the even keys several times each;
+  // the repeats should collapse into one touch per key.
+  [NSThread sleepForTimeInterval:1.5];
+  for (NSUInteger pass = 0; pass < 3; ++pass) {
+    for (NSUInteger i = 0; i < 10; i += 2) {
+      NSString *key = [NSString stringWithFormat:@"%u", i];
+      STAssertEqualStrings([cache_ valueForKey:key], key, nil);
+    }
+  }
+
+  // Flushing records the touches and then trims down to the soft maximum,
+  // which has to drop the odd keys since they were never read.
+  [cache_ flush];
+  STAssertEquals([cache_ count], (NSUInteger)5, nil);
+  for (NSUInteger i = 0; i < 10; ++i) {
+    NSString *key = [NSString stringWithFormat:@"%u", i];
+    if (i % 2) {
+      STAssertNil([cache_ valueForKey:key], @"%@ should be evicted", key);
+    } else {
+      STAssertEqualStrings([cache_ valueForKey:key], key, nil);
+    }
+  }
+}
+
 - (void)testInvalidateEntriesNotAccessedAfter {
   // Insert a batch of entries that will be deleted.
   [cache_ setValue:@"xx" forKey:@"1"];
@@ -143,13 +285,7 @@
   [cache_ release];
   cache_ = nil;
 
-  NSError* error = nil;
-  NSString *path = [self tempDbPath];
-  [[NSFileManager defaultManager] removeItemAtPath:path error:&error];
-  STAssertNil(error,
-              @"Unable to clean up after test: %@: %@",
-              [self tempDbPath],
-              [error localizedDescription]);
+  [self removeTempDb];
 }
 
 @end
@@ -32,12 +32,15 @@
 
 #import <Foundation/Foundation.h>
 #import <GTM/GTMDefines.h>
+#import "HGSOperation.h"
 
 /*!
   @header
   @discussion HGSSearchOperation
 */
 
+@class HGSAffinityExecutor;
+@class HGSCancellationToken;
 @class HGSQuery;
 @class HGSSearchSource;
 @class HGSScoredResult;
@@ -50,12 +53,19 @@
 @interface HGSSearchOperation : NSObject {
  @private
   BOOL finished_;
-  BOOL queryCancelled_;
+  HGSCancellationToken *cancellationToken_;
   NSOperation *operation_;
   HGSSearchSource *source_;
   HGSQuery *query_;
   uint64_t queueTime_;
   uint64_t runTime_;
+  /*!
+   Whether the operation has been queued, and whether something (running it,
+   or cancelling it while it was still queued) has claimed the job of
+   finishing it. Changed atomically, since those can race.
+  */
+  volatile int32_t runState_;
+  BOOL recordsRunTime_;
 }
 
 @property (readonly, retain) HGSSearchSource *source;
@@ -65,12 +75,33 @@
 /*!
  Is YES if the source will handle its own threading, or not require a
  thread at all. The default is for sources to be non-concurrent (a thread will
- be created on its behalf).
+ be created on its behalf). Concurrent operations are started on an
+ HGSAffinityExecutor, so they always run on the same thread and have a run
+ loop available. Sources listed in
+ -[HGSDelegate sourcesRequiringThreadAffinity] get an executor of their own,
+ all other sources share one.
  */
 @property (readonly, assign, getter=isConcurrent) BOOL concurrent;
 @property (readonly, assign, getter=isFinished) BOOL finished;
 @property (readonly, assign, getter=isCancelled) BOOL cancelled;
 @property (readonly, retain) NSString *displayName;
+/*!
+ Cancelled when the operation is cancelled. Long running searches should grab
+ it once and check it in their inner loops, or hand it to whatever they are
+ blocked on (see -[HGSCancellationToken installProgressHandlerInDatabase:]).
+*/
+@property (readonly, retain) HGSCancellationToken *cancellationToken;
+/*!
+ The generation of the operation's query.
+*/
+@property (readonly, assign) UInt64 generation;
+/*!
+ Whether HGSSearchSourceRanker should learn from how long the operation took.
+ Defaults to YES. Set to NO for operations that don't do the source's normal
+ amount of work (refining cached results) or that aren't run for the user's
+ query (speculative runs), so that they don't skew the source's estimates.
+*/
+@property (readwrite, assign) BOOL recordsRunTime;
 
 - (id)initWithQuery:(HGSQuery*)query source:(HGSSearchSource *)source;
 
@@ -84,7 +115,9 @@
 
 /*!
  Cancels this operation and clears the observer so no more notification will
- come in.
+ come in. An operation that is cancelled while it is still waiting to run is
+ finished right away, so kHGSSearchOperationDidFinishNotification is posted
+ for it even though it never ran.
 */
 - (void)cancel;
 
@@ -93,6 +126,40 @@
  on the current thread, otherwise it will be posted to an NSOperationQueue.
 */
 - (void)runOnCurrentThread:(BOOL)onThread;
+
+/*!
+ Posts the operation to the shared HGSOperationQueue with |priority|.
+ runOnCurrentThread:NO is equivalent to running with
+ NSOperationQueuePriorityVeryHigh.
+*/
+- (void)runWithQueuePriority:(NSOperationQueuePriority)priority;
+
+/*!
+ Posts the operation to |lane| of the shared HGSOperationQueue with
+ |priority|. runWithQueuePriority: uses eHGSOperationLaneInteractive.
+*/
+- (void)runWithQueuePriority:(NSOperationQueuePriority)priority
+                        lane:(HGSOperationLane)lane;
+
+/*!
+ Runs the operation on |executor|'s thread. Used for sources that need all of
+ their searches to happen on the same thread.
+*/
+- (void)runOnAffinityExecutor:(HGSAffinityExecutor *)executor;
+
+/*!
+ Posts kHGSSearchOperationDidUpdateResultsNotification on the main thread.
+ If the operation has been cancelled by the time the notification gets to the
+ main thread it is dropped, so observers never do any work for stale queries.
+ Subclasses should use this rather than posting the notification themselves.
+*/
+- (void)postDidUpdateResultsNotification;
+
+/*!
+ The number of update notifications that have been dropped because their
+ operation had been cancelled by the time they reached the main thread.
+*/
++ (UInt64)staleUpdateNotificationCount;
 @end
 
 /*!
@@ -148,6 +215,17 @@
 @end
 
 
+/*!
+ Converts a mach_absolute_time() interval (such as runTime or queueTime) into
+ nanoseconds.
+*/
+GTM_EXTERN uint64_t HGSMachTimeToNanoseconds(uint64_t machTime);
+
+/*!
+ Converts nanoseconds into a mach_absolute_time() interval.
+*/
+GTM_EXTERN uint64_t HGSNanosecondsToMachTime(uint64_t nanoseconds);
+
 #pragma mark Notifications
 
 /*!
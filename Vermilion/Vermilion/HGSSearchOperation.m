@@ -31,12 +31,24 @@
 //
 
 #import "HGSSearchOperation.h"
+#import "HGSAffinityExecutor.h"
+#import "HGSCancellationToken.h"
+#import "HGSDelegate.h"
+#import "HGSPluginLoader.h"
 #import <mach/mach_time.h>
+#import <libkern/OSAtomic.h>
 #import "HGSSearchSource.h"
-#import "HGSOperation.h"
+#import "HGSQuery.h"
 #import "HGSLog.h"
+#import "HGSDTrace.h"
+#import "HGSTracer.h"
+#import "HGSPerformanceCounters.h"
 #import "NSNotificationCenter+MainThread.h"
 
+static inline char *HGSSearchOperationProbeSourceID(HGSSearchOperation *op) {
+  return (char *)[[[op source] identifier] UTF8String];
+}
+
 NSString *const kHGSSearchOperationWillStartNotification 
   = @"HGSSearchOperationWillStartNotification";
 NSString *const kHGSSearchOperationDidFinishNotification 
@@ -46,8 +58,42 @@ NSString *const kHGSSearchOperationDidUpdateResultsNotification
 NSString *const kHGSSearchOperationWasCancelledNotification
   = @"HGSSearchOperationWasCancelledNotification";
 
+// Executor shared by the concurrent operations of sources that haven't asked
+// for thread affinity.
+static NSString *const kHGSSearchOperationConcurrentExecutorIdentifier
+  = @"com.google.qsb.searchoperation.concurrent";
+
+static mach_timebase_info_data_t HGSMachTimebaseInfo(void) {
+  static mach_timebase_info_data_t sTimebaseInfo;
+  if (sTimebaseInfo.denom == 0) {
+    mach_timebase_info(&sTimebaseInfo);
+  }
+  return sTimebaseInfo;
+}
+
+uint64_t HGSMachTimeToNanoseconds(uint64_t machTime) {
+  mach_timebase_info_data_t info = HGSMachTimebaseInfo();
+  return machTime * info.numer / info.denom;
+}
+
+uint64_t HGSNanosecondsToMachTime(uint64_t nanoseconds) {
+  mach_timebase_info_data_t info = HGSMachTimebaseInfo();
+  return nanoseconds * info.denom / info.numer;
+}
+
+// Values of runState_.
+enum {
+  kHGSSearchOperationIdle = 0,
+  kHGSSearchOperationQueued,
+  kHGSSearchOperationStarted,
+};
+
 @interface HGSSearchOperation ()
+- (void)markQueued;
+- (BOOL)claimStart;
+- (HGSAffinityExecutor *)concurrentExecutor;
 @property (assign, getter=isFinished) BOOL finished;
+- (void)postDidUpdateResultsNotificationOnMainThread:(id)ignored;
 @end
 
 @implementation HGSSearchOperation
@@ -57,13 +103,23 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 @synthesize finished = finished_;
 @synthesize runTime = runTime_;
 @synthesize queueTime = queueTime_;
+@synthesize cancellationToken = cancellationToken_;
+@synthesize recordsRunTime = recordsRunTime_;
 @dynamic concurrent;
 @dynamic cancelled;
 
+static volatile int64_t gHGSStaleUpdateNotificationCount = 0;
+
++ (UInt64)staleUpdateNotificationCount {
+  return gHGSStaleUpdateNotificationCount;
+}
+
 - (id)initWithQuery:(HGSQuery*)query source:(HGSSearchSource *)source {
   if ((self = [super init])) {
     source_ = [source retain];
     query_ = [query retain]; 
+    cancellationToken_ = [[HGSCancellationToken alloc] init];
+    recordsRunTime_ = YES;
     if (!source_ || !query_) {
       HGSLogDebug(@"HGSSearchOperation -initWithQuery:source: nil source "
                   @"or query");
@@ -77,6 +133,7 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 - (void)dealloc {
   [source_ release];
   [query_ release];
+  [cancellationToken_ release];
   [super dealloc];
 }
 
@@ -89,20 +146,46 @@ NSString *const kHGSSearchOperationWasCancelledNotification
     // Even though we clear the operation here, we don't need to
     // do anything from a threading pov.  If |operation_| were in a queue to run,
     // the queue would have a retain on it, so it won't get freed from under it.
-    queryCancelled_ = YES;
+    [cancellationToken_ cancel];
     [operation_ cancel];
     [operation_ release];
     operation_ = nil;
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationWasCancelledNotification
                                       object:self];
+    // The queue retires cancelled operations without running them, so if
+    // this one hadn't started yet nothing else is going to finish it, and
+    // its observers would never hear that it is done.
+    if ([self claimStart]) {
+      [self finishQuery];
+    }
   }
 }
 
+- (void)markQueued {
+  OSAtomicCompareAndSwap32Barrier(kHGSSearchOperationIdle,
+                                  kHGSSearchOperationQueued,
+                                  &runState_);
+}
+
+// Returns YES if the caller gets to start (and so finish) a queued
+// operation. Only one caller ever does.
+- (BOOL)claimStart {
+  BOOL claimed
+    = OSAtomicCompareAndSwap32Barrier(kHGSSearchOperationQueued,
+                                      kHGSSearchOperationStarted,
+                                      &runState_);
+  if (claimed) {
+    runTime_ = mach_absolute_time();
+    queueTime_ = runTime_ - queueTime_;
+  }
+  return claimed;
+}
+
 - (BOOL)isCancelled {
   // NOTE: this is thread safe because the NSOperationQueue has to retain the
   // operation while it runs.  So the fact that -cancel releases it is ok.
-  return queryCancelled_ || [operation_ isCancelled];
+  return [cancellationToken_ isCancelled] || [operation_ isCancelled];
 }
 
 - (void)wrappedMain {
@@ -124,23 +207,44 @@ NSString *const kHGSSearchOperationWasCancelledNotification
   }
 }
   
+// Sources that need thread affinity get an executor of their own. All other
+// concurrent operations just need a run loop to start their work on and be
+// called back on, so they share one, rather than each source holding on to
+// a thread for the life of the process.
+- (HGSAffinityExecutor *)concurrentExecutor {
+  NSString *identifier = [source_ identifier];
+  id<HGSDelegate> delegate = [[HGSPluginLoader sharedPluginLoader] delegate];
+  NSArray *affinitySources = [delegate sourcesRequiringThreadAffinity];
+  if (![affinitySources containsObject:identifier]) {
+    identifier = kHGSSearchOperationConcurrentExecutorIdentifier;
+  }
+  return [HGSAffinityExecutor executorWithIdentifier:identifier];
+}
+
 - (void)queryOperation:(id)ignored {
-  if (![self isCancelled]) {
+  // Cancelled while queued, and already finished by -cancel.
+  if (![self claimStart]) return;
+  if ([self isCancelled]) {
+    [self finishQuery];
+  } else {
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationWillStartNotification
                                       object:self];
-    runTime_ = mach_absolute_time();
-    queueTime_ = runTime_ - queueTime_;
+    if (VERMILION_OPERATION_START_ENABLED()) {
+      VERMILION_OPERATION_START(HGSSearchOperationProbeSourceID(self), self);
+    }
+    HGSPerformanceCounterAdd(eHGSOperationStartedCounter, 1);
     if ([self isConcurrent]) {
-      if ([NSThread currentThread] == [NSThread mainThread]) {
+      HGSAffinityExecutor *executor = [self concurrentExecutor];
+      if ([executor isCurrentThread]) {
         [self wrappedMain];
       } else {
-        // Concurrents were queued just to get things started, we bounce to the
-        // main loop to actually run them (and they must call finishQuery
-        // when done).
-        [self performSelectorOnMainThread:@selector(wrappedMain)
-                               withObject:nil
-                            waitUntilDone:NO];
+        // Concurrents were queued just to get things started, we bounce to
+        // an executor to actually run them, so they always get the same
+        // thread and a run loop (and they must call finishQuery when done).
+        [executor performSelector:@selector(wrappedMain)
+                         onTarget:self
+                       withObject:nil];
       }
     } else {
       // Fire it
@@ -173,7 +277,32 @@ NSString *const kHGSSearchOperationWasCancelledNotification
     // Never send the notification twice
     return;
   }
-  runTime_ = mach_absolute_time() - runTime_;
+  uint64_t now = mach_absolute_time();
+  runTime_ = now - runTime_;
+  if (HGSTracerIsEnabled()) {
+    NSString *name = [source_ identifier];
+    uint64_t runStart = now - runTime_;
+    HGSTracerRecordAsyncSpan(kHGSTracerQueueCategory, name, self,
+                             runStart - queueTime_, runStart);
+    // Concurrent operations hop threads, so they can't be shown as a span
+    // on the thread they finished on.
+    if ([self isConcurrent]) {
+      HGSTracerRecordAsyncSpan(kHGSTracerOperationCategory, name, self,
+                               runStart, now);
+    } else {
+      HGSTracerRecordSpan(kHGSTracerOperationCategory, name, runStart, now);
+    }
+  }
+  if ([self isCancelled]) {
+    HGSPerformanceCounterAdd(eHGSOperationCancelledCounter, 1);
+    HGSPerformanceCounterAdd(eHGSCancelledWorkNanosecondsCounter,
+                             HGSMachTimeToNanoseconds(runTime_));
+  }
+  if (VERMILION_OPERATION_FINISH_ENABLED()) {
+    VERMILION_OPERATION_FINISH(HGSSearchOperationProbeSourceID(self), self,
+                               HGSMachTimeToNanoseconds(runTime_),
+                               [self isCancelled] ? 1 : 0);
+  }
   [self setFinished:YES];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidFinishNotification
@@ -191,6 +320,30 @@ NSString *const kHGSSearchOperationWasCancelledNotification
   [self doesNotRecognizeSelector:_cmd];
 }
 
+- (UInt64)generation {
+  return [query_ generation];
+}
+
+- (void)postDidUpdateResultsNotification {
+  if ([NSThread isMainThread]) {
+    [self postDidUpdateResultsNotificationOnMainThread:nil];
+  } else {
+    [self performSelectorOnMainThread:@selector(postDidUpdateResultsNotificationOnMainThread:)
+                           withObject:nil
+                        waitUntilDone:NO];
+  }
+}
+
+- (void)postDidUpdateResultsNotificationOnMainThread:(id)ignored {
+  if ([self isCancelled]) {
+    OSAtomicIncrement64Barrier(&gHGSStaleUpdateNotificationCount);
+    return;
+  }
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc postNotificationName:kHGSSearchOperationDidUpdateResultsNotification
+                    object:self];
+}
+
 - (NSArray *)sortedRankedResultsInRange:(NSRange)range
                              typeFilter:(HGSTypeFilter *)typeFilter {
   NSMutableArray *array = nil;
@@ -239,15 +392,45 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 }
 
 - (void)runOnCurrentThread:(BOOL)onThread {
-  NSOperation *operation = [self searchOperation];
-  queueTime_ = mach_absolute_time();
   if (onThread) {
+    [self searchOperation];
+    queueTime_ = mach_absolute_time();
+    [self markQueued];
+    if (VERMILION_OPERATION_QUEUE_ENABLED()) {
+      VERMILION_OPERATION_QUEUE(HGSSearchOperationProbeSourceID(self), self);
+    }
     [self queryOperation:nil];
   } else {
-    HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
-    [operation setQueuePriority:NSOperationQueuePriorityVeryHigh];
-    [queue addOperation:operation];
+    [self runWithQueuePriority:NSOperationQueuePriorityVeryHigh];
+  }
+}
+
+- (void)runOnAffinityExecutor:(HGSAffinityExecutor *)executor {
+  queueTime_ = mach_absolute_time();
+  [self markQueued];
+  if (VERMILION_OPERATION_QUEUE_ENABLED()) {
+    VERMILION_OPERATION_QUEUE(HGSSearchOperationProbeSourceID(self), self);
+  }
+  [executor performSelector:@selector(queryOperation:)
+                   onTarget:self
+                 withObject:nil];
+}
+
+- (void)runWithQueuePriority:(NSOperationQueuePriority)priority {
+  [self runWithQueuePriority:priority lane:eHGSOperationLaneInteractive];
+}
+
+- (void)runWithQueuePriority:(NSOperationQueuePriority)priority
+                        lane:(HGSOperationLane)lane {
+  NSOperation *operation = [self searchOperation];
+  queueTime_ = mach_absolute_time();
+  [self markQueued];
+  if (VERMILION_OPERATION_QUEUE_ENABLED()) {
+    VERMILION_OPERATION_QUEUE(HGSSearchOperationProbeSourceID(self), self);
   }
+  HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+  [operation setQueuePriority:priority];
+  [queue addOperation:operation lane:lane];
 }
 
 - (void)enableUpdates {
@@ -33,9 +33,166 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSSearchOperation.h"
+#import "HGSCallbackSearchSource.h"
+#import "HGSExtension.h"
+#import "HGSQuery.h"
 
-@interface HGSSearchOperationTest : GTMTestCase 
+static const NSUInteger kHGSSearchOperationTestCount = 50;
+
+@interface HGSSearchOperationTestSource : HGSCallbackSearchSource
+@end
+
+@implementation HGSSearchOperationTestSource
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  // Nothing to find.
+}
+
+@end
+
+// A concurrent source that notes the thread it was run on.
+@interface HGSSearchOperationConcurrentTestSource : HGSCallbackSearchSource {
+ @private
+  NSThread *thread_;
+}
+- (NSThread *)thread;
+@end
+
+@implementation HGSSearchOperationConcurrentTestSource
+
+- (void)dealloc {
+  [thread_ release];
+  [super dealloc];
+}
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  @synchronized(self) {
+    [thread_ autorelease];
+    thread_ = [[NSThread currentThread] retain];
+  }
+  [operation finishQuery];
+}
+
+- (NSThread *)thread {
+  @synchronized(self) {
+    return [[thread_ retain] autorelease];
+  }
+  return nil;
+}
+
+- (BOOL)isSearchConcurrent {
+  return YES;
+}
+
+@end
+
+@interface HGSSearchOperationTest : GTMTestCase {
+ @private
+  NSUInteger finishedCount_;
+}
 @end
 
 @implementation HGSSearchOperationTest
+
+- (void)searchOperationDidFinish:(NSNotification *)notification {
+  ++finishedCount_;
+}
+
+// Cancels operations right after queueing them, so that most are cancelled
+// before they get to run, and checks that every one of them still reports
+// that it finished.
+- (void)testCancelWhileQueuedFinishes {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundle, kHGSExtensionBundleKey,
+       @"com.google.qsb.searchoperationtest.source",
+       kHGSExtensionIdentifierKey,
+       nil];
+  HGSSearchOperationTestSource *source
+    = [[[HGSSearchOperationTestSource alloc] initWithConfiguration:config]
+       autorelease];
+  STAssertNotNil(source, nil);
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"cancel"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  NSMutableArray *operations = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kHGSSearchOperationTestCount; ++i) {
+    HGSSearchOperation *operation
+      = [source searchOperationForQuery:query];
+    [operations addObject:operation];
+    [nc addObserver:self
+           selector:@selector(searchOperationDidFinish:)
+               name:kHGSSearchOperationDidFinishNotification
+             object:operation];
+    [operation runWithQueuePriority:NSOperationQueuePriorityLow];
+    [operation cancel];
+  }
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (finishedCount_ < kHGSSearchOperationTestCount
+         && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertEquals(finishedCount_, (NSUInteger)kHGSSearchOperationTestCount, nil);
+  for (HGSSearchOperation *operation in operations) {
+    STAssertTrue([operation isFinished], nil);
+  }
+  // Let any notifications still in flight show up, to catch duplicates.
+  [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  STAssertEquals(finishedCount_, (NSUInteger)kHGSSearchOperationTestCount, nil);
+  [nc removeObserver:self];
+}
+
+// Concurrent sources that haven't asked for thread affinity share a thread,
+// rather than getting one each.
+- (void)testConcurrentSourcesShareExecutor {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSString *identifiers[] = {
+    @"com.google.qsb.searchoperationtest.concurrent1",
+    @"com.google.qsb.searchoperationtest.concurrent2"
+  };
+  const NSUInteger kSourceCount = sizeof(identifiers) / sizeof(identifiers[0]);
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"concurrent"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  NSMutableArray *sources = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kSourceCount; ++i) {
+    NSDictionary *config
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         bundle, kHGSExtensionBundleKey,
+         identifiers[i], kHGSExtensionIdentifierKey,
+         nil];
+    HGSSearchOperationConcurrentTestSource *source
+      = [[[HGSSearchOperationConcurrentTestSource alloc]
+          initWithConfiguration:config] autorelease];
+    STAssertNotNil(source, nil);
+    [sources addObject:source];
+    HGSSearchOperation *operation = [source searchOperationForQuery:query];
+    STAssertTrue([operation isConcurrent], nil);
+    [nc addObserver:self
+           selector:@selector(searchOperationDidFinish:)
+               name:kHGSSearchOperationDidFinishNotification
+             object:operation];
+    [operation runOnCurrentThread:NO];
+  }
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (finishedCount_ < kSourceCount && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertEquals(finishedCount_, (NSUInteger)kSourceCount, nil);
+  NSThread *thread = [[sources objectAtIndex:0] thread];
+  STAssertNotNil(thread, nil);
+  STAssertNotEquals(thread, [NSThread mainThread], nil);
+  STAssertEquals([[sources objectAtIndex:1] thread], thread, nil);
+  [nc removeObserver:self];
+}
+
 @end
@@ -179,6 +179,73 @@
 
 @end
 
+/*!
+  Sources can adopt HGSRefinableSearchSource to tell the query controller that
+  their results for one query can be derived from their results for an earlier
+  query, so that the results from the previous keystroke can be reused instead
+  of searching from scratch. Typical adopters are sources whose results for a
+  longer query are a subset of their results for a prefix of it, and sources
+  that ignore the query string altogether.
+  @seealso //google_vermilion_ref/occ/cl/HGSQueryResultCache HGSQueryResultCache
+*/
+@protocol HGSRefinableSearchSource
+
+/*!
+  Called on the main thread, so must be cheap.
+  @param oldQuery A query that this source has results for. Always has the same
+         pivot objects and action argument as |newQuery|.
+  @param newQuery The query that we would like results for.
+  @result YES if the results for |newQuery| can be derived from the results
+          for |oldQuery| with
+          resultsByRefiningResults:ofQuery:forOperation:.
+*/
+- (BOOL)canRefineResultsOfQuery:(HGSQuery *)oldQuery
+                        toQuery:(HGSQuery *)newQuery;
+
+/*!
+  Derive the results for [operation query] from the results of an earlier
+  query. Called on the operation's thread, so must be thread safe, and should
+  check [operation isCancelled] periodically.
+  @param results The HGSScoredResults that this source returned for |oldQuery|.
+  @param oldQuery The query |results| were returned for.
+  @param operation The operation being run for the new query.
+  @result The HGSScoredResults for [operation query].
+*/
+- (NSArray *)resultsByRefiningResults:(NSArray *)results
+                              ofQuery:(HGSQuery *)oldQuery
+                         forOperation:(HGSSearchOperation *)operation;
+@end
+
+/*!
+  Posted on the main thread by an HGSRefinableSearchSource when the results it
+  returned for earlier queries are no longer valid (for example because it
+  rebuilt its index), so that cached results for it get thrown away.
+  Object is the source.
+*/
+extern NSString *const kHGSRefinableSearchSourceResultsInvalidatedNotification;
+
+/*!
+  Sources that remember what the user has typed in the past can adopt
+  HGSQueryPredictingSearchSource to help HGSSpeculativeQueryExecutor guess
+  what the user is going to type next.
+*/
+@protocol HGSQueryPredictingSearchSource
+
+/*!
+  Called on the main thread while the user is idle, so must be cheap.
+  @param query The query the user has typed so far.
+  @param maximumCount The maximum number of predictions wanted.
+  @result An array of NSStrings, most likely first, of queries that the user
+          is likely to type next, as the user would type them. Each should
+          extend the tokenized query string of |query| once tokenized. Since results for a query are refined for any
+          query that starts with it (see HGSQueryResultCache), predicting
+          the next keystroke or two is usually more useful than predicting
+          whole queries.
+*/
+- (NSArray *)predictedQueryStringsForQuery:(HGSQuery *)query
+                              maximumCount:(NSUInteger)maximumCount;
+@end
+
 /*!
   kHGSValidateSearchSourceBehaviorsPrefKey is a boolean preference that the
   engine can use to enable extra logging about Source behaviors to help
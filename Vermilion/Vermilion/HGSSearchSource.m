@@ -52,6 +52,8 @@ NSString *const kHGSSearchSourcePivotableTypesKey
   = @"HGSSearchSourcePivotableTypes";
 NSString *const kHGSSearchSourceCannotArchiveKey
 = @"HGSSearchSourceCannotArchive";
+NSString *const kHGSRefinableSearchSourceResultsInvalidatedNotification
+  = @"HGSRefinableSearchSourceResultsInvalidatedNotification";
 
 @implementation HGSSearchSource
 @synthesize pivotableTypes = pivotableTypes_;
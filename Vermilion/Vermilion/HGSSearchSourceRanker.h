@@ -40,17 +40,29 @@
 
 @class HGSSearchSource;
 @class HGSExtensionPoint;
+@class HGSQuery;
 
 /*!
- Keeps track of the ranking of search sources. Currently this is only the
- order that they fire off in searches, but eventually will be responsible
- for influencing the ranking of results in HGSMixer.
+ Keeps track of the ranking of search sources. This decides the order that
+ they fire off in searches, and which of them are worth running at all for a
+ given query (see -shouldDeferSource:forQuery:). Eventually will be
+ responsible for influencing the ranking of results in HGSMixer.
 */
 @interface HGSSearchSourceRanker : NSObject {
  @private
   NSMutableDictionary *rankDictionary_;
   HGSExtensionPoint *sourcesPoint_;
   UInt64 promotionCount_;
+  NSString *currentQueryShape_;
+  // Slot in the saved file of each source's record, keyed by source ID.
+  NSMutableDictionary *recordSlots_;
+  NSMutableData *fileImage_;
+  // Number of record slots in fileImage_, including those of records that
+  // couldn't be loaded, which are never reused.
+  NSUInteger recordCount_;
+  NSString *storagePath_;
+  UInt64 deferralCount_;
+  UInt64 explorationCount_;
   BOOL dirty_;
 }
 
@@ -61,15 +73,16 @@
 
 /*!
  Returns the shared ranker which will initialize itself with data stored
- in user preferences if available, or else a default initial set of data.
- It will update the user preference data on a regular basis automatically.
+ in the application support folder (or, for older versions, the user
+ preferences) if available, or else a default initial set of data.
+ It saves its data, off the main thread, on a regular basis automatically.
 */
 + (HGSSearchSourceRanker *)sharedSearchSourceRanker;
 
 /*! 
  Designated initializer. Initialize with data previously obtained from
- rankerData. In general you should always use +sharedSearchSourceRanker.
- This exists mainly for unittesting.
+ rankerData or binaryRankerData. In general you should always use
+ +sharedSearchSourceRanker. This exists mainly for unittesting.
  @param data Data to initialize the ranker with.
  @param point HGSExtensionPoint to get sources from.
  @result HGSSearchSourceRanker instance.
@@ -82,7 +95,16 @@
 - (id)rankerData;
 
 /*!
- Returns the list of source in order from fastest to slowest.
+ Archives the current ranker data in the compact binary form that the shared
+ ranker saves. Each source has a fixed size record, and only the records of
+ sources that have changed since the last call are encoded again.
+*/
+- (NSData *)binaryRankerData;
+
+/*!
+ Returns the list of source in order from fastest to slowest. Once a source
+ has enough history, its 90th percentile run time is used so that sources
+ that are often slow sort after sources that are steady.
 */
 - (NSArray *)orderedSourcesByPerformance;
 
@@ -91,6 +113,47 @@
 */
 - (UInt64)averageTimeForSource:(HGSSearchSource *)source;
 
+/*!
+ Returns how long we expect a source to take to run, in seconds, based on
+ its history. Once a source has enough history this is its 90th percentile
+ run time, otherwise it is its average run time. Returns 0 if we don't know
+ anything about the source.
+*/
+- (NSTimeInterval)expectedRunTimeForSource:(HGSSearchSource *)source;
+
+/*!
+ Returns the time, in seconds, below which |percentile| percent of a source's
+ runs have finished. Returns 0 if the source hasn't run.
+*/
+- (NSTimeInterval)runTimeForSource:(HGSSearchSource *)source
+                      atPercentile:(double)percentile;
+
+/*!
+ Returns the time, in seconds, below which |percentile| percent of a source's
+ operations have waited in the queue before running. Returns 0 if the
+ source hasn't run.
+*/
+- (NSTimeInterval)queueTimeForSource:(HGSSearchSource *)source
+                        atPercentile:(double)percentile;
+
+/*!
+ Returns how long, in seconds, a source should be given before it is
+ considered to have hung: a multiple of its 99th percentile run time, but no
+ less than kHGSSearchSourceMinimumTimeoutPrefKey. Returns 0 if we don't have
+ enough history to say.
+*/
+- (NSTimeInterval)timeoutForSource:(HGSSearchSource *)source;
+
+/*!
+ Tells the ranker that a source was cancelled for taking too long. Cancelled
+ operations aren't otherwise recorded, so without this a source that has
+ become slower would keep being timed out against its old history.
+ @param source The source that was cancelled.
+ @param interval How long, in seconds, it had been running.
+*/
+- (void)recordTimeoutOfSource:(HGSSearchSource *)source
+                afterInterval:(NSTimeInterval)interval;
+
 /*!
  Total number of promotions.
 */
@@ -101,4 +164,80 @@
 */
 - (UInt64)promotionCountForSource:(HGSSearchSource *)source;
 
+/*!
+ Returns a short string describing the shape of a query: whether it is
+ pivoted, how many terms it has and roughly how long it is. Queries with the
+ same shape tend to get useful results from the same sources, so run and
+ promotion counts are kept per shape.
+*/
+- (NSString *)shapeForQuery:(HGSQuery *)query;
+
+/*!
+ Should |source| be held back to a second wave for |query|? Sources are
+ deferred when they are expensive (see
+ kHGSSearchSourceGatingMinimumRunTimePrefKey) and their results have almost
+ never been promoted for queries of the same shape. Every so often a source
+ that would be deferred is let through anyway so that its statistics don't
+ go stale. Decisions are logged at debug level and counted.
+*/
+- (BOOL)shouldDeferSource:(HGSSearchSource *)source forQuery:(HGSQuery *)query;
+
+/*!
+ Number of times that -shouldDeferSource:forQuery: has deferred a source.
+*/
+- (UInt64)deferralCount;
+
+/*!
+ Number of times that -shouldDeferSource:forQuery: has let a source that
+ should have been deferred run so that its statistics stay current.
+*/
+- (UInt64)explorationCount;
+
 @end
+
+/*!
+ Boolean preference for turning source gating on and off.
+*/
+#define kHGSSearchSourceGatingEnabledPrefKey @"HGSSearchSourceGatingEnabled"
+
+/*!
+ Double preference for the average run time (in seconds) above which a source
+ is expensive enough to be considered for deferral.
+*/
+#define kHGSSearchSourceGatingMinimumRunTimePrefKey \
+  @"HGSSearchSourceGatingMinimumRunTime"
+
+/*!
+ Integer preference for how many times a source has to have run for queries
+ of a shape before its promotion rate for that shape is trusted.
+*/
+#define kHGSSearchSourceGatingMinimumRunsPrefKey \
+  @"HGSSearchSourceGatingMinimumRuns"
+
+/*!
+ Double preference for the fraction of runs that have to lead to a promotion
+ for a source to avoid deferral.
+*/
+#define kHGSSearchSourceGatingPromotionRatePrefKey \
+  @"HGSSearchSourceGatingPromotionRate"
+
+/*!
+ Integer preference for how often a source that would be deferred is run
+ anyway. One in every this many deferrals is let through. 0 never lets them
+ through.
+*/
+#define kHGSSearchSourceGatingExplorationIntervalPrefKey \
+  @"HGSSearchSourceGatingExplorationInterval"
+
+/*!
+ Double preference for how many times a source's 99th percentile run time it
+ is given before it is timed out.
+*/
+#define kHGSSearchSourceTimeoutMultiplierPrefKey \
+  @"HGSSearchSourceTimeoutMultiplier"
+
+/*!
+ Double preference for the shortest timeout (in seconds) that a source will
+ be given, however fast its history says it is.
+*/
+#define kHGSSearchSourceMinimumTimeoutPrefKey @"HGSSearchSourceMinimumTimeout"
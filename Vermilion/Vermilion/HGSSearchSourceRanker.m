@@ -31,9 +31,17 @@
 //
 
 #import "HGSSearchSourceRanker.h"
+#import "HGSAffinityExecutor.h"
+#import "HGSDelegate.h"
 #import "HGSMemorySearchSource.h"
+#import "HGSPluginLoader.h"
+#import "HGSSearchOperation.h"
 #import "HGSCoreExtensionPoints.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSQuery.h"
+#import "HGSQueryController.h"
 #import "HGSResult.h"
+#import "HGSTokenizer.h"
 #import "HGSLog.h"
 #import "HGSBundle.h"
 
@@ -41,31 +49,156 @@ static NSString *const kHGSSearchSourceRankerDataPointRunTimeKey
   = @"runtime";
 static NSString *const kHGSSearchSourceRankerDataPointPromotionsKey
   = @"promotions";
+static NSString *const kHGSSearchSourceRankerDataPointShapeRunsKey
+  = @"shapeRuns";
+static NSString *const kHGSSearchSourceRankerDataPointShapePromotionsKey
+  = @"shapePromotions";
+static NSString *const kHGSSearchSourceRankerDataPointRunHistogramKey
+  = @"runHistogram";
+static NSString *const kHGSSearchSourceRankerDataPointQueueHistogramKey
+  = @"queueHistogram";
+// Where ranker data used to be stored, before it had a file of its own.
 static NSString *const kHGSSearchSourceRankerDataKey
   = @"HGSSearchSourceRankerData";
 static NSString *const kHGSSearchSourceRankerSourceIDKey
   = @"HGSSearchSourceRankerSourceID";
+static NSString *const kHGSSearchSourceRankerFileName
+  = @"SearchSourceRanker.data";
+static NSString *const kHGSSearchSourceRankerWriterIdentifier
+  = @"com.google.qsb.searchsourceranker.writer";
+
+// Number of runs a source needs before we trust its histograms over its
+// average.
+static const UInt64 kHGSSearchSourceRankerMinimumHistogramCount = 20;
+
+// Query shapes are a combination of pivoted or not, 0 to 3 terms and one of
+// three length classes.
+static const char kHGSSearchSourceRankerLengthClasses[] = "sml";
+#define kHGSSearchSourceRankerShapeCount (2 * 4 * 3)
+
+// The binary ranker file is a header followed by one fixed size record per
+// source. Everything is little endian. Records never move once they have
+// been given a slot, so saving only has to re-encode the records of the
+// sources that have changed.
+static const UInt32 kHGSSearchSourceRankerFileMagic = 'HGSR';
+static const UInt32 kHGSSearchSourceRankerFileVersion = 1;
+#define kHGSSearchSourceRankerSourceIDLength 128
+
+typedef struct {
+  UInt32 magic;
+  UInt32 version;
+  UInt32 recordSize;
+  UInt32 recordCount;
+} HGSSearchSourceRankerFileHeader;
+
+typedef struct {
+  char sourceID[kHGSSearchSourceRankerSourceIDLength];
+  UInt64 averageTime;
+  UInt64 promotions;
+  UInt32 shapeRuns[kHGSSearchSourceRankerShapeCount];
+  UInt32 shapePromotions[kHGSSearchSourceRankerShapeCount];
+  UInt16 runCounts[kHGSLatencyHistogramCountsLength];
+  UInt16 queueCounts[kHGSLatencyHistogramCountsLength];
+} HGSSearchSourceRankerRecord;
+
+// Returns YES if |data| is a ranker file that we can load.
+static BOOL HGSSearchSourceRankerIsValidBinaryData(NSData *data) {
+  NSUInteger length = [data length];
+  const HGSSearchSourceRankerFileHeader *header = [data bytes];
+  if (length < sizeof(*header)
+      || CFSwapInt32LittleToHost(header->magic) != kHGSSearchSourceRankerFileMagic
+      || CFSwapInt32LittleToHost(header->version) != kHGSSearchSourceRankerFileVersion
+      || CFSwapInt32LittleToHost(header->recordSize) != sizeof(HGSSearchSourceRankerRecord)) {
+    HGSLog(@"Ignoring source ranker data that we don't understand.");
+    return NO;
+  }
+  NSUInteger recordCount = CFSwapInt32LittleToHost(header->recordCount);
+  if (length != sizeof(*header) + recordCount * sizeof(HGSSearchSourceRankerRecord)) {
+    HGSLog(@"Ignoring truncated source ranker data.");
+    return NO;
+  }
+  return YES;
+}
+
+static NSString *HGSSearchSourceRankerShape(BOOL pivoted,
+                                            NSUInteger termCount,
+                                            char lengthClass) {
+  return [NSString stringWithFormat:@"%@t%lu%c",
+          pivoted ? @"p" : @"", (unsigned long)termCount, lengthClass];
+}
+
+static NSString *HGSSearchSourceRankerShapeForIndex(NSUInteger index) {
+  BOOL pivoted = index >= kHGSSearchSourceRankerShapeCount / 2;
+  index %= kHGSSearchSourceRankerShapeCount / 2;
+  return HGSSearchSourceRankerShape(pivoted, index / 3,
+                                    kHGSSearchSourceRankerLengthClasses[index % 3]);
+}
+
+// Returns -1 for strings that aren't shapes.
+static NSInteger HGSSearchSourceRankerShapeIndex(NSString *shape) {
+  const char *chars = [shape UTF8String];
+  if (!chars) return -1;
+  NSInteger index = 0;
+  if (chars[0] == 'p') {
+    index = kHGSSearchSourceRankerShapeCount / 2;
+    ++chars;
+  }
+  if (chars[0] != 't' || chars[1] < '0' || chars[1] > '3') return -1;
+  if (chars[2] == '\0') return -1;
+  const char *lengthClass = strchr(kHGSSearchSourceRankerLengthClasses, chars[2]);
+  if (!lengthClass || chars[3] != '\0') return -1;
+  return index + (chars[1] - '0') * 3
+    + (lengthClass - kHGSSearchSourceRankerLengthClasses);
+}
 
 // Ranks sources in the order that we should run them
 @interface HGSSearchSourceRankerDataPoint : NSObject {
  @private
   UInt64 averageTime_;
   UInt64 promotions_;
+  // Run and promotion counts keyed by query shape.
+  NSMutableDictionary *shapeRuns_;
+  NSMutableDictionary *shapePromotions_;
+  // Number of times that we have wanted to defer this source.
+  NSUInteger deferrals_;
+  HGSLatencyHistogram *runHistogram_;
+  HGSLatencyHistogram *queueHistogram_;
   BOOL firstRunCompleted_;
+  // Has anything that is saved changed since the record was last encoded.
+  BOOL recordDirty_;
 }
 - (id)initWithDictionary:(NSDictionary *)dict;
+- (id)initWithRecord:(const HGSSearchSourceRankerRecord *)record;
 - (void)encodeToDictionary:(NSMutableDictionary *)dict;
+- (void)encodeToRecord:(HGSSearchSourceRankerRecord *)record
+              sourceID:(NSString *)sourceID;
+- (BOOL)isRecordDirty;
+- (void)setRecordDirty:(BOOL)dirty;
 - (void)addTimeDataPoint:(UInt64)machTime;
+- (void)addQueueTimeDataPoint:(UInt64)machTime;
+- (void)addTimeout:(UInt64)nanoseconds;
+- (UInt64)expectedTime;
+- (HGSLatencyHistogram *)runHistogram;
+- (HGSLatencyHistogram *)queueHistogram;
+- (void)addRunForShape:(NSString *)shape;
 - (void)promote;
+- (void)promoteForShape:(NSString *)shape;
 - (UInt64)averageTime;
 - (UInt64)promotionCount;
+- (UInt64)runCountForShape:(NSString *)shape;
+- (UInt64)promotionCountForShape:(NSString *)shape;
+- (NSUInteger)addDeferral;
 @end
 
 @interface HGSSearchSourceRanker ()
 
-- (void)saveToPreferencesTimer:(NSTimer *)timer;
+- (void)loadBinaryRankerData:(NSData *)data;
+- (void)saveTimer:(NSTimer *)timer;
+- (void)writeBinaryRankerData:(NSData *)data;
 - (void)resultDidPromote:(NSNotification *)notification;
 - (void)searchOperationDidFinish:(NSNotification *)notification;
+- (void)queryControllerWillStart:(NSNotification *)notification;
+- (HGSSearchSourceRankerDataPoint *)dataPointForSource:(HGSSearchSource *)source;
 
 @end
 
@@ -84,8 +217,8 @@ static NSInteger HGSSearchSourceRankerPerformanceSort(id src1,
   HGSSearchSourceRankerDataPoint *dp1 = [rankDictionary objectForKey:id1];
   HGSSearchSourceRankerDataPoint *dp2 = [rankDictionary objectForKey:id2];
   NSInteger order = NSOrderedSame;
-  UInt64 time1 = [dp1 averageTime];
-  UInt64 time2 = [dp2 averageTime];
+  UInt64 time1 = [dp1 expectedTime];
+  UInt64 time2 = [dp2 expectedTime];
   if (time1 > time2) {
     order = NSOrderedDescending;
   } else if (time1 < time2) {
@@ -134,6 +267,29 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 
 @synthesize dirty = dirty_;
 
++ (void)initialize {
+  if (self == [HGSSearchSourceRanker class]) {
+    NSDictionary *defaultsDict
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithBool:YES],
+         kHGSSearchSourceGatingEnabledPrefKey,
+         [NSNumber numberWithDouble:0.1],
+         kHGSSearchSourceGatingMinimumRunTimePrefKey,
+         [NSNumber numberWithInt:25],
+         kHGSSearchSourceGatingMinimumRunsPrefKey,
+         [NSNumber numberWithDouble:0.01],
+         kHGSSearchSourceGatingPromotionRatePrefKey,
+         [NSNumber numberWithInt:20],
+         kHGSSearchSourceGatingExplorationIntervalPrefKey,
+         [NSNumber numberWithDouble:4.0],
+         kHGSSearchSourceTimeoutMultiplierPrefKey,
+         [NSNumber numberWithDouble:2.0],
+         kHGSSearchSourceMinimumTimeoutPrefKey,
+         nil];
+    NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+    [sd registerDefaults:defaultsDict];
+  }
+}
 
 + (HGSSearchSourceRanker *)sharedSearchSourceRanker {
   // Not using GTMObjectSingleton because we want to be able to
@@ -149,24 +305,39 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 }
 
 - (id)init {
-  NSUserDefaults *userDefaults = [NSUserDefaults standardUserDefaults];
-  NSArray *array = [userDefaults arrayForKey:kHGSSearchSourceRankerDataKey];
-  if (!array) {
+  id<HGSDelegate> delegate = [[HGSPluginLoader sharedPluginLoader] delegate];
+  NSString *folder = [delegate userApplicationSupportFolderForApp];
+  NSString *path
+    = [folder stringByAppendingPathComponent:kHGSSearchSourceRankerFileName];
+  id data = path ? [NSData dataWithContentsOfFile:path] : nil;
+  BOOL isValidFile = YES;
+  if (data && !HGSSearchSourceRankerIsValidBinaryData(data)) {
+    // Start again from the defaults, and overwrite the file on the next save.
+    data = nil;
+    isValidFile = NO;
+  }
+  if (!data && isValidFile) {
+    // Older versions kept the data in the user's preferences.
+    NSUserDefaults *userDefaults = [NSUserDefaults standardUserDefaults];
+    data = [userDefaults arrayForKey:kHGSSearchSourceRankerDataKey];
+  }
+  if (!data) {
     // Load defaults
     NSBundle *bundle = HGSGetPluginBundle();
     NSString *plistPath
       = [bundle pathForResource:@"HGSSearchSourceRankerCalibration"
                          ofType:@"plist"];
-    array = [NSArray arrayWithContentsOfFile:plistPath];
+    data = [NSArray arrayWithContentsOfFile:plistPath];
   }
-  HGSAssert(array, nil);
-  self = [self initWithRankerData:array
+  HGSAssert(data, nil);
+  self = [self initWithRankerData:data
                      sourcesPoint:[HGSExtensionPoint sourcesPoint]];
   if (self) {
+    storagePath_ = [path copy];
     [NSTimer scheduledTimerWithTimeInterval:10
                                      target:self
-                                   selector:@selector(saveToPreferencesTimer:)
-                                   userInfo:@"saveToPreferencesTimer"
+                                   selector:@selector(saveTimer:)
+                                   userInfo:@"saveTimer"
                                     repeats:YES];
   }
   return self;
@@ -175,10 +346,15 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 - (id)initWithRankerData:(id)data sourcesPoint:(HGSExtensionPoint*)point {
   if ((self = [super init])) {
     HGSAssert(point, nil);
-    HGSAssert([data isKindOfClass:[NSArray class]], nil);
+    HGSAssert(!data
+              || [data isKindOfClass:[NSArray class]]
+              || [data isKindOfClass:[NSData class]], nil);
     rankDictionary_ = [[NSMutableDictionary alloc] init];
+    recordSlots_ = [[NSMutableDictionary alloc] init];
     sourcesPoint_ = [point retain];
-    if (data) {
+    if ([data isKindOfClass:[NSData class]]) {
+      [self loadBinaryRankerData:data];
+    } else if (data) {
       for (NSDictionary *entry in data) {
         NSString *key = [entry objectForKey:kHGSSearchSourceRankerSourceIDKey];
         HGSSearchSourceRankerDataPoint *dp
@@ -199,6 +375,10 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
            selector:@selector(searchOperationDidFinish:)
                name:kHGSSearchOperationDidFinishNotification
              object:nil];
+    [nc addObserver:self
+           selector:@selector(queryControllerWillStart:)
+               name:kHGSQueryControllerWillStartNotification
+             object:nil];
   }
   return self;
 }
@@ -207,6 +387,10 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 - (void)dealloc {
   [rankDictionary_ release];
   [sourcesPoint_ release];
+  [currentQueryShape_ release];
+  [recordSlots_ release];
+  [fileImage_ release];
+  [storagePath_ release];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   [nc removeObserver:self];
   [super dealloc];
@@ -229,17 +413,109 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   return array;
 }
 
-- (void)addTimeDataPoint:(UInt64)machTime
-               forSource:(HGSSearchSource *)source {
-  NSString *sourceID = [source identifier];
-  @synchronized (self) {
+- (void)loadBinaryRankerData:(NSData *)data {
+  if (!HGSSearchSourceRankerIsValidBinaryData(data)) return;
+  const HGSSearchSourceRankerFileHeader *header = [data bytes];
+  NSUInteger recordCount = CFSwapInt32LittleToHost(header->recordCount);
+  const HGSSearchSourceRankerRecord *records
+    = (const HGSSearchSourceRankerRecord *)(header + 1);
+  for (NSUInteger i = 0; i < recordCount; ++i) {
+    const HGSSearchSourceRankerRecord *record = records + i;
+    size_t idLength = strnlen(record->sourceID,
+                              kHGSSearchSourceRankerSourceIDLength);
+    NSString *sourceID
+      = [[[NSString alloc] initWithBytes:record->sourceID
+                                  length:idLength
+                                encoding:NSUTF8StringEncoding] autorelease];
+    if (![sourceID length]) continue;
     HGSSearchSourceRankerDataPoint *dp
-      = [rankDictionary_ objectForKey:sourceID];
-    if (!dp) {
-      dp = [[[HGSSearchSourceRankerDataPoint alloc] init] autorelease];
-      [rankDictionary_ setObject:dp forKey:sourceID];
+      = [[[HGSSearchSourceRankerDataPoint alloc] initWithRecord:record]
+         autorelease];
+    [rankDictionary_ setObject:dp forKey:sourceID];
+    [recordSlots_ setObject:[NSNumber numberWithUnsignedInteger:i]
+                     forKey:sourceID];
+    promotionCount_ += [dp promotionCount];
+  }
+  // Keep the data as it is, so that sources that don't change never have to
+  // be encoded again. Slots of records that we skipped stay taken, so new
+  // sources are added after all of them.
+  fileImage_ = [data mutableCopy];
+  recordCount_ = recordCount;
+}
+
+- (NSData *)binaryRankerData {
+  @synchronized (self) {
+    if (!fileImage_) {
+      fileImage_
+        = [[NSMutableData alloc] initWithLength:sizeof(HGSSearchSourceRankerFileHeader)];
+      [recordSlots_ removeAllObjects];
+      recordCount_ = 0;
+    }
+    for (NSString *sourceID in rankDictionary_) {
+      HGSSearchSourceRankerDataPoint *dp
+        = [rankDictionary_ objectForKey:sourceID];
+      NSNumber *slot = [recordSlots_ objectForKey:sourceID];
+      if (!slot) {
+        NSUInteger idLength
+          = [sourceID lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        if (idLength >= kHGSSearchSourceRankerSourceIDLength) {
+          HGSLogDebug(@"Source identifier %@ is too long to save ranker "
+                      @"data for.", sourceID);
+          continue;
+        }
+        slot = [NSNumber numberWithUnsignedInteger:recordCount_++];
+        [recordSlots_ setObject:slot forKey:sourceID];
+        [fileImage_ increaseLengthBy:sizeof(HGSSearchSourceRankerRecord)];
+        [dp setRecordDirty:YES];
+      }
+      if ([dp isRecordDirty]) {
+        HGSSearchSourceRankerFileHeader *header = [fileImage_ mutableBytes];
+        HGSSearchSourceRankerRecord *records
+          = (HGSSearchSourceRankerRecord *)(header + 1);
+        [dp encodeToRecord:records + [slot unsignedIntegerValue]
+                  sourceID:sourceID];
+        [dp setRecordDirty:NO];
+      }
     }
+    HGSSearchSourceRankerFileHeader *header = [fileImage_ mutableBytes];
+    header->magic = CFSwapInt32HostToLittle(kHGSSearchSourceRankerFileMagic);
+    header->version = CFSwapInt32HostToLittle(kHGSSearchSourceRankerFileVersion);
+    header->recordSize
+      = CFSwapInt32HostToLittle(sizeof(HGSSearchSourceRankerRecord));
+    header->recordCount = CFSwapInt32HostToLittle(recordCount_);
+    return [NSData dataWithData:fileImage_];
+  }
+  return nil;
+}
+
+- (HGSSearchSourceRankerDataPoint *)dataPointForSource:(HGSSearchSource *)source {
+  NSString *sourceID = [source identifier];
+  HGSSearchSourceRankerDataPoint *dp = [rankDictionary_ objectForKey:sourceID];
+  if (!dp) {
+    dp = [[[HGSSearchSourceRankerDataPoint alloc] init] autorelease];
+    [rankDictionary_ setObject:dp forKey:sourceID];
+  }
+  return dp;
+}
+
+- (void)addTimeDataPoint:(UInt64)machTime
+               queueTime:(UInt64)queueMachTime
+               forSource:(HGSSearchSource *)source
+                   shape:(NSString *)shape {
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp = [self dataPointForSource:source];
     [dp addTimeDataPoint:machTime];
+    [dp addQueueTimeDataPoint:queueMachTime];
+    [dp addRunForShape:shape];
+    [self setDirty:YES];
+  }
+}
+
+- (void)recordTimeoutOfSource:(HGSSearchSource *)source
+                afterInterval:(NSTimeInterval)interval {
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp = [self dataPointForSource:source];
+    [dp addTimeout:(UInt64)(interval * 1000000000.0)];
     [self setDirty:YES];
   }
 }
@@ -257,6 +533,53 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   return avgTime;
 }
 
+- (NSTimeInterval)expectedRunTimeForSource:(HGSSearchSource *)source {
+  UInt64 expectedTime = 0;
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:[source identifier]];
+    expectedTime = [dp expectedTime];
+  }
+  return expectedTime / 1000000000.0;
+}
+
+- (NSTimeInterval)runTimeForSource:(HGSSearchSource *)source
+                      atPercentile:(double)percentile {
+  UInt64 nanoseconds = 0;
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:[source identifier]];
+    nanoseconds = [[dp runHistogram] valueAtPercentile:percentile];
+  }
+  return nanoseconds / 1000000000.0;
+}
+
+- (NSTimeInterval)queueTimeForSource:(HGSSearchSource *)source
+                        atPercentile:(double)percentile {
+  UInt64 nanoseconds = 0;
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:[source identifier]];
+    nanoseconds = [[dp queueHistogram] valueAtPercentile:percentile];
+  }
+  return nanoseconds / 1000000000.0;
+}
+
+- (NSTimeInterval)timeoutForSource:(HGSSearchSource *)source {
+  UInt64 count = 0;
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:[source identifier]];
+    count = [[dp runHistogram] count];
+  }
+  if (count < kHGSSearchSourceRankerMinimumHistogramCount) return 0;
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  double multiplier = [sd doubleForKey:kHGSSearchSourceTimeoutMultiplierPrefKey];
+  NSTimeInterval minimum = [sd doubleForKey:kHGSSearchSourceMinimumTimeoutPrefKey];
+  NSTimeInterval p99 = [self runTimeForSource:source atPercentile:99];
+  return MAX(p99 * multiplier, minimum);
+}
+
 - (NSArray *)orderedSourcesByPerformance {
   NSMutableArray *sources
     = [NSMutableArray arrayWithArray:[sourcesPoint_ extensions]];
@@ -278,6 +601,86 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   return [dp promotionCount];
 }
 
+- (NSString *)shapeForQuery:(HGSQuery *)query {
+  HGSTokenizedString *tokenizedString = [query tokenizedQueryString];
+  NSString *separator = [HGSTokenizer tokenizerSeparatorString];
+  NSArray *terms
+    = [[tokenizedString tokenizedString] componentsSeparatedByString:separator];
+  NSUInteger termCount = 0;
+  for (NSString *term in terms) {
+    if ([term length]) ++termCount;
+  }
+  // Beyond three terms the number of terms doesn't tell us much more.
+  termCount = MIN(termCount, 3U);
+  NSUInteger length = [tokenizedString tokenizedLength];
+  char lengthClass = 'l';
+  if (length <= 2) {
+    lengthClass = 's';
+  } else if (length <= 5) {
+    lengthClass = 'm';
+  }
+  BOOL pivoted = [[query pivotObjects] count] > 0;
+  return HGSSearchSourceRankerShape(pivoted, termCount, lengthClass);
+}
+
+- (BOOL)shouldDeferSource:(HGSSearchSource *)source forQuery:(HGSQuery *)query {
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  if (![sd boolForKey:kHGSSearchSourceGatingEnabledPrefKey]) return NO;
+  NSTimeInterval expected = [self expectedRunTimeForSource:source];
+  NSTimeInterval minimumRunTime
+    = [sd doubleForKey:kHGSSearchSourceGatingMinimumRunTimePrefKey];
+  if (expected < minimumRunTime) return NO;
+
+  NSString *shape = [self shapeForQuery:query];
+  NSInteger minimumRuns
+    = [sd integerForKey:kHGSSearchSourceGatingMinimumRunsPrefKey];
+  double minimumPromotionRate
+    = [sd doubleForKey:kHGSSearchSourceGatingPromotionRatePrefKey];
+  NSInteger explorationInterval
+    = [sd integerForKey:kHGSSearchSourceGatingExplorationIntervalPrefKey];
+  BOOL unpromising = NO;
+  BOOL defer = NO;
+  UInt64 runs = 0;
+  UInt64 promotions = 0;
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:[source identifier]];
+    runs = [dp runCountForShape:shape];
+    promotions = [dp promotionCountForShape:shape];
+    // Until we have seen enough runs we can't tell a source that is never
+    // useful from one that we haven't given a chance.
+    unpromising = (runs >= (UInt64)MAX(minimumRuns, 1)
+                   && promotions < runs * minimumPromotionRate);
+    if (unpromising) {
+      NSUInteger deferrals = [dp addDeferral];
+      if (explorationInterval > 0 && deferrals % explorationInterval == 0) {
+        explorationCount_ += 1;
+      } else {
+        deferralCount_ += 1;
+        defer = YES;
+      }
+    }
+  }
+  if (defer) {
+    HGSLogDebug(@"Deferring source %@ for query shape %@: expected to take "
+                @"%.3fs, %llu promotions in %llu runs.",
+                [source identifier], shape, expected, promotions, runs);
+  } else if (unpromising) {
+    HGSLogDebug(@"Running source %@ for query shape %@ to refresh its "
+                @"statistics: %llu promotions in %llu runs.",
+                [source identifier], shape, promotions, runs);
+  }
+  return defer;
+}
+
+- (UInt64)deferralCount {
+  return deferralCount_;
+}
+
+- (UInt64)explorationCount {
+  return explorationCount_;
+}
+
 - (NSString *)description {
   NSArray *orderedSources = [self orderedSourcesByPerformance];
   NSMutableString *desc
@@ -286,19 +689,50 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
     NSString *identifier = [source identifier];
     HGSSearchSourceRankerDataPoint *dp
       = [rankDictionary_ objectForKey:identifier];
-    [desc appendFormat:@" %15lld %@\n", [dp averageTime], [source displayName]];
+    HGSLatencyHistogram *run = [dp runHistogram];
+    HGSLatencyHistogram *queue = [dp queueHistogram];
+    [desc appendFormat:@" %15lld run p50/p90/p99 %llu/%llu/%llu us "
+     @"queue p50/p90/p99 %llu/%llu/%llu us %@\n",
+     [dp averageTime],
+     [run valueAtPercentile:50] / 1000, [run valueAtPercentile:90] / 1000,
+     [run valueAtPercentile:99] / 1000,
+     [queue valueAtPercentile:50] / 1000, [queue valueAtPercentile:90] / 1000,
+     [queue valueAtPercentile:99] / 1000,
+     [source displayName]];
   }
   return desc;
 }
 
 #pragma mark Timer and Notification callbacks
-- (void)saveToPreferencesTimer:(NSTimer *)timer {
-  if ([self isDirty]) {
-    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-    NSArray *data = [self rankerData];
-    [defaults setObject:data forKey:kHGSSearchSourceRankerDataKey];
+- (void)saveTimer:(NSTimer *)timer {
+  if (![self isDirty] || !storagePath_) return;
+  NSData *data = nil;
+  @synchronized (self) {
+    data = [self binaryRankerData];
     [self setDirty:NO];
   }
+  // Writes are serialized on an executor of their own so that they can
+  // never land out of order.
+  HGSAffinityExecutor *writer
+    = [HGSAffinityExecutor executorWithIdentifier:kHGSSearchSourceRankerWriterIdentifier];
+  [writer performSelector:@selector(writeBinaryRankerData:)
+                 onTarget:self
+               withObject:data];
+}
+
+- (void)writeBinaryRankerData:(NSData *)data {
+  NSError *error = nil;
+  // NSAtomicWrite writes to a temporary file and renames it into place, so
+  // a crash part way through leaves the previous data intact.
+  if ([data writeToFile:storagePath_ options:NSAtomicWrite error:&error]) {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    if ([defaults objectForKey:kHGSSearchSourceRankerDataKey]) {
+      [defaults removeObjectForKey:kHGSSearchSourceRankerDataKey];
+    }
+  } else {
+    HGSLog(@"Unable to save source ranker data to %@ (%@)",
+           storagePath_, error);
+  }
 }
 
 - (void)resultDidPromote:(NSNotification *)notification {
@@ -309,6 +743,11 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
     HGSSearchSourceRankerDataPoint *dp
       = [rankDictionary_ objectForKey:sourceID];
     [dp promote];
+    // Promotions don't say which query the result came from, so credit the
+    // shape of the query that the user was most recently looking at.
+    if (currentQueryShape_) {
+      [dp promoteForShape:currentQueryShape_];
+    }
     [self setDirty:YES];
     promotionCount_ += 1;
   }
@@ -316,11 +755,25 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 
 - (void)searchOperationDidFinish:(NSNotification *)notification {
   HGSSearchOperation *operation = [notification object];
-  if (![operation isCancelled]) {
-    // only add a data point if the op wasn't cancelled.
+  if (![operation isCancelled] && [operation recordsRunTime]) {
+    // only add a data point if the op wasn't cancelled, and did the normal
+    // amount of work for a user's query.
     UInt64 runTime = [operation runTime];
+    UInt64 queueTime = [operation queueTime];
+    NSString *shape = [self shapeForQuery:[operation query]];
     [self addTimeDataPoint:runTime
-                 forSource:[operation source]];
+                 queueTime:queueTime
+                 forSource:[operation source]
+                     shape:shape];
+  }
+}
+
+- (void)queryControllerWillStart:(NSNotification *)notification {
+  HGSQueryController *controller = [notification object];
+  NSString *shape = [self shapeForQuery:[controller query]];
+  @synchronized (self) {
+    [currentQueryShape_ autorelease];
+    currentQueryShape_ = [shape copy];
   }
 }
 
@@ -335,17 +788,119 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
     averageTime_ = [number unsignedLongLongValue];
     number = [dict objectForKey:kHGSSearchSourceRankerDataPointPromotionsKey];
     promotions_ = [number unsignedLongLongValue];
+    NSDictionary *shapeDict
+      = [dict objectForKey:kHGSSearchSourceRankerDataPointShapeRunsKey];
+    shapeRuns_ = [[NSMutableDictionary alloc] initWithDictionary:shapeDict];
+    shapeDict
+      = [dict objectForKey:kHGSSearchSourceRankerDataPointShapePromotionsKey];
+    shapePromotions_
+      = [[NSMutableDictionary alloc] initWithDictionary:shapeDict];
+    NSData *data
+      = [dict objectForKey:kHGSSearchSourceRankerDataPointRunHistogramKey];
+    runHistogram_ = [[HGSLatencyHistogram alloc] initWithData:data];
+    data = [dict objectForKey:kHGSSearchSourceRankerDataPointQueueHistogramKey];
+    queueHistogram_ = [[HGSLatencyHistogram alloc] initWithData:data];
+  }
+  return self;
+}
+
+- (id)initWithRecord:(const HGSSearchSourceRankerRecord *)record {
+  if ((self = [self initWithDictionary:nil])) {
+    averageTime_ = CFSwapInt64LittleToHost(record->averageTime);
+    promotions_ = CFSwapInt64LittleToHost(record->promotions);
+    for (NSUInteger i = 0; i < kHGSSearchSourceRankerShapeCount; ++i) {
+      UInt32 runs = CFSwapInt32LittleToHost(record->shapeRuns[i]);
+      UInt32 promotions = CFSwapInt32LittleToHost(record->shapePromotions[i]);
+      if (runs) {
+        [shapeRuns_ setObject:[NSNumber numberWithUnsignedInt:runs]
+                       forKey:HGSSearchSourceRankerShapeForIndex(i)];
+      }
+      if (promotions) {
+        [shapePromotions_ setObject:[NSNumber numberWithUnsignedInt:promotions]
+                             forKey:HGSSearchSourceRankerShapeForIndex(i)];
+      }
+    }
+    UInt16 counts[kHGSLatencyHistogramCountsLength];
+    for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+      counts[i] = CFSwapInt16LittleToHost(record->runCounts[i]);
+    }
+    [runHistogram_ release];
+    runHistogram_ = [[HGSLatencyHistogram alloc] initWithCounts:counts];
+    for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+      counts[i] = CFSwapInt16LittleToHost(record->queueCounts[i]);
+    }
+    [queueHistogram_ release];
+    queueHistogram_ = [[HGSLatencyHistogram alloc] initWithCounts:counts];
   }
   return self;
 }
 
+- (id)init {
+  return [self initWithDictionary:nil];
+}
+
+- (void)dealloc {
+  [shapeRuns_ release];
+  [shapePromotions_ release];
+  [runHistogram_ release];
+  [queueHistogram_ release];
+  [super dealloc];
+}
+
 - (void)encodeToDictionary:(NSMutableDictionary *)dict {
   [dict setObject:[NSNumber numberWithUnsignedLongLong:[self averageTime]]
            forKey:kHGSSearchSourceRankerDataPointRunTimeKey];
   [dict setObject:[NSNumber numberWithUnsignedLongLong:promotions_]
            forKey:kHGSSearchSourceRankerDataPointPromotionsKey];
+  [dict setObject:[NSDictionary dictionaryWithDictionary:shapeRuns_]
+           forKey:kHGSSearchSourceRankerDataPointShapeRunsKey];
+  [dict setObject:[NSDictionary dictionaryWithDictionary:shapePromotions_]
+           forKey:kHGSSearchSourceRankerDataPointShapePromotionsKey];
+  [dict setObject:[runHistogram_ data]
+           forKey:kHGSSearchSourceRankerDataPointRunHistogramKey];
+  [dict setObject:[queueHistogram_ data]
+           forKey:kHGSSearchSourceRankerDataPointQueueHistogramKey];
  }
 
+static void HGSEncodeShapeCounts(NSDictionary *shapeCounts, UInt32 *counts) {
+  for (NSString *shape in shapeCounts) {
+    NSInteger index = HGSSearchSourceRankerShapeIndex(shape);
+    if (index >= 0) {
+      UInt64 count = [[shapeCounts objectForKey:shape] unsignedLongLongValue];
+      counts[index] = CFSwapInt32HostToLittle((UInt32)MIN(count, UINT32_MAX));
+    }
+  }
+}
+
+- (void)encodeToRecord:(HGSSearchSourceRankerRecord *)record
+              sourceID:(NSString *)sourceID {
+  bzero(record, sizeof(*record));
+  [sourceID getCString:record->sourceID
+             maxLength:kHGSSearchSourceRankerSourceIDLength
+              encoding:NSUTF8StringEncoding];
+  record->averageTime = CFSwapInt64HostToLittle(averageTime_);
+  record->promotions = CFSwapInt64HostToLittle(promotions_);
+  HGSEncodeShapeCounts(shapeRuns_, record->shapeRuns);
+  HGSEncodeShapeCounts(shapePromotions_, record->shapePromotions);
+  UInt16 counts[kHGSLatencyHistogramCountsLength];
+  [runHistogram_ getCounts:counts];
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+    record->runCounts[i] = CFSwapInt16HostToLittle(counts[i]);
+  }
+  [queueHistogram_ getCounts:counts];
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramCountsLength; ++i) {
+    record->queueCounts[i] = CFSwapInt16HostToLittle(counts[i]);
+  }
+}
+
+- (BOOL)isRecordDirty {
+  return recordDirty_;
+}
+
+- (void)setRecordDirty:(BOOL)dirty {
+  recordDirty_ = dirty;
+}
+
 - (void)addTimeDataPoint:(UInt64)machTime {
   if (firstRunCompleted_) {
     // Calculate a very simple moving average, but only if we already
@@ -358,6 +913,38 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   } else {
     firstRunCompleted_ = YES;
   }
+  // Unlike the average, the first run does count here. It is usually the
+  // slowest, and that's the kind of thing the histogram is for.
+  [runHistogram_ recordValue:HGSMachTimeToNanoseconds(machTime)];
+  recordDirty_ = YES;
+}
+
+- (void)addQueueTimeDataPoint:(UInt64)machTime {
+  [queueHistogram_ recordValue:HGSMachTimeToNanoseconds(machTime)];
+  recordDirty_ = YES;
+}
+
+- (void)addTimeout:(UInt64)nanoseconds {
+  [runHistogram_ recordValue:nanoseconds];
+  recordDirty_ = YES;
+}
+
+- (UInt64)expectedTime {
+  UInt64 expectedTime = 0;
+  if ([runHistogram_ count] >= kHGSSearchSourceRankerMinimumHistogramCount) {
+    expectedTime = [runHistogram_ valueAtPercentile:90];
+  } else {
+    expectedTime = HGSMachTimeToNanoseconds(averageTime_);
+  }
+  return expectedTime;
+}
+
+- (HGSLatencyHistogram *)runHistogram {
+  return runHistogram_;
+}
+
+- (HGSLatencyHistogram *)queueHistogram {
+  return queueHistogram_;
 }
 
 - (UInt64)averageTime {
@@ -371,10 +958,42 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 
 - (void)promote {
   promotions_++;
+  recordDirty_ = YES;
 }
 
 - (UInt64)promotionCount {
   return promotions_;
 }
 
+static void HGSIncrementShapeCount(NSMutableDictionary *counts,
+                                   NSString *shape) {
+  NSNumber *count = [counts objectForKey:shape];
+  count = [NSNumber numberWithUnsignedLongLong:[count unsignedLongLongValue] + 1];
+  [counts setObject:count forKey:shape];
+}
+
+- (void)addRunForShape:(NSString *)shape {
+  if (shape) {
+    HGSIncrementShapeCount(shapeRuns_, shape);
+    recordDirty_ = YES;
+  }
+}
+
+- (void)promoteForShape:(NSString *)shape {
+  HGSIncrementShapeCount(shapePromotions_, shape);
+  recordDirty_ = YES;
+}
+
+- (UInt64)runCountForShape:(NSString *)shape {
+  return [[shapeRuns_ objectForKey:shape] unsignedLongLongValue];
+}
+
+- (UInt64)promotionCountForShape:(NSString *)shape {
+  return [[shapePromotions_ objectForKey:shape] unsignedLongLongValue];
+}
+
+- (NSUInteger)addDeferral {
+  return ++deferrals_;
+}
+
 @end
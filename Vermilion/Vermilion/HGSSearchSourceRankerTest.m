@@ -36,7 +36,14 @@
 
 #import "HGSSearchSourceRanker.h"
 #import "HGSExtensionPoint.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSQuery.h"
 #import "HGSSearchSource.h"
+#import "HGSSearchOperation.h"
+
+@interface HGSSearchSourceRanker (HGSSearchSourceRankerTest)
+- (void)searchOperationDidFinish:(NSNotification *)notification;
+@end
 
 @interface HGSSearchSourceRankerTest : GTMTestCase {
  @private
@@ -117,4 +124,252 @@
   STAssertNotNil(description, nil);
 }
 
+- (HGSQuery *)queryWithString:(NSString *)string {
+  return [[[HGSQuery alloc] initWithString:string
+                            actionArgument:nil
+                           actionOperation:nil
+                              pivotObjects:nil
+                                queryFlags:0] autorelease];
+}
+
+- (void)testShapeForQuery {
+  STAssertEqualObjects([ranker_ shapeForQuery:[self queryWithString:@"a"]],
+                       @"t1s", nil);
+  STAssertEqualObjects([ranker_ shapeForQuery:[self queryWithString:@"ab cd"]],
+                       @"t2m", nil);
+  STAssertEqualObjects([ranker_ shapeForQuery:
+                        [self queryWithString:@"hello big wide world"]],
+                       @"t3l", nil);
+}
+
+- (void)testGating {
+  // A slow source that has run plenty of times for single short terms, and
+  // only been promoted for longer queries.
+  NSString *identifier = @"com.google.qsb.test.gated.source";
+  NSDictionary *shapeRuns
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithInt:100], @"t1s",
+       [NSNumber numberWithInt:100], @"t1l",
+       nil];
+  NSDictionary *shapePromotions
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:30]
+                                  forKey:@"t1l"];
+  NSDictionary *entry
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       identifier, @"HGSSearchSourceRankerSourceID",
+       [NSNumber numberWithUnsignedLongLong:1ULL << 40], @"runtime",
+       [NSNumber numberWithInt:30], @"promotions",
+       shapeRuns, @"shapeRuns",
+       shapePromotions, @"shapePromotions",
+       nil];
+  HGSSearchSourceRanker *ranker
+    = [[[HGSSearchSourceRanker alloc]
+        initWithRankerData:[NSArray arrayWithObject:entry]
+              sourcesPoint:sourcesPoint_] autorelease];
+  STAssertNotNil(ranker, nil);
+
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  NSString *name = @"searchSourceRankerTestGatedSource";
+  [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+  HGSSimpleNamedSearchSource *source
+    = [HGSSimpleNamedSearchSource sourceWithName:name
+                                      identifier:identifier
+                                          bundle:bundle];
+  STAssertNotNil(source, nil);
+
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSInteger interval
+    = [sd integerForKey:kHGSSearchSourceGatingExplorationIntervalPrefKey];
+  STAssertGreaterThan(interval, (NSInteger)1, nil);
+
+  // Never useful for short queries, so it is deferred for them, apart from
+  // once per interval.
+  HGSQuery *shortQuery = [self queryWithString:@"a"];
+  for (NSInteger i = 1; i < interval; ++i) {
+    STAssertTrue([ranker shouldDeferSource:source forQuery:shortQuery],
+                 @"%ld", (long)i);
+  }
+  STAssertFalse([ranker shouldDeferSource:source forQuery:shortQuery], nil);
+  STAssertEquals([ranker deferralCount], (UInt64)(interval - 1), nil);
+  STAssertEquals([ranker explorationCount], (UInt64)1, nil);
+
+  // Useful for long queries.
+  HGSQuery *longQuery = [self queryWithString:@"something"];
+  STAssertFalse([ranker shouldDeferSource:source forQuery:longQuery], nil);
+
+  // Not enough history for two term queries to judge.
+  HGSQuery *twoTermQuery = [self queryWithString:@"a b"];
+  STAssertFalse([ranker shouldDeferSource:source forQuery:twoTermQuery], nil);
+  STAssertEquals([ranker deferralCount], (UInt64)(interval - 1), nil);
+
+  // Shape statistics survive archiving.
+  NSArray *data = [ranker rankerData];
+  HGSSearchSourceRanker *restored
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:data
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertTrue([restored shouldDeferSource:source forQuery:shortQuery], nil);
+}
+
+- (void)testPercentilesAndTimeouts {
+  NSString *identifier = @"com.google.qsb.test.histogram.source";
+  HGSLatencyHistogram *runs = [[[HGSLatencyHistogram alloc] init] autorelease];
+  // Usually 10ms, but one run in five takes a second.
+  for (int i = 0; i < 100; ++i) {
+    [runs recordValue:(i % 5) ? 10000000 : 1000000000];
+  }
+  NSDictionary *entry
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       identifier, @"HGSSearchSourceRankerSourceID",
+       [NSNumber numberWithInt:0], @"runtime",
+       [runs data], @"runHistogram",
+       nil];
+  HGSSearchSourceRanker *ranker
+    = [[[HGSSearchSourceRanker alloc]
+        initWithRankerData:[NSArray arrayWithObject:entry]
+              sourcesPoint:sourcesPoint_] autorelease];
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  NSString *name = @"searchSourceRankerTestHistogramSource";
+  [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+  HGSSimpleNamedSearchSource *source
+    = [HGSSimpleNamedSearchSource sourceWithName:name
+                                      identifier:identifier
+                                          bundle:bundle];
+  NSTimeInterval p50 = [ranker runTimeForSource:source atPercentile:50];
+  NSTimeInterval p99 = [ranker runTimeForSource:source atPercentile:99];
+  STAssertTrue(p50 >= 0.01 && p50 < 0.011, @"%f", p50);
+  STAssertTrue(p99 >= 1.0 && p99 < 1.07, @"%f", p99);
+  STAssertEquals([ranker queueTimeForSource:source atPercentile:50], 0.0, nil);
+  // The average would have hidden the slow runs.
+  STAssertTrue([ranker expectedRunTimeForSource:source] >= 1.0, nil);
+
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  double multiplier
+    = [sd doubleForKey:kHGSSearchSourceTimeoutMultiplierPrefKey];
+  NSTimeInterval timeout = [ranker timeoutForSource:source];
+  STAssertEqualsWithAccuracy(timeout, p99 * multiplier, 0.001, nil);
+
+  // Timeouts push the tail out.
+  for (int i = 0; i < 10; ++i) {
+    [ranker recordTimeoutOfSource:source afterInterval:timeout];
+  }
+  STAssertGreaterThan([ranker timeoutForSource:source], timeout, nil);
+}
+
+- (void)testOnlyRecordedOperationsCount {
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  NSString *name = @"searchSourceRankerTestRecordedSource";
+  [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+  HGSSimpleNamedSearchSource *source
+    = [HGSSimpleNamedSearchSource sourceWithName:name
+                                      identifier:@"com.google.qsb.test.recorded"
+                                          bundle:bundle];
+  HGSQuery *query = [self queryWithString:@"a"];
+  BOOL recordsRunTime[] = { NO, YES };
+  NSTimeInterval expected[] = { 0.0, 0.01 };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    id operation = [OCMockObject niceMockForClass:[HGSSearchOperation class]];
+    BOOL no = NO;
+    uint64_t runTime = HGSNanosecondsToMachTime(10000000);
+    uint64_t queueTime = 0;
+    [[[operation stub] andReturnValue:OCMOCK_VALUE(no)] isCancelled];
+    [[[operation stub] andReturnValue:OCMOCK_VALUE(recordsRunTime[i])]
+     recordsRunTime];
+    [[[operation stub] andReturnValue:OCMOCK_VALUE(runTime)] runTime];
+    [[[operation stub] andReturnValue:OCMOCK_VALUE(queueTime)] queueTime];
+    [[[operation stub] andReturn:query] query];
+    [[[operation stub] andReturn:source] source];
+    NSNotification *notification
+      = [NSNotification notificationWithName:
+           kHGSSearchOperationDidFinishNotification
+                                      object:operation];
+    [ranker_ searchOperationDidFinish:notification];
+    // Refined and speculative runs don't pull the estimates down.
+    NSTimeInterval p50 = [ranker_ runTimeForSource:source atPercentile:50];
+    STAssertEqualsWithAccuracy(p50, expected[i], 0.001, @"%d", (int)i);
+  }
+}
+
+- (void)testBinaryRankerData {
+  NSData *data = [ranker_ binaryRankerData];
+  STAssertNotNil(data, nil);
+  HGSSearchSourceRanker *restored
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:data
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertNotNil(restored, nil);
+  STAssertEquals([restored promotionCount], [ranker_ promotionCount], nil);
+  STAssertEqualObjects([NSSet setWithArray:[restored rankerData]],
+                       [NSSet setWithArray:[ranker_ rankerData]], nil);
+
+  // Nothing has changed, so nothing should be any different.
+  STAssertEqualObjects([restored binaryRankerData], data, nil);
+
+  // Changes to a source show up.
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  NSString *name = @"searchSourceRankerTestBinarySource";
+  [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+  HGSSimpleNamedSearchSource *source
+    = [HGSSimpleNamedSearchSource sourceWithName:name
+                                      identifier:@"com.google.qsb.applications.source"
+                                          bundle:bundle];
+  for (int i = 0; i < 30; ++i) {
+    [restored recordTimeoutOfSource:source afterInterval:5];
+  }
+  NSData *changedData = [restored binaryRankerData];
+  STAssertEquals([changedData length], [data length], nil);
+  STAssertNotEqualObjects(changedData, data, nil);
+  HGSSearchSourceRanker *changed
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:changedData
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertTrue([changed runTimeForSource:source atPercentile:50] >= 5.0, nil);
+
+  // Data we don't understand is ignored.
+  NSData *garbage = [@"garbage" dataUsingEncoding:NSUTF8StringEncoding];
+  HGSSearchSourceRanker *empty
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:garbage
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertNotNil(empty, nil);
+  STAssertEquals([[empty rankerData] count], (NSUInteger)0, nil);
+}
+
+- (void)testBinaryRankerDataWithUnreadableRecord {
+  NSData *data = [ranker_ binaryRankerData];
+  NSUInteger sourceCount = [[ranker_ rankerData] count];
+  STAssertGreaterThan(sourceCount, (NSUInteger)1, nil);
+  // The file is a 16 byte header followed by the records, each of which
+  // starts with its source ID. Wipe out the ID of the first one.
+  const NSUInteger kHeaderLength = 16;
+  NSUInteger recordLength = ([data length] - kHeaderLength) / sourceCount;
+  NSMutableData *damaged = [NSMutableData dataWithData:data];
+  [damaged resetBytesInRange:NSMakeRange(kHeaderLength, recordLength)];
+  HGSSearchSourceRanker *restored
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:damaged
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertEquals([[restored rankerData] count], sourceCount - 1, nil);
+
+  // A new source gets a slot of its own, rather than the slot of the record
+  // that we skipped or of one that we loaded.
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  NSString *name = @"searchSourceRankerTestNewSource";
+  [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+  HGSSimpleNamedSearchSource *source
+    = [HGSSimpleNamedSearchSource sourceWithName:name
+                                      identifier:@"com.google.qsb.test.new"
+                                          bundle:bundle];
+  [restored recordTimeoutOfSource:source afterInterval:5];
+  NSData *grownData = [restored binaryRankerData];
+  STAssertEquals([grownData length], [data length] + recordLength, nil);
+  HGSSearchSourceRanker *grown
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:grownData
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  STAssertEquals([[grown rankerData] count], sourceCount, nil);
+  STAssertEqualObjects([NSSet setWithArray:[grown rankerData]],
+                       [NSSet setWithArray:[restored rankerData]], nil);
+}
+
 @end
@@ -0,0 +1,119 @@
+//
+//  HGSShardedLRUCache.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import <Foundation/Foundation.h>
+#import <Vermilion/HGSLRUCache.h>
+
+// A thread-safe LRU cache built from several HGSLRUCaches. Keys are split
+// across the shards by their hash, and each shard has its own lock and its
+// own share of the cache size, so readers of different keys rarely contend.
+// Eviction is LRU within a shard rather than across the whole cache.
+//
+// Callbacks have the same meaning as for HGSLRUCache. Evict callbacks are
+// called with the shard's lock held, so they must not call back into the
+// cache.
+//
+// NOTE: Cache deallocation does _not_ trigger eviction callbacks.
+//
+@interface HGSShardedLRUCache : NSObject {
+ @private
+  NSUInteger                    shardCount_;
+  HGSLRUCacheCallBacks          *callBacks_;
+  void                          *shards_;  // strong
+}
+
+// Create a cache whose shards use the LRU policy.
+//
+// Args:
+//   size: Number of bytes to hold in the cache. Each shard gets an equal
+//         share, and a value must fit in a single shard.
+//   shardCount: Number of shards. Zero picks a count from the number of
+//               processors.
+//   callBacks: A properly filled in HGSLRUCacheCallBacks structure.
+//   evictContext: Context pointer passed to the eviction callback (may be
+//                 NULL). This is weakly held by the cache.
+//
+- (id)initWithCacheSize:(size_t)size
+             shardCount:(NSUInteger)shardCount
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext;
+
+// Designated initializer
+//
+// Args:
+//   policy: The eviction policy each shard uses.
+//   See initWithCacheSize:shardCount:callBacks:evictContext: for the rest.
+//
+- (id)initWithCacheSize:(size_t)size
+             shardCount:(NSUInteger)shardCount
+                 policy:(HGSLRUCachePolicy)policy
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext;
+
+// Obtain a value from the cache and mark it as recently used. Another
+// thread may evict the value as soon as the shard is unlocked, so the
+// value is retained with the valueRetain callback before it is returned.
+//
+// Args:
+//   key: Cache key (must be compatible with HGSLRUCacheCallBacks)
+//
+// Returns:
+//   The cache value, which the caller must release with the valueRelease
+//   callback, or NULL if the value is not in the cache.
+//
+- (const void *)copyValueForKey:(const void *)key;
+
+// Forget a cached value without triggering eviction callbacks.
+// See -[HGSLRUCache removeValueForKey:].
+//
+- (void)removeValueForKey:(const void *)key;
+
+// Add or replace a value in the key's shard.
+// See -[HGSLRUCache setValue:forKey:size:].
+//
+// Returns:
+//  YES on successful cache, NO if the value is too large for a shard or
+//  an eviction callback failed.
+//
+- (BOOL)setValue:(const void *)value forKey:(const void *)key size:(size_t)size;
+
+// Get a count of the number of cached values across all shards.
+//
+- (CFIndex)count;
+
+// Returns the number of shards.
+//
+- (NSUInteger)shardCount;
+
+@end
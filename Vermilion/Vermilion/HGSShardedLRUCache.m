@@ -0,0 +1,180 @@
+//
+//  HGSShardedLRUCache.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#import "HGSShardedLRUCache.h"
+#import <pthread.h>
+
+// Upper bound on the shard count picked when the caller passes zero.
+static const NSUInteger kHGSShardedLRUCacheMaxDefaultShards = 16;
+
+// Each shard is padded out to its own cache lines so that threads locking
+// neighbouring shards don't bounce the same line between processors.
+typedef union {
+  struct {
+    pthread_mutex_t lock;
+    HGSLRUCache *cache;  // strong
+  } shard;
+  char padding[128];
+} HGSShardedLRUCacheShard;
+
+@interface HGSShardedLRUCache ()
+- (HGSShardedLRUCacheShard *)shardForKey:(const void *)key;
+@end
+
+@implementation HGSShardedLRUCache
+
+- (id)initWithCacheSize:(size_t)size
+             shardCount:(NSUInteger)shardCount
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext {
+  return [self initWithCacheSize:size
+                      shardCount:shardCount
+                          policy:eHGSLRUCachePolicyLRU
+                       callBacks:callBacks
+                    evictContext:evictContext];
+}
+
+- (id)initWithCacheSize:(size_t)size
+             shardCount:(NSUInteger)shardCount
+                 policy:(HGSLRUCachePolicy)policy
+              callBacks:(HGSLRUCacheCallBacks *)callBacks
+           evictContext:(void *)evictContext {
+  if ((self = [super init])) {
+    if (!shardCount) {
+      NSUInteger processors 
+        = [[NSProcessInfo processInfo] activeProcessorCount];
+      shardCount = 1;
+      while (shardCount < processors * 2 
+             && shardCount < kHGSShardedLRUCacheMaxDefaultShards) {
+        shardCount *= 2;
+      }
+    }
+    if (!callBacks || (callBacks->version != 0) || size < shardCount) {
+      [self release];
+      return nil;
+    }
+    callBacks_ = callBacks;
+    HGSShardedLRUCacheShard *shards 
+      = calloc(shardCount, sizeof(HGSShardedLRUCacheShard));
+    if (!shards) {
+      // COV_NF_START
+      [self release];
+      return nil;
+      // COV_NF_END
+    }
+    shards_ = shards;
+    for (NSUInteger i = 0; i < shardCount; ++i) {
+      HGSLRUCache *cache 
+        = [[HGSLRUCache alloc] initWithCacheSize:size / shardCount
+                                          policy:policy
+                                       callBacks:callBacks
+                                    evictContext:evictContext];
+      if (!cache) {
+        // COV_NF_START
+        [self release];
+        return nil;
+        // COV_NF_END
+      }
+      pthread_mutex_init(&shards[i].shard.lock, NULL);
+      shards[i].shard.cache = cache;
+      // Only count shards that are fully set up so dealloc can unwind them.
+      shardCount_ = i + 1;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  HGSShardedLRUCacheShard *shards = shards_;
+  for (NSUInteger i = 0; i < shardCount_; ++i) {
+    [shards[i].shard.cache release];
+    pthread_mutex_destroy(&shards[i].shard.lock);
+  }
+  free(shards);
+  [super dealloc];
+}
+
+- (HGSShardedLRUCacheShard *)shardForKey:(const void *)key {
+  CFHashCode hash = callBacks_->keyHash(key);
+  // Fold the high bits in, since the low bits of some hashes (pointers for
+  // instance) are mostly constant.
+  hash ^= (hash >> 16);
+  hash ^= (hash >> 7);
+  return &((HGSShardedLRUCacheShard *)shards_)[hash % shardCount_];
+}
+
+- (const void *)copyValueForKey:(const void *)key {
+  HGSShardedLRUCacheShard *shard = [self shardForKey:key];
+  pthread_mutex_lock(&shard->shard.lock);
+  const void *value = [shard->shard.cache valueForKey:key];
+  if (value) {
+    value = callBacks_->valueRetain(kCFAllocatorDefault, value);
+  }
+  pthread_mutex_unlock(&shard->shard.lock);
+  return value;
+}
+
+- (void)removeValueForKey:(const void *)key {
+  HGSShardedLRUCacheShard *shard = [self shardForKey:key];
+  pthread_mutex_lock(&shard->shard.lock);
+  [shard->shard.cache removeValueForKey:key];
+  pthread_mutex_unlock(&shard->shard.lock);
+}
+
+- (BOOL)setValue:(const void *)value 
+          forKey:(const void *)key 
+            size:(size_t)size {
+  HGSShardedLRUCacheShard *shard = [self shardForKey:key];
+  pthread_mutex_lock(&shard->shard.lock);
+  BOOL cached = [shard->shard.cache setValue:value forKey:key size:size];
+  pthread_mutex_unlock(&shard->shard.lock);
+  return cached;
+}
+
+- (CFIndex)count {
+  HGSShardedLRUCacheShard *shards = shards_;
+  CFIndex count = 0;
+  for (NSUInteger i = 0; i < shardCount_; ++i) {
+    pthread_mutex_lock(&shards[i].shard.lock);
+    count += [shards[i].shard.cache count];
+    pthread_mutex_unlock(&shards[i].shard.lock);
+  }
+  return count;
+}
+
+- (NSUInteger)shardCount {
+  return shardCount_;
+}
+
+@end
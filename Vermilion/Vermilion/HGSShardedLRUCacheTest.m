@@ -0,0 +1,219 @@
+//
+//  HGSShardedLRUCacheTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+
+#import "GTMSenTestCase.h"
+#import "HGSShardedLRUCache.h"
+#import <libkern/OSAtomic.h>
+
+@interface HGSShardedLRUCacheTest : GTMTestCase {
+ @private
+  HGSShardedLRUCache *cache_;
+  NSArray *keys_;
+  volatile int32_t failures_;
+}
+- (void)readOnThread:(NSNumber *)count;
+@end
+
+static const void *HGSShardedLRUCacheTestRetain(CFAllocatorRef allocator, 
+                                                const void *value) {
+  return [(id)value retain];
+}
+
+static void HGSShardedLRUCacheTestRelease(CFAllocatorRef allocator, 
+                                          const void *value) {
+  [(id)value release];
+}
+
+static Boolean HGSShardedLRUCacheTestEqual(const void *value1, 
+                                           const void *value2) {
+  return [(id)value1 isEqual:(id)value2];
+}
+
+static CFHashCode HGSShardedLRUCacheTestHash(const void *value) {
+  return [(id)value hash];
+}
+
+static BOOL HGSShardedLRUCacheTestEvict(const void *key, 
+                                        const void *value, 
+                                        void *context) {
+  [(NSMutableArray *)context addObject:(id)key];
+  return YES;
+}
+
+static HGSLRUCacheCallBacks gHGSShardedLRUCacheTestCallBacks = {
+  0,
+  HGSShardedLRUCacheTestRetain,
+  HGSShardedLRUCacheTestRelease,
+  HGSShardedLRUCacheTestEqual,
+  HGSShardedLRUCacheTestHash,
+  HGSShardedLRUCacheTestRetain,
+  HGSShardedLRUCacheTestRelease,
+  HGSShardedLRUCacheTestEvict
+};
+
+@implementation HGSShardedLRUCacheTest
+
+- (void)readOnThread:(NSNumber *)count {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSUInteger keyCount = [keys_ count];
+  for (NSUInteger i = 0; i < [count unsignedIntegerValue]; ++i) {
+    NSString *key = [keys_ objectAtIndex:i % keyCount];
+    id value = (id)[cache_ copyValueForKey:key];
+    if (value && ![value isEqual:key]) {
+      OSAtomicIncrement32(&failures_);
+    }
+    [value release];
+    if (i % 16 == 0) {
+      // Keep some writes in the mix so readers race with eviction.
+      [cache_ setValue:key forKey:key size:1];
+    }
+  }
+  [pool release];
+}
+
+- (void)testInit {
+  HGSShardedLRUCache *cache 
+    = [[[HGSShardedLRUCache alloc] initWithCacheSize:1024 
+                                          shardCount:4
+                                           callBacks:NULL 
+                                        evictContext:NULL] autorelease];
+  STAssertNil(cache, nil);
+  cache = [[[HGSShardedLRUCache alloc] 
+            initWithCacheSize:2 
+                   shardCount:4
+                    callBacks:&gHGSShardedLRUCacheTestCallBacks 
+                 evictContext:NULL] autorelease];
+  STAssertNil(cache, nil);
+  cache = [[[HGSShardedLRUCache alloc] 
+            initWithCacheSize:1024 
+                   shardCount:0
+                    callBacks:&gHGSShardedLRUCacheTestCallBacks 
+                 evictContext:NULL] autorelease];
+  STAssertNotNil(cache, nil);
+  STAssertGreaterThan([cache shardCount], (NSUInteger)0, nil);
+  STAssertEquals([cache count], (CFIndex)0, nil);
+}
+
+- (void)testSetAndGet {
+  NSMutableArray *evicted = [NSMutableArray array];
+  HGSShardedLRUCache *cache 
+    = [[[HGSShardedLRUCache alloc] 
+        initWithCacheSize:1024 
+               shardCount:4
+                callBacks:&gHGSShardedLRUCacheTestCallBacks 
+             evictContext:evicted] autorelease];
+  STAssertNotNil(cache, nil);
+  STAssertNULL([cache copyValueForKey:@"Foo"], nil);
+  STAssertTrue([cache setValue:@"Bar" forKey:@"Foo" size:10], nil);
+  id value = (id)[cache copyValueForKey:@"Foo"];
+  STAssertEqualObjects(value, @"Bar", nil);
+  [value release];
+  STAssertEquals([cache count], (CFIndex)1, nil);
+  
+  // A value has to fit in one shard.
+  STAssertFalse([cache setValue:@"Bar" forKey:@"Big" size:257], nil);
+  STAssertTrue([cache setValue:@"Bar" forKey:@"Big" size:256], nil);
+  
+  [cache removeValueForKey:@"Foo"];
+  [cache removeValueForKey:@"Big"];
+  STAssertNULL([cache copyValueForKey:@"Foo"], nil);
+  STAssertEquals([cache count], (CFIndex)0, nil);
+  STAssertEquals([evicted count], (NSUInteger)0, nil);
+}
+
+- (void)testEviction {
+  NSMutableArray *evicted = [NSMutableArray array];
+  HGSShardedLRUCache *cache 
+    = [[[HGSShardedLRUCache alloc] 
+        initWithCacheSize:64 
+               shardCount:4
+                callBacks:&gHGSShardedLRUCacheTestCallBacks 
+             evictContext:evicted] autorelease];
+  NSUInteger keyCount = 200;
+  for (NSUInteger i = 0; i < keyCount; ++i) {
+    NSString *key = [NSString stringWithFormat:@"key-%u", i];
+    STAssertTrue([cache setValue:key forKey:key size:1], nil);
+  }
+  // Every shard is bounded on its own, so the total never goes over.
+  STAssertLessThanOrEqual([cache count], (CFIndex)64, nil);
+  STAssertEquals((CFIndex)[evicted count] + [cache count], 
+                 (CFIndex)keyCount, nil);
+  // The most recent key is always still in its shard.
+  NSString *last = [NSString stringWithFormat:@"key-%u", keyCount - 1];
+  id value = (id)[cache copyValueForKey:last];
+  STAssertEqualObjects(value, last, nil);
+  [value release];
+  STAssertFalse([evicted containsObject:last], nil);
+}
+
+- (void)testThreads {
+  NSUInteger keyCount = 512;
+  NSMutableArray *keys = [NSMutableArray arrayWithCapacity:keyCount];
+  for (NSUInteger i = 0; i < keyCount; ++i) {
+    [keys addObject:[NSString stringWithFormat:@"key-%u", i]];
+  }
+  keys_ = keys;
+  // Smaller than the key set so the writers keep evicting.
+  cache_ = [[[HGSShardedLRUCache alloc] 
+             initWithCacheSize:keyCount / 2
+                    shardCount:8
+                     callBacks:&gHGSShardedLRUCacheTestCallBacks 
+                  evictContext:nil] autorelease];
+  failures_ = 0;
+  NSUInteger threadCount = 4;
+  NSMutableArray *threads = [NSMutableArray array];
+  for (NSUInteger i = 0; i < threadCount; ++i) {
+    NSThread *thread 
+      = [[[NSThread alloc] initWithTarget:self
+                                 selector:@selector(readOnThread:)
+                                   object:[NSNumber numberWithUnsignedInteger:
+                                           20000]] autorelease];
+    [threads addObject:thread];
+    [thread start];
+  }
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:30];
+  for (NSThread *thread in threads) {
+    while (![thread isFinished] && [deadline timeIntervalSinceNow] > 0) {
+      [NSThread sleepForTimeInterval:0.01];
+    }
+    STAssertTrue([thread isFinished], nil);
+  }
+  STAssertEquals(failures_, (int32_t)0, nil);
+  STAssertLessThanOrEqual([cache_ count], (CFIndex)(keyCount / 2), nil);
+  cache_ = nil;
+  keys_ = nil;
+}
+
+@end
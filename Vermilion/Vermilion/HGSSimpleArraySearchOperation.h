@@ -43,6 +43,15 @@
 @interface HGSSimpleArraySearchOperation : HGSSearchOperation {
  @private 
   NSArray *results_;
+  // The results as they were handed to us by the source, before being
+  // scored for the action argument and sorted.
+  NSArray *sourceResults_;
+  // Counts of each result type in |results_|, computed when results are set
+  // so that counting by filter doesn't have to walk the results.
+  NSCountedSet *resultTypeCounts_;
+  // Cache of counts that have already been computed for a given filter.
+  // Keyed by HGSTypeFilter. Reset whenever |results_| changes.
+  NSMutableDictionary *filterCounts_;
 }
 
 /*!
@@ -53,6 +62,12 @@
  */
 - (void)setRankedResults:(NSArray*)results;
 
+/*!
+ The results most recently passed to setRankedResults:, before they were
+ scored against the query's action argument. Threadsafe.
+*/
+- (NSArray *)sourceResults;
+
 @end
 
 
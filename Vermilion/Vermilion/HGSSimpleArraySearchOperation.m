@@ -32,8 +32,6 @@
 
 #import "HGSSimpleArraySearchOperation.h"
 #import "HGSLog.h"
-#import "NSNotificationCenter+MainThread.h"
-#import "GTMMethodCheck.h"
 #import "HGSMixer.h"
 #import "HGSResult.h"
 #import "HGSTypeFilter.h"
@@ -41,10 +39,19 @@
 #import "HGSQuery.h"
 
 @implementation HGSSimpleArraySearchOperation
-GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:object:userInfo:);
+
+- (id)initWithQuery:(HGSQuery*)query source:(HGSSearchSource *)source {
+  if ((self = [super initWithQuery:query source:source])) {
+    filterCounts_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
 
 - (void)dealloc {
   [results_ release];
+  [sourceResults_ release];
+  [resultTypeCounts_ release];
+  [filterCounts_ release];
   [super dealloc];
 }
 
@@ -58,7 +65,7 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
   // should be calling finishQuery shortly to let it know it's done.
   NSUInteger resultsCount = [results count];
   if (resultsCount == 0) return;
-  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  NSArray *sourceResults = results;
   HGSQuery *query = [self query];
   HGSActionArgument *actionArg = [query actionArgument];
   if (actionArg) {
@@ -81,13 +88,30 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
   } 
   NSArray *sortedResults 
     = [results sortedArrayUsingFunction:HGSMixerScoredResultSort context:nil];
+  // Tally up the types once here so that -resultCountForFilter: only has to
+  // look at the distinct types, and not every result.
+  NSCountedSet *typeCounts = [[NSCountedSet alloc] init];
+  for (HGSScoredResult *result in sortedResults) {
+    [typeCounts addObject:[result type]];
+  }
   @synchronized (self) {
     [results_ autorelease];
     results_ = [sortedResults retain];
+    [sourceResults_ autorelease];
+    sourceResults_ = [sourceResults copy];
+    [resultTypeCounts_ autorelease];
+    resultTypeCounts_ = typeCounts;
+    [filterCounts_ removeAllObjects];
+  }
+  [self postDidUpdateResultsNotification];
+}
+
+- (NSArray *)sourceResults {
+  NSArray *sourceResults = nil;
+  @synchronized (self) {
+    sourceResults = [[sourceResults_ retain] autorelease];
   }
-  [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidUpdateResultsNotification
-                                    object:self
-                                  userInfo:nil];
+  return sourceResults;
 }
 
 - (NSUInteger)resultCountForFilter:(HGSTypeFilter *)filter {
@@ -96,11 +120,18 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
     if ([filter allowsAllTypes]) {
       count = [results_ count];
     } else {
-      for(HGSResult *result in results_) {
-        if ([filter isValidType:[result type]]) {
-          count += 1;
+      NSNumber *cachedCount = [filterCounts_ objectForKey:filter];
+      if (cachedCount) {
+        count = [cachedCount unsignedIntegerValue];
+      } else {
+        for (NSString *type in resultTypeCounts_) {
+          if ([filter isValidType:type]) {
+            count += [resultTypeCounts_ countForObject:type];
+          }
         }
-      } 
+        [filterCounts_ setObject:[NSNumber numberWithUnsignedInteger:count]
+                          forKey:filter];
+      }
     }
   }
   return count;
@@ -31,6 +31,14 @@
 //
 
 #import "GTMSenTestCase.h"
+#import <OCMock/OCMock.h>
+
+#import "HGSSimpleArraySearchOperation.h"
+#import "HGSSearchSource.h"
+#import "HGSQuery.h"
+#import "HGSResult.h"
+#import "HGSType.h"
+#import "HGSTypeFilter.h"
 
 @interface HGSSimpleArraySearchOperationTest : GTMTestCase {
 }
@@ -38,4 +46,52 @@
 
 
 @implementation HGSSimpleArraySearchOperationTest
+
+- (void)testResultCountForFilter {
+  id source = [OCMockObject niceMockForClass:[HGSSearchSource class]];
+  id query = [OCMockObject niceMockForClass:[HGSQuery class]];
+  HGSSimpleArraySearchOperation *op
+    = [[[HGSSimpleArraySearchOperation alloc] initWithQuery:query
+                                                     source:source]
+       autorelease];
+  STAssertNotNil(op, nil);
+  NSArray *types = [NSArray arrayWithObjects:
+                    kHGSTypeFile, kHGSTypeFileImage, kHGSTypeFileImage,
+                    kHGSTypeWebBookmark, kHGSTypeContact, nil];
+  NSMutableArray *results = [NSMutableArray arrayWithCapacity:[types count]];
+  NSUInteger i = 0;
+  for (NSString *type in types) {
+    NSString *uri = [NSString stringWithFormat:@"test://result/%u", i++];
+    HGSScoredResult *result = [HGSScoredResult resultWithURI:uri
+                                                        name:uri
+                                                        type:type
+                                                      source:source
+                                                  attributes:nil
+                                                       score:0.5
+                                                       flags:0
+                                                 matchedTerm:nil
+                                              matchedIndexes:nil];
+    STAssertNotNil(result, nil);
+    [results addObject:result];
+  }
+  [op setRankedResults:results];
+
+  HGSTypeFilter *allFilter = [HGSTypeFilter filterAllowingAllTypes];
+  STAssertEquals([op resultCountForFilter:allFilter], (NSUInteger)5, nil);
+  NSSet *fileSet = [NSSet setWithObject:kHGSTypeFile];
+  HGSTypeFilter *fileFilter = [HGSTypeFilter filterWithConformTypes:fileSet];
+  STAssertEquals([op resultCountForFilter:fileFilter], (NSUInteger)3, nil);
+  // Second lookup comes out of the per filter cache.
+  STAssertEquals([op resultCountForFilter:fileFilter], (NSUInteger)3, nil);
+  HGSTypeFilter *notFileFilter
+    = [HGSTypeFilter filterWithDoesNotConformTypes:fileSet];
+  STAssertEquals([op resultCountForFilter:notFileFilter], (NSUInteger)2, nil);
+
+  // Replacing the results must invalidate the cached counts.
+  [op setRankedResults:[results subarrayWithRange:NSMakeRange(3, 2)]];
+  STAssertEquals([op resultCountForFilter:fileFilter], (NSUInteger)0, nil);
+  STAssertEquals([op resultCountForFilter:notFileFilter], (NSUInteger)2, nil);
+  STAssertEquals([op resultCountForFilter:allFilter], (NSUInteger)2, nil);
+}
+
 @end
@@ -0,0 +1,125 @@
+//
+//  HGSSpeculativeQueryExecutor.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+/*!
+ @header
+ @discussion HGSSpeculativeQueryExecutor
+*/
+
+#import <Foundation/Foundation.h>
+
+@class HGSQuery;
+@class HGSQueryResultCache;
+
+/*!
+ While the user pauses typing, guesses at the queries they are most likely to
+ type next and runs cheap local sources against them ahead of time, storing
+ the results in an HGSQueryResultCache so that the real query can pick them
+ up instead of running the sources itself.
+ 
+ Predictions come from sources adopting HGSQueryPredictingSearchSource
+ (e.g. shortcuts). Only sources adopting HGSRefinableSearchSource whose
+ average run time (as recorded by HGSSearchSourceRanker) is below a threshold
+ are run, most promoted first, and the total of their average run times is
+ kept under a CPU budget. Results are only cached while the total number
+ of speculative results stays under a memory budget.
+ 
+ Everything is cancelled as soon as -cancel is called, which should be done
+ as soon as real input arrives. Must be used from the main thread.
+*/
+@interface HGSSpeculativeQueryExecutor : NSObject {
+ @private
+  HGSQueryResultCache *resultCache_;
+  HGSQuery *lastQuery_;
+  __weak NSTimer *idleTimer_;
+  NSMutableArray *operations_;
+  NSUInteger cachedResultCount_;
+}
+
+/*!
+ Designated initializer.
+ @param resultCache The cache to put speculative results in. Should be the
+        same cache that is handed to the HGSQueryControllers.
+*/
+- (id)initWithResultCache:(HGSQueryResultCache *)resultCache;
+
+/*!
+ Schedule a round of speculation based on |query| once the user has been idle
+ for a short while. Cancels any speculation already in progress.
+*/
+- (void)speculateAfterQuery:(HGSQuery *)query;
+
+/*!
+ Stop all speculation immediately.
+*/
+- (void)cancel;
+
+/*!
+ YES if speculation is scheduled or operations are running.
+*/
+- (BOOL)isSpeculating;
+
+@end
+
+/*!
+ Double preference for how long (in seconds) the user has to be idle before
+ speculation starts.
+*/
+#define kHGSSpeculativeQueryIdleDelayPrefKey @"HGSSpeculativeQueryIdleDelay"
+
+/*!
+ Integer preference for the maximum number of predicted queries to run.
+ Set to 0 to turn off speculation.
+*/
+#define kHGSSpeculativeQueryMaximumQueriesPrefKey \
+  @"HGSSpeculativeQueryMaximumQueries"
+
+/*!
+ Double preference for the total amount of source run time (in milliseconds)
+ that a single round of speculation is allowed to use.
+*/
+#define kHGSSpeculativeQueryCPUBudgetPrefKey @"HGSSpeculativeQueryCPUBudget"
+
+/*!
+ Double preference for the maximum average run time (in milliseconds) for a
+ source to be considered cheap enough to run speculatively.
+*/
+#define kHGSSpeculativeQueryMaximumSourceTimePrefKey \
+  @"HGSSpeculativeQueryMaximumSourceTime"
+
+/*!
+ Integer preference for the maximum number of results that a single round of
+ speculation is allowed to keep in the cache.
+*/
+#define kHGSSpeculativeQueryResultBudgetPrefKey \
+  @"HGSSpeculativeQueryResultBudget"
@@ -0,0 +1,280 @@
+//
+//  HGSSpeculativeQueryExecutor.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSSpeculativeQueryExecutor.h"
+#import "HGSQuery.h"
+#import "HGSQueryResultCache.h"
+#import "HGSSearchSource.h"
+#import "HGSSearchOperation.h"
+#import "HGSSearchSourceRanker.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSTokenizer.h"
+#import "HGSTypeFilter.h"
+#import "HGSLog.h"
+
+@interface HGSSpeculativeQueryExecutor ()
+- (void)idleTimerFired:(NSTimer *)timer;
+- (NSArray *)predictedTokenizedQueryStrings;
+- (NSArray *)candidateSources;
+- (void)searchOperationDidFinish:(NSNotification *)notification;
+@end
+
+// Sort sources so the ones that the user has picked results from most often
+// come first.
+static NSInteger HGSSpeculativeSourcePromotionSort(id src1,
+                                                   id src2,
+                                                   void *context) {
+  HGSSearchSourceRanker *ranker = (HGSSearchSourceRanker *)context;
+  UInt64 promotions1 = [ranker promotionCountForSource:src1];
+  UInt64 promotions2 = [ranker promotionCountForSource:src2];
+  NSInteger order = NSOrderedSame;
+  if (promotions1 < promotions2) {
+    order = NSOrderedDescending;
+  } else if (promotions1 > promotions2) {
+    order = NSOrderedAscending;
+  }
+  return order;
+}
+
+@implementation HGSSpeculativeQueryExecutor
+
++ (void)initialize {
+  if (self == [HGSSpeculativeQueryExecutor class]) {
+    NSDictionary *defaultsDict
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble:0.25],
+         kHGSSpeculativeQueryIdleDelayPrefKey,
+         [NSNumber numberWithInteger:3],
+         kHGSSpeculativeQueryMaximumQueriesPrefKey,
+         [NSNumber numberWithDouble:25.0],
+         kHGSSpeculativeQueryCPUBudgetPrefKey,
+         [NSNumber numberWithDouble:10.0],
+         kHGSSpeculativeQueryMaximumSourceTimePrefKey,
+         [NSNumber numberWithInteger:1000],
+         kHGSSpeculativeQueryResultBudgetPrefKey,
+         nil];
+    NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+    [sd registerDefaults:defaultsDict];
+  }
+}
+
+- (id)init {
+  return [self initWithResultCache:nil];
+}
+
+- (id)initWithResultCache:(HGSQueryResultCache *)resultCache {
+  if ((self = [super init])) {
+    resultCache_ = [resultCache retain];
+    operations_ = [[NSMutableArray alloc] init];
+    if (!resultCache_) {
+      HGSLogDebug(@"HGSSpeculativeQueryExecutor needs a result cache");
+      [self release];
+      self = nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self cancel];
+  [resultCache_ release];
+  [operations_ release];
+  [super dealloc];
+}
+
+- (void)speculateAfterQuery:(HGSQuery *)query {
+  [self cancel];
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  if ([sd integerForKey:kHGSSpeculativeQueryMaximumQueriesPrefKey] <= 0) {
+    return;
+  }
+  if (![[query tokenizedQueryString] tokenizedLength]) return;
+  lastQuery_ = [query retain];
+  NSTimeInterval delay = [sd doubleForKey:kHGSSpeculativeQueryIdleDelayPrefKey];
+  idleTimer_ 
+    = [NSTimer scheduledTimerWithTimeInterval:delay
+                                       target:self
+                                     selector:@selector(idleTimerFired:)
+                                     userInfo:nil
+                                      repeats:NO];
+}
+
+- (void)cancel {
+  if (idleTimer_) {
+    // The timer may be the last thing holding on to us.
+    [[self retain] autorelease];
+    [idleTimer_ invalidate];
+    idleTimer_ = nil;
+  }
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  for (HGSSearchOperation *operation in operations_) {
+    [nc removeObserver:self name:nil object:operation];
+    [operation cancel];
+  }
+  [operations_ removeAllObjects];
+  [lastQuery_ release];
+  lastQuery_ = nil;
+  cachedResultCount_ = 0;
+}
+
+- (BOOL)isSpeculating {
+  return idleTimer_ || [operations_ count];
+}
+
+// Predictions are tokenized here, once, exactly as a typed query would be, so
+// that the speculative results are cached under the key the user's query will
+// look up.
+- (NSArray *)predictedTokenizedQueryStrings {
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSUInteger maximumQueries
+    = [sd integerForKey:kHGSSpeculativeQueryMaximumQueriesPrefKey];
+  NSString *queryString 
+    = [[lastQuery_ tokenizedQueryString] tokenizedString];
+  NSMutableArray *predictions = [NSMutableArray array];
+  NSMutableSet *predictedStrings = [NSMutableSet setWithObject:queryString];
+  NSArray *sources = [[HGSExtensionPoint sourcesPoint] extensions];
+  for (HGSSearchSource *source in sources) {
+    if (![source conformsToProtocol:@protocol(HGSQueryPredictingSearchSource)]) {
+      continue;
+    }
+    id<HGSQueryPredictingSearchSource> predictor
+      = (id<HGSQueryPredictingSearchSource>)source;
+    NSArray *sourcePredictions 
+      = [predictor predictedQueryStringsForQuery:lastQuery_
+                                    maximumCount:maximumQueries];
+    for (NSString *prediction in sourcePredictions) {
+      if ([predictions count] >= maximumQueries) break;
+      HGSTokenizedString *tokenizedPrediction
+        = [HGSTokenizer tokenizeString:prediction];
+      NSString *predictedString = [tokenizedPrediction tokenizedString];
+      if (![predictedString length]
+          || [predictedStrings containsObject:predictedString]) {
+        continue;
+      }
+      [predictedStrings addObject:predictedString];
+      [predictions addObject:tokenizedPrediction];
+    }
+  }
+  return predictions;
+}
+
+- (NSArray *)candidateSources {
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  double maxSourceMS 
+    = [sd doubleForKey:kHGSSpeculativeQueryMaximumSourceTimePrefKey];
+  UInt64 maxSourceTime = HGSNanosecondsToMachTime(maxSourceMS * 1000000.0);
+  HGSSearchSourceRanker *ranker 
+    = [HGSSearchSourceRanker sharedSearchSourceRanker];
+  NSMutableArray *candidates = [NSMutableArray array];
+  for (HGSSearchSource *source in [ranker orderedSourcesByPerformance]) {
+    // Only sources that are proven to be cheap, and that can use the
+    // results we put in the cache.
+    UInt64 averageTime = [ranker averageTimeForSource:source];
+    if (averageTime == 0 || averageTime > maxSourceTime) continue;
+    if ([source conformsToProtocol:@protocol(HGSRefinableSearchSource)]) {
+      [candidates addObject:source];
+    }
+  }
+  [candidates sortUsingFunction:HGSSpeculativeSourcePromotionSort
+                        context:ranker];
+  return candidates;
+}
+
+- (void)idleTimerFired:(NSTimer *)timer {
+  idleTimer_ = nil;
+  NSArray *predictions = [self predictedTokenizedQueryStrings];
+  if (![predictions count]) return;
+  NSArray *sources = [self candidateSources];
+  if (![sources count]) return;
+  
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  double budgetMS = [sd doubleForKey:kHGSSpeculativeQueryCPUBudgetPrefKey];
+  UInt64 budget = HGSNanosecondsToMachTime(budgetMS * 1000000.0);
+  HGSSearchSourceRanker *ranker 
+    = [HGSSearchSourceRanker sharedSearchSourceRanker];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  for (HGSTokenizedString *prediction in predictions) {
+    HGSQuery *query
+      = [[[HGSQuery alloc] initWithTokenizedString:prediction
+                                    actionArgument:[lastQuery_ actionArgument]
+                                   actionOperation:[lastQuery_ actionOperation]
+                                      pivotObjects:[lastQuery_ pivotObjects]
+                                        queryFlags:[lastQuery_ flags]]
+       autorelease];
+    for (HGSSearchSource *source in sources) {
+      UInt64 averageTime = [ranker averageTimeForSource:source];
+      if (averageTime > budget) continue;
+      if (![source isValidSourceForQuery:query]) continue;
+      // Don't bother if the cache can already satisfy it.
+      if ([resultCache_ searchOperationForSource:source query:query]) continue;
+      HGSSearchOperation *operation = [source searchOperationForQuery:query];
+      if (!operation) continue;
+      [operation setRecordsRunTime:NO];
+      budget -= averageTime;
+      [nc addObserver:self
+             selector:@selector(searchOperationDidFinish:)
+                 name:kHGSSearchOperationDidFinishNotification
+               object:operation];
+      [operations_ addObject:operation];
+    }
+  }
+  HGSLogDebug(@"Speculatively running %u operations for %@",
+              [operations_ count], predictions);
+  // Copy because operations can finish synchronously. Speculative work must
+  // never get in the way of the real query, so it runs in its own lane,
+  // behind everything else.
+  NSArray *operations = [NSArray arrayWithArray:operations_];
+  for (HGSSearchOperation *operation in operations) {
+    [operation runWithQueuePriority:NSOperationQueuePriorityVeryLow
+                               lane:eHGSOperationLaneSpeculative];
+  }
+}
+
+- (void)searchOperationDidFinish:(NSNotification *)notification {
+  HGSSearchOperation *operation = [notification object];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc removeObserver:self name:nil object:operation];
+  if (![operations_ containsObject:operation]) return;
+  HGSTypeFilter *allTypes = [HGSTypeFilter filterAllowingAllTypes];
+  NSUInteger resultCount = [operation resultCountForFilter:allTypes];
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  NSUInteger resultBudget
+    = [sd integerForKey:kHGSSpeculativeQueryResultBudgetPrefKey];
+  if (cachedResultCount_ + resultCount <= resultBudget) {
+    [resultCache_ cacheResultsOfOperation:operation];
+    cachedResultCount_ += resultCount;
+  }
+  [operations_ removeObject:operation];
+}
+
+@end
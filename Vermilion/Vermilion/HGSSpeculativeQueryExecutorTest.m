@@ -0,0 +1,262 @@
+//
+//  HGSSpeculativeQueryExecutorTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+
+#import "HGSSpeculativeQueryExecutor.h"
+#import "HGSQueryResultCache.h"
+#import "HGSQuery.h"
+#import "HGSCallbackSearchSource.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSExtension.h"
+#import "HGSBundle.h"
+#import "HGSResult.h"
+#import "HGSTokenizer.h"
+#import "HGSTypeFilter.h"
+
+@interface HGSSpeculativeQueryExecutorTest : GTMTestCase
+@end
+
+// Predicts that its suffix ("c" by default) comes next, and returns one result
+// per query, recording the queries it actually searched for.
+@interface HGSSpeculativeQueryExecutorTestSource : HGSCallbackSearchSource
+    <HGSRefinableSearchSource, HGSQueryPredictingSearchSource> {
+ @private
+  NSMutableArray *searchedQueries_;
+  NSString *predictedSuffix_;
+}
+- (NSArray *)searchedQueries;
+- (void)setPredictedSuffix:(NSString *)suffix;
+@end
+
+@implementation HGSSpeculativeQueryExecutorTestSource
+
+- (id)initWithConfiguration:(NSDictionary *)configuration {
+  if ((self = [super initWithConfiguration:configuration])) {
+    searchedQueries_ = [[NSMutableArray alloc] init];
+    predictedSuffix_ = @"c";
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [searchedQueries_ release];
+  [predictedSuffix_ release];
+  [super dealloc];
+}
+
+- (NSArray *)searchedQueries {
+  @synchronized(searchedQueries_) {
+    return [NSArray arrayWithArray:searchedQueries_];
+  }
+  return nil;
+}
+
+- (void)setPredictedSuffix:(NSString *)suffix {
+  [predictedSuffix_ autorelease];
+  predictedSuffix_ = [suffix copy];
+}
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  HGSTokenizedString *queryString = [[operation query] tokenizedQueryString];
+  @synchronized(searchedQueries_) {
+    [searchedQueries_ addObject:[queryString tokenizedString]];
+  }
+  NSString *uri
+    = [NSString stringWithFormat:@"test:%@", [queryString tokenizedString]];
+  HGSScoredResult *result
+    = [HGSScoredResult resultWithURI:uri
+                                name:[queryString originalString]
+                                type:@"test"
+                              source:self
+                          attributes:nil
+                               score:1.0
+                               flags:0
+                         matchedTerm:queryString
+                      matchedIndexes:nil];
+  [operation setRankedResults:[NSArray arrayWithObject:result]];
+}
+
+- (BOOL)canRefineResultsOfQuery:(HGSQuery *)oldQuery
+                        toQuery:(HGSQuery *)newQuery {
+  NSString *oldString = [[oldQuery tokenizedQueryString] tokenizedString];
+  NSString *newString = [[newQuery tokenizedQueryString] tokenizedString];
+  return [newString hasPrefix:oldString];
+}
+
+- (NSArray *)resultsByRefiningResults:(NSArray *)results
+                              ofQuery:(HGSQuery *)oldQuery
+                         forOperation:(HGSSearchOperation *)operation {
+  return results;
+}
+
+- (NSArray *)predictedQueryStringsForQuery:(HGSQuery *)query
+                              maximumCount:(NSUInteger)maximumCount {
+  NSString *queryString = [[query tokenizedQueryString] originalString];
+  NSString *prediction = [queryString stringByAppendingString:predictedSuffix_];
+  return [NSArray arrayWithObject:prediction];
+}
+
+@end
+
+@implementation HGSSpeculativeQueryExecutorTest
+
+- (void)testInit {
+  HGSSpeculativeQueryExecutor *executor
+    = [[[HGSSpeculativeQueryExecutor alloc] init] autorelease];
+  STAssertNil(executor, nil);
+  HGSQueryResultCache *cache = [[[HGSQueryResultCache alloc] init] autorelease];
+  executor 
+    = [[[HGSSpeculativeQueryExecutor alloc] initWithResultCache:cache]
+       autorelease];
+  STAssertNotNil(executor, nil);
+  STAssertFalse([executor isSpeculating], nil);
+}
+
+- (void)testScheduleAndCancel {
+  HGSQueryResultCache *cache = [[[HGSQueryResultCache alloc] init] autorelease];
+  HGSSpeculativeQueryExecutor *executor 
+    = [[[HGSSpeculativeQueryExecutor alloc] initWithResultCache:cache]
+       autorelease];
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"ab"
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil
+                                           queryFlags:0] autorelease];
+  [executor speculateAfterQuery:query];
+  STAssertTrue([executor isSpeculating], nil);
+  [executor cancel];
+  STAssertFalse([executor isSpeculating], nil);
+  
+  // Nothing to speculate on for an empty query.
+  query = [[[HGSQuery alloc] initWithString:@""
+                             actionArgument:nil
+                            actionOperation:nil
+                               pivotObjects:nil
+                                 queryFlags:0] autorelease];
+  [executor speculateAfterQuery:query];
+  STAssertFalse([executor isSpeculating], nil);
+}
+
+- (HGSQuery *)queryWithString:(NSString *)string {
+  return [[[HGSQuery alloc] initWithString:string
+                            actionArgument:nil
+                           actionOperation:nil
+                              pivotObjects:nil
+                                queryFlags:0] autorelease];
+}
+
+// Speculates after the user types "ab", with |source| predicting |suffix|
+// next, and then checks that each of |typed| is served from the speculative
+// result for |predicted| without searching again.
+- (void)checkSpeculationWithPredictedSuffix:(NSString *)suffix
+                                  predicted:(NSString *)predicted
+                                      typed:(NSArray *)typed {
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       @"com.google.qsb.speculativequeryexecutortest.source", 
+       kHGSExtensionIdentifierKey,
+       @"HGSSpeculativeQueryExecutorTestSource",
+       kHGSExtensionUserVisibleNameKey,
+       nil];
+  HGSSpeculativeQueryExecutorTestSource *source
+    = [[[HGSSpeculativeQueryExecutorTestSource alloc]
+        initWithConfiguration:config] autorelease];
+  STAssertNotNil(source, nil);
+  [source setPredictedSuffix:suffix];
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertTrue([sourcesPoint extendWithObject:source], nil);
+  
+  // Run the user's query for real, which also gives the ranker a run time for
+  // the source so that it is cheap enough to speculate with.
+  HGSQuery *query = [self queryWithString:@"ab"];
+  HGSSearchOperation *operation = [source searchOperationForQuery:query];
+  [operation runOnCurrentThread:YES];
+  
+  HGSQueryResultCache *cache
+    = [[[HGSQueryResultCache alloc] initWithMaximumEntries:10
+                                                maximumAge:60] autorelease];
+  HGSSpeculativeQueryExecutor *executor 
+    = [[[HGSSpeculativeQueryExecutor alloc] initWithResultCache:cache]
+       autorelease];
+  [executor speculateAfterQuery:query];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  while ([executor isSpeculating] && [timeout timeIntervalSinceNow] > 0) {
+    [runLoop runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+  }
+  STAssertFalse([executor isSpeculating], nil);
+  NSString *tokenizedPrediction
+    = [[HGSTokenizer tokenizeString:predicted] tokenizedString];
+  NSArray *expectedQueries
+    = [NSArray arrayWithObjects:@"ab", tokenizedPrediction, nil];
+  STAssertEqualObjects([source searchedQueries], expectedQueries, nil);
+  
+  NSString *expectedURI 
+    = [NSString stringWithFormat:@"test:%@", tokenizedPrediction];
+  for (NSString *typedString in typed) {
+    HGSQuery *nextQuery = [self queryWithString:typedString];
+    operation = [cache searchOperationForSource:source query:nextQuery];
+    STAssertNotNil(operation, @"%@", typedString);
+    [operation runOnCurrentThread:YES];
+    HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+    STAssertEquals([operation resultCountForFilter:filter], (NSUInteger)1,
+                   @"%@", typedString);
+    HGSScoredResult *result = [operation sortedRankedResultAtIndex:0
+                                                        typeFilter:filter];
+    STAssertEqualObjects([result uri], expectedURI, @"%@", typedString);
+  }
+  STAssertEqualObjects([source searchedQueries], expectedQueries, nil);
+  [sourcesPoint removeExtension:source];
+}
+
+- (void)testSpeculativeResultsAreReused {
+  // The next keystroke, and anything typed after it, is served from the
+  // speculative results.
+  [self checkSpeculationWithPredictedSuffix:@"c"
+                                  predicted:@"abc"
+                                      typed:[NSArray arrayWithObjects:
+                                             @"abc", @"abcd", nil]];
+}
+
+- (void)testMultipleWordSpeculativeResultsAreReused {
+  // A prediction that starts a new word is tokenized once, like the query the
+  // user types, so it is cached under the same key.
+  [self checkSpeculationWithPredictedSuffix:@" C"
+                                  predicted:@"ab C"
+                                      typed:[NSArray arrayWithObjects:
+                                             @"ab c", @"ab cd", @"ab C", nil]];
+}
+
+@end
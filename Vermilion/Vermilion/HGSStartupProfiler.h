@@ -0,0 +1,195 @@
+//
+//  HGSStartupProfiler.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+
+#import <Foundation/Foundation.h>
+#import <GTM/GTMDefines.h>
+
+/*!
+ @header
+ @discussion HGSStartupProfiler
+
+ An opt-in recorder for where launch time goes. Spans are recorded around
+ loading each plugin bundle, installing each extension and loading each
+ source's results cache, as well as around the larger startup phases. Each
+ span gets its wall time, the CPU time of the recording thread and the
+ change in malloc'd memory, and spans that nest inside another on the same
+ thread are subtracted from its self time.
+
+ The results can be read as a sorted text report or written out as a
+ property list, so slow-starting plugins can be spotted and compared across
+ releases. When the profiler is disabled every call returns after a single
+ check.
+
+ Allocations are measured as the change in bytes and blocks in use across
+ all malloc zones, so work on other threads during a span is counted too
+ and memory freed within the span is not.
+*/
+
+/*!
+ Category for the larger steps of startup.
+*/
+#define kHGSStartupProfilerPhaseCategory @"phase"
+/*!
+ Category for loading and instantiating a plugin bundle.
+*/
+#define kHGSStartupProfilerPluginCategory @"plugin"
+/*!
+ Category for installing an extension.
+*/
+#define kHGSStartupProfilerExtensionCategory @"extension"
+/*!
+ Category for loading a cache from disk.
+*/
+#define kHGSStartupProfilerCacheCategory @"cache"
+
+/*!
+ Default key for turning the profiler on at launch. Defaults to NO.
+*/
+#define kHGSStartupProfilerEnabledPrefKey @"HGSStartupProfilerEnabled"
+
+/*!
+ NSString. The kHGSStartupProfiler*Category of a span.
+*/
+#define kHGSStartupProfilerCategoryKey @"Category"
+/*!
+ NSString. What the span measured, such as a bundle or extension identifier.
+*/
+#define kHGSStartupProfilerNameKey @"Name"
+/*!
+ NSNumber. Seconds from the first recorded span to the start of this one.
+*/
+#define kHGSStartupProfilerStartKey @"Start"
+/*!
+ NSNumber. Wall time of the span in seconds.
+*/
+#define kHGSStartupProfilerWallTimeKey @"WallTime"
+/*!
+ NSNumber. Wall time of the span in seconds, less its nested spans.
+*/
+#define kHGSStartupProfilerSelfTimeKey @"SelfTime"
+/*!
+ NSNumber. CPU time of the recording thread during the span in seconds.
+*/
+#define kHGSStartupProfilerCPUTimeKey @"CPUTime"
+/*!
+ NSNumber. Change in malloc'd bytes in use across the span.
+*/
+#define kHGSStartupProfilerAllocatedBytesKey @"AllocatedBytes"
+/*!
+ NSNumber. Change in malloc'd blocks in use across the span.
+*/
+#define kHGSStartupProfilerAllocatedBlocksKey @"AllocatedBlocks"
+/*!
+ NSNumber. How many spans the span was nested in.
+*/
+#define kHGSStartupProfilerDepthKey @"Depth"
+
+/*!
+ NSString. CFBundleVersion of the main bundle, in written profiles.
+*/
+#define kHGSStartupProfilerVersionKey @"Version"
+/*!
+ NSDate. When the profile was written.
+*/
+#define kHGSStartupProfilerDateKey @"Date"
+/*!
+ NSArray of span dictionaries in the order they finished, in written
+ profiles.
+*/
+#define kHGSStartupProfilerSpansKey @"Spans"
+
+/*!
+ The state of a span being recorded. Treat as opaque.
+*/
+typedef struct {
+  uint64_t wallStart;
+  uint64_t cpuStart;
+  int64_t bytesStart;
+  int64_t blocksStart;
+  NSUInteger depth;
+  BOOL recording;
+} HGSStartupProfilerMark;
+
+/*!
+ Returns YES if spans are being recorded.
+*/
+GTM_EXTERN BOOL HGSStartupProfilerIsEnabled(void);
+
+/*!
+ Starts or stops recording. Spans already recorded are kept.
+*/
+GTM_EXTERN void HGSStartupProfilerSetEnabled(BOOL enabled);
+
+/*!
+ Starts a span on the current thread. Every call must be balanced by a call
+ to HGSStartupProfilerEnd on the same thread, even if the profiler has been
+ disabled in between.
+*/
+GTM_EXTERN HGSStartupProfilerMark HGSStartupProfilerBegin(void);
+
+/*!
+ Finishes the span started with |mark| and records it.
+ @param mark The value returned by HGSStartupProfilerBegin.
+ @param category One of the kHGSStartupProfiler*Category strings.
+ @param name What was measured. Prefer identifiers over display names so
+        profiles from different localizations can be compared.
+*/
+GTM_EXTERN void HGSStartupProfilerEnd(HGSStartupProfilerMark mark,
+                                      NSString *category, NSString *name);
+
+/*!
+ Returns the recorded spans as dictionaries keyed by the
+ kHGSStartupProfiler*Key keys, in the order they finished.
+*/
+GTM_EXTERN NSArray *HGSStartupProfilerSpans(void);
+
+/*!
+ Returns a human readable report with a summary per category followed by
+ the spans sorted by self time, slowest first.
+*/
+GTM_EXTERN NSString *HGSStartupProfilerReport(void);
+
+/*!
+ Writes the recorded spans to |path| as an XML property list with the
+ kHGSStartupProfilerVersionKey, kHGSStartupProfilerDateKey and
+ kHGSStartupProfilerSpansKey keys.
+ @result YES if the file was written.
+*/
+GTM_EXTERN BOOL HGSStartupProfilerWriteToFile(NSString *path);
+
+/*!
+ Discards all recorded spans.
+*/
+GTM_EXTERN void HGSStartupProfilerReset(void);
@@ -0,0 +1,340 @@
+//
+//  HGSStartupProfiler.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+
+
+#import "HGSStartupProfiler.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <malloc/malloc.h>
+#import <pthread.h>
+#import "HGSSearchOperation.h"
+
+// Deepest nesting we keep self time for. Deeper spans are still recorded but
+// are not subtracted from their parents.
+#define kHGSStartupProfilerMaxDepth 32
+
+// The spans open on one thread. |childTime| holds the wall time of the
+// finished spans nested directly in the span open at each depth.
+typedef struct {
+  NSUInteger depth;
+  uint64_t childTime[kHGSStartupProfilerMaxDepth];
+} HGSStartupProfilerStack;
+
+typedef struct {
+  NSString *category;
+  NSString *name;
+  uint64_t start;
+  uint64_t wallTime;
+  uint64_t selfTime;
+  uint64_t cpuTime;
+  int64_t bytes;
+  int64_t blocks;
+  NSUInteger depth;
+} HGSStartupProfilerSpan;
+
+static volatile BOOL gHGSStartupProfilerEnabled = NO;
+static pthread_key_t gHGSStartupProfilerKey;
+static pthread_once_t gHGSStartupProfilerOnce = PTHREAD_ONCE_INIT;
+// Guards the span array.
+static OSSpinLock gHGSStartupProfilerLock = OS_SPINLOCK_INIT;
+static HGSStartupProfilerSpan *gHGSStartupProfilerSpans = NULL;
+static NSUInteger gHGSStartupProfilerSpanCount = 0;
+static NSUInteger gHGSStartupProfilerSpanCapacity = 0;
+
+static void HGSStartupProfilerCreateKey(void) {
+  pthread_key_create(&gHGSStartupProfilerKey, free);
+}
+
+static HGSStartupProfilerStack *HGSStartupProfilerCurrentStack(void) {
+  pthread_once(&gHGSStartupProfilerOnce, HGSStartupProfilerCreateKey);
+  HGSStartupProfilerStack *stack 
+    = pthread_getspecific(gHGSStartupProfilerKey);
+  if (!stack) {
+    stack = calloc(1, sizeof(HGSStartupProfilerStack));
+    pthread_setspecific(gHGSStartupProfilerKey, stack);
+  }
+  return stack;
+}
+
+static uint64_t HGSStartupProfilerThreadCPUTime(void) {
+  thread_basic_info_data_t info;
+  mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+  mach_port_t thread = mach_thread_self();
+  kern_return_t err = thread_info(thread, THREAD_BASIC_INFO, 
+                                  (thread_info_t)&info, &count);
+  mach_port_deallocate(mach_task_self(), thread);
+  if (err != KERN_SUCCESS) return 0;
+  uint64_t seconds = info.user_time.seconds + info.system_time.seconds;
+  uint64_t micros 
+    = info.user_time.microseconds + info.system_time.microseconds;
+  return seconds * NSEC_PER_SEC + micros * NSEC_PER_USEC;
+}
+
+static void HGSStartupProfilerMallocUsage(int64_t *bytes, int64_t *blocks) {
+  malloc_statistics_t stats;
+  malloc_zone_statistics(NULL, &stats);
+  *bytes = stats.size_in_use;
+  *blocks = stats.blocks_in_use;
+}
+
+static NSNumber *HGSStartupProfilerSeconds(uint64_t nanoseconds) {
+  return [NSNumber numberWithDouble:(double)nanoseconds / NSEC_PER_SEC];
+}
+
+BOOL HGSStartupProfilerIsEnabled(void) {
+  return gHGSStartupProfilerEnabled;
+}
+
+void HGSStartupProfilerSetEnabled(BOOL enabled) {
+  gHGSStartupProfilerEnabled = enabled;
+}
+
+HGSStartupProfilerMark HGSStartupProfilerBegin(void) {
+  HGSStartupProfilerMark mark;
+  bzero(&mark, sizeof(mark));
+  if (!gHGSStartupProfilerEnabled) return mark;
+  HGSStartupProfilerStack *stack = HGSStartupProfilerCurrentStack();
+  mark.depth = stack->depth++;
+  if (mark.depth < kHGSStartupProfilerMaxDepth) {
+    stack->childTime[mark.depth] = 0;
+  }
+  mark.recording = YES;
+  HGSStartupProfilerMallocUsage(&mark.bytesStart, &mark.blocksStart);
+  mark.cpuStart = HGSStartupProfilerThreadCPUTime();
+  // Wall time last, so the measurements above are not part of the span.
+  mark.wallStart = mach_absolute_time();
+  return mark;
+}
+
+void HGSStartupProfilerEnd(HGSStartupProfilerMark mark,
+                           NSString *category, NSString *name) {
+  if (!mark.recording) return;
+  uint64_t wallEnd = mach_absolute_time();
+  uint64_t cpuEnd = HGSStartupProfilerThreadCPUTime();
+  int64_t bytesEnd, blocksEnd;
+  HGSStartupProfilerMallocUsage(&bytesEnd, &blocksEnd);
+
+  HGSStartupProfilerStack *stack = HGSStartupProfilerCurrentStack();
+  stack->depth = mark.depth;
+  uint64_t wallTime = HGSMachTimeToNanoseconds(wallEnd - mark.wallStart);
+  uint64_t childTime = 0;
+  if (mark.depth < kHGSStartupProfilerMaxDepth) {
+    childTime = stack->childTime[mark.depth];
+  }
+  if (mark.depth > 0 && mark.depth <= kHGSStartupProfilerMaxDepth) {
+    stack->childTime[mark.depth - 1] += wallTime;
+  }
+
+  HGSStartupProfilerSpan span;
+  span.category = [category copy];
+  span.name = [name copy];
+  span.start = mark.wallStart;
+  span.wallTime = wallTime;
+  span.selfTime = wallTime > childTime ? wallTime - childTime : 0;
+  span.cpuTime = cpuEnd > mark.cpuStart ? cpuEnd - mark.cpuStart : 0;
+  span.bytes = bytesEnd - mark.bytesStart;
+  span.blocks = blocksEnd - mark.blocksStart;
+  span.depth = mark.depth;
+
+  OSSpinLockLock(&gHGSStartupProfilerLock);
+  if (gHGSStartupProfilerSpanCount == gHGSStartupProfilerSpanCapacity) {
+    NSUInteger capacity = MAX(gHGSStartupProfilerSpanCapacity * 2, 256);
+    HGSStartupProfilerSpan *spans 
+      = realloc(gHGSStartupProfilerSpans, 
+                capacity * sizeof(HGSStartupProfilerSpan));
+    if (spans) {
+      gHGSStartupProfilerSpans = spans;
+      gHGSStartupProfilerSpanCapacity = capacity;
+    }
+  }
+  BOOL added = gHGSStartupProfilerSpanCount < gHGSStartupProfilerSpanCapacity;
+  if (added) {
+    gHGSStartupProfilerSpans[gHGSStartupProfilerSpanCount++] = span;
+  }
+  OSSpinLockUnlock(&gHGSStartupProfilerLock);
+  if (!added) {
+    [span.category release];
+    [span.name release];
+  }
+}
+
+NSArray *HGSStartupProfilerSpans(void) {
+  OSSpinLockLock(&gHGSStartupProfilerLock);
+  NSUInteger count = gHGSStartupProfilerSpanCount;
+  HGSStartupProfilerSpan *spans = NULL;
+  if (count) {
+    spans = malloc(count * sizeof(HGSStartupProfilerSpan));
+    if (spans) {
+      memcpy(spans, gHGSStartupProfilerSpans,
+             count * sizeof(HGSStartupProfilerSpan));
+      for (NSUInteger i = 0; i < count; ++i) {
+        [spans[i].category retain];
+        [spans[i].name retain];
+      }
+    } else {
+      count = 0;
+    }
+  }
+  OSSpinLockUnlock(&gHGSStartupProfilerLock);
+
+  uint64_t epoch = UINT64_MAX;
+  for (NSUInteger i = 0; i < count; ++i) {
+    epoch = MIN(epoch, spans[i].start);
+  }
+  NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    HGSStartupProfilerSpan *span = &spans[i];
+    uint64_t start = HGSMachTimeToNanoseconds(span->start - epoch);
+    NSDictionary *dict 
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         span->category ? span->category : @"", kHGSStartupProfilerCategoryKey,
+         span->name ? span->name : @"", kHGSStartupProfilerNameKey,
+         HGSStartupProfilerSeconds(start), kHGSStartupProfilerStartKey,
+         HGSStartupProfilerSeconds(span->wallTime), 
+         kHGSStartupProfilerWallTimeKey,
+         HGSStartupProfilerSeconds(span->selfTime), 
+         kHGSStartupProfilerSelfTimeKey,
+         HGSStartupProfilerSeconds(span->cpuTime), 
+         kHGSStartupProfilerCPUTimeKey,
+         [NSNumber numberWithLongLong:span->bytes], 
+         kHGSStartupProfilerAllocatedBytesKey,
+         [NSNumber numberWithLongLong:span->blocks], 
+         kHGSStartupProfilerAllocatedBlocksKey,
+         [NSNumber numberWithUnsignedInteger:span->depth], 
+         kHGSStartupProfilerDepthKey,
+         nil];
+    [result addObject:dict];
+    [span->category release];
+    [span->name release];
+  }
+  free(spans);
+  return result;
+}
+
+static NSInteger HGSStartupProfilerCompareSelfTime(id a, id b, void *context) {
+  // Slowest first.
+  NSNumber *aTime = [a objectForKey:kHGSStartupProfilerSelfTimeKey];
+  NSNumber *bTime = [b objectForKey:kHGSStartupProfilerSelfTimeKey];
+  return [bTime compare:aTime];
+}
+
+NSString *HGSStartupProfilerReport(void) {
+  NSArray *spans = HGSStartupProfilerSpans();
+  NSMutableString *report = [NSMutableString string];
+
+  // Totals per category use self time so nested spans are not counted twice.
+  NSMutableDictionary *totals = [NSMutableDictionary dictionary];
+  for (NSDictionary *span in spans) {
+    NSString *category = [span objectForKey:kHGSStartupProfilerCategoryKey];
+    NSMutableArray *total = [totals objectForKey:category];
+    double selfTime 
+      = [[span objectForKey:kHGSStartupProfilerSelfTimeKey] doubleValue];
+    double cpuTime 
+      = [[span objectForKey:kHGSStartupProfilerCPUTimeKey] doubleValue];
+    NSUInteger count = 1;
+    if (total) {
+      selfTime += [[total objectAtIndex:0] doubleValue];
+      cpuTime += [[total objectAtIndex:1] doubleValue];
+      count += [[total objectAtIndex:2] unsignedIntegerValue];
+    }
+    total = [NSArray arrayWithObjects:
+             [NSNumber numberWithDouble:selfTime],
+             [NSNumber numberWithDouble:cpuTime],
+             [NSNumber numberWithUnsignedInteger:count],
+             nil];
+    [totals setObject:total forKey:category];
+  }
+  [report appendString:@"Category      Count    Self(ms)     CPU(ms)\n"];
+  NSArray *categories 
+    = [[totals allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  for (NSString *category in categories) {
+    NSArray *total = [totals objectForKey:category];
+    NSUInteger count = [[total objectAtIndex:2] unsignedIntegerValue];
+    [report appendFormat:@"%-12s %6lu %11.1f %11.1f\n",
+     [category UTF8String], (unsigned long)count,
+     [[total objectAtIndex:0] doubleValue] * 1000.0,
+     [[total objectAtIndex:1] doubleValue] * 1000.0];
+  }
+
+  [report appendString:@"\n    Self(ms)   Wall(ms)    CPU(ms)     Alloc(KB)"
+                       @"  Category    Name\n"];
+  NSArray *sorted 
+    = [spans sortedArrayUsingFunction:HGSStartupProfilerCompareSelfTime
+                              context:NULL];
+  for (NSDictionary *span in sorted) {
+    double bytes 
+      = [[span objectForKey:kHGSStartupProfilerAllocatedBytesKey] doubleValue];
+    NSString *category = [span objectForKey:kHGSStartupProfilerCategoryKey];
+    [report appendFormat:@"%12.1f %10.1f %10.1f %13.1f  %-11s %@\n",
+     [[span objectForKey:kHGSStartupProfilerSelfTimeKey] doubleValue] * 1000.0,
+     [[span objectForKey:kHGSStartupProfilerWallTimeKey] doubleValue] * 1000.0,
+     [[span objectForKey:kHGSStartupProfilerCPUTimeKey] doubleValue] * 1000.0,
+     bytes / 1024.0,
+     [category UTF8String],
+     [span objectForKey:kHGSStartupProfilerNameKey]];
+  }
+  return report;
+}
+
+BOOL HGSStartupProfilerWriteToFile(NSString *path) {
+  NSString *version 
+    = [[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"];
+  if (!version) {
+    version = @"";
+  }
+  NSDictionary *profile 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       version, kHGSStartupProfilerVersionKey,
+       [NSDate date], kHGSStartupProfilerDateKey,
+       HGSStartupProfilerSpans(), kHGSStartupProfilerSpansKey,
+       nil];
+  return [profile writeToFile:path atomically:YES];
+}
+
+void HGSStartupProfilerReset(void) {
+  OSSpinLockLock(&gHGSStartupProfilerLock);
+  HGSStartupProfilerSpan *spans = gHGSStartupProfilerSpans;
+  NSUInteger count = gHGSStartupProfilerSpanCount;
+  gHGSStartupProfilerSpans = NULL;
+  gHGSStartupProfilerSpanCount = 0;
+  gHGSStartupProfilerSpanCapacity = 0;
+  OSSpinLockUnlock(&gHGSStartupProfilerLock);
+  for (NSUInteger i = 0; i < count; ++i) {
+    [spans[i].category release];
+    [spans[i].name release];
+  }
+  free(spans);
+}
@@ -0,0 +1,161 @@
+//
+//  HGSStartupProfilerTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+
+
+#import "GTMSenTestCase.h"
+#import "HGSStartupProfiler.h"
+
+@interface HGSStartupProfilerTest : GTMTestCase
+@end
+
+@implementation HGSStartupProfilerTest
+
+- (void)setUp {
+  HGSStartupProfilerReset();
+  HGSStartupProfilerSetEnabled(YES);
+}
+
+- (void)tearDown {
+  HGSStartupProfilerSetEnabled(NO);
+  HGSStartupProfilerReset();
+}
+
+- (NSDictionary *)spanNamed:(NSString *)name inSpans:(NSArray *)spans {
+  for (NSDictionary *span in spans) {
+    if ([[span objectForKey:kHGSStartupProfilerNameKey] isEqual:name]) {
+      return span;
+    }
+  }
+  return nil;
+}
+
+- (void)testDisabled {
+  HGSStartupProfilerSetEnabled(NO);
+  HGSStartupProfilerMark mark = HGSStartupProfilerBegin();
+  HGSStartupProfilerEnd(mark, kHGSStartupProfilerPhaseCategory, @"off");
+  STAssertEquals([HGSStartupProfilerSpans() count], (NSUInteger)0, nil);
+
+  // A span begun while disabled is not recorded even if the profiler is
+  // turned on before it ends.
+  mark = HGSStartupProfilerBegin();
+  HGSStartupProfilerSetEnabled(YES);
+  HGSStartupProfilerEnd(mark, kHGSStartupProfilerPhaseCategory, @"off");
+  STAssertEquals([HGSStartupProfilerSpans() count], (NSUInteger)0, nil);
+}
+
+- (void)testNesting {
+  HGSStartupProfilerMark outer = HGSStartupProfilerBegin();
+  HGSStartupProfilerMark inner = HGSStartupProfilerBegin();
+  usleep(20000);
+  HGSStartupProfilerEnd(inner, kHGSStartupProfilerCacheCategory, @"inner");
+  usleep(10000);
+  HGSStartupProfilerEnd(outer, kHGSStartupProfilerExtensionCategory, 
+                        @"outer");
+
+  NSArray *spans = HGSStartupProfilerSpans();
+  STAssertEquals([spans count], (NSUInteger)2, nil);
+  NSDictionary *outerSpan = [self spanNamed:@"outer" inSpans:spans];
+  NSDictionary *innerSpan = [self spanNamed:@"inner" inSpans:spans];
+  STAssertNotNil(outerSpan, nil);
+  STAssertNotNil(innerSpan, nil);
+  STAssertEqualObjects([outerSpan objectForKey:kHGSStartupProfilerDepthKey],
+                       [NSNumber numberWithInt:0], nil);
+  STAssertEqualObjects([innerSpan objectForKey:kHGSStartupProfilerDepthKey],
+                       [NSNumber numberWithInt:1], nil);
+  STAssertEqualObjects([innerSpan objectForKey:kHGSStartupProfilerCategoryKey],
+                       kHGSStartupProfilerCacheCategory, nil);
+
+  double outerWall 
+    = [[outerSpan objectForKey:kHGSStartupProfilerWallTimeKey] doubleValue];
+  double outerSelf 
+    = [[outerSpan objectForKey:kHGSStartupProfilerSelfTimeKey] doubleValue];
+  double innerWall 
+    = [[innerSpan objectForKey:kHGSStartupProfilerWallTimeKey] doubleValue];
+  double innerSelf 
+    = [[innerSpan objectForKey:kHGSStartupProfilerSelfTimeKey] doubleValue];
+  STAssertGreaterThanOrEqual(innerWall, 0.02, nil);
+  STAssertEqualsWithAccuracy(innerSelf, innerWall, 0.0001, nil);
+  STAssertGreaterThan(outerWall, innerWall, nil);
+  STAssertEqualsWithAccuracy(outerSelf, outerWall - innerWall, 0.0001, nil);
+  // Sleeping does not use CPU.
+  double outerCPU 
+    = [[outerSpan objectForKey:kHGSStartupProfilerCPUTimeKey] doubleValue];
+  STAssertLessThan(outerCPU, outerWall, nil);
+}
+
+- (void)testAllocations {
+  HGSStartupProfilerMark mark = HGSStartupProfilerBegin();
+  void *block = malloc(1024 * 1024);
+  HGSStartupProfilerEnd(mark, kHGSStartupProfilerCacheCategory, @"alloc");
+  free(block);
+  NSDictionary *span = [self spanNamed:@"alloc" 
+                               inSpans:HGSStartupProfilerSpans()];
+  long long bytes 
+    = [[span objectForKey:kHGSStartupProfilerAllocatedBytesKey] longLongValue];
+  STAssertGreaterThanOrEqual(bytes, 1024LL * 1024LL, nil);
+}
+
+- (void)testReportAndFile {
+  HGSStartupProfilerMark fast = HGSStartupProfilerBegin();
+  HGSStartupProfilerEnd(fast, kHGSStartupProfilerPluginCategory, 
+                        @"com.google.fast");
+  HGSStartupProfilerMark slow = HGSStartupProfilerBegin();
+  usleep(10000);
+  HGSStartupProfilerEnd(slow, kHGSStartupProfilerPluginCategory, 
+                        @"com.google.slow");
+
+  NSString *report = HGSStartupProfilerReport();
+  NSRange slowRange = [report rangeOfString:@"com.google.slow"];
+  NSRange fastRange = [report rangeOfString:@"com.google.fast"];
+  STAssertNotEquals(slowRange.location, (NSUInteger)NSNotFound, nil);
+  STAssertNotEquals(fastRange.location, (NSUInteger)NSNotFound, nil);
+  STAssertLessThan(slowRange.location, fastRange.location, 
+                   @"Slowest spans should be listed first: %@", report);
+
+  NSString *path 
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       @"HGSStartupProfilerTest.plist"];
+  STAssertTrue(HGSStartupProfilerWriteToFile(path), nil);
+  NSDictionary *profile = [NSDictionary dictionaryWithContentsOfFile:path];
+  STAssertNotNil([profile objectForKey:kHGSStartupProfilerDateKey], nil);
+  NSArray *spans = [profile objectForKey:kHGSStartupProfilerSpansKey];
+  STAssertEquals([spans count], (NSUInteger)2, nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+  HGSStartupProfilerReset();
+  STAssertEquals([HGSStartupProfilerSpans() count], (NSUInteger)0, nil);
+}
+
+@end
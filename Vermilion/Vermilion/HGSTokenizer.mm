@@ -35,6 +35,7 @@
 #import "GTMGarbageCollection.h"
 #import "HGSLog.h"
 #import "HGSBundle.h"
+#import "HGSDTrace.h"
 
 typedef struct HGSRangeMapping {
   NSRange domain_;
@@ -110,6 +111,10 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
   CFMutableStringRef normalizedString 
     = CFStringCreateMutableCopy(NULL, 0, (CFStringRef)string);
   if (!normalizedString) return nil;
+  // Only start once we know that we will get to the matching finish.
+  if (VERMILION_TOKENIZE_START_ENABLED()) {
+    VERMILION_TOKENIZE_START((int)[string length]);
+  }
   CFStringFold(normalizedString, options, currentLocale);
   
   std::vector<CFRange> tokensRanges;
@@ -234,6 +239,9 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
   }
   CFRelease(normalizedString);
   [tokenizedString setTokenizedString:finalString];
+  if (VERMILION_TOKENIZE_FINISH_ENABLED()) {
+    VERMILION_TOKENIZE_FINISH((int)[string length], (int)tokenRangeCount);
+  }
   return tokenizedString;
 }
 
@@ -0,0 +1,138 @@
+//
+//  HGSTracer.h
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import <Foundation/Foundation.h>
+#import <GTM/GTMDefines.h>
+
+/*!
+ @header
+ @discussion HGSTracer
+
+ An opt-in timeline recorder for queries. When enabled, spans for queries,
+ search operations, merge passes and UI updates are written into a fixed
+ size ring buffer that can be exported as Chrome trace-event JSON and
+ opened in chrome://tracing or Perfetto, with one lane per thread.
+
+ Recording is lock free: each event claims a slot with an atomic increment
+ and publishes it with a sequence number, so writers never wait on each
+ other or on an export. When the buffer wraps, the oldest events are
+ overwritten. When tracing is disabled every call returns after a single
+ check.
+
+ Timestamps are mach_absolute_time() values, usually taken with
+ HGSTracerTimestamp() at the start of the span.
+*/
+
+/*!
+ Category for query-wide spans.
+*/
+#define kHGSTracerQueryCategory "query"
+/*!
+ Category for search operation spans.
+*/
+#define kHGSTracerOperationCategory "operation"
+/*!
+ Category for the time search operations spend waiting to run.
+*/
+#define kHGSTracerQueueCategory "queue"
+/*!
+ Category for result merge passes.
+*/
+#define kHGSTracerMergeCategory "merge"
+/*!
+ Category for UI work such as display timer stages and table reloads.
+*/
+#define kHGSTracerUICategory "ui"
+
+/*!
+ Number of events kept in the ring buffer.
+*/
+#define kHGSTracerCapacity 8192
+
+/*!
+ Default key for turning the tracer on at startup. Defaults to NO.
+*/
+#define kHGSTracerEnabledPrefKey @"HGSTracerEnabled"
+
+/*!
+ Returns YES if events are being recorded.
+*/
+GTM_EXTERN BOOL HGSTracerIsEnabled(void);
+
+/*!
+ Starts or stops recording. Events already in the buffer are kept.
+*/
+GTM_EXTERN void HGSTracerSetEnabled(BOOL enabled);
+
+/*!
+ Returns the current mach_absolute_time() if tracing is enabled, otherwise
+ 0. Pass it back as the start of a span; spans starting at 0 are ignored, so
+ a span that began while tracing was off is never recorded.
+*/
+GTM_EXTERN uint64_t HGSTracerTimestamp(void);
+
+/*!
+ Records a span on the current thread. Spans on a thread should nest.
+ @param category One of the kHGSTracer*Category strings. Must be a constant.
+ @param name The name of the span. Long names are truncated.
+ @param start mach_absolute_time() at the start of the span.
+ @param end mach_absolute_time() at the end of the span.
+*/
+GTM_EXTERN void HGSTracerRecordSpan(const char *category, NSString *name,
+                                    uint64_t start, uint64_t end);
+
+/*!
+ Records a span that may overlap other spans on the current thread, such as
+ time spent waiting in a queue or work that hops between threads. It is
+ shown on its own track, keyed by |category| and |identifier|.
+*/
+GTM_EXTERN void HGSTracerRecordAsyncSpan(const char *category, NSString *name,
+                                         const void *identifier,
+                                         uint64_t start, uint64_t end);
+
+/*!
+ Records a point in time on the current thread.
+*/
+GTM_EXTERN void HGSTracerRecordInstant(const char *category, NSString *name);
+
+/*!
+ Returns the events in the buffer as Chrome trace-event JSON. Safe to call
+ while other threads are recording; events being written during the export
+ are skipped.
+*/
+GTM_EXTERN NSData *HGSTracerChromeTraceData(void);
+
+/*!
+ Discards all recorded events.
+*/
+GTM_EXTERN void HGSTracerReset(void);
@@ -0,0 +1,279 @@
+//
+//  HGSTracer.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "HGSTracer.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import "HGSSearchOperation.h"
+
+#define kHGSTracerNameLength 96
+
+typedef enum {
+  eHGSTracerSpanPhase = 'X',
+  eHGSTracerAsyncPhase = 'b',
+  eHGSTracerInstantPhase = 'i',
+} HGSTracerPhase;
+
+// A slot in the ring buffer. |sequence| is the ticket of the event in the
+// slot, or 0 while the slot is being written.
+typedef struct {
+  volatile int64_t sequence;
+  uint64_t start;
+  uint64_t end;
+  const void *identifier;
+  const char *category;
+  uint32_t thread;
+  char phase;
+  char name[kHGSTracerNameLength];
+} HGSTracerEvent;
+
+static volatile BOOL gHGSTracerEnabled = NO;
+// Allocated the first time tracing is enabled and never freed, so writers
+// that raced a disable never touch freed memory.
+static HGSTracerEvent *volatile gHGSTracerEvents = NULL;
+static volatile int64_t gHGSTracerNextTicket = 0;
+static volatile int64_t gHGSTracerFirstTicket = 0;
+static uint64_t gHGSTracerEpoch = 0;
+
+// Thread names are collected once per thread so that the export can label
+// the lanes. This is the only lock, and each thread takes it once.
+static pthread_key_t gHGSTracerThreadKey;
+static pthread_once_t gHGSTracerThreadKeyOnce = PTHREAD_ONCE_INIT;
+static NSMutableDictionary *gHGSTracerThreadNames = nil;
+
+static void HGSTracerCreateThreadKey(void) {
+  pthread_key_create(&gHGSTracerThreadKey, NULL);
+  gHGSTracerThreadNames = [[NSMutableDictionary alloc] init];
+}
+
+static uint32_t HGSTracerCurrentThread(void) {
+  uint32_t thread = pthread_mach_thread_np(pthread_self());
+  pthread_once(&gHGSTracerThreadKeyOnce, HGSTracerCreateThreadKey);
+  if (!pthread_getspecific(gHGSTracerThreadKey)) {
+    pthread_setspecific(gHGSTracerThreadKey, (void *)1);
+    NSString *name = nil;
+    if (pthread_main_np()) {
+      name = @"Main";
+    } else {
+      name = [[NSThread currentThread] name];
+      if (![name length]) {
+        name = [NSString stringWithFormat:@"Thread %u", thread];
+      }
+    }
+    @synchronized(gHGSTracerThreadNames) {
+      [gHGSTracerThreadNames setObject:name
+                                forKey:[NSNumber numberWithUnsignedInt:thread]];
+    }
+  }
+  return thread;
+}
+
+static void HGSTracerRecord(char phase, const char *category, NSString *name,
+                            const void *identifier,
+                            uint64_t start, uint64_t end) {
+  HGSTracerEvent *events = gHGSTracerEvents;
+  if (!gHGSTracerEnabled || !events || start < gHGSTracerEpoch) return;
+  uint32_t thread = HGSTracerCurrentThread();
+  int64_t ticket = OSAtomicIncrement64Barrier(&gHGSTracerNextTicket);
+  HGSTracerEvent *event = &events[(ticket - 1) % kHGSTracerCapacity];
+  event->sequence = 0;
+  OSMemoryBarrier();
+  event->start = start;
+  event->end = end < start ? start : end;
+  event->identifier = identifier;
+  event->category = category;
+  event->thread = thread;
+  event->phase = phase;
+  if (!name 
+      || !CFStringGetCString((CFStringRef)name, event->name,
+                             sizeof(event->name), kCFStringEncodingUTF8)) {
+    // Too long (or no name), so fall back to a truncated copy.
+    event->name[0] = '\0';
+    if (name) {
+      CFIndex used = 0;
+      CFStringGetBytes((CFStringRef)name, 
+                       CFRangeMake(0, CFStringGetLength((CFStringRef)name)),
+                       kCFStringEncodingUTF8, 0, false, 
+                       (UInt8 *)event->name, sizeof(event->name) - 1, &used);
+      event->name[used] = '\0';
+    }
+  }
+  OSMemoryBarrier();
+  event->sequence = ticket;
+}
+
+BOOL HGSTracerIsEnabled(void) {
+  return gHGSTracerEnabled;
+}
+
+void HGSTracerSetEnabled(BOOL enabled) {
+  if (enabled && !gHGSTracerEvents) {
+    HGSTracerEvent *events = calloc(kHGSTracerCapacity, sizeof(HGSTracerEvent));
+    if (!events) return;
+    gHGSTracerEpoch = mach_absolute_time();
+    if (!OSAtomicCompareAndSwapPtrBarrier(NULL, events,
+                                          (void *volatile *)&gHGSTracerEvents)) {
+      free(events);
+    }
+  }
+  gHGSTracerEnabled = enabled;
+  OSMemoryBarrier();
+}
+
+uint64_t HGSTracerTimestamp(void) {
+  return gHGSTracerEnabled ? mach_absolute_time() : 0;
+}
+
+void HGSTracerRecordSpan(const char *category, NSString *name,
+                         uint64_t start, uint64_t end) {
+  if (!gHGSTracerEnabled || !start) return;
+  HGSTracerRecord(eHGSTracerSpanPhase, category, name, NULL, start, end);
+}
+
+void HGSTracerRecordAsyncSpan(const char *category, NSString *name,
+                              const void *identifier,
+                              uint64_t start, uint64_t end) {
+  if (!gHGSTracerEnabled || !start) return;
+  HGSTracerRecord(eHGSTracerAsyncPhase, category, name, identifier,
+                  start, end);
+}
+
+void HGSTracerRecordInstant(const char *category, NSString *name) {
+  if (!gHGSTracerEnabled) return;
+  uint64_t now = mach_absolute_time();
+  HGSTracerRecord(eHGSTracerInstantPhase, category, name, NULL, now, now);
+}
+
+void HGSTracerReset(void) {
+  OSMemoryBarrier();
+  gHGSTracerFirstTicket = gHGSTracerNextTicket;
+  OSMemoryBarrier();
+}
+
+static void HGSTracerAppendJSONString(NSMutableString *json, 
+                                      NSString *string) {
+  [json appendString:@"\""];
+  NSUInteger length = [string length];
+  for (NSUInteger i = 0; i < length; ++i) {
+    unichar c = [string characterAtIndex:i];
+    if (c == '"' || c == '\\') {
+      [json appendFormat:@"\\%C", c];
+    } else if (c < 0x20) {
+      [json appendFormat:@"\\u%04x", c];
+    } else {
+      [json appendFormat:@"%C", c];
+    }
+  }
+  [json appendString:@"\""];
+}
+
+static double HGSTracerMicroseconds(uint64_t machTime) {
+  return HGSMachTimeToNanoseconds(machTime - gHGSTracerEpoch) / 1000.0;
+}
+
+NSData *HGSTracerChromeTraceData(void) {
+  NSMutableString *json = [NSMutableString stringWithString:
+                           @"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["];
+  int pid = getpid();
+  NSString *separator = @"";
+  NSDictionary *threadNames = nil;
+  if (gHGSTracerThreadNames) {
+    @synchronized(gHGSTracerThreadNames) {
+      threadNames = [[gHGSTracerThreadNames copy] autorelease];
+    }
+  }
+  for (NSNumber *thread in threadNames) {
+    [json appendFormat:@"%@{\"name\":\"thread_name\",\"ph\":\"M\","
+                       @"\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+     separator, pid, [thread unsignedIntValue]];
+    HGSTracerAppendJSONString(json, [threadNames objectForKey:thread]);
+    [json appendString:@"}}"];
+    separator = @",";
+  }
+  HGSTracerEvent *events = gHGSTracerEvents;
+  if (events) {
+    int64_t last = gHGSTracerNextTicket;
+    int64_t first = MAX(gHGSTracerFirstTicket, last - kHGSTracerCapacity) + 1;
+    for (int64_t ticket = first; ticket <= last; ++ticket) {
+      HGSTracerEvent *slot = &events[(ticket - 1) % kHGSTracerCapacity];
+      HGSTracerEvent event;
+      if (slot->sequence != ticket) continue;
+      OSMemoryBarrier();
+      memcpy(&event, slot, sizeof(event));
+      OSMemoryBarrier();
+      // Overwritten while we were copying it.
+      if (slot->sequence != ticket) continue;
+      event.name[sizeof(event.name) - 1] = '\0';
+      NSString *name = [NSString stringWithUTF8String:event.name];
+      if (!name) name = @"?";
+      double start = HGSTracerMicroseconds(event.start);
+      double end = HGSTracerMicroseconds(event.end);
+      NSString *fields 
+        = [NSString stringWithFormat:@"\"cat\":\"%s\",\"pid\":%d,\"tid\":%u",
+           event.category, pid, event.thread];
+      switch (event.phase) {
+        case eHGSTracerSpanPhase:
+          [json appendFormat:@"%@{\"ph\":\"X\",%@,\"ts\":%.3f,\"dur\":%.3f,"
+                             @"\"name\":",
+           separator, fields, start, end - start];
+          HGSTracerAppendJSONString(json, name);
+          [json appendString:@"}"];
+          break;
+        case eHGSTracerAsyncPhase:
+          [json appendFormat:@"%@{\"ph\":\"b\",%@,\"ts\":%.3f,\"id\":\"%p\","
+                             @"\"name\":",
+           separator, fields, start, event.identifier];
+          HGSTracerAppendJSONString(json, name);
+          [json appendFormat:@"},{\"ph\":\"e\",%@,\"ts\":%.3f,\"id\":\"%p\","
+                             @"\"name\":",
+           fields, end, event.identifier];
+          HGSTracerAppendJSONString(json, name);
+          [json appendString:@"}"];
+          break;
+        case eHGSTracerInstantPhase:
+          [json appendFormat:@"%@{\"ph\":\"i\",\"s\":\"t\",%@,\"ts\":%.3f,"
+                             @"\"name\":",
+           separator, fields, start];
+          HGSTracerAppendJSONString(json, name);
+          [json appendString:@"}"];
+          break;
+        default:
+          continue;
+      }
+      separator = @",";
+    }
+  }
+  [json appendString:@"]}"];
+  return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
@@ -0,0 +1,162 @@
+//
+//  HGSTracerTest.m
+//
+//  Copyright (c) 2010 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#import "GTMSenTestCase.h"
+#import "HGSTracer.h"
+
+@interface HGSTracerTest : GTMTestCase
+@end
+
+@interface HGSTracerTestRecorder : NSOperation {
+ @private
+  NSUInteger count_;
+}
+- (id)initWithCount:(NSUInteger)count;
+@end
+
+@implementation HGSTracerTestRecorder
+- (id)initWithCount:(NSUInteger)count {
+  if ((self = [super init])) {
+    count_ = count;
+  }
+  return self;
+}
+
+- (void)main {
+  for (NSUInteger i = 0; i < count_; ++i) {
+    uint64_t start = HGSTracerTimestamp();
+    HGSTracerRecordSpan(kHGSTracerOperationCategory, @"recorder",
+                        start, HGSTracerTimestamp());
+  }
+}
+@end
+
+static NSString *HGSTracerTestTrace(void) {
+  NSData *data = HGSTracerChromeTraceData();
+  return [[[NSString alloc] initWithData:data
+                                encoding:NSUTF8StringEncoding] autorelease];
+}
+
+static NSUInteger HGSTracerTestCount(NSString *trace, NSString *string) {
+  return [[trace componentsSeparatedByString:string] count] - 1;
+}
+
+@implementation HGSTracerTest
+
+- (void)tearDown {
+  HGSTracerSetEnabled(NO);
+  HGSTracerReset();
+}
+
+- (void)testDisabled {
+  HGSTracerSetEnabled(NO);
+  HGSTracerReset();
+  STAssertFalse(HGSTracerIsEnabled(), nil);
+  STAssertEquals(HGSTracerTimestamp(), (uint64_t)0, nil);
+  HGSTracerRecordInstant(kHGSTracerQueryCategory, @"ignored");
+  HGSTracerRecordSpan(kHGSTracerQueryCategory, @"ignored", 1, 2);
+  NSString *trace = HGSTracerTestTrace();
+  STAssertTrue([trace hasPrefix:@"{"], @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"ignored"), (NSUInteger)0, 
+                 @"%@", trace);
+}
+
+- (void)testEvents {
+  HGSTracerSetEnabled(YES);
+  HGSTracerReset();
+  STAssertTrue(HGSTracerIsEnabled(), nil);
+  uint64_t start = HGSTracerTimestamp();
+  STAssertNotEquals(start, (uint64_t)0, nil);
+  HGSTracerRecordInstant(kHGSTracerQueryCategory, @"keystroke");
+  HGSTracerRecordAsyncSpan(kHGSTracerQueueCategory, @"source", self,
+                           start, HGSTracerTimestamp());
+  HGSTracerRecordSpan(kHGSTracerMergeCategory, @"say \"hi\"\n",
+                      start, HGSTracerTimestamp());
+  // Spans that started while tracing was off are dropped.
+  HGSTracerRecordSpan(kHGSTracerMergeCategory, @"dropped", 0, 
+                      HGSTracerTimestamp());
+  NSString *trace = HGSTracerTestTrace();
+  STAssertTrue([trace hasPrefix:@"{"], @"%@", trace);
+  STAssertTrue([trace hasSuffix:@"]}"], @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"ph\":\"i\""), (NSUInteger)1, 
+                 @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"ph\":\"b\""), (NSUInteger)1, 
+                 @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"ph\":\"e\""), (NSUInteger)1, 
+                 @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"ph\":\"X\""), (NSUInteger)1, 
+                 @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"cat\":\"merge\""), 
+                 (NSUInteger)1, @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"dropped"), (NSUInteger)0, 
+                 @"%@", trace);
+  STAssertEquals(HGSTracerTestCount(trace, @"\"say \\\"hi\\\"\\u000a\""), 
+                 (NSUInteger)1, @"%@", trace);
+  STAssertGreaterThanOrEqual(HGSTracerTestCount(trace, @"\"thread_name\""), 
+                             (NSUInteger)1, @"%@", trace);
+  
+  HGSTracerReset();
+  trace = HGSTracerTestTrace();
+  STAssertEquals(HGSTracerTestCount(trace, @"keystroke"), (NSUInteger)0, 
+                 @"%@", trace);
+}
+
+- (void)testWrapping {
+  HGSTracerSetEnabled(YES);
+  HGSTracerReset();
+  for (NSUInteger i = 0; i < kHGSTracerCapacity + 100; ++i) {
+    HGSTracerRecordInstant(kHGSTracerUICategory, @"tick");
+  }
+  NSString *trace = HGSTracerTestTrace();
+  STAssertEquals(HGSTracerTestCount(trace, @"\"tick\""), 
+                 (NSUInteger)kHGSTracerCapacity, nil);
+}
+
+- (void)testConcurrentWriters {
+  HGSTracerSetEnabled(YES);
+  HGSTracerReset();
+  NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+  NSUInteger writers = 4;
+  NSUInteger perWriter = 1000;
+  for (NSUInteger i = 0; i < writers; ++i) {
+    NSOperation *op 
+      = [[[HGSTracerTestRecorder alloc] initWithCount:perWriter] autorelease];
+    [queue addOperation:op];
+  }
+  [queue waitUntilAllOperationsAreFinished];
+  NSString *trace = HGSTracerTestTrace();
+  STAssertEquals(HGSTracerTestCount(trace, @"\"recorder\""), 
+                 writers * perWriter, nil);
+}
+
+@end
@@ -132,7 +132,7 @@
   return nil;
 }
 
-- (NSArray *)sourcesToRunOnMainThread {
+- (NSArray *)sourcesRequiringThreadAffinity {
   return nil;
 }
 
@@ -36,8 +36,10 @@
 #import <Vermilion/HGSAction.h>
 #import <Vermilion/HGSActionArgument.h>
 #import <Vermilion/HGSActionOperation.h>
+#import <Vermilion/HGSAffinityExecutor.h>
 #import <Vermilion/HGSBundle.h>
 #import <Vermilion/HGSCallbackSearchSource.h>
+#import <Vermilion/HGSCancellationToken.h>
 #import <Vermilion/HGSCoreExtensionPoints.h>
 #import <Vermilion/HGSCorporaSource.h>
 #import <Vermilion/HGSDelegate.h>
@@ -46,22 +48,30 @@
 #import <Vermilion/HGSGDataServiceSource.h>
 #import <Vermilion/HGSGDataUploadAction.h>
 #import <Vermilion/HGSIconProvider.h>
+#import <Vermilion/HGSLatencyHistogram.h>
 #import <Vermilion/HGSLog.h>
+#import <Vermilion/HGSLRUCache.h>
 #import <Vermilion/HGSMemorySearchSource.h>
 #import <Vermilion/HGSMixer.h>
 #import <Vermilion/HGSOperation.h>
 #import <Vermilion/HGSPathCellElement.h>
+#import <Vermilion/HGSPerformanceCounters.h>
 #import <Vermilion/HGSPlugin.h>
 #import <Vermilion/HGSPluginLoader.h>
 #import <Vermilion/HGSProtoExtension.h>
 #import <Vermilion/HGSQuery.h>
 #import <Vermilion/HGSQueryController.h>
+#import <Vermilion/HGSQueryResultCache.h>
 #import <Vermilion/HGSResult.h>
 #import <Vermilion/HGSSearchOperation.h>
 #import <Vermilion/HGSSearchSource.h>
 #import <Vermilion/HGSSearchTermScorer.h>
+#import <Vermilion/HGSShardedLRUCache.h>
 #import <Vermilion/HGSSimpleAccount.h>
+#import <Vermilion/HGSSpeculativeQueryExecutor.h>
+#import <Vermilion/HGSStartupProfiler.h>
 #import <Vermilion/HGSTokenizer.h>
+#import <Vermilion/HGSTracer.h>
 #import <Vermilion/HGSType.h>
 #import <Vermilion/HGSTypeFilter.h>
 #import <Vermilion/HGSUserMessage.h>